@@ -8,9 +8,1531 @@
 // provided by the GCC compiler, starting from version 4.7, 
 // or by using the stdatomic.h library introduced in the C11 standard.
 
+// Build: gcc -O2 -pthread main.c -o atomics
+// Run without arguments for the basic example. Other modes:
+//   bench [max_threads] [ms]   scaling of one shared counter vs a sharded counter
+//   bench-reclaim [threads] [ms]  epoch vs hazard pointer reclamation vs rwlock
+//   bench-aba [threads] [ops]  stress the cmpxchg16b stack and freelist vs a mutex stack
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+// Counters
+
+// The __sync builtins are always full barriers, and a counter that every
+//  thread increments keeps one cache line bouncing between cores. For
+//  statistics neither is needed: the increment only has to be atomic, not
+//  ordered, and nobody reads the total until later.
+//
+// struct counter is a single C11 atomic updated with explicit memory orders.
+//  struct sharded_counter gives every thread its own cache-line-sized slot
+//  (shared only once there are more threads than slots) and adds the slots
+//  up only when read, so increments stay local to one core.
+
+#define CACHE_LINE 64
+
+/**
+ * A single shared counter
+ */
+struct counter {
+    _Atomic uint64_t value;
+};
+
+/**
+ * Add to a counter; relaxed, since statistics need atomicity but no ordering
+ * @param c The counter
+ * @param n Amount to add
+ */
+static inline void counter_add(struct counter *c, uint64_t n) {
+    atomic_fetch_add_explicit(&c->value, n, memory_order_relaxed);
+}
+
+/**
+ * Subtract from a counter
+ * @param c The counter
+ * @param n Amount to subtract
+ */
+static inline void counter_sub(struct counter *c, uint64_t n) {
+    atomic_fetch_sub_explicit(&c->value, n, memory_order_relaxed);
+}
+
+/**
+ * Read a counter
+ * @param c The counter
+ * @return The current value
+ */
+static inline uint64_t counter_read(struct counter *c) {
+    return atomic_load_explicit(&c->value, memory_order_relaxed);
+}
+
+/**
+ * Drop a reference; returns 1 for the caller that dropped the last one.
+ * Release orders this thread's writes to the object before the decrement,
+ * and the acquire fence lets the last owner see everyone's writes before
+ * freeing it.
+ * @param c The reference count
+ * @return 1 if the count reached zero
+ */
+static inline int counter_put_ref(struct counter *c) {
+    if (atomic_fetch_sub_explicit(&c->value, 1, memory_order_release) == 1) {
+        atomic_thread_fence(memory_order_acquire);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * One shard, padded to a full cache line so neighbours never share it
+ */
+struct counter_slot {
+    _Alignas(CACHE_LINE) _Atomic int64_t value;
+};
+
+/**
+ * A counter split into per-thread slots
+ */
+struct sharded_counter {
+    struct counter_slot *slots;
+    unsigned int nslots;  // Power of two
+};
+
+/**
+ * Initialize a sharded counter with two slots per configured CPU
+ * @param c The counter
+ * @return 0 on success, -1 on error
+ */
+int sharded_counter_init(struct sharded_counter *c) {
+    long cpus = sysconf(_SC_NPROCESSORS_CONF);
+    unsigned int n = 1;
+
+    while (n < 2 * (unsigned long)(cpus > 0 ? cpus : 1))
+        n <<= 1;
+    c->slots = aligned_alloc(CACHE_LINE, n * sizeof(struct counter_slot));
+    if (!c->slots) {
+        perror("aligned_alloc");
+        return -1;
+    }
+    for (unsigned int i = 0; i < n; ++i)
+        atomic_init(&c->slots[i].value, 0);
+    c->nslots = n;
+    return 0;
+}
+
+/**
+ * Free a sharded counter
+ * @param c The counter
+ */
+void sharded_counter_destroy(struct sharded_counter *c) {
+    free(c->slots);
+    c->slots = NULL;
+}
+
+static atomic_uint counter_next_slot;
+static _Thread_local unsigned int counter_thread_slot;  // 0 = not assigned yet
+
+/**
+ * Pick the calling thread's slot. Threads are dealt slots round-robin on
+ * first use, which is cheaper than asking for the current CPU on every
+ * increment, and gives consecutive threads distinct slots. With more threads
+ * than slots two threads can share one, so slots are still updated
+ * atomically; the add is then almost always uncontended and already in this
+ * core's cache.
+ */
+static inline struct counter_slot *sharded_counter_slot(struct sharded_counter *c) {
+    unsigned int slot = counter_thread_slot;
+
+    if (__builtin_expect(slot == 0, 0)) {
+        // The ticket alone: adding the CPU as a second spreader makes threads collide
+        slot = atomic_fetch_add_explicit(&counter_next_slot, 1, memory_order_relaxed) + 1;
+        counter_thread_slot = slot;
+    }
+    return &c->slots[slot & (c->nslots - 1)];
+}
+
+/**
+ * Add to a sharded counter
+ * @param c The counter
+ * @param n Amount to add (may be negative)
+ */
+static inline void sharded_counter_add(struct sharded_counter *c, int64_t n) {
+    atomic_fetch_add_explicit(&sharded_counter_slot(c)->value, n, memory_order_relaxed);
+}
+
+/**
+ * Read a sharded counter by summing its slots. Concurrent updates may or
+ * may not be included, exactly as with a racing read of a single counter.
+ * @param c The counter
+ * @return The current total
+ */
+int64_t sharded_counter_read(struct sharded_counter *c) {
+    int64_t sum = 0;
+
+    for (unsigned int i = 0; i < c->nslots; ++i)
+        sum += atomic_load_explicit(&c->slots[i].value, memory_order_relaxed);
+    return sum;
+}
+
+// Memory Reclamation
+
+// A node unlinked from a lock-free structure cannot be freed right away:
+//  another thread may have loaded a pointer to it just before the unlink and
+//  still be about to read it. Two schemes decide when freeing is safe.
+//
+// Epoch-based reclamation (EBR): readers announce the global epoch while
+//  inside a read-side critical section. Retired nodes are kept per thread in
+//  three bags keyed by the epoch they were retired in. The epoch only
+//  advances once every active thread has seen it, so after two advances no
+//  thread can still hold a pointer into a bag, and the bag is freed whole.
+//  Read-side cost is one store and one fence per critical section, however
+//  many nodes are visited, but one stalled reader blocks all reclamation.
+//
+// Hazard pointers (HP): readers publish each pointer they are about to use
+//  in one of a few per-thread slots. A retiring thread frees the nodes that
+//  no slot mentions once its retire list reaches a threshold. Every node
+//  visited costs a store and a fence, but the number of retired-but-unfreed
+//  nodes stays bounded even if a reader stalls.
+//
+// Both work on nodes that embed struct reclaim_node. Thread records are
+//  kept on global lists and reused after their thread unregisters.
+
+#define EBR_BATCH 64               // Retires between attempts to advance the epoch
+#define HP_SLOTS 2                 // Hazard pointers per thread
+#define HP_RETIRE_THRESHOLD 64     // Retired nodes that trigger a hazard scan
+
+/**
+ * Header embedded in every reclaimable node
+ */
+struct reclaim_node {
+    struct reclaim_node *next;
+    void (*free_fn)(struct reclaim_node *node);
+};
+
+// Nodes retired but not freed yet, over all threads, and the peak; for the benchmark
+static atomic_long reclaim_pending;
+static atomic_long reclaim_pending_peak;
+
+static void reclaim_count_retire(void) {
+    long now = atomic_fetch_add_explicit(&reclaim_pending, 1, memory_order_relaxed) + 1;
+    long peak = atomic_load_explicit(&reclaim_pending_peak, memory_order_relaxed);
+
+    while (now > peak && !atomic_compare_exchange_weak_explicit(&reclaim_pending_peak, &peak, now,
+                                                                memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+/**
+ * Free a list of retired nodes
+ * @return Number of nodes freed
+ */
+static long reclaim_free_list(struct reclaim_node *node) {
+    long n = 0;
+
+    while (node) {
+        struct reclaim_node *next = node->next;
+        node->free_fn(node);
+        node = next;
+        ++n;
+    }
+    atomic_fetch_sub_explicit(&reclaim_pending, n, memory_order_relaxed);
+    return n;
+}
+
+/**
+ * Per-thread EBR state
+ */
+struct ebr_record {
+    _Alignas(CACHE_LINE) atomic_uint_fast64_t state;  // (epoch << 1) | 1 while active, 0 otherwise
+    atomic_int in_use;
+    struct ebr_record *next;
+    unsigned int nesting;
+    unsigned int retired_since_advance;
+    struct {
+        uint64_t epoch;
+        struct reclaim_node *head;
+    } bags[3];
+};
+
+static _Alignas(CACHE_LINE) atomic_uint_fast64_t ebr_epoch = 1;
+static struct ebr_record *_Atomic ebr_records;
+static _Thread_local struct ebr_record *ebr_self;
+
+/**
+ * Get the calling thread's record, claiming or creating one on first use
+ */
+static struct ebr_record *ebr_record_get(void) {
+    struct ebr_record *r = ebr_self;
+
+    if (__builtin_expect(r != NULL, 1))
+        return r;
+    for (r = atomic_load_explicit(&ebr_records, memory_order_acquire); r; r = r->next) {
+        int free_slot = 0;
+        if (atomic_compare_exchange_strong(&r->in_use, &free_slot, 1))
+            return ebr_self = r;
+    }
+    r = aligned_alloc(CACHE_LINE, sizeof(*r));
+    if (!r) {
+        perror("aligned_alloc");
+        exit(EXIT_FAILURE);
+    }
+    memset(r, 0, sizeof(*r));
+    atomic_init(&r->state, 0);
+    atomic_init(&r->in_use, 1);
+    r->next = atomic_load_explicit(&ebr_records, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&ebr_records, &r->next, r, memory_order_release,
+                                                  memory_order_relaxed))
+        ;
+    return ebr_self = r;
+}
+
+/**
+ * Enter a read-side critical section. Pointers loaded from a shared structure
+ * stay valid until the matching ebr_exit(). Sections may nest.
+ */
+void ebr_enter(void) {
+    struct ebr_record *r = ebr_record_get();
+    uint64_t epoch;
+
+    if (r->nesting++)
+        return;
+    // Re-check after the fence so we never announce an epoch that was
+    // already left behind while we were publishing it
+    do {
+        epoch = atomic_load_explicit(&ebr_epoch, memory_order_relaxed);
+        atomic_store_explicit(&r->state, (epoch << 1) | 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+    } while (atomic_load_explicit(&ebr_epoch, memory_order_relaxed) != epoch);
+}
+
+/**
+ * Leave a read-side critical section
+ */
+void ebr_exit(void) {
+    struct ebr_record *r = ebr_self;
+
+    if (--r->nesting == 0)
+        atomic_store_explicit(&r->state, 0, memory_order_release);
+}
+
+/**
+ * Advance the global epoch if every active thread has observed it
+ * @return The global epoch afterwards
+ */
+static uint64_t ebr_try_advance(void) {
+    uint64_t epoch = atomic_load_explicit(&ebr_epoch, memory_order_acquire);
+
+    atomic_thread_fence(memory_order_seq_cst);
+    for (struct ebr_record *r = atomic_load_explicit(&ebr_records, memory_order_acquire); r; r = r->next) {
+        uint64_t state = atomic_load_explicit(&r->state, memory_order_acquire);
+        if ((state & 1) && (state >> 1) != epoch)
+            return epoch;
+    }
+    if (atomic_compare_exchange_strong(&ebr_epoch, &epoch, epoch + 1))
+        return epoch + 1;
+    return epoch;  // Someone else advanced it
+}
+
+/**
+ * Free the bags that no reader can still see
+ */
+static void ebr_reclaim(struct ebr_record *r, uint64_t epoch) {
+    for (int i = 0; i < 3; ++i) {
+        if (r->bags[i].head && r->bags[i].epoch + 2 <= epoch) {
+            reclaim_free_list(r->bags[i].head);
+            r->bags[i].head = NULL;
+        }
+    }
+}
+
+/**
+ * Retire a node that has been unlinked; it is freed once no reader can hold it
+ * @param node The node
+ * @param free_fn Called to free it
+ */
+void ebr_retire(struct reclaim_node *node, void (*free_fn)(struct reclaim_node *)) {
+    struct ebr_record *r = ebr_record_get();
+    uint64_t epoch = atomic_load_explicit(&ebr_epoch, memory_order_acquire);
+    int i = (int)(epoch % 3);
+
+    if (r->bags[i].epoch != epoch) {
+        // This bag holds nodes from epoch - 3 or earlier: already safe
+        reclaim_free_list(r->bags[i].head);
+        r->bags[i].head = NULL;
+        r->bags[i].epoch = epoch;
+    }
+    node->free_fn = free_fn;
+    node->next = r->bags[i].head;
+    r->bags[i].head = node;
+    reclaim_count_retire();
+    if (++r->retired_since_advance >= EBR_BATCH) {
+        r->retired_since_advance = 0;
+        ebr_reclaim(r, ebr_try_advance());
+    }
+}
+
+/**
+ * Free everything the calling thread retired, waiting for readers as needed,
+ * and release its record. Call before a thread that used EBR exits.
+ */
+void ebr_unregister(void) {
+    struct ebr_record *r = ebr_self;
+    uint64_t target = 0;
+
+    if (!r)
+        return;
+    for (int i = 0; i < 3; ++i)
+        if (r->bags[i].head && r->bags[i].epoch + 2 > target)
+            target = r->bags[i].epoch + 2;
+    while (ebr_try_advance() < target)
+        sched_yield();
+    ebr_reclaim(r, target);
+    r->nesting = 0;
+    r->retired_since_advance = 0;
+    atomic_store_explicit(&r->state, 0, memory_order_release);
+    atomic_store_explicit(&r->in_use, 0, memory_order_release);
+    ebr_self = NULL;
+}
+
+/**
+ * Per-thread hazard pointer state
+ */
+struct hp_record {
+    _Alignas(CACHE_LINE) void *_Atomic hazard[HP_SLOTS];
+    atomic_int in_use;
+    struct hp_record *next;
+    struct reclaim_node *retired;
+    unsigned int nretired;
+};
+
+static struct hp_record *_Atomic hp_records;
+static _Thread_local struct hp_record *hp_self;
+
+/**
+ * Get the calling thread's record, claiming or creating one on first use
+ */
+static struct hp_record *hp_record_get(void) {
+    struct hp_record *r = hp_self;
+
+    if (__builtin_expect(r != NULL, 1))
+        return r;
+    for (r = atomic_load_explicit(&hp_records, memory_order_acquire); r; r = r->next) {
+        int free_slot = 0;
+        if (atomic_compare_exchange_strong(&r->in_use, &free_slot, 1))
+            return hp_self = r;
+    }
+    r = aligned_alloc(CACHE_LINE, sizeof(*r));
+    if (!r) {
+        perror("aligned_alloc");
+        exit(EXIT_FAILURE);
+    }
+    memset(r, 0, sizeof(*r));
+    for (int i = 0; i < HP_SLOTS; ++i)
+        atomic_init(&r->hazard[i], NULL);
+    atomic_init(&r->in_use, 1);
+    r->next = atomic_load_explicit(&hp_records, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&hp_records, &r->next, r, memory_order_release,
+                                                  memory_order_relaxed))
+        ;
+    return hp_self = r;
+}
+
+/**
+ * Load a shared pointer and protect it with a hazard slot
+ *
+ * The pointer is published, then the source re-read: if it still holds the
+ * same value, the node was reachable after our hazard became visible, so no
+ * scan can free it until the slot is cleared.
+ * @param slot Hazard slot index, below HP_SLOTS
+ * @param src The shared pointer
+ * @return The protected pointer (may be NULL)
+ */
+void *hp_protect(int slot, void *_Atomic *src) {
+    struct hp_record *r = hp_record_get();
+    void *p = atomic_load_explicit(src, memory_order_relaxed);
+
+    for (;;) {
+        atomic_store_explicit(&r->hazard[slot], p, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        void *again = atomic_load_explicit(src, memory_order_acquire);
+        if (again == p)
+            return p;
+        p = again;
+    }
+}
+
+/**
+ * Publish a hazard for a pointer the caller will validate itself
+ * @param slot Hazard slot index
+ * @param p The pointer
+ */
+static inline void hp_set(int slot, void *p) {
+    atomic_store_explicit(&hp_record_get()->hazard[slot], p, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+/**
+ * Clear one hazard slot
+ * @param slot Hazard slot index
+ */
+static inline void hp_clear(int slot) {
+    atomic_store_explicit(&hp_self->hazard[slot], NULL, memory_order_release);
+}
+
+static int hp_compare(const void *a, const void *b) {
+    uintptr_t x = *(const uintptr_t *)a, y = *(const uintptr_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Free every retired node that no hazard slot protects
+ */
+static void hp_scan(struct hp_record *self) {
+    struct hp_record *records = atomic_load_explicit(&hp_records, memory_order_acquire);
+    struct reclaim_node *keep = NULL, *node, *next, *dead = NULL;
+    uintptr_t *hazards;
+    size_t cap = 0, n = 0;
+
+    // Records are only ever prepended, so this snapshot of the list stays valid
+    for (struct hp_record *r = records; r; r = r->next)
+        cap += HP_SLOTS;
+    hazards = malloc(cap * sizeof(*hazards));
+    if (!hazards)
+        return;  // Try again on the next retire
+    atomic_thread_fence(memory_order_seq_cst);
+    for (struct hp_record *r = records; r; r = r->next)
+        for (int i = 0; i < HP_SLOTS; ++i) {
+            void *p = atomic_load_explicit(&r->hazard[i], memory_order_acquire);
+            if (p)
+                hazards[n++] = (uintptr_t)p;
+        }
+    qsort(hazards, n, sizeof(*hazards), hp_compare);
+
+    self->nretired = 0;
+    for (node = self->retired; node; node = next) {
+        uintptr_t key = (uintptr_t)node;
+        next = node->next;
+        if (n && bsearch(&key, hazards, n, sizeof(*hazards), hp_compare)) {
+            node->next = keep;
+            keep = node;
+            self->nretired++;
+        } else {
+            node->next = dead;
+            dead = node;
+        }
+    }
+    self->retired = keep;
+    reclaim_free_list(dead);
+    free(hazards);
+}
+
+/**
+ * Retire a node that has been unlinked; freed once no hazard points at it
+ * @param node The node
+ * @param free_fn Called to free it
+ */
+void hp_retire(struct reclaim_node *node, void (*free_fn)(struct reclaim_node *)) {
+    struct hp_record *r = hp_record_get();
+
+    node->free_fn = free_fn;
+    node->next = r->retired;
+    r->retired = node;
+    reclaim_count_retire();
+    if (++r->nretired >= HP_RETIRE_THRESHOLD)
+        hp_scan(r);
+}
+
+/**
+ * Clear the calling thread's hazards, free what it retired once unprotected,
+ * and release its record. Call before a thread that used HP exits.
+ */
+void hp_unregister(void) {
+    struct hp_record *r = hp_self;
+
+    if (!r)
+        return;
+    for (int i = 0; i < HP_SLOTS; ++i)
+        hp_clear(i);
+    while (r->retired) {
+        hp_scan(r);
+        if (r->retired)
+            sched_yield();
+    }
+    atomic_store_explicit(&r->in_use, 0, memory_order_release);
+    hp_self = NULL;
+}
+
+// Lock-Free Stack
+
+// A Treiber stack: push and pop are a single CAS on top. Popping reads
+//  top->next before the CAS, and that node may have been popped and freed
+//  by another thread in between. With reclamation it cannot be freed (and
+//  so cannot be reused either, which also rules out ABA) while we hold it.
+
+/**
+ * Stack node
+ */
+struct lf_node {
+    struct reclaim_node reclaim;  // First member: retired nodes are cast back
+    struct lf_node *_Atomic next;
+    long value;
+};
+
+/**
+ * Lock-free stack
+ */
+struct lf_stack {
+    _Alignas(CACHE_LINE) struct lf_node *_Atomic top;
+};
+
+static void lf_node_free(struct reclaim_node *node) {
+    free(node);
+}
+
+/**
+ * Push a value
+ * @return 0 on success, -1 on allocation failure
+ */
+int lf_stack_push(struct lf_stack *s, long value) {
+    struct lf_node *node = malloc(sizeof(*node));
+
+    if (!node)
+        return -1;
+    node->value = value;
+    struct lf_node *top = atomic_load_explicit(&s->top, memory_order_relaxed);
+    do {
+        atomic_store_explicit(&node->next, top, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(&s->top, &top, node, memory_order_release,
+                                                    memory_order_relaxed));
+    return 0;
+}
+
+/**
+ * Pop a value, protecting the top node with an epoch
+ * @return 1 if a value was popped, 0 if the stack was empty
+ */
+int lf_stack_pop_ebr(struct lf_stack *s, long *value) {
+    struct lf_node *top;
+
+    ebr_enter();
+    top = atomic_load_explicit(&s->top, memory_order_acquire);
+    while (top && !atomic_compare_exchange_weak_explicit(&s->top, &top,
+                                                         atomic_load_explicit(&top->next, memory_order_relaxed),
+                                                         memory_order_acquire, memory_order_acquire))
+        ;
+    ebr_exit();
+    if (!top)
+        return 0;
+    *value = top->value;
+    ebr_retire(&top->reclaim, lf_node_free);
+    return 1;
+}
+
+/**
+ * Pop a value, protecting the top node with a hazard pointer
+ * @return 1 if a value was popped, 0 if the stack was empty
+ */
+int lf_stack_pop_hp(struct lf_stack *s, long *value) {
+    struct lf_node *top;
+
+    for (;;) {
+        top = hp_protect(0, (void *_Atomic *)&s->top);
+        if (!top)
+            break;
+        struct lf_node *next = atomic_load_explicit(&top->next, memory_order_relaxed);
+        if (atomic_compare_exchange_strong_explicit(&s->top, &top, next, memory_order_acquire,
+                                                    memory_order_relaxed))
+            break;
+    }
+    hp_clear(0);
+    if (!top)
+        return 0;
+    *value = top->value;
+    hp_retire(&top->reclaim, lf_node_free);
+    return 1;
+}
+
+// Read-Mostly List
+
+// A sorted set of keys with lock-free lookups. Writers serialize on a mutex
+//  and publish with release stores, so the only hard part left is freeing
+//  removed nodes, which is what this list compares: EBR, hazard pointers,
+//  or a plain reader-writer lock with no reclamation problem at all.
+//
+// For hazard pointers a removed node's next pointer is marked (low bit set)
+//  before it is retired. A reader validates each hop by re-reading the link
+//  it came from: an unmarked, unchanged link proves the node it protected
+//  was still in the list, and a marked one sends it back to the head.
+
+/**
+ * List node
+ */
+struct rm_node {
+    struct reclaim_node reclaim;
+    struct rm_node *_Atomic next;
+    long key;
+};
+
+enum rm_scheme { RM_RWLOCK, RM_EBR, RM_HP, RM_SCHEME_COUNT };
+
+static const char *const rm_scheme_names[RM_SCHEME_COUNT] = { "rwlock", "ebr", "hazard" };
+
+/**
+ * Sorted list of keys
+ */
+struct rm_list {
+    enum rm_scheme scheme;
+    struct rm_node *_Atomic head;
+    pthread_mutex_t write_lock;     // Serializes writers for EBR and HP
+    pthread_rwlock_t rwlock;        // Used by the rwlock scheme instead
+};
+
+#define RM_MARK ((uintptr_t)1)
+
+static inline struct rm_node *rm_unmark(struct rm_node *p) {
+    return (struct rm_node *)((uintptr_t)p & ~RM_MARK);
+}
+
+void rm_list_init(struct rm_list *l, enum rm_scheme scheme) {
+    l->scheme = scheme;
+    atomic_init(&l->head, NULL);
+    pthread_mutex_init(&l->write_lock, NULL);
+    pthread_rwlock_init(&l->rwlock, NULL);
+}
+
+/**
+ * Free the list; no other thread may be using it
+ */
+void rm_list_destroy(struct rm_list *l) {
+    struct rm_node *n = atomic_load(&l->head);
+
+    while (n) {
+        struct rm_node *next = rm_unmark(atomic_load(&n->next));
+        free(n);
+        n = next;
+    }
+    pthread_mutex_destroy(&l->write_lock);
+    pthread_rwlock_destroy(&l->rwlock);
+}
+
+static int rm_lookup_plain(struct rm_list *l, long key) {
+    struct rm_node *n = rm_unmark(atomic_load_explicit(&l->head, memory_order_acquire));
+
+    while (n && n->key < key)
+        n = rm_unmark(atomic_load_explicit(&n->next, memory_order_acquire));
+    return n && n->key == key;
+}
+
+static int rm_lookup_hp(struct rm_list *l, long key) {
+    struct rm_node *_Atomic *link;
+    struct rm_node *cur;
+    int slot;
+
+retry:
+    link = &l->head;
+    slot = 0;
+    cur = atomic_load_explicit(link, memory_order_acquire);
+    for (;;) {
+        if ((uintptr_t)cur & RM_MARK)
+            goto retry;
+        if (!cur)
+            break;
+        hp_set(slot, cur);
+        if (atomic_load_explicit(link, memory_order_acquire) != cur)
+            goto retry;
+        if (cur->key >= key)
+            break;
+        // The node owning link stays protected in the other slot until now
+        link = &cur->next;
+        slot ^= 1;
+        cur = atomic_load_explicit(link, memory_order_acquire);
+    }
+    int found = cur && cur->key == key;
+    hp_clear(0);
+    hp_clear(1);
+    return found;
+}
+
+/**
+ * Check whether a key is in the list
+ * @return 1 if present
+ */
+int rm_list_contains(struct rm_list *l, long key) {
+    int found;
+
+    switch (l->scheme) {
+    case RM_RWLOCK:
+        pthread_rwlock_rdlock(&l->rwlock);
+        found = rm_lookup_plain(l, key);
+        pthread_rwlock_unlock(&l->rwlock);
+        return found;
+    case RM_EBR:
+        ebr_enter();
+        found = rm_lookup_plain(l, key);
+        ebr_exit();
+        return found;
+    default:
+        return rm_lookup_hp(l, key);
+    }
+}
+
+static void rm_node_free(struct reclaim_node *node) {
+    free(node);
+}
+
+/**
+ * Insert the key if absent, or remove it if present
+ * @return 1 if the key was inserted, 0 if it was removed, -1 on allocation failure
+ */
+int rm_list_toggle(struct rm_list *l, long key) {
+    struct rm_node *_Atomic *link = &l->head;
+    struct rm_node *cur, *removed = NULL;
+    int inserted = -1;
+
+    if (l->scheme == RM_RWLOCK)
+        pthread_rwlock_wrlock(&l->rwlock);
+    else
+        pthread_mutex_lock(&l->write_lock);
+
+    // Writers are serialized: plain traversal, no marks on live links
+    while ((cur = atomic_load_explicit(link, memory_order_relaxed)) && cur->key < key)
+        link = &cur->next;
+    if (cur && cur->key == key) {
+        struct rm_node *next = atomic_load_explicit(&cur->next, memory_order_relaxed);
+        atomic_store_explicit(link, next, memory_order_release);
+        // Any reader still holding cur must notice it left the list
+        atomic_store_explicit(&cur->next, (struct rm_node *)((uintptr_t)next | RM_MARK), memory_order_release);
+        removed = cur;
+        inserted = 0;
+    } else {
+        struct rm_node *n = malloc(sizeof(*n));
+        if (n) {
+            n->key = key;
+            atomic_init(&n->next, cur);
+            atomic_store_explicit(link, n, memory_order_release);
+            inserted = 1;
+        }
+    }
+
+    if (l->scheme == RM_RWLOCK) {
+        pthread_rwlock_unlock(&l->rwlock);
+        free(removed);
+    } else {
+        pthread_mutex_unlock(&l->write_lock);
+        if (removed) {
+            if (l->scheme == RM_EBR)
+                ebr_retire(&removed->reclaim, rm_node_free);
+            else
+                hp_retire(&removed->reclaim, rm_node_free);
+        }
+    }
+    return inserted;
+}
+
+// Tagged Stack and Freelist
+
+// A Treiber stack whose nodes are recycled rather than freed suffers from
+//  ABA: a popper reads top = A and A->next = B, stalls, and meanwhile A and
+//  B are popped and A pushed back. Its CAS from A to B then succeeds and
+//  puts the no-longer-linked B back on top. Pairing top with a generation
+//  tag that changes on every update, and swapping both with one 16-byte
+//  CAS (cmpxchg16b), makes the stale CAS fail.
+//
+// The CAS is inline assembly so the file builds without -mcx16 and without
+//  libatomic, which __atomic on __int128 would otherwise need. CPUs without
+//  cmpxchg16b (and non-x86-64 builds) use the same stack behind a mutex.
+//
+// Popping reads top->next of a node another thread may already have
+//  popped, so nodes must stay mapped while the stack is in use. The
+//  freelist guarantees that: its objects are carved from chunks that are
+//  only freed by freelist_destroy().
+
+#define ABA_STACK_LOCKED 1  // aba_stack_init() flag: use the mutex even if cmpxchg16b exists
+
+/**
+ * Intrusive stack link; put it first in the object
+ */
+struct aba_node {
+    struct aba_node *next;
+};
+
+/**
+ * Stack top paired with its generation tag
+ */
+struct tagged_ptr {
+    struct aba_node *ptr;
+    uintptr_t tag;
+} __attribute__((aligned(16)));
+
+/**
+ * ABA-safe stack
+ */
+struct aba_stack {
+    _Alignas(CACHE_LINE) struct tagged_ptr top;
+    int lock_free;
+    pthread_mutex_t lock;  // Fallback only
+};
+
+/**
+ * Check whether the CPU implements cmpxchg16b
+ */
+static int cpu_has_cmpxchg16b(void) {
+#if defined(__x86_64__)
+    unsigned int eax, ebx, ecx, edx;
+    __asm__ __volatile__("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1), "c"(0));
+    return (ecx >> 13) & 1;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Compare and swap 16 bytes
+ * @param target Aligned pair to update
+ * @param expected Expected value; updated with the current one on failure
+ * @param desired New value
+ * @return 1 if the swap happened
+ */
+static inline int dwcas(struct tagged_ptr *target, struct tagged_ptr *expected, struct tagged_ptr desired) {
+#if defined(__x86_64__)
+    unsigned char ok;
+    __asm__ __volatile__("lock cmpxchg16b %1\n\tsete %0"
+                         : "=q"(ok), "+m"(*target), "+a"(expected->ptr), "+d"(expected->tag)
+                         : "b"(desired.ptr), "c"(desired.tag)
+                         : "memory", "cc");
+    return ok;
+#else
+    (void)target; (void)expected; (void)desired;
+    return 0;  // Never called: aba_stack_init() picks the locked stack
+#endif
+}
+
+/**
+ * Read top; the two halves may come from different updates, which the CAS then rejects
+ */
+static inline struct tagged_ptr aba_stack_load(struct aba_stack *s) {
+    struct tagged_ptr t;
+    t.tag = __atomic_load_n(&s->top.tag, __ATOMIC_ACQUIRE);
+    t.ptr = __atomic_load_n(&s->top.ptr, __ATOMIC_ACQUIRE);
+    return t;
+}
+
+/**
+ * Initialize a stack
+ * @param s The stack
+ * @param flags 0, or ABA_STACK_LOCKED to force the mutex fallback
+ */
+void aba_stack_init(struct aba_stack *s, int flags) {
+    s->top.ptr = NULL;
+    s->top.tag = 0;
+    s->lock_free = !(flags & ABA_STACK_LOCKED) && cpu_has_cmpxchg16b();
+    pthread_mutex_init(&s->lock, NULL);
+}
+
+void aba_stack_destroy(struct aba_stack *s) {
+    pthread_mutex_destroy(&s->lock);
+}
+
+/**
+ * Push a node
+ */
+void aba_stack_push(struct aba_stack *s, struct aba_node *node) {
+    if (!s->lock_free) {
+        pthread_mutex_lock(&s->lock);
+        node->next = s->top.ptr;
+        s->top.ptr = node;
+        pthread_mutex_unlock(&s->lock);
+        return;
+    }
+    struct tagged_ptr top = aba_stack_load(s);
+    struct tagged_ptr desired = { node, 0 };
+    do {
+        __atomic_store_n(&node->next, top.ptr, __ATOMIC_RELAXED);
+        desired.tag = top.tag + 1;
+    } while (!dwcas(&s->top, &top, desired));
+}
+
+/**
+ * Pop a node
+ * @return The node, or NULL if the stack is empty
+ */
+struct aba_node *aba_stack_pop(struct aba_stack *s) {
+    if (!s->lock_free) {
+        pthread_mutex_lock(&s->lock);
+        struct aba_node *node = s->top.ptr;
+        if (node)
+            s->top.ptr = node->next;
+        pthread_mutex_unlock(&s->lock);
+        return node;
+    }
+    struct tagged_ptr top = aba_stack_load(s);
+    for (;;) {
+        if (!top.ptr)
+            return NULL;
+        // May read a node that was just popped and reused; the tag check below then fails
+        struct tagged_ptr desired = { __atomic_load_n(&top.ptr->next, __ATOMIC_RELAXED), top.tag + 1 };
+        if (dwcas(&s->top, &top, desired))
+            return top.ptr;
+    }
+}
+
+/**
+ * Chunk of freelist objects
+ */
+struct freelist_chunk {
+    struct freelist_chunk *next;
+};
+
+/**
+ * Lock-free pool of fixed-size objects
+ */
+struct freelist {
+    struct aba_stack stack;
+    size_t obj_size;
+    size_t chunk_objs;
+    pthread_mutex_t grow_lock;
+    struct freelist_chunk *chunks;
+};
+
+/**
+ * Allocate a chunk and push its objects, keeping one for the caller
+ */
+static void *freelist_grow(struct freelist *fl) {
+    size_t header = (sizeof(struct freelist_chunk) + 15) & ~(size_t)15;
+    struct freelist_chunk *chunk = malloc(header + fl->obj_size * fl->chunk_objs);
+
+    if (!chunk)
+        return NULL;
+    pthread_mutex_lock(&fl->grow_lock);
+    chunk->next = fl->chunks;
+    fl->chunks = chunk;
+    pthread_mutex_unlock(&fl->grow_lock);
+
+    char *objs = (char *)chunk + header;
+    for (size_t i = 1; i < fl->chunk_objs; ++i)
+        aba_stack_push(&fl->stack, (struct aba_node *)(objs + i * fl->obj_size));
+    return objs;
+}
+
+/**
+ * Initialize a freelist
+ * @param fl The freelist
+ * @param obj_size Object size; rounded up to 16 bytes
+ * @param chunk_objs Objects allocated at a time when the freelist runs dry
+ * @param flags Passed to aba_stack_init()
+ */
+void freelist_init(struct freelist *fl, size_t obj_size, size_t chunk_objs, int flags) {
+    if (obj_size < sizeof(struct aba_node))
+        obj_size = sizeof(struct aba_node);
+    fl->obj_size = (obj_size + 15) & ~(size_t)15;
+    fl->chunk_objs = chunk_objs > 1 ? chunk_objs : 2;
+    fl->chunks = NULL;
+    aba_stack_init(&fl->stack, flags);
+    pthread_mutex_init(&fl->grow_lock, NULL);
+}
+
+/**
+ * Take an object, growing the freelist if it is empty
+ * @return The object, or NULL if out of memory
+ */
+void *freelist_alloc(struct freelist *fl) {
+    void *obj = aba_stack_pop(&fl->stack);
+    return obj ? obj : freelist_grow(fl);
+}
+
+/**
+ * Return an object
+ */
+void freelist_free(struct freelist *fl, void *obj) {
+    aba_stack_push(&fl->stack, obj);
+}
+
+/**
+ * Free all chunks; no object may be in use
+ */
+void freelist_destroy(struct freelist *fl) {
+    while (fl->chunks) {
+        struct freelist_chunk *next = fl->chunks->next;
+        free(fl->chunks);
+        fl->chunks = next;
+    }
+    aba_stack_destroy(&fl->stack);
+    pthread_mutex_destroy(&fl->grow_lock);
+}
+
+// Counter Benchmark
+
+enum counter_kind { COUNTER_SYNC, COUNTER_RELAXED, COUNTER_SHARDED, COUNTER_KIND_COUNT };
+
+static const char *const counter_kind_names[COUNTER_KIND_COUNT] = { "__sync", "relaxed", "sharded" };
+
+/**
+ * State shared by the benchmark threads
+ */
+struct counter_bench {
+    enum counter_kind kind;
+    _Alignas(CACHE_LINE) uint64_t sync_value;
+    _Alignas(CACHE_LINE) struct counter relaxed;
+    struct sharded_counter sharded;
+    _Alignas(CACHE_LINE) atomic_int stop;
+};
+
+/**
+ * Per-thread result, padded so threads do not share a line
+ */
+struct counter_bench_thread {
+    _Alignas(CACHE_LINE) struct counter_bench *bench;
+    uint64_t increments;
+    pthread_t tid;
+};
+
+/**
+ * Read the monotonic clock in nanoseconds
+ */
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * Increment the selected counter until told to stop
+ */
+static void *counter_bench_worker(void *arg) {
+    struct counter_bench_thread *t = arg;
+    struct counter_bench *b = t->bench;
+    uint64_t n = 0;
+
+    while (!atomic_load_explicit(&b->stop, memory_order_relaxed)) {
+        for (int i = 0; i < 256; ++i) {
+            switch (b->kind) {
+            case COUNTER_SYNC:
+                __sync_fetch_and_add(&b->sync_value, 1);
+                break;
+            case COUNTER_RELAXED:
+                counter_add(&b->relaxed, 1);
+                break;
+            default:
+                sharded_counter_add(&b->sharded, 1);
+                break;
+            }
+        }
+        n += 256;
+    }
+    t->increments = n;
+    return NULL;
+}
+
+/**
+ * Run one counter kind with a number of threads for a fixed time
+ * @return Increments per second, or 0 if the total did not match
+ */
+static double counter_bench_run(struct counter_bench *b, enum counter_kind kind, int threads, int millis) {
+    struct counter_bench_thread *t = aligned_alloc(CACHE_LINE, sizeof(*t) * threads);
+    struct timespec duration = { millis / 1000, (millis % 1000) * 1000000L };
+    uint64_t expected = 0, got;
+    uint64_t start, elapsed;
+
+    if (!t)
+        return 0;
+    memset(t, 0, sizeof(*t) * threads);
+    b->kind = kind;
+    b->sync_value = 0;
+    atomic_store(&b->relaxed.value, 0);
+    for (unsigned int i = 0; i < b->sharded.nslots; ++i)
+        atomic_store(&b->sharded.slots[i].value, 0);
+    atomic_store(&b->stop, 0);
+
+    start = now_ns();
+    for (int i = 0; i < threads; ++i) {
+        t[i].bench = b;
+        pthread_create(&t[i].tid, NULL, counter_bench_worker, &t[i]);
+    }
+    nanosleep(&duration, NULL);
+    atomic_store(&b->stop, 1);
+    for (int i = 0; i < threads; ++i) {
+        pthread_join(t[i].tid, NULL);
+        expected += t[i].increments;
+    }
+    elapsed = now_ns() - start;
+
+    got = kind == COUNTER_SYNC ? b->sync_value
+        : kind == COUNTER_RELAXED ? counter_read(&b->relaxed)
+        : (uint64_t)sharded_counter_read(&b->sharded);
+    free(t);
+    if (got != expected) {
+        fprintf(stderr, "%s: counted %llu, expected %llu\n", counter_kind_names[kind],
+                (unsigned long long)got, (unsigned long long)expected);
+        return 0;
+    }
+    return expected * 1e9 / elapsed;
+}
+
+/**
+ * Print increments per second for every counter kind from 1 to max_threads
+ * @param max_threads Highest thread count (0 = number of online CPUs)
+ * @param millis Duration of each run
+ * @return 0 on success, 1 if a counter lost updates
+ */
+int counter_bench_main(int max_threads, int millis) {
+    static struct counter_bench b;
+    int failed = 0;
+
+    if (max_threads <= 0)
+        max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (sharded_counter_init(&b.sharded) < 0)
+        return 1;
+
+    printf("%-8s", "threads");
+    for (int k = 0; k < COUNTER_KIND_COUNT; ++k)
+        printf(" %12s", counter_kind_names[k]);
+    printf("   (Mops/s)\n");
+    for (int threads = 1; threads <= max_threads; threads = threads < max_threads && threads * 2 > max_threads ? max_threads : threads * 2) {
+        printf("%-8d", threads);
+        for (int k = 0; k < COUNTER_KIND_COUNT; ++k) {
+            double rate = counter_bench_run(&b, k, threads, millis);
+            failed |= rate == 0;
+            printf(" %12.1f", rate / 1e6);
+        }
+        printf("\n");
+    }
+    sharded_counter_destroy(&b.sharded);
+    return failed;
+}
+
+// Reclamation Benchmark
+
+// Stack: every thread pushes and pops as fast as it can; the run checks
+//  that the popped values add up to the pushed ones and reports the peak
+//  number of retired-but-unfreed nodes.
+// List: readers look up random keys in a 64-node list, alone and then
+//  alongside a writer that keeps inserting and removing keys.
+
+#define RM_LIST_KEYS 128  // Keys 0..127; the even ones start in the list
+
+/**
+ * State shared by the reclamation benchmark threads
+ */
+struct reclaim_bench {
+    struct lf_stack stack;
+    struct rm_list list;
+    int use_hp;
+    _Alignas(CACHE_LINE) atomic_int stop;
+};
+
+/**
+ * Per-thread result
+ */
+struct reclaim_bench_thread {
+    _Alignas(CACHE_LINE) struct reclaim_bench *bench;
+    pthread_t tid;
+    uint64_t ops;
+    long pushed_sum, popped_sum;
+    unsigned int seed;
+};
+
+static void *stack_bench_worker(void *arg) {
+    struct reclaim_bench_thread *t = arg;
+    struct reclaim_bench *b = t->bench;
+    long value = 0;
+
+    while (!atomic_load_explicit(&b->stop, memory_order_relaxed)) {
+        long v = (long)(++t->ops & 0xffff);
+        if (lf_stack_push(&b->stack, v) == 0)
+            t->pushed_sum += v;
+        if (b->use_hp ? lf_stack_pop_hp(&b->stack, &value) : lf_stack_pop_ebr(&b->stack, &value))
+            t->popped_sum += value;
+    }
+    if (b->use_hp)
+        hp_unregister();
+    else
+        ebr_unregister();
+    return NULL;
+}
+
+static void *list_bench_reader(void *arg) {
+    struct reclaim_bench_thread *t = arg;
+    struct reclaim_bench *b = t->bench;
+    uint64_t ops = 0;
+
+    while (!atomic_load_explicit(&b->stop, memory_order_relaxed)) {
+        for (int i = 0; i < 64; ++i) {
+            t->seed = t->seed * 1103515245u + 12345u;
+            t->popped_sum += rm_list_contains(&b->list, (t->seed >> 16) % RM_LIST_KEYS);
+        }
+        ops += 64;
+    }
+    t->ops = ops;
+    hp_unregister();
+    ebr_unregister();
+    return NULL;
+}
+
+static void *list_bench_writer(void *arg) {
+    struct reclaim_bench_thread *t = arg;
+    struct reclaim_bench *b = t->bench;
+
+    while (!atomic_load_explicit(&b->stop, memory_order_relaxed)) {
+        t->seed = t->seed * 1103515245u + 12345u;
+        rm_list_toggle(&b->list, (t->seed >> 16) % RM_LIST_KEYS);
+        t->ops++;
+    }
+    hp_unregister();
+    ebr_unregister();
+    return NULL;
+}
+
+/**
+ * Start threads running fn, sleep, stop them and return the elapsed nanoseconds
+ */
+static uint64_t reclaim_bench_run(struct reclaim_bench *b, struct reclaim_bench_thread *t, int n,
+                                  void *(*fn)(void *), struct reclaim_bench_thread *writer, int millis) {
+    struct timespec duration = { millis / 1000, (millis % 1000) * 1000000L };
+    uint64_t start = now_ns();
+
+    atomic_store(&b->stop, 0);
+    atomic_store(&reclaim_pending_peak, atomic_load(&reclaim_pending));
+    for (int i = 0; i < n; ++i) {
+        memset(&t[i], 0, sizeof(t[i]));
+        t[i].bench = b;
+        t[i].seed = (unsigned int)i * 7919u + 1;
+        pthread_create(&t[i].tid, NULL, fn, &t[i]);
+    }
+    if (writer) {
+        memset(writer, 0, sizeof(*writer));
+        writer->bench = b;
+        writer->seed = 424242;
+        pthread_create(&writer->tid, NULL, list_bench_writer, writer);
+    }
+    nanosleep(&duration, NULL);
+    atomic_store(&b->stop, 1);
+    for (int i = 0; i < n; ++i)
+        pthread_join(t[i].tid, NULL);
+    if (writer)
+        pthread_join(writer->tid, NULL);
+    return now_ns() - start;
+}
+
+/**
+ * Run the stack and list benchmarks
+ * @param threads Stack threads and list readers (0 = number of online CPUs, at least 2)
+ * @param millis Duration of each run
+ * @return 0 on success, 1 if the stack lost or duplicated values
+ */
+int reclaim_bench_main(int threads, int millis) {
+    static struct reclaim_bench b;
+    struct reclaim_bench_thread *t, writer;
+    int failed = 0;
+
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 2 ? (int)cpus : 2;
+    }
+    t = aligned_alloc(CACHE_LINE, sizeof(*t) * threads);
+    if (!t)
+        return 1;
+
+    printf("stack, %d threads\n%-8s %12s %14s\n", threads, "scheme", "Mops/s", "peak unfreed");
+    for (int use_hp = 0; use_hp < 2; ++use_hp) {
+        long pushed = 0, popped = 0, value;
+        b.use_hp = use_hp;
+        uint64_t elapsed = reclaim_bench_run(&b, t, threads, stack_bench_worker, NULL, millis);
+        uint64_t ops = 0;
+        for (int i = 0; i < threads; ++i) {
+            ops += t[i].ops;
+            pushed += t[i].pushed_sum;
+            popped += t[i].popped_sum;
+        }
+        while (use_hp ? lf_stack_pop_hp(&b.stack, &value) : lf_stack_pop_ebr(&b.stack, &value))
+            popped += value;
+        printf("%-8s %12.2f %14ld\n", rm_scheme_names[use_hp ? RM_HP : RM_EBR], ops * 1e3 / elapsed,
+               atomic_load(&reclaim_pending_peak));
+        if (pushed != popped) {
+            fprintf(stderr, "stack: pushed sum %ld, popped sum %ld\n", pushed, popped);
+            failed = 1;
+        }
+        hp_unregister();
+        ebr_unregister();
+    }
+
+    printf("\nlist, %d keys\n%-8s %8s %16s %16s %14s\n", RM_LIST_KEYS, "scheme", "readers",
+           "Mlookups/s", "writer Kops/s", "peak unfreed");
+    for (int scheme = 0; scheme < RM_SCHEME_COUNT; ++scheme) {
+        rm_list_init(&b.list, scheme);
+        for (long k = 0; k < RM_LIST_KEYS; k += 2)
+            rm_list_toggle(&b.list, k);
+        for (int pass = 0; pass < 2; ++pass) {
+            int readers = pass ? threads : 1;
+            uint64_t elapsed = reclaim_bench_run(&b, t, readers, list_bench_reader, pass ? &writer : NULL, millis);
+            uint64_t lookups = 0;
+            for (int i = 0; i < readers; ++i)
+                lookups += t[i].ops;
+            printf("%-8s %6d%s %16.2f %16.1f %14ld\n", rm_scheme_names[scheme], readers, pass ? "+w" : "  ",
+                   lookups * 1e3 / elapsed, pass ? writer.ops * 1e6 / elapsed : 0.0,
+                   atomic_load(&reclaim_pending_peak));
+        }
+        hp_unregister();
+        ebr_unregister();
+        rm_list_destroy(&b.list);
+    }
+    free(t);
+    return failed;
+}
+
+// Tagged Stack Benchmark
+
+// Every thread repeatedly takes a few objects from a shared freelist, pushes
+//  them onto a shared stack, pops the same number back and returns them to
+//  the freelist, so nodes are recycled constantly: the setting in which an
+//  untagged stack corrupts itself. Each object carries an ownership flag
+//  that a pop claims, which catches a node handed out twice, and the run
+//  ends by counting every object back.
+
+#define ABA_BURST 4  // Objects each thread holds at once
+
+/**
+ * Object moved between the freelist and the stack
+ */
+struct aba_item {
+    struct aba_node node;
+    atomic_int on_stack;
+    int owner;
+};
+
+/**
+ * State shared by the stress threads
+ */
+struct aba_bench {
+    struct freelist freelist;
+    struct aba_stack stack;
+    long ops_per_thread;
+    atomic_long errors;
+};
+
+/**
+ * Per-thread arguments
+ */
+struct aba_bench_thread {
+    _Alignas(CACHE_LINE) struct aba_bench *bench;
+    pthread_t tid;
+    int id;
+};
+
+static void *aba_bench_worker(void *arg) {
+    struct aba_bench_thread *t = arg;
+    struct aba_bench *b = t->bench;
+    struct aba_item *items[ABA_BURST];
+
+    for (long op = 0; op < b->ops_per_thread; op += ABA_BURST) {
+        for (int i = 0; i < ABA_BURST; ++i) {
+            items[i] = freelist_alloc(&b->freelist);
+            items[i]->owner = t->id;
+            atomic_store_explicit(&items[i]->on_stack, 1, memory_order_relaxed);
+            aba_stack_push(&b->stack, &items[i]->node);
+        }
+        for (int i = 0; i < ABA_BURST; ++i) {
+            // Our pushes are still on the stack, so a pop can only come up empty if the stack is broken
+            struct aba_item *item = (struct aba_item *)aba_stack_pop(&b->stack);
+            if (!item || !atomic_exchange_explicit(&item->on_stack, 0, memory_order_relaxed)) {
+                atomic_fetch_add(&b->errors, 1);
+                continue;
+            }
+            freelist_free(&b->freelist, item);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Run the stress test on one implementation
+ * @return Stack operations per second, or 0 if anything was lost or duplicated
+ */
+static double aba_bench_run(int flags, int threads, long ops) {
+    static struct aba_bench b;
+    struct aba_bench_thread *t = aligned_alloc(CACHE_LINE, sizeof(*t) * threads);
+    long objects = 0, on_stack = 0;
+    uint64_t start, elapsed;
+
+    if (!t)
+        return 0;
+    freelist_init(&b.freelist, sizeof(struct aba_item), 256, flags);
+    aba_stack_init(&b.stack, flags);
+    b.ops_per_thread = ops;
+    atomic_store(&b.errors, 0);
+
+    start = now_ns();
+    for (int i = 0; i < threads; ++i) {
+        t[i].bench = &b;
+        t[i].id = i;
+        pthread_create(&t[i].tid, NULL, aba_bench_worker, &t[i]);
+    }
+    for (int i = 0; i < threads; ++i)
+        pthread_join(t[i].tid, NULL);
+    elapsed = now_ns() - start;
+
+    while (aba_stack_pop(&b.stack))
+        ++on_stack;
+    while (aba_stack_pop(&b.freelist.stack))
+        ++objects;
+    long chunks = 0;
+    for (struct freelist_chunk *c = b.freelist.chunks; c; c = c->next)
+        ++chunks;
+    long errors = atomic_load(&b.errors);
+    if (errors || on_stack || objects != chunks * (long)b.freelist.chunk_objs) {
+        fprintf(stderr, "%s stack: %ld bad pops, %ld left on stack, %ld of %ld objects returned\n",
+                b.stack.lock_free ? "cmpxchg16b" : "locked", errors, on_stack, objects,
+                chunks * (long)b.freelist.chunk_objs);
+        elapsed = 0;
+    }
+    freelist_destroy(&b.freelist);
+    aba_stack_destroy(&b.stack);
+    free(t);
+    // Each op is one push and one pop on the stack and one on the freelist
+    return elapsed ? threads * (double)ops * 4 * 1e9 / elapsed : 0;
+}
+
+/**
+ * Stress and time the cmpxchg16b stack against the mutex fallback
+ * @param threads Number of threads (0 = twice the online CPUs, at least 8)
+ * @param ops Objects cycled per thread
+ * @return 0 on success, 1 if a run failed its checks
+ */
+int aba_bench_main(int threads, long ops) {
+    int failed = 0;
+
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 4 ? (int)cpus * 2 : 8;
+    }
+    printf("cmpxchg16b %s, %d threads, %ld objects cycled per thread\n",
+           cpu_has_cmpxchg16b() ? "available" : "missing", threads, ops);
+    printf("%-12s %12s\n", "stack", "Mops/s");
+    for (int locked = 0; locked < 2; ++locked) {
+        if (!locked && !cpu_has_cmpxchg16b())
+            continue;
+        double rate = aba_bench_run(locked ? ABA_STACK_LOCKED : 0, threads, ops);
+        failed |= rate == 0;
+        printf("%-12s %12.2f\n", locked ? "mutex" : "cmpxchg16b", rate / 1e6);
+    }
+    return failed;
+}
+
+/**
+ * Basic example, or one of the benchmarks listed at the top
+ */
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+        return counter_bench_main(argc > 2 ? atoi(argv[2]) : 0, argc > 3 ? atoi(argv[3]) : 200);
+    if (argc > 1 && strcmp(argv[1], "bench-reclaim") == 0)
+        return reclaim_bench_main(argc > 2 ? atoi(argv[2]) : 0, argc > 3 ? atoi(argv[3]) : 300);
+    if (argc > 1 && strcmp(argv[1], "bench-aba") == 0)
+        return aba_bench_main(argc > 2 ? atoi(argv[2]) : 0, argc > 3 ? atol(argv[3]) : 1000000);
 
-int main() {
     int value = 0;
 
     // Atomic increment
@@ -33,6 +1555,15 @@ int main() {
         printf("Atomic compare and swap failed, value: %d\n", value);
     }
 
+    // The same operations with C11 atomics and explicit memory orders
+    struct counter requests = { 0 };
+    counter_add(&requests, 1);
+    counter_sub(&requests, 1);
+    printf("C11 counter after increment and decrement: %llu\n", (unsigned long long)counter_read(&requests));
+
+    struct counter refs = { 2 };
+    counter_put_ref(&refs);
+    printf("Last reference dropped: %d\n", counter_put_ref(&refs)); // Output: 1
+
     return 0;
 }
-
@@ -31,14 +31,130 @@
  * CPU memory barriers enforce ordering of memory accesses at the hardware level. They ensure that all memory accesses before the barrier are completed before any memory accesses after the barrier.
  */
 
+/**
+ * Build: gcc -O2 -pthread main.c -o barriers
+ * Run "bench [messages]" to compare the SPSC ring below with a mutex plus fence queue, or
+ * "bench-seqlock [max_readers] [ms]" to compare the seqlock with pthread_rwlock and a mutex, or
+ * "bench-false-sharing [max_threads] [iterations]" for packed vs padded counters, or "layout" for the
+ * cache line report of the structs in this file.
+ */
+
+#define _GNU_SOURCE  // pthread_setaffinity_np()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <stdatomic.h>
 #include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Cache Line Padding
+ * Cores keep caches coherent a whole line at a time, so two variables written by different threads that
+ * happen to share a line (false sharing) bounce it between cores on every write, although neither thread
+ * reads the other's data. Nothing in the source shows it; adjacent globals, arrays of per-thread counters
+ * and small structs are the usual victims. The macros below give such objects a line of their own, and
+ * CHECK_LAYOUT() lists the hot fields of a struct that share or straddle lines.
+ */
+
+#define CACHE_LINE 64  // Most x86-64 and Arm cores; some Intel parts also prefetch lines in pairs
+
+/**
+ * Start an object on a cache line boundary
+ */
+#define CACHE_ALIGNED _Alignas(CACHE_LINE)
+
+/**
+ * Define struct padded_NAME: a TYPE alone on its cache line(s). The alignment also rounds sizeof up to a
+ * whole number of lines, so arrays of it never share.
+ */
+#define DEFINE_PADDED(NAME, TYPE)          \
+    struct padded_##NAME {                 \
+        CACHE_ALIGNED TYPE value;          \
+    }
+
+/**
+ * Fail the build if FIELD of TYPE does not start a cache line
+ */
+#define ASSERT_OWN_LINE(TYPE, FIELD) \
+    _Static_assert(offsetof(TYPE, FIELD) % CACHE_LINE == 0, #TYPE "." #FIELD " does not start a cache line")
+
+DEFINE_PADDED(u64, uint64_t);
+
+/**
+ * A field for check_layout(): where it is and which thread (or role) writes it
+ */
+struct field_info {
+    const char *name;
+    size_t offset;
+    size_t size;
+    int writer;  // Fields with different writers should not share a line; -1 = read-only
+};
+
+#define HOT_FIELD(TYPE, FIELD, WRITER) { #FIELD, offsetof(TYPE, FIELD), sizeof(((TYPE *)0)->FIELD), (WRITER) }
+
+/**
+ * Print a layout report for a struct
+ * @param out Where to print
+ * @param type_name Name of the struct
+ * @param size sizeof the struct
+ * @param align _Alignof the struct
+ * @param fields Its hot fields
+ * @param count Number of fields
+ * @return Number of problems found
+ */
+int check_layout(FILE *out, const char *type_name, size_t size, size_t align, const struct field_info *fields,
+                 size_t count) {
+    int problems = 0;
+
+    fprintf(out, "%s: %zu bytes, aligned to %zu\n", type_name, size, align);
+    if (align < CACHE_LINE && size > 1) {
+        // Line numbers below assume the struct starts a line; otherwise every boundary can shift
+        fprintf(out, "  note: not line aligned, instances may straddle lines anywhere\n");
+    }
+    for (size_t i = 0; i < count; ++i) {
+        const struct field_info *f = &fields[i];
+        size_t first = f->offset / CACHE_LINE, last = (f->offset + f->size - 1) / CACHE_LINE;
+
+        fprintf(out, "  %-16s offset %4zu size %4zu line %zu", f->name, f->offset, f->size, first);
+        if (last != first)
+            fprintf(out, "-%zu", last);
+        fprintf(out, "\n");
+        if (last != first && f->size <= CACHE_LINE) {
+            fprintf(out, "  STRADDLE: %s crosses a line boundary\n", f->name);
+            problems++;
+        }
+        for (size_t j = 0; j < i; ++j) {
+            const struct field_info *g = &fields[j];
+            size_t gfirst = g->offset / CACHE_LINE, glast = (g->offset + g->size - 1) / CACHE_LINE;
+            if (f->writer == g->writer || (f->writer < 0 && g->writer < 0))
+                continue;
+            if (first <= glast && gfirst <= last) {
+                fprintf(out, "  SHARED: %s (writer %d) and %s (writer %d) share a line\n", g->name, g->writer,
+                        f->name, f->writer);
+                problems++;
+            }
+        }
+    }
+    return problems;
+}
+
+/**
+ * Run check_layout() on TYPE with a list of HOT_FIELD() entries
+ */
+#define CHECK_LAYOUT(OUT, TYPE, ...)                                                                          \
+    check_layout((OUT), #TYPE, sizeof(TYPE), _Alignof(TYPE), (const struct field_info[]){ __VA_ARGS__ },      \
+                 sizeof((const struct field_info[]){ __VA_ARGS__ }) / sizeof(struct field_info))
 
 /**
  * Example with CPU memory barrier and mutex
  */
-pthread_mutex_t mutex;
-atomic_int shared_value = 0;
+CACHE_ALIGNED pthread_mutex_t mutex;
+CACHE_ALIGNED atomic_int shared_value = 0;  // Written outside the mutex: keep it off the mutex's line
 
 /**
  * Thread function that demonstrates the use of a CPU memory barrier and a mutex for synchronization.
@@ -63,3 +179,908 @@ void* thread_function(void* arg) {
     
     return NULL;
 }
+
+/**
+ * Single-Producer/Single-Consumer Ring Buffer
+ * Publishing data to one other thread needs no full fence and no lock. The producer writes the slot and then
+ * stores its head index with release ordering; the consumer loads that index with acquire ordering, which
+ * guarantees it sees the slot contents. The same pairing in the other direction hands slots back.
+ *
+ * Each side also keeps a cached copy of the other side's index and only reloads it when the cached value says
+ * the ring is full (or empty), so in steady state each side touches the other's cache line once per lap rather
+ * than once per message. Producer and consumer state live on separate cache lines so they never false-share.
+ */
+
+/**
+ * SPSC ring of pointers; capacity is a power of two
+ */
+struct spsc_ring {
+    _Alignas(CACHE_LINE) _Atomic size_t head;  // Next slot to write, owned by the producer
+    size_t cached_tail;                       // Producer's last view of tail
+
+    _Alignas(CACHE_LINE) _Atomic size_t tail;  // Next slot to read, owned by the consumer
+    size_t cached_head;                       // Consumer's last view of head
+
+    _Alignas(CACHE_LINE) size_t mask;
+    void **slots;
+};
+
+/**
+ * Initialize a ring
+ * @param r The ring
+ * @param capacity Number of slots, rounded up to a power of two
+ * @return 0 on success, -1 on error
+ */
+int spsc_ring_init(struct spsc_ring *r, size_t capacity) {
+    size_t n = 2;
+
+    while (n < capacity)
+        n <<= 1;
+    r->slots = aligned_alloc(CACHE_LINE, n * sizeof(void *) < CACHE_LINE ? CACHE_LINE : n * sizeof(void *));
+    if (!r->slots) {
+        perror("aligned_alloc");
+        return -1;
+    }
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    r->cached_tail = 0;
+    r->cached_head = 0;
+    r->mask = n - 1;
+    return 0;
+}
+
+/**
+ * Free a ring's storage
+ * @param r The ring
+ */
+void spsc_ring_destroy(struct spsc_ring *r) {
+    free(r->slots);
+    r->slots = NULL;
+}
+
+/**
+ * Enqueue up to n messages; producer thread only
+ * @param r The ring
+ * @param msgs Messages to enqueue
+ * @param n Number of messages
+ * @return Number of messages enqueued, 0 if the ring is full
+ */
+size_t spsc_ring_enqueue_batch(struct spsc_ring *r, void *const *msgs, size_t n) {
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    size_t capacity = r->mask + 1;
+    size_t free_slots = capacity - (head - r->cached_tail);
+
+    if (free_slots < n) {
+        // Acquire pairs with the consumer's release: it has finished reading these slots
+        r->cached_tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+        free_slots = capacity - (head - r->cached_tail);
+        if (free_slots == 0)
+            return 0;
+        if (n > free_slots)
+            n = free_slots;
+    }
+    for (size_t i = 0; i < n; ++i)
+        r->slots[(head + i) & r->mask] = msgs[i];
+    // Release: the slot writes above become visible before the new head
+    atomic_store_explicit(&r->head, head + n, memory_order_release);
+    return n;
+}
+
+/**
+ * Dequeue up to n messages; consumer thread only
+ * @param r The ring
+ * @param msgs Where to store the messages
+ * @param n Maximum number of messages
+ * @return Number of messages dequeued, 0 if the ring is empty
+ */
+size_t spsc_ring_dequeue_batch(struct spsc_ring *r, void **msgs, size_t n) {
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    size_t avail = r->cached_head - tail;
+
+    if (avail < n) {
+        // Acquire pairs with the producer's release: the slots are written
+        r->cached_head = atomic_load_explicit(&r->head, memory_order_acquire);
+        avail = r->cached_head - tail;
+        if (avail == 0)
+            return 0;
+        if (n > avail)
+            n = avail;
+    }
+    for (size_t i = 0; i < n; ++i)
+        msgs[i] = r->slots[(tail + i) & r->mask];
+    // Release: we are done reading the slots before the producer may reuse them
+    atomic_store_explicit(&r->tail, tail + n, memory_order_release);
+    return n;
+}
+
+/**
+ * Enqueue one message
+ * @return 1 on success, 0 if the ring is full
+ */
+static inline int spsc_ring_enqueue(struct spsc_ring *r, void *msg) {
+    return (int)spsc_ring_enqueue_batch(r, &msg, 1);
+}
+
+/**
+ * Dequeue one message
+ * @return 1 on success, 0 if the ring is empty
+ */
+static inline int spsc_ring_dequeue(struct spsc_ring *r, void **msg) {
+    return (int)spsc_ring_dequeue_batch(r, msg, 1);
+}
+
+/**
+ * Sequence Lock
+ * For data that is read far more often than written. A writer makes the sequence number odd, updates the
+ * data and makes it even again; a reader records the sequence number, copies the data and checks that the
+ * number is unchanged and even, retrying otherwise. Readers never write shared memory, so any number of
+ * them run in parallel without moving a cache line.
+ *
+ * The copy can race with a writer, so the data is accessed with relaxed atomic word loads and stores (not
+ * memcpy) to keep the race defined. The fences follow Boehm's recipe: the writer's release fence after
+ * making the count odd keeps data stores from moving above it, and the reader's acquire fence before
+ * re-reading the count keeps data loads from moving below it.
+ */
+
+/**
+ * Sequence lock; the count is odd while a write is in progress
+ */
+struct seqlock {
+    _Alignas(CACHE_LINE) atomic_uint seq;
+};
+
+void seqlock_init(struct seqlock *l) {
+    atomic_init(&l->seq, 0);
+}
+
+/**
+ * Start a write; writers exclude each other by taking the count from even to odd
+ * @param l The lock
+ */
+void seqlock_write_begin(struct seqlock *l) {
+    unsigned int seq = atomic_load_explicit(&l->seq, memory_order_relaxed);
+
+    for (;;) {
+        if (!(seq & 1) && atomic_compare_exchange_weak_explicit(&l->seq, &seq, seq + 1, memory_order_acquire,
+                                                                memory_order_relaxed))
+            break;
+        if (seq & 1) {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+            seq = atomic_load_explicit(&l->seq, memory_order_relaxed);
+        }
+    }
+    atomic_thread_fence(memory_order_release);
+}
+
+/**
+ * Finish a write and publish the data
+ * @param l The lock
+ */
+void seqlock_write_end(struct seqlock *l) {
+    atomic_store_explicit(&l->seq, atomic_load_explicit(&l->seq, memory_order_relaxed) + 1, memory_order_release);
+}
+
+/**
+ * Start a read
+ * @param l The lock
+ * @return Token for seqlock_read_retry(); waits out a write in progress
+ */
+unsigned int seqlock_read_begin(const struct seqlock *l) {
+    unsigned int seq;
+
+    while ((seq = atomic_load_explicit((atomic_uint *)&l->seq, memory_order_acquire)) & 1) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+    return seq;
+}
+
+/**
+ * Check whether the data read since seqlock_read_begin() may be torn
+ * @param l The lock
+ * @param seq Token from seqlock_read_begin()
+ * @return 1 if the read must be repeated
+ */
+int seqlock_read_retry(const struct seqlock *l, unsigned int seq) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit((atomic_uint *)&l->seq, memory_order_relaxed) != seq;
+}
+
+/**
+ * Copy data protected by a seqlock out, racing a possible writer
+ * @param dst Destination
+ * @param src Protected data; 8-byte aligned
+ * @param size Bytes to copy
+ */
+static inline void seqlock_copy_out(void *dst, const void *src, size_t size) {
+    const uint64_t *s = src;
+    unsigned char *d = dst;
+    size_t i = 0;
+
+    for (; i + 8 <= size; i += 8, ++s) {
+        uint64_t w = __atomic_load_n(s, __ATOMIC_RELAXED);
+        memcpy(d + i, &w, 8);
+    }
+    for (; i < size; ++i)
+        d[i] = __atomic_load_n((const unsigned char *)src + i, __ATOMIC_RELAXED);
+}
+
+/**
+ * Copy data protected by a seqlock in, while readers may be copying it out
+ * @param dst Protected data; 8-byte aligned
+ * @param src Source
+ * @param size Bytes to copy
+ */
+static inline void seqlock_copy_in(void *dst, const void *src, size_t size) {
+    uint64_t *d = dst;
+    const unsigned char *s = src;
+    size_t i = 0;
+
+    for (; i + 8 <= size; i += 8, ++d) {
+        uint64_t w;
+        memcpy(&w, s + i, 8);
+        __atomic_store_n(d, w, __ATOMIC_RELAXED);
+    }
+    for (; i < size; ++i)
+        __atomic_store_n((unsigned char *)dst + i, s[i], __ATOMIC_RELAXED);
+}
+
+/**
+ * Define a struct seqlock_NAME holding a TYPE value under a seqlock, with
+ * seqlock_NAME_init(), _read() returning a consistent copy and _write()
+ * replacing the value
+ */
+#define DEFINE_SEQLOCK_TYPE(NAME, TYPE)                                                   \
+    struct seqlock_##NAME {                                                               \
+        struct seqlock lock;                                                              \
+        _Alignas(8) TYPE value;                                                           \
+    };                                                                                    \
+    static inline void seqlock_##NAME##_init(struct seqlock_##NAME *s, const TYPE *v) {   \
+        seqlock_init(&s->lock);                                                           \
+        memcpy(&s->value, v, sizeof(TYPE));                                               \
+    }                                                                                     \
+    static inline void seqlock_##NAME##_read(const struct seqlock_##NAME *s, TYPE *out) { \
+        unsigned int seq;                                                                 \
+        do {                                                                              \
+            seq = seqlock_read_begin(&s->lock);                                           \
+            seqlock_copy_out(out, &s->value, sizeof(TYPE));                               \
+        } while (seqlock_read_retry(&s->lock, seq));                                      \
+    }                                                                                     \
+    static inline void seqlock_##NAME##_write(struct seqlock_##NAME *s, const TYPE *v) {  \
+        seqlock_write_begin(&s->lock);                                                    \
+        seqlock_copy_in(&s->value, v, sizeof(TYPE));                                      \
+        seqlock_write_end(&s->lock);                                                      \
+    }
+
+/**
+ * Baseline: Mutex Plus Fence Queue
+ * The same ring protected by a mutex, with the full fence that thread_function() above uses after every
+ * operation. This is what publishing through the pattern at the top of this file costs.
+ */
+struct locked_queue {
+    pthread_mutex_t mutex;
+    size_t head, tail, mask;
+    void **slots;
+};
+
+int locked_queue_init(struct locked_queue *q, size_t capacity) {
+    size_t n = 2;
+
+    while (n < capacity)
+        n <<= 1;
+    q->slots = malloc(n * sizeof(void *));
+    if (!q->slots) {
+        perror("malloc");
+        return -1;
+    }
+    pthread_mutex_init(&q->mutex, NULL);
+    q->head = q->tail = 0;
+    q->mask = n - 1;
+    return 0;
+}
+
+void locked_queue_destroy(struct locked_queue *q) {
+    pthread_mutex_destroy(&q->mutex);
+    free(q->slots);
+}
+
+int locked_queue_enqueue(struct locked_queue *q, void *msg) {
+    int ok = 0;
+
+    pthread_mutex_lock(&q->mutex);
+    if (q->head - q->tail <= q->mask) {
+        q->slots[q->head++ & q->mask] = msg;
+        ok = 1;
+    }
+    pthread_mutex_unlock(&q->mutex);
+    atomic_thread_fence(memory_order_seq_cst);
+    return ok;
+}
+
+int locked_queue_dequeue(struct locked_queue *q, void **msg) {
+    int ok = 0;
+
+    pthread_mutex_lock(&q->mutex);
+    if (q->head != q->tail) {
+        *msg = q->slots[q->tail++ & q->mask];
+        ok = 1;
+    }
+    pthread_mutex_unlock(&q->mutex);
+    atomic_thread_fence(memory_order_seq_cst);
+    return ok;
+}
+
+/**
+ * Benchmark
+ * Throughput streams messages from a producer pinned to one CPU to a consumer pinned to another and checks
+ * they arrive in order. Latency bounces one message back and forth through a pair of queues.
+ */
+
+#define BENCH_RING_SIZE 4096
+#define BENCH_BATCH 32
+#define SPINS_BEFORE_YIELD 256
+
+enum queue_kind { QUEUE_SPSC, QUEUE_SPSC_BATCH, QUEUE_LOCKED, QUEUE_KIND_COUNT };
+
+static const char *const queue_kind_names[QUEUE_KIND_COUNT] = { "spsc", "spsc batch", "mutex+fence" };
+
+/**
+ * A queue under test, one of the kinds above
+ */
+struct bench_queue {
+    enum queue_kind kind;
+    struct spsc_ring ring;
+    struct locked_queue locked;
+};
+
+/**
+ * Arguments of a benchmark thread
+ */
+struct bench_thread {
+    struct bench_queue *in, *out;  // out is NULL for the consumer of a throughput run
+    uint64_t count;
+    int cpu;
+    uint64_t errors;
+};
+
+/**
+ * Read the monotonic clock in nanoseconds
+ */
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * Pin the calling thread to a CPU, wrapping around the online CPUs
+ */
+static void pin_to_cpu(int cpu) {
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu % (ncpu > 0 ? ncpu : 1), &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/**
+ * Back off while waiting for the other side; yield eventually so the benchmark also runs on one CPU
+ */
+static inline void bench_wait(unsigned int *spins) {
+    if (++*spins < SPINS_BEFORE_YIELD) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    } else {
+        *spins = 0;
+        sched_yield();
+    }
+}
+
+static size_t bench_enqueue(struct bench_queue *q, void *const *msgs, size_t n) {
+    switch (q->kind) {
+    case QUEUE_SPSC:
+        return (size_t)spsc_ring_enqueue(&q->ring, msgs[0]);
+    case QUEUE_SPSC_BATCH:
+        return spsc_ring_enqueue_batch(&q->ring, msgs, n);
+    default:
+        return (size_t)locked_queue_enqueue(&q->locked, msgs[0]);
+    }
+}
+
+static size_t bench_dequeue(struct bench_queue *q, void **msgs, size_t n) {
+    switch (q->kind) {
+    case QUEUE_SPSC:
+        return (size_t)spsc_ring_dequeue(&q->ring, msgs);
+    case QUEUE_SPSC_BATCH:
+        return spsc_ring_dequeue_batch(&q->ring, msgs, n);
+    default:
+        return (size_t)locked_queue_dequeue(&q->locked, msgs);
+    }
+}
+
+/**
+ * Send the numbers 1..count in order, in batches where the queue supports it
+ */
+static void *bench_producer(void *arg) {
+    struct bench_thread *t = arg;
+    void *batch[BENCH_BATCH];
+    uint64_t next = 1;
+    unsigned int spins = 0;
+
+    pin_to_cpu(t->cpu);
+    while (next <= t->count) {
+        size_t n = t->count - next + 1 < BENCH_BATCH ? t->count - next + 1 : BENCH_BATCH;
+        for (size_t i = 0; i < n; ++i)
+            batch[i] = (void *)(uintptr_t)(next + i);
+        for (size_t done = 0; done < n;) {
+            size_t sent = bench_enqueue(t->out, batch + done, n - done);
+            if (sent == 0)
+                bench_wait(&spins);
+            done += sent;
+        }
+        next += n;
+    }
+    return NULL;
+}
+
+/**
+ * Receive count messages and check they arrive in order
+ */
+static void *bench_consumer(void *arg) {
+    struct bench_thread *t = arg;
+    void *batch[BENCH_BATCH];
+    uint64_t expected = 1;
+    unsigned int spins = 0;
+
+    pin_to_cpu(t->cpu);
+    while (expected <= t->count) {
+        size_t n = bench_dequeue(t->in, batch, BENCH_BATCH);
+        if (n == 0)
+            bench_wait(&spins);
+        for (size_t i = 0; i < n; ++i, ++expected)
+            t->errors += (uintptr_t)batch[i] != expected;
+    }
+    return NULL;
+}
+
+/**
+ * Echo messages from in back to out until count have passed
+ */
+static void *bench_echo(void *arg) {
+    struct bench_thread *t = arg;
+    unsigned int spins = 0;
+    void *msg;
+
+    pin_to_cpu(t->cpu);
+    for (uint64_t i = 0; i < t->count; ++i) {
+        while (bench_dequeue(t->in, &msg, 1) == 0)
+            bench_wait(&spins);
+        while (bench_enqueue(t->out, &msg, 1) == 0)
+            bench_wait(&spins);
+    }
+    return NULL;
+}
+
+static int bench_queue_init(struct bench_queue *q, enum queue_kind kind) {
+    q->kind = kind;
+    return kind == QUEUE_LOCKED ? locked_queue_init(&q->locked, BENCH_RING_SIZE)
+                                : spsc_ring_init(&q->ring, BENCH_RING_SIZE);
+}
+
+static void bench_queue_destroy(struct bench_queue *q) {
+    if (q->kind == QUEUE_LOCKED)
+        locked_queue_destroy(&q->locked);
+    else
+        spsc_ring_destroy(&q->ring);
+}
+
+/**
+ * Stream messages from CPU 0 to CPU 1
+ * @return Messages per second, or 0 on error
+ */
+static double bench_throughput(enum queue_kind kind, uint64_t count) {
+    static struct bench_queue q;
+    struct bench_thread producer = { .out = &q, .count = count, .cpu = 0 };
+    struct bench_thread consumer = { .in = &q, .count = count, .cpu = 1 };
+    pthread_t ptid, ctid;
+    uint64_t start;
+    double elapsed;
+
+    if (bench_queue_init(&q, kind) < 0)
+        return 0;
+    start = now_ns();
+    pthread_create(&ctid, NULL, bench_consumer, &consumer);
+    pthread_create(&ptid, NULL, bench_producer, &producer);
+    pthread_join(ptid, NULL);
+    pthread_join(ctid, NULL);
+    elapsed = (double)(now_ns() - start);
+    bench_queue_destroy(&q);
+    if (consumer.errors) {
+        fprintf(stderr, "%s: %llu messages out of order\n", queue_kind_names[kind],
+                (unsigned long long)consumer.errors);
+        return 0;
+    }
+    return count * 1e9 / elapsed;
+}
+
+/**
+ * Bounce one message between CPU 0 and CPU 1
+ * @return Average round trip in nanoseconds, or 0 on error
+ */
+static double bench_round_trip(enum queue_kind kind, uint64_t count) {
+    static struct bench_queue ping, pong;
+    struct bench_thread echo = { .in = &ping, .out = &pong, .count = count, .cpu = 1 };
+    unsigned int spins = 0;
+    pthread_t tid;
+    uint64_t start;
+    void *msg;
+    double elapsed;
+
+    // Batching does not apply to a single message in flight
+    if (kind == QUEUE_SPSC_BATCH)
+        kind = QUEUE_SPSC;
+    if (bench_queue_init(&ping, kind) < 0 || bench_queue_init(&pong, kind) < 0)
+        return 0;
+    pin_to_cpu(0);
+    pthread_create(&tid, NULL, bench_echo, &echo);
+    start = now_ns();
+    for (uint64_t i = 1; i <= count; ++i) {
+        msg = (void *)(uintptr_t)i;
+        while (bench_enqueue(&ping, &msg, 1) == 0)
+            bench_wait(&spins);
+        while (bench_dequeue(&pong, &msg, 1) == 0)
+            bench_wait(&spins);
+        if ((uintptr_t)msg != i)
+            fprintf(stderr, "round trip %llu returned %llu\n", (unsigned long long)i,
+                    (unsigned long long)(uintptr_t)msg);
+    }
+    elapsed = (double)(now_ns() - start);
+    pthread_join(tid, NULL);
+    bench_queue_destroy(&ping);
+    bench_queue_destroy(&pong);
+    return elapsed / count;
+}
+
+/**
+ * Seqlock Benchmark
+ * Readers copy a 64-byte snapshot whose eight fields a writer always sets to the same version number, so
+ * a torn copy shows up as fields that disagree. A single writer updates it about every 20 us while the
+ * number of readers doubles, under a seqlock, a pthread_rwlock and a mutex.
+ */
+
+/**
+ * Read-mostly payload: all fields hold the same version
+ */
+struct snapshot {
+    uint64_t version[8];
+};
+
+DEFINE_SEQLOCK_TYPE(snapshot, struct snapshot)
+
+enum read_lock_kind { READ_SEQLOCK, READ_RWLOCK, READ_MUTEX, READ_LOCK_KIND_COUNT };
+
+static const char *const read_lock_names[READ_LOCK_KIND_COUNT] = { "seqlock", "rwlock", "mutex" };
+
+/**
+ * State shared by the seqlock benchmark threads
+ */
+struct read_bench {
+    enum read_lock_kind kind;
+    struct seqlock_snapshot seq;
+    pthread_rwlock_t rwlock;
+    pthread_mutex_t mutex;
+    struct snapshot plain;  // Guarded by rwlock or mutex
+    _Alignas(CACHE_LINE) atomic_int stop;
+};
+
+/**
+ * Per-reader result
+ */
+struct read_bench_thread {
+    _Alignas(CACHE_LINE) struct read_bench *bench;
+    pthread_t tid;
+    int cpu;
+    uint64_t reads, torn;
+};
+
+static void read_bench_get(struct read_bench *b, struct snapshot *out) {
+    switch (b->kind) {
+    case READ_SEQLOCK:
+        seqlock_snapshot_read(&b->seq, out);
+        break;
+    case READ_RWLOCK:
+        pthread_rwlock_rdlock(&b->rwlock);
+        *out = b->plain;
+        pthread_rwlock_unlock(&b->rwlock);
+        break;
+    default:
+        pthread_mutex_lock(&b->mutex);
+        *out = b->plain;
+        pthread_mutex_unlock(&b->mutex);
+        break;
+    }
+}
+
+static void *read_bench_reader(void *arg) {
+    struct read_bench_thread *t = arg;
+    struct read_bench *b = t->bench;
+    struct snapshot s;
+
+    pin_to_cpu(t->cpu);
+    while (!atomic_load_explicit(&b->stop, memory_order_relaxed)) {
+        for (int i = 0; i < 64; ++i) {
+            read_bench_get(b, &s);
+            for (int f = 1; f < 8; ++f)
+                t->torn += s.version[f] != s.version[0];
+        }
+        t->reads += 64;
+    }
+    return NULL;
+}
+
+static void *read_bench_writer(void *arg) {
+    struct read_bench_thread *t = arg;
+    struct read_bench *b = t->bench;
+    struct timespec pause = { 0, 20000 };
+    struct snapshot s;
+
+    while (!atomic_load_explicit(&b->stop, memory_order_relaxed)) {
+        ++t->reads;
+        for (int f = 0; f < 8; ++f)
+            s.version[f] = t->reads;
+        switch (b->kind) {
+        case READ_SEQLOCK:
+            seqlock_snapshot_write(&b->seq, &s);
+            break;
+        case READ_RWLOCK:
+            pthread_rwlock_wrlock(&b->rwlock);
+            b->plain = s;
+            pthread_rwlock_unlock(&b->rwlock);
+            break;
+        default:
+            pthread_mutex_lock(&b->mutex);
+            b->plain = s;
+            pthread_mutex_unlock(&b->mutex);
+            break;
+        }
+        nanosleep(&pause, NULL);
+    }
+    return NULL;
+}
+
+/**
+ * Compare reader throughput of the seqlock, rwlock and mutex
+ * @param max_readers Highest reader count (0 = number of online CPUs)
+ * @param millis Duration of each run
+ * @return 0 on success, 1 if a reader saw a torn snapshot
+ */
+int seqlock_bench_main(int max_readers, int millis) {
+    static struct read_bench b;
+    struct read_bench_thread *t, writer;
+    struct timespec duration = { millis / 1000, (millis % 1000) * 1000000L };
+    struct snapshot zero = { { 0 } };
+    int failed = 0;
+
+    if (max_readers <= 0)
+        max_readers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    t = aligned_alloc(CACHE_LINE, sizeof(*t) * max_readers);
+    if (!t)
+        return 1;
+    seqlock_snapshot_init(&b.seq, &zero);
+    pthread_rwlock_init(&b.rwlock, NULL);
+    pthread_mutex_init(&b.mutex, NULL);
+
+    printf("%-8s %8s %14s %10s %8s\n", "lock", "readers", "Mreads/s", "writes", "torn");
+    for (int readers = 1; readers <= max_readers; readers = readers < max_readers && readers * 2 > max_readers ? max_readers : readers * 2) {
+        for (int k = 0; k < READ_LOCK_KIND_COUNT; ++k) {
+            uint64_t reads = 0, torn = 0, start;
+            b.kind = k;
+            atomic_store(&b.stop, 0);
+            memset(&writer, 0, sizeof(writer));
+            writer.bench = &b;
+            start = now_ns();
+            for (int i = 0; i < readers; ++i) {
+                memset(&t[i], 0, sizeof(t[i]));
+                t[i].bench = &b;
+                t[i].cpu = i;
+                pthread_create(&t[i].tid, NULL, read_bench_reader, &t[i]);
+            }
+            pthread_create(&writer.tid, NULL, read_bench_writer, &writer);
+            nanosleep(&duration, NULL);
+            atomic_store(&b.stop, 1);
+            for (int i = 0; i < readers; ++i) {
+                pthread_join(t[i].tid, NULL);
+                reads += t[i].reads;
+                torn += t[i].torn;
+            }
+            pthread_join(writer.tid, NULL);
+            printf("%-8s %8d %14.2f %10llu %8llu\n", read_lock_names[k], readers,
+                   reads * 1e3 / (now_ns() - start), (unsigned long long)writer.reads, (unsigned long long)torn);
+            failed |= torn != 0;
+        }
+    }
+    pthread_rwlock_destroy(&b.rwlock);
+    pthread_mutex_destroy(&b.mutex);
+    free(t);
+    return failed;
+}
+
+/**
+ * False Sharing Benchmark
+ * Every thread increments only its own counter. Packed, the counters sit in one array and share lines;
+ * padded, each is a struct padded_u64. Any difference in speed is false sharing. The layout mode runs
+ * CHECK_LAYOUT() over the structs in this file and a deliberately bad example.
+ */
+
+#define FS_MAX_THREADS 64
+
+/**
+ * State shared by the false sharing benchmark threads
+ */
+struct fs_bench {
+    CACHE_ALIGNED uint64_t packed[FS_MAX_THREADS];
+    struct padded_u64 padded[FS_MAX_THREADS];
+    int use_padded;
+    uint64_t iterations;
+};
+
+/**
+ * Per-thread arguments
+ */
+struct fs_bench_thread {
+    CACHE_ALIGNED struct fs_bench *bench;
+    pthread_t tid;
+    int index;
+};
+
+static void *fs_bench_worker(void *arg) {
+    struct fs_bench_thread *t = arg;
+    struct fs_bench *b = t->bench;
+    volatile uint64_t *counter = b->use_padded ? &b->padded[t->index].value : &b->packed[t->index];
+
+    pin_to_cpu(t->index);
+    for (uint64_t i = 0; i < b->iterations; ++i)
+        *counter += 1;
+    return NULL;
+}
+
+static double fs_bench_run(struct fs_bench *b, int threads, int use_padded) {
+    struct fs_bench_thread t[FS_MAX_THREADS];
+    uint64_t start;
+
+    b->use_padded = use_padded;
+    memset(b->packed, 0, sizeof(b->packed));
+    memset(b->padded, 0, sizeof(b->padded));
+    start = now_ns();
+    for (int i = 0; i < threads; ++i) {
+        t[i].bench = b;
+        t[i].index = i;
+        pthread_create(&t[i].tid, NULL, fs_bench_worker, &t[i]);
+    }
+    for (int i = 0; i < threads; ++i)
+        pthread_join(t[i].tid, NULL);
+    return threads * (double)b->iterations * 1e3 / (now_ns() - start);
+}
+
+/**
+ * Compare packed and padded per-thread counters
+ * @param max_threads Highest thread count (0 = number of online CPUs, at least 2)
+ * @param iterations Increments per thread
+ * @return 0
+ */
+int false_sharing_bench_main(int max_threads, uint64_t iterations) {
+    static struct fs_bench b;
+
+    if (max_threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        max_threads = cpus > 2 ? (int)cpus : 2;
+    }
+    if (max_threads > FS_MAX_THREADS)
+        max_threads = FS_MAX_THREADS;
+    b.iterations = iterations;
+    printf("%-8s %14s %14s %10s\n", "threads", "packed Mops/s", "padded Mops/s", "slowdown");
+    for (int threads = 1; threads <= max_threads; threads = threads < max_threads && threads * 2 > max_threads ? max_threads : threads * 2) {
+        double packed = fs_bench_run(&b, threads, 0);
+        double padded = fs_bench_run(&b, threads, 1);
+        printf("%-8d %14.1f %14.1f %9.2fx\n", threads, packed, padded, padded / packed);
+    }
+    return 0;
+}
+
+/**
+ * Example of a struct that false-shares: the receive and transmit threads each update their own counters,
+ * but all of them fit in one line
+ */
+struct conn_stats {
+    uint64_t rx_packets;  // Receive thread
+    uint64_t rx_bytes;    // Receive thread
+    uint64_t tx_packets;  // Transmit thread
+    uint64_t tx_bytes;    // Transmit thread
+    char name[16];        // Read-only
+};
+
+/**
+ * The same counters with one line per writer
+ */
+struct conn_stats_padded {
+    CACHE_ALIGNED uint64_t rx_packets;
+    uint64_t rx_bytes;
+    CACHE_ALIGNED uint64_t tx_packets;
+    uint64_t tx_bytes;
+    CACHE_ALIGNED char name[16];
+};
+
+ASSERT_OWN_LINE(struct conn_stats_padded, tx_packets);
+ASSERT_OWN_LINE(struct spsc_ring, tail);
+
+/**
+ * Print layout reports for the structs in this file
+ * @return 0 if the problems in struct conn_stats were found, 1 otherwise
+ */
+int layout_main(void) {
+    long line = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+    int problems;
+
+    printf("L1 data cache line: %ld bytes (CACHE_LINE is %d)\n\n", line, CACHE_LINE);
+    problems = CHECK_LAYOUT(stdout, struct conn_stats,
+                            HOT_FIELD(struct conn_stats, rx_packets, 0), HOT_FIELD(struct conn_stats, rx_bytes, 0),
+                            HOT_FIELD(struct conn_stats, tx_packets, 1), HOT_FIELD(struct conn_stats, tx_bytes, 1),
+                            HOT_FIELD(struct conn_stats, name, -1));
+    printf("\n");
+    CHECK_LAYOUT(stdout, struct conn_stats_padded,
+                 HOT_FIELD(struct conn_stats_padded, rx_packets, 0), HOT_FIELD(struct conn_stats_padded, rx_bytes, 0),
+                 HOT_FIELD(struct conn_stats_padded, tx_packets, 1), HOT_FIELD(struct conn_stats_padded, tx_bytes, 1),
+                 HOT_FIELD(struct conn_stats_padded, name, -1));
+    printf("\n");
+    CHECK_LAYOUT(stdout, struct spsc_ring,
+                 HOT_FIELD(struct spsc_ring, head, 0), HOT_FIELD(struct spsc_ring, cached_tail, 0),
+                 HOT_FIELD(struct spsc_ring, tail, 1), HOT_FIELD(struct spsc_ring, cached_head, 1),
+                 HOT_FIELD(struct spsc_ring, mask, -1), HOT_FIELD(struct spsc_ring, slots, -1));
+    printf("\n");
+    CHECK_LAYOUT(stdout, struct seqlock_snapshot,
+                 HOT_FIELD(struct seqlock_snapshot, lock, 0), HOT_FIELD(struct seqlock_snapshot, value, 0));
+    printf("\nglobals: mutex on line %#lx, shared_value on line %#lx\n",
+           (unsigned long)((uintptr_t)&mutex / CACHE_LINE), (unsigned long)((uintptr_t)&shared_value / CACHE_LINE));
+    return problems ? 0 : 1;
+}
+
+/**
+ * Entry point: runs the example thread, or one of the benchmarks listed at the top
+ */
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        uint64_t count = argc > 2 ? strtoull(argv[2], NULL, 0) : 10000000;
+        int failed = 0;
+
+        if (sysconf(_SC_NPROCESSORS_ONLN) < 2)
+            printf("note: one CPU online, producer and consumer share it\n");
+        printf("%-12s %14s %14s\n", "queue", "msgs/s", "round trip");
+        for (int k = 0; k < QUEUE_KIND_COUNT; ++k) {
+            double rate = bench_throughput(k, count);
+            double rtt = bench_round_trip(k, count / 100 ? count / 100 : 1);
+            failed |= rate == 0 || rtt == 0;
+            printf("%-12s %13.1fM %12.0fns\n", queue_kind_names[k], rate / 1e6, rtt);
+        }
+        return failed;
+    }
+    if (argc > 1 && strcmp(argv[1], "bench-seqlock") == 0)
+        return seqlock_bench_main(argc > 2 ? atoi(argv[2]) : 0, argc > 3 ? atoi(argv[3]) : 300);
+    if (argc > 1 && strcmp(argv[1], "bench-false-sharing") == 0)
+        return false_sharing_bench_main(argc > 2 ? atoi(argv[2]) : 0,
+                                        argc > 3 ? strtoull(argv[3], NULL, 0) : 100000000);
+    if (argc > 1 && strcmp(argv[1], "layout") == 0)
+        return layout_main();
+
+    pthread_t thread;
+    pthread_mutex_init(&mutex, NULL);
+    pthread_create(&thread, NULL, thread_function, NULL);
+    pthread_join(thread, NULL);
+    pthread_mutex_destroy(&mutex);
+    printf("shared_value = %d\n", atomic_load(&shared_value));
+    return 0;
+}
@@ -1,4 +1,13 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+#include <stdatomic.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 /**
  * @file meta_programming.c
@@ -8,6 +17,11 @@
  * It includes conditional compilation, macros with arguments, string concatenation,
  * token pasting, and looping with recursive macros.
  *
+ * Build: gcc -O2 main.c -o meta
+ * Run "bench-containers [n]" to compare the generated containers with void* ones, qsort() and bsearch(),
+ * or "bench-kernels [iterations]" to compare the unrolled kernels of Example 7 with rolled loops,
+ * "trace [file]" to write a Chrome trace of an instrumented workload, or "bench-trace [calls]" for the
+ * cost of a trace site. Build with -DTRACE_LEVEL=... and -DTRACE_MASK=... to select sites.
  */
 
 // Example 1: Conditional Compilation
@@ -16,12 +30,13 @@
 /**
  * @brief Conditional compilation macro.
  *
- * Prints the value of a variable if DEBUG is defined.
+ * Prints the value of a variable of any scalar type if DEBUG is defined. It is a LOG site at level
+ * DEBUG of subsystem CORE (see Example 8), so TRACE_LEVEL and TRACE_MASK can also compile it out.
  *
  * @param x The variable to print.
  */
 #if DEBUG
-    #define DEBUG_PRINT(x) printf("Debug: %s = %d\n", #x, x)
+    #define DEBUG_PRINT(x) LOG(DEBUG, CORE, DEBUG_FORMAT(x), #x, DEBUG_ARG(x))
 #else
     #define DEBUG_PRINT(x)
 #endif
@@ -56,65 +71,1736 @@
  */
 #define PASTE(x, y) x ## y
 
-// Example 5: Looping with Recursive Macros (up to 10)
+// Example 5: Looping with Recursive Macros (up to 256)
+/**
+ * @brief Macro for repeating another macro n times.
+ *
+ * REPEAT(n, M, data) expands to M(0, data) M(1, data) ... M(n - 1, data), for n from 0 to 256.
+ * n must be a literal or a macro that expands to one, and each index is passed to M as a literal,
+ * so M may paste it into names. M supplies its own separators (a comma for an initializer, + for a
+ * sum, ; for statements).
+ *
+ * The preprocessor does not re-enter a macro while expanding it, so REPEAT and FOR_EACH cannot be
+ * nested; generate the inner loop as its own inline function instead (see Example 7).
+ *
+ * @param n The number of repetitions.
+ * @param M The macro to repeat, called as M(index, data).
+ * @param data Passed through to every call of M.
+ */
+#define REPEAT(n, M, data) CONCAT(REPEAT_, n)(M, data)
+
+/**
+ * @brief Macro for applying another macro to each of its arguments.
+ *
+ * FOR_EACH(M, data, a, b, c) expands to M(0, data, a) M(1, data, b) M(2, data, c), for up to 256
+ * arguments.
+ *
+ * @param M The macro to apply, called as M(index, data, item).
+ * @param data Passed through to every call of M.
+ */
+#define FOR_EACH(M, data, ...) REPEAT(NARGS(__VA_ARGS__), FOR_EACH_ITEM, (M, data, __VA_ARGS__))
+#define FOR_EACH_ITEM(i, pack) FOR_EACH_APPLY(i, FOR_EACH_UNPACK pack)
+#define FOR_EACH_UNPACK(...) __VA_ARGS__
+#define FOR_EACH_APPLY(i, ...) FOR_EACH_CALL(i, __VA_ARGS__)
+#define FOR_EACH_CALL(i, M, data, ...) FOR_EACH_INVOKE(M, i, data, FIRST(CONCAT(SKIP_, i)(__VA_ARGS__)))
+#define FOR_EACH_INVOKE(M, i, data, item) M(i, data, item)
+
+/**
+ * @brief The first of the arguments.
+ */
+#define FIRST(...) FIRST_(__VA_ARGS__, ~)
+#define FIRST_(x, ...) x
+
+/**
+ * @brief The number of arguments, from 1 to 256.
+ */
+#define NARGS(...) NARGS_PICK(__VA_ARGS__, 256, 255, 254, 253, 252, 251, 250, 249, 248, 247, 246, 245,   \
+    244, 243, 242, 241, 240, 239, 238, 237, 236, 235, 234, 233, 232, 231, 230, 229, 228, 227, 226, 225,  \
+    224, 223, 222, 221, 220, 219, 218, 217, 216, 215, 214, 213, 212, 211, 210, 209, 208, 207, 206, 205,  \
+    204, 203, 202, 201, 200, 199, 198, 197, 196, 195, 194, 193, 192, 191, 190, 189, 188, 187, 186, 185,  \
+    184, 183, 182, 181, 180, 179, 178, 177, 176, 175, 174, 173, 172, 171, 170, 169, 168, 167, 166, 165,  \
+    164, 163, 162, 161, 160, 159, 158, 157, 156, 155, 154, 153, 152, 151, 150, 149, 148, 147, 146, 145,  \
+    144, 143, 142, 141, 140, 139, 138, 137, 136, 135, 134, 133, 132, 131, 130, 129, 128, 127, 126, 125,  \
+    124, 123, 122, 121, 120, 119, 118, 117, 116, 115, 114, 113, 112, 111, 110, 109, 108, 107, 106, 105,  \
+    104, 103, 102, 101, 100, 99, 98, 97, 96, 95, 94, 93, 92, 91, 90, 89, 88, 87, 86, 85, 84, 83, 82,     \
+    81, 80, 79, 78, 77, 76, 75, 74, 73, 72, 71, 70, 69, 68, 67, 66, 65, 64, 63, 62, 61, 60, 59, 58, 57,  \
+    56, 55, 54, 53, 52, 51, 50, 49, 48, 47, 46, 45, 44, 43, 42, 41, 40, 39, 38, 37, 36, 35, 34, 33, 32,  \
+    31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6,  \
+    5, 4, 3, 2, 1)
+#define NARGS_PICK(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, _17, _18,      \
+    _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, _33, _34, _35, _36, _37, _38,  \
+    _39, _40, _41, _42, _43, _44, _45, _46, _47, _48, _49, _50, _51, _52, _53, _54, _55, _56, _57, _58,  \
+    _59, _60, _61, _62, _63, _64, _65, _66, _67, _68, _69, _70, _71, _72, _73, _74, _75, _76, _77, _78,  \
+    _79, _80, _81, _82, _83, _84, _85, _86, _87, _88, _89, _90, _91, _92, _93, _94, _95, _96, _97, _98,  \
+    _99, _100, _101, _102, _103, _104, _105, _106, _107, _108, _109, _110, _111, _112, _113, _114,       \
+    _115, _116, _117, _118, _119, _120, _121, _122, _123, _124, _125, _126, _127, _128, _129, _130,      \
+    _131, _132, _133, _134, _135, _136, _137, _138, _139, _140, _141, _142, _143, _144, _145, _146,      \
+    _147, _148, _149, _150, _151, _152, _153, _154, _155, _156, _157, _158, _159, _160, _161, _162,      \
+    _163, _164, _165, _166, _167, _168, _169, _170, _171, _172, _173, _174, _175, _176, _177, _178,      \
+    _179, _180, _181, _182, _183, _184, _185, _186, _187, _188, _189, _190, _191, _192, _193, _194,      \
+    _195, _196, _197, _198, _199, _200, _201, _202, _203, _204, _205, _206, _207, _208, _209, _210,      \
+    _211, _212, _213, _214, _215, _216, _217, _218, _219, _220, _221, _222, _223, _224, _225, _226,      \
+    _227, _228, _229, _230, _231, _232, _233, _234, _235, _236, _237, _238, _239, _240, _241, _242,      \
+    _243, _244, _245, _246, _247, _248, _249, _250, _251, _252, _253, _254, _255, _256, N, ...) N
+
+// Expansions of REPEAT
+#define REPEAT_0(M, d)
+#define REPEAT_1(M, d) M(0, d)
+#define REPEAT_2(M, d) REPEAT_1(M, d) M(1, d)
+#define REPEAT_3(M, d) REPEAT_2(M, d) M(2, d)
+#define REPEAT_4(M, d) REPEAT_3(M, d) M(3, d)
+#define REPEAT_5(M, d) REPEAT_4(M, d) M(4, d)
+#define REPEAT_6(M, d) REPEAT_5(M, d) M(5, d)
+#define REPEAT_7(M, d) REPEAT_6(M, d) M(6, d)
+#define REPEAT_8(M, d) REPEAT_7(M, d) M(7, d)
+#define REPEAT_9(M, d) REPEAT_8(M, d) M(8, d)
+#define REPEAT_10(M, d) REPEAT_9(M, d) M(9, d)
+#define REPEAT_11(M, d) REPEAT_10(M, d) M(10, d)
+#define REPEAT_12(M, d) REPEAT_11(M, d) M(11, d)
+#define REPEAT_13(M, d) REPEAT_12(M, d) M(12, d)
+#define REPEAT_14(M, d) REPEAT_13(M, d) M(13, d)
+#define REPEAT_15(M, d) REPEAT_14(M, d) M(14, d)
+#define REPEAT_16(M, d) REPEAT_15(M, d) M(15, d)
+#define REPEAT_17(M, d) REPEAT_16(M, d) M(16, d)
+#define REPEAT_18(M, d) REPEAT_17(M, d) M(17, d)
+#define REPEAT_19(M, d) REPEAT_18(M, d) M(18, d)
+#define REPEAT_20(M, d) REPEAT_19(M, d) M(19, d)
+#define REPEAT_21(M, d) REPEAT_20(M, d) M(20, d)
+#define REPEAT_22(M, d) REPEAT_21(M, d) M(21, d)
+#define REPEAT_23(M, d) REPEAT_22(M, d) M(22, d)
+#define REPEAT_24(M, d) REPEAT_23(M, d) M(23, d)
+#define REPEAT_25(M, d) REPEAT_24(M, d) M(24, d)
+#define REPEAT_26(M, d) REPEAT_25(M, d) M(25, d)
+#define REPEAT_27(M, d) REPEAT_26(M, d) M(26, d)
+#define REPEAT_28(M, d) REPEAT_27(M, d) M(27, d)
+#define REPEAT_29(M, d) REPEAT_28(M, d) M(28, d)
+#define REPEAT_30(M, d) REPEAT_29(M, d) M(29, d)
+#define REPEAT_31(M, d) REPEAT_30(M, d) M(30, d)
+#define REPEAT_32(M, d) REPEAT_31(M, d) M(31, d)
+#define REPEAT_33(M, d) REPEAT_32(M, d) M(32, d)
+#define REPEAT_34(M, d) REPEAT_33(M, d) M(33, d)
+#define REPEAT_35(M, d) REPEAT_34(M, d) M(34, d)
+#define REPEAT_36(M, d) REPEAT_35(M, d) M(35, d)
+#define REPEAT_37(M, d) REPEAT_36(M, d) M(36, d)
+#define REPEAT_38(M, d) REPEAT_37(M, d) M(37, d)
+#define REPEAT_39(M, d) REPEAT_38(M, d) M(38, d)
+#define REPEAT_40(M, d) REPEAT_39(M, d) M(39, d)
+#define REPEAT_41(M, d) REPEAT_40(M, d) M(40, d)
+#define REPEAT_42(M, d) REPEAT_41(M, d) M(41, d)
+#define REPEAT_43(M, d) REPEAT_42(M, d) M(42, d)
+#define REPEAT_44(M, d) REPEAT_43(M, d) M(43, d)
+#define REPEAT_45(M, d) REPEAT_44(M, d) M(44, d)
+#define REPEAT_46(M, d) REPEAT_45(M, d) M(45, d)
+#define REPEAT_47(M, d) REPEAT_46(M, d) M(46, d)
+#define REPEAT_48(M, d) REPEAT_47(M, d) M(47, d)
+#define REPEAT_49(M, d) REPEAT_48(M, d) M(48, d)
+#define REPEAT_50(M, d) REPEAT_49(M, d) M(49, d)
+#define REPEAT_51(M, d) REPEAT_50(M, d) M(50, d)
+#define REPEAT_52(M, d) REPEAT_51(M, d) M(51, d)
+#define REPEAT_53(M, d) REPEAT_52(M, d) M(52, d)
+#define REPEAT_54(M, d) REPEAT_53(M, d) M(53, d)
+#define REPEAT_55(M, d) REPEAT_54(M, d) M(54, d)
+#define REPEAT_56(M, d) REPEAT_55(M, d) M(55, d)
+#define REPEAT_57(M, d) REPEAT_56(M, d) M(56, d)
+#define REPEAT_58(M, d) REPEAT_57(M, d) M(57, d)
+#define REPEAT_59(M, d) REPEAT_58(M, d) M(58, d)
+#define REPEAT_60(M, d) REPEAT_59(M, d) M(59, d)
+#define REPEAT_61(M, d) REPEAT_60(M, d) M(60, d)
+#define REPEAT_62(M, d) REPEAT_61(M, d) M(61, d)
+#define REPEAT_63(M, d) REPEAT_62(M, d) M(62, d)
+#define REPEAT_64(M, d) REPEAT_63(M, d) M(63, d)
+#define REPEAT_65(M, d) REPEAT_64(M, d) M(64, d)
+#define REPEAT_66(M, d) REPEAT_65(M, d) M(65, d)
+#define REPEAT_67(M, d) REPEAT_66(M, d) M(66, d)
+#define REPEAT_68(M, d) REPEAT_67(M, d) M(67, d)
+#define REPEAT_69(M, d) REPEAT_68(M, d) M(68, d)
+#define REPEAT_70(M, d) REPEAT_69(M, d) M(69, d)
+#define REPEAT_71(M, d) REPEAT_70(M, d) M(70, d)
+#define REPEAT_72(M, d) REPEAT_71(M, d) M(71, d)
+#define REPEAT_73(M, d) REPEAT_72(M, d) M(72, d)
+#define REPEAT_74(M, d) REPEAT_73(M, d) M(73, d)
+#define REPEAT_75(M, d) REPEAT_74(M, d) M(74, d)
+#define REPEAT_76(M, d) REPEAT_75(M, d) M(75, d)
+#define REPEAT_77(M, d) REPEAT_76(M, d) M(76, d)
+#define REPEAT_78(M, d) REPEAT_77(M, d) M(77, d)
+#define REPEAT_79(M, d) REPEAT_78(M, d) M(78, d)
+#define REPEAT_80(M, d) REPEAT_79(M, d) M(79, d)
+#define REPEAT_81(M, d) REPEAT_80(M, d) M(80, d)
+#define REPEAT_82(M, d) REPEAT_81(M, d) M(81, d)
+#define REPEAT_83(M, d) REPEAT_82(M, d) M(82, d)
+#define REPEAT_84(M, d) REPEAT_83(M, d) M(83, d)
+#define REPEAT_85(M, d) REPEAT_84(M, d) M(84, d)
+#define REPEAT_86(M, d) REPEAT_85(M, d) M(85, d)
+#define REPEAT_87(M, d) REPEAT_86(M, d) M(86, d)
+#define REPEAT_88(M, d) REPEAT_87(M, d) M(87, d)
+#define REPEAT_89(M, d) REPEAT_88(M, d) M(88, d)
+#define REPEAT_90(M, d) REPEAT_89(M, d) M(89, d)
+#define REPEAT_91(M, d) REPEAT_90(M, d) M(90, d)
+#define REPEAT_92(M, d) REPEAT_91(M, d) M(91, d)
+#define REPEAT_93(M, d) REPEAT_92(M, d) M(92, d)
+#define REPEAT_94(M, d) REPEAT_93(M, d) M(93, d)
+#define REPEAT_95(M, d) REPEAT_94(M, d) M(94, d)
+#define REPEAT_96(M, d) REPEAT_95(M, d) M(95, d)
+#define REPEAT_97(M, d) REPEAT_96(M, d) M(96, d)
+#define REPEAT_98(M, d) REPEAT_97(M, d) M(97, d)
+#define REPEAT_99(M, d) REPEAT_98(M, d) M(98, d)
+#define REPEAT_100(M, d) REPEAT_99(M, d) M(99, d)
+#define REPEAT_101(M, d) REPEAT_100(M, d) M(100, d)
+#define REPEAT_102(M, d) REPEAT_101(M, d) M(101, d)
+#define REPEAT_103(M, d) REPEAT_102(M, d) M(102, d)
+#define REPEAT_104(M, d) REPEAT_103(M, d) M(103, d)
+#define REPEAT_105(M, d) REPEAT_104(M, d) M(104, d)
+#define REPEAT_106(M, d) REPEAT_105(M, d) M(105, d)
+#define REPEAT_107(M, d) REPEAT_106(M, d) M(106, d)
+#define REPEAT_108(M, d) REPEAT_107(M, d) M(107, d)
+#define REPEAT_109(M, d) REPEAT_108(M, d) M(108, d)
+#define REPEAT_110(M, d) REPEAT_109(M, d) M(109, d)
+#define REPEAT_111(M, d) REPEAT_110(M, d) M(110, d)
+#define REPEAT_112(M, d) REPEAT_111(M, d) M(111, d)
+#define REPEAT_113(M, d) REPEAT_112(M, d) M(112, d)
+#define REPEAT_114(M, d) REPEAT_113(M, d) M(113, d)
+#define REPEAT_115(M, d) REPEAT_114(M, d) M(114, d)
+#define REPEAT_116(M, d) REPEAT_115(M, d) M(115, d)
+#define REPEAT_117(M, d) REPEAT_116(M, d) M(116, d)
+#define REPEAT_118(M, d) REPEAT_117(M, d) M(117, d)
+#define REPEAT_119(M, d) REPEAT_118(M, d) M(118, d)
+#define REPEAT_120(M, d) REPEAT_119(M, d) M(119, d)
+#define REPEAT_121(M, d) REPEAT_120(M, d) M(120, d)
+#define REPEAT_122(M, d) REPEAT_121(M, d) M(121, d)
+#define REPEAT_123(M, d) REPEAT_122(M, d) M(122, d)
+#define REPEAT_124(M, d) REPEAT_123(M, d) M(123, d)
+#define REPEAT_125(M, d) REPEAT_124(M, d) M(124, d)
+#define REPEAT_126(M, d) REPEAT_125(M, d) M(125, d)
+#define REPEAT_127(M, d) REPEAT_126(M, d) M(126, d)
+#define REPEAT_128(M, d) REPEAT_127(M, d) M(127, d)
+#define REPEAT_129(M, d) REPEAT_128(M, d) M(128, d)
+#define REPEAT_130(M, d) REPEAT_129(M, d) M(129, d)
+#define REPEAT_131(M, d) REPEAT_130(M, d) M(130, d)
+#define REPEAT_132(M, d) REPEAT_131(M, d) M(131, d)
+#define REPEAT_133(M, d) REPEAT_132(M, d) M(132, d)
+#define REPEAT_134(M, d) REPEAT_133(M, d) M(133, d)
+#define REPEAT_135(M, d) REPEAT_134(M, d) M(134, d)
+#define REPEAT_136(M, d) REPEAT_135(M, d) M(135, d)
+#define REPEAT_137(M, d) REPEAT_136(M, d) M(136, d)
+#define REPEAT_138(M, d) REPEAT_137(M, d) M(137, d)
+#define REPEAT_139(M, d) REPEAT_138(M, d) M(138, d)
+#define REPEAT_140(M, d) REPEAT_139(M, d) M(139, d)
+#define REPEAT_141(M, d) REPEAT_140(M, d) M(140, d)
+#define REPEAT_142(M, d) REPEAT_141(M, d) M(141, d)
+#define REPEAT_143(M, d) REPEAT_142(M, d) M(142, d)
+#define REPEAT_144(M, d) REPEAT_143(M, d) M(143, d)
+#define REPEAT_145(M, d) REPEAT_144(M, d) M(144, d)
+#define REPEAT_146(M, d) REPEAT_145(M, d) M(145, d)
+#define REPEAT_147(M, d) REPEAT_146(M, d) M(146, d)
+#define REPEAT_148(M, d) REPEAT_147(M, d) M(147, d)
+#define REPEAT_149(M, d) REPEAT_148(M, d) M(148, d)
+#define REPEAT_150(M, d) REPEAT_149(M, d) M(149, d)
+#define REPEAT_151(M, d) REPEAT_150(M, d) M(150, d)
+#define REPEAT_152(M, d) REPEAT_151(M, d) M(151, d)
+#define REPEAT_153(M, d) REPEAT_152(M, d) M(152, d)
+#define REPEAT_154(M, d) REPEAT_153(M, d) M(153, d)
+#define REPEAT_155(M, d) REPEAT_154(M, d) M(154, d)
+#define REPEAT_156(M, d) REPEAT_155(M, d) M(155, d)
+#define REPEAT_157(M, d) REPEAT_156(M, d) M(156, d)
+#define REPEAT_158(M, d) REPEAT_157(M, d) M(157, d)
+#define REPEAT_159(M, d) REPEAT_158(M, d) M(158, d)
+#define REPEAT_160(M, d) REPEAT_159(M, d) M(159, d)
+#define REPEAT_161(M, d) REPEAT_160(M, d) M(160, d)
+#define REPEAT_162(M, d) REPEAT_161(M, d) M(161, d)
+#define REPEAT_163(M, d) REPEAT_162(M, d) M(162, d)
+#define REPEAT_164(M, d) REPEAT_163(M, d) M(163, d)
+#define REPEAT_165(M, d) REPEAT_164(M, d) M(164, d)
+#define REPEAT_166(M, d) REPEAT_165(M, d) M(165, d)
+#define REPEAT_167(M, d) REPEAT_166(M, d) M(166, d)
+#define REPEAT_168(M, d) REPEAT_167(M, d) M(167, d)
+#define REPEAT_169(M, d) REPEAT_168(M, d) M(168, d)
+#define REPEAT_170(M, d) REPEAT_169(M, d) M(169, d)
+#define REPEAT_171(M, d) REPEAT_170(M, d) M(170, d)
+#define REPEAT_172(M, d) REPEAT_171(M, d) M(171, d)
+#define REPEAT_173(M, d) REPEAT_172(M, d) M(172, d)
+#define REPEAT_174(M, d) REPEAT_173(M, d) M(173, d)
+#define REPEAT_175(M, d) REPEAT_174(M, d) M(174, d)
+#define REPEAT_176(M, d) REPEAT_175(M, d) M(175, d)
+#define REPEAT_177(M, d) REPEAT_176(M, d) M(176, d)
+#define REPEAT_178(M, d) REPEAT_177(M, d) M(177, d)
+#define REPEAT_179(M, d) REPEAT_178(M, d) M(178, d)
+#define REPEAT_180(M, d) REPEAT_179(M, d) M(179, d)
+#define REPEAT_181(M, d) REPEAT_180(M, d) M(180, d)
+#define REPEAT_182(M, d) REPEAT_181(M, d) M(181, d)
+#define REPEAT_183(M, d) REPEAT_182(M, d) M(182, d)
+#define REPEAT_184(M, d) REPEAT_183(M, d) M(183, d)
+#define REPEAT_185(M, d) REPEAT_184(M, d) M(184, d)
+#define REPEAT_186(M, d) REPEAT_185(M, d) M(185, d)
+#define REPEAT_187(M, d) REPEAT_186(M, d) M(186, d)
+#define REPEAT_188(M, d) REPEAT_187(M, d) M(187, d)
+#define REPEAT_189(M, d) REPEAT_188(M, d) M(188, d)
+#define REPEAT_190(M, d) REPEAT_189(M, d) M(189, d)
+#define REPEAT_191(M, d) REPEAT_190(M, d) M(190, d)
+#define REPEAT_192(M, d) REPEAT_191(M, d) M(191, d)
+#define REPEAT_193(M, d) REPEAT_192(M, d) M(192, d)
+#define REPEAT_194(M, d) REPEAT_193(M, d) M(193, d)
+#define REPEAT_195(M, d) REPEAT_194(M, d) M(194, d)
+#define REPEAT_196(M, d) REPEAT_195(M, d) M(195, d)
+#define REPEAT_197(M, d) REPEAT_196(M, d) M(196, d)
+#define REPEAT_198(M, d) REPEAT_197(M, d) M(197, d)
+#define REPEAT_199(M, d) REPEAT_198(M, d) M(198, d)
+#define REPEAT_200(M, d) REPEAT_199(M, d) M(199, d)
+#define REPEAT_201(M, d) REPEAT_200(M, d) M(200, d)
+#define REPEAT_202(M, d) REPEAT_201(M, d) M(201, d)
+#define REPEAT_203(M, d) REPEAT_202(M, d) M(202, d)
+#define REPEAT_204(M, d) REPEAT_203(M, d) M(203, d)
+#define REPEAT_205(M, d) REPEAT_204(M, d) M(204, d)
+#define REPEAT_206(M, d) REPEAT_205(M, d) M(205, d)
+#define REPEAT_207(M, d) REPEAT_206(M, d) M(206, d)
+#define REPEAT_208(M, d) REPEAT_207(M, d) M(207, d)
+#define REPEAT_209(M, d) REPEAT_208(M, d) M(208, d)
+#define REPEAT_210(M, d) REPEAT_209(M, d) M(209, d)
+#define REPEAT_211(M, d) REPEAT_210(M, d) M(210, d)
+#define REPEAT_212(M, d) REPEAT_211(M, d) M(211, d)
+#define REPEAT_213(M, d) REPEAT_212(M, d) M(212, d)
+#define REPEAT_214(M, d) REPEAT_213(M, d) M(213, d)
+#define REPEAT_215(M, d) REPEAT_214(M, d) M(214, d)
+#define REPEAT_216(M, d) REPEAT_215(M, d) M(215, d)
+#define REPEAT_217(M, d) REPEAT_216(M, d) M(216, d)
+#define REPEAT_218(M, d) REPEAT_217(M, d) M(217, d)
+#define REPEAT_219(M, d) REPEAT_218(M, d) M(218, d)
+#define REPEAT_220(M, d) REPEAT_219(M, d) M(219, d)
+#define REPEAT_221(M, d) REPEAT_220(M, d) M(220, d)
+#define REPEAT_222(M, d) REPEAT_221(M, d) M(221, d)
+#define REPEAT_223(M, d) REPEAT_222(M, d) M(222, d)
+#define REPEAT_224(M, d) REPEAT_223(M, d) M(223, d)
+#define REPEAT_225(M, d) REPEAT_224(M, d) M(224, d)
+#define REPEAT_226(M, d) REPEAT_225(M, d) M(225, d)
+#define REPEAT_227(M, d) REPEAT_226(M, d) M(226, d)
+#define REPEAT_228(M, d) REPEAT_227(M, d) M(227, d)
+#define REPEAT_229(M, d) REPEAT_228(M, d) M(228, d)
+#define REPEAT_230(M, d) REPEAT_229(M, d) M(229, d)
+#define REPEAT_231(M, d) REPEAT_230(M, d) M(230, d)
+#define REPEAT_232(M, d) REPEAT_231(M, d) M(231, d)
+#define REPEAT_233(M, d) REPEAT_232(M, d) M(232, d)
+#define REPEAT_234(M, d) REPEAT_233(M, d) M(233, d)
+#define REPEAT_235(M, d) REPEAT_234(M, d) M(234, d)
+#define REPEAT_236(M, d) REPEAT_235(M, d) M(235, d)
+#define REPEAT_237(M, d) REPEAT_236(M, d) M(236, d)
+#define REPEAT_238(M, d) REPEAT_237(M, d) M(237, d)
+#define REPEAT_239(M, d) REPEAT_238(M, d) M(238, d)
+#define REPEAT_240(M, d) REPEAT_239(M, d) M(239, d)
+#define REPEAT_241(M, d) REPEAT_240(M, d) M(240, d)
+#define REPEAT_242(M, d) REPEAT_241(M, d) M(241, d)
+#define REPEAT_243(M, d) REPEAT_242(M, d) M(242, d)
+#define REPEAT_244(M, d) REPEAT_243(M, d) M(243, d)
+#define REPEAT_245(M, d) REPEAT_244(M, d) M(244, d)
+#define REPEAT_246(M, d) REPEAT_245(M, d) M(245, d)
+#define REPEAT_247(M, d) REPEAT_246(M, d) M(246, d)
+#define REPEAT_248(M, d) REPEAT_247(M, d) M(247, d)
+#define REPEAT_249(M, d) REPEAT_248(M, d) M(248, d)
+#define REPEAT_250(M, d) REPEAT_249(M, d) M(249, d)
+#define REPEAT_251(M, d) REPEAT_250(M, d) M(250, d)
+#define REPEAT_252(M, d) REPEAT_251(M, d) M(251, d)
+#define REPEAT_253(M, d) REPEAT_252(M, d) M(252, d)
+#define REPEAT_254(M, d) REPEAT_253(M, d) M(253, d)
+#define REPEAT_255(M, d) REPEAT_254(M, d) M(254, d)
+#define REPEAT_256(M, d) REPEAT_255(M, d) M(255, d)
+
+// SKIP_n(...): the arguments after the first n
+#define SKIP_0(...) __VA_ARGS__
+#define SKIP_1(x, ...) SKIP_0(__VA_ARGS__)
+#define SKIP_2(x, ...) SKIP_1(__VA_ARGS__)
+#define SKIP_3(x, ...) SKIP_2(__VA_ARGS__)
+#define SKIP_4(x, ...) SKIP_3(__VA_ARGS__)
+#define SKIP_5(x, ...) SKIP_4(__VA_ARGS__)
+#define SKIP_6(x, ...) SKIP_5(__VA_ARGS__)
+#define SKIP_7(x, ...) SKIP_6(__VA_ARGS__)
+#define SKIP_8(x, ...) SKIP_7(__VA_ARGS__)
+#define SKIP_9(x, ...) SKIP_8(__VA_ARGS__)
+#define SKIP_10(x, ...) SKIP_9(__VA_ARGS__)
+#define SKIP_11(x, ...) SKIP_10(__VA_ARGS__)
+#define SKIP_12(x, ...) SKIP_11(__VA_ARGS__)
+#define SKIP_13(x, ...) SKIP_12(__VA_ARGS__)
+#define SKIP_14(x, ...) SKIP_13(__VA_ARGS__)
+#define SKIP_15(x, ...) SKIP_14(__VA_ARGS__)
+#define SKIP_16(x, ...) SKIP_15(__VA_ARGS__)
+#define SKIP_17(x, ...) SKIP_16(__VA_ARGS__)
+#define SKIP_18(x, ...) SKIP_17(__VA_ARGS__)
+#define SKIP_19(x, ...) SKIP_18(__VA_ARGS__)
+#define SKIP_20(x, ...) SKIP_19(__VA_ARGS__)
+#define SKIP_21(x, ...) SKIP_20(__VA_ARGS__)
+#define SKIP_22(x, ...) SKIP_21(__VA_ARGS__)
+#define SKIP_23(x, ...) SKIP_22(__VA_ARGS__)
+#define SKIP_24(x, ...) SKIP_23(__VA_ARGS__)
+#define SKIP_25(x, ...) SKIP_24(__VA_ARGS__)
+#define SKIP_26(x, ...) SKIP_25(__VA_ARGS__)
+#define SKIP_27(x, ...) SKIP_26(__VA_ARGS__)
+#define SKIP_28(x, ...) SKIP_27(__VA_ARGS__)
+#define SKIP_29(x, ...) SKIP_28(__VA_ARGS__)
+#define SKIP_30(x, ...) SKIP_29(__VA_ARGS__)
+#define SKIP_31(x, ...) SKIP_30(__VA_ARGS__)
+#define SKIP_32(x, ...) SKIP_31(__VA_ARGS__)
+#define SKIP_33(x, ...) SKIP_32(__VA_ARGS__)
+#define SKIP_34(x, ...) SKIP_33(__VA_ARGS__)
+#define SKIP_35(x, ...) SKIP_34(__VA_ARGS__)
+#define SKIP_36(x, ...) SKIP_35(__VA_ARGS__)
+#define SKIP_37(x, ...) SKIP_36(__VA_ARGS__)
+#define SKIP_38(x, ...) SKIP_37(__VA_ARGS__)
+#define SKIP_39(x, ...) SKIP_38(__VA_ARGS__)
+#define SKIP_40(x, ...) SKIP_39(__VA_ARGS__)
+#define SKIP_41(x, ...) SKIP_40(__VA_ARGS__)
+#define SKIP_42(x, ...) SKIP_41(__VA_ARGS__)
+#define SKIP_43(x, ...) SKIP_42(__VA_ARGS__)
+#define SKIP_44(x, ...) SKIP_43(__VA_ARGS__)
+#define SKIP_45(x, ...) SKIP_44(__VA_ARGS__)
+#define SKIP_46(x, ...) SKIP_45(__VA_ARGS__)
+#define SKIP_47(x, ...) SKIP_46(__VA_ARGS__)
+#define SKIP_48(x, ...) SKIP_47(__VA_ARGS__)
+#define SKIP_49(x, ...) SKIP_48(__VA_ARGS__)
+#define SKIP_50(x, ...) SKIP_49(__VA_ARGS__)
+#define SKIP_51(x, ...) SKIP_50(__VA_ARGS__)
+#define SKIP_52(x, ...) SKIP_51(__VA_ARGS__)
+#define SKIP_53(x, ...) SKIP_52(__VA_ARGS__)
+#define SKIP_54(x, ...) SKIP_53(__VA_ARGS__)
+#define SKIP_55(x, ...) SKIP_54(__VA_ARGS__)
+#define SKIP_56(x, ...) SKIP_55(__VA_ARGS__)
+#define SKIP_57(x, ...) SKIP_56(__VA_ARGS__)
+#define SKIP_58(x, ...) SKIP_57(__VA_ARGS__)
+#define SKIP_59(x, ...) SKIP_58(__VA_ARGS__)
+#define SKIP_60(x, ...) SKIP_59(__VA_ARGS__)
+#define SKIP_61(x, ...) SKIP_60(__VA_ARGS__)
+#define SKIP_62(x, ...) SKIP_61(__VA_ARGS__)
+#define SKIP_63(x, ...) SKIP_62(__VA_ARGS__)
+#define SKIP_64(x, ...) SKIP_63(__VA_ARGS__)
+#define SKIP_65(x, ...) SKIP_64(__VA_ARGS__)
+#define SKIP_66(x, ...) SKIP_65(__VA_ARGS__)
+#define SKIP_67(x, ...) SKIP_66(__VA_ARGS__)
+#define SKIP_68(x, ...) SKIP_67(__VA_ARGS__)
+#define SKIP_69(x, ...) SKIP_68(__VA_ARGS__)
+#define SKIP_70(x, ...) SKIP_69(__VA_ARGS__)
+#define SKIP_71(x, ...) SKIP_70(__VA_ARGS__)
+#define SKIP_72(x, ...) SKIP_71(__VA_ARGS__)
+#define SKIP_73(x, ...) SKIP_72(__VA_ARGS__)
+#define SKIP_74(x, ...) SKIP_73(__VA_ARGS__)
+#define SKIP_75(x, ...) SKIP_74(__VA_ARGS__)
+#define SKIP_76(x, ...) SKIP_75(__VA_ARGS__)
+#define SKIP_77(x, ...) SKIP_76(__VA_ARGS__)
+#define SKIP_78(x, ...) SKIP_77(__VA_ARGS__)
+#define SKIP_79(x, ...) SKIP_78(__VA_ARGS__)
+#define SKIP_80(x, ...) SKIP_79(__VA_ARGS__)
+#define SKIP_81(x, ...) SKIP_80(__VA_ARGS__)
+#define SKIP_82(x, ...) SKIP_81(__VA_ARGS__)
+#define SKIP_83(x, ...) SKIP_82(__VA_ARGS__)
+#define SKIP_84(x, ...) SKIP_83(__VA_ARGS__)
+#define SKIP_85(x, ...) SKIP_84(__VA_ARGS__)
+#define SKIP_86(x, ...) SKIP_85(__VA_ARGS__)
+#define SKIP_87(x, ...) SKIP_86(__VA_ARGS__)
+#define SKIP_88(x, ...) SKIP_87(__VA_ARGS__)
+#define SKIP_89(x, ...) SKIP_88(__VA_ARGS__)
+#define SKIP_90(x, ...) SKIP_89(__VA_ARGS__)
+#define SKIP_91(x, ...) SKIP_90(__VA_ARGS__)
+#define SKIP_92(x, ...) SKIP_91(__VA_ARGS__)
+#define SKIP_93(x, ...) SKIP_92(__VA_ARGS__)
+#define SKIP_94(x, ...) SKIP_93(__VA_ARGS__)
+#define SKIP_95(x, ...) SKIP_94(__VA_ARGS__)
+#define SKIP_96(x, ...) SKIP_95(__VA_ARGS__)
+#define SKIP_97(x, ...) SKIP_96(__VA_ARGS__)
+#define SKIP_98(x, ...) SKIP_97(__VA_ARGS__)
+#define SKIP_99(x, ...) SKIP_98(__VA_ARGS__)
+#define SKIP_100(x, ...) SKIP_99(__VA_ARGS__)
+#define SKIP_101(x, ...) SKIP_100(__VA_ARGS__)
+#define SKIP_102(x, ...) SKIP_101(__VA_ARGS__)
+#define SKIP_103(x, ...) SKIP_102(__VA_ARGS__)
+#define SKIP_104(x, ...) SKIP_103(__VA_ARGS__)
+#define SKIP_105(x, ...) SKIP_104(__VA_ARGS__)
+#define SKIP_106(x, ...) SKIP_105(__VA_ARGS__)
+#define SKIP_107(x, ...) SKIP_106(__VA_ARGS__)
+#define SKIP_108(x, ...) SKIP_107(__VA_ARGS__)
+#define SKIP_109(x, ...) SKIP_108(__VA_ARGS__)
+#define SKIP_110(x, ...) SKIP_109(__VA_ARGS__)
+#define SKIP_111(x, ...) SKIP_110(__VA_ARGS__)
+#define SKIP_112(x, ...) SKIP_111(__VA_ARGS__)
+#define SKIP_113(x, ...) SKIP_112(__VA_ARGS__)
+#define SKIP_114(x, ...) SKIP_113(__VA_ARGS__)
+#define SKIP_115(x, ...) SKIP_114(__VA_ARGS__)
+#define SKIP_116(x, ...) SKIP_115(__VA_ARGS__)
+#define SKIP_117(x, ...) SKIP_116(__VA_ARGS__)
+#define SKIP_118(x, ...) SKIP_117(__VA_ARGS__)
+#define SKIP_119(x, ...) SKIP_118(__VA_ARGS__)
+#define SKIP_120(x, ...) SKIP_119(__VA_ARGS__)
+#define SKIP_121(x, ...) SKIP_120(__VA_ARGS__)
+#define SKIP_122(x, ...) SKIP_121(__VA_ARGS__)
+#define SKIP_123(x, ...) SKIP_122(__VA_ARGS__)
+#define SKIP_124(x, ...) SKIP_123(__VA_ARGS__)
+#define SKIP_125(x, ...) SKIP_124(__VA_ARGS__)
+#define SKIP_126(x, ...) SKIP_125(__VA_ARGS__)
+#define SKIP_127(x, ...) SKIP_126(__VA_ARGS__)
+#define SKIP_128(x, ...) SKIP_127(__VA_ARGS__)
+#define SKIP_129(x, ...) SKIP_128(__VA_ARGS__)
+#define SKIP_130(x, ...) SKIP_129(__VA_ARGS__)
+#define SKIP_131(x, ...) SKIP_130(__VA_ARGS__)
+#define SKIP_132(x, ...) SKIP_131(__VA_ARGS__)
+#define SKIP_133(x, ...) SKIP_132(__VA_ARGS__)
+#define SKIP_134(x, ...) SKIP_133(__VA_ARGS__)
+#define SKIP_135(x, ...) SKIP_134(__VA_ARGS__)
+#define SKIP_136(x, ...) SKIP_135(__VA_ARGS__)
+#define SKIP_137(x, ...) SKIP_136(__VA_ARGS__)
+#define SKIP_138(x, ...) SKIP_137(__VA_ARGS__)
+#define SKIP_139(x, ...) SKIP_138(__VA_ARGS__)
+#define SKIP_140(x, ...) SKIP_139(__VA_ARGS__)
+#define SKIP_141(x, ...) SKIP_140(__VA_ARGS__)
+#define SKIP_142(x, ...) SKIP_141(__VA_ARGS__)
+#define SKIP_143(x, ...) SKIP_142(__VA_ARGS__)
+#define SKIP_144(x, ...) SKIP_143(__VA_ARGS__)
+#define SKIP_145(x, ...) SKIP_144(__VA_ARGS__)
+#define SKIP_146(x, ...) SKIP_145(__VA_ARGS__)
+#define SKIP_147(x, ...) SKIP_146(__VA_ARGS__)
+#define SKIP_148(x, ...) SKIP_147(__VA_ARGS__)
+#define SKIP_149(x, ...) SKIP_148(__VA_ARGS__)
+#define SKIP_150(x, ...) SKIP_149(__VA_ARGS__)
+#define SKIP_151(x, ...) SKIP_150(__VA_ARGS__)
+#define SKIP_152(x, ...) SKIP_151(__VA_ARGS__)
+#define SKIP_153(x, ...) SKIP_152(__VA_ARGS__)
+#define SKIP_154(x, ...) SKIP_153(__VA_ARGS__)
+#define SKIP_155(x, ...) SKIP_154(__VA_ARGS__)
+#define SKIP_156(x, ...) SKIP_155(__VA_ARGS__)
+#define SKIP_157(x, ...) SKIP_156(__VA_ARGS__)
+#define SKIP_158(x, ...) SKIP_157(__VA_ARGS__)
+#define SKIP_159(x, ...) SKIP_158(__VA_ARGS__)
+#define SKIP_160(x, ...) SKIP_159(__VA_ARGS__)
+#define SKIP_161(x, ...) SKIP_160(__VA_ARGS__)
+#define SKIP_162(x, ...) SKIP_161(__VA_ARGS__)
+#define SKIP_163(x, ...) SKIP_162(__VA_ARGS__)
+#define SKIP_164(x, ...) SKIP_163(__VA_ARGS__)
+#define SKIP_165(x, ...) SKIP_164(__VA_ARGS__)
+#define SKIP_166(x, ...) SKIP_165(__VA_ARGS__)
+#define SKIP_167(x, ...) SKIP_166(__VA_ARGS__)
+#define SKIP_168(x, ...) SKIP_167(__VA_ARGS__)
+#define SKIP_169(x, ...) SKIP_168(__VA_ARGS__)
+#define SKIP_170(x, ...) SKIP_169(__VA_ARGS__)
+#define SKIP_171(x, ...) SKIP_170(__VA_ARGS__)
+#define SKIP_172(x, ...) SKIP_171(__VA_ARGS__)
+#define SKIP_173(x, ...) SKIP_172(__VA_ARGS__)
+#define SKIP_174(x, ...) SKIP_173(__VA_ARGS__)
+#define SKIP_175(x, ...) SKIP_174(__VA_ARGS__)
+#define SKIP_176(x, ...) SKIP_175(__VA_ARGS__)
+#define SKIP_177(x, ...) SKIP_176(__VA_ARGS__)
+#define SKIP_178(x, ...) SKIP_177(__VA_ARGS__)
+#define SKIP_179(x, ...) SKIP_178(__VA_ARGS__)
+#define SKIP_180(x, ...) SKIP_179(__VA_ARGS__)
+#define SKIP_181(x, ...) SKIP_180(__VA_ARGS__)
+#define SKIP_182(x, ...) SKIP_181(__VA_ARGS__)
+#define SKIP_183(x, ...) SKIP_182(__VA_ARGS__)
+#define SKIP_184(x, ...) SKIP_183(__VA_ARGS__)
+#define SKIP_185(x, ...) SKIP_184(__VA_ARGS__)
+#define SKIP_186(x, ...) SKIP_185(__VA_ARGS__)
+#define SKIP_187(x, ...) SKIP_186(__VA_ARGS__)
+#define SKIP_188(x, ...) SKIP_187(__VA_ARGS__)
+#define SKIP_189(x, ...) SKIP_188(__VA_ARGS__)
+#define SKIP_190(x, ...) SKIP_189(__VA_ARGS__)
+#define SKIP_191(x, ...) SKIP_190(__VA_ARGS__)
+#define SKIP_192(x, ...) SKIP_191(__VA_ARGS__)
+#define SKIP_193(x, ...) SKIP_192(__VA_ARGS__)
+#define SKIP_194(x, ...) SKIP_193(__VA_ARGS__)
+#define SKIP_195(x, ...) SKIP_194(__VA_ARGS__)
+#define SKIP_196(x, ...) SKIP_195(__VA_ARGS__)
+#define SKIP_197(x, ...) SKIP_196(__VA_ARGS__)
+#define SKIP_198(x, ...) SKIP_197(__VA_ARGS__)
+#define SKIP_199(x, ...) SKIP_198(__VA_ARGS__)
+#define SKIP_200(x, ...) SKIP_199(__VA_ARGS__)
+#define SKIP_201(x, ...) SKIP_200(__VA_ARGS__)
+#define SKIP_202(x, ...) SKIP_201(__VA_ARGS__)
+#define SKIP_203(x, ...) SKIP_202(__VA_ARGS__)
+#define SKIP_204(x, ...) SKIP_203(__VA_ARGS__)
+#define SKIP_205(x, ...) SKIP_204(__VA_ARGS__)
+#define SKIP_206(x, ...) SKIP_205(__VA_ARGS__)
+#define SKIP_207(x, ...) SKIP_206(__VA_ARGS__)
+#define SKIP_208(x, ...) SKIP_207(__VA_ARGS__)
+#define SKIP_209(x, ...) SKIP_208(__VA_ARGS__)
+#define SKIP_210(x, ...) SKIP_209(__VA_ARGS__)
+#define SKIP_211(x, ...) SKIP_210(__VA_ARGS__)
+#define SKIP_212(x, ...) SKIP_211(__VA_ARGS__)
+#define SKIP_213(x, ...) SKIP_212(__VA_ARGS__)
+#define SKIP_214(x, ...) SKIP_213(__VA_ARGS__)
+#define SKIP_215(x, ...) SKIP_214(__VA_ARGS__)
+#define SKIP_216(x, ...) SKIP_215(__VA_ARGS__)
+#define SKIP_217(x, ...) SKIP_216(__VA_ARGS__)
+#define SKIP_218(x, ...) SKIP_217(__VA_ARGS__)
+#define SKIP_219(x, ...) SKIP_218(__VA_ARGS__)
+#define SKIP_220(x, ...) SKIP_219(__VA_ARGS__)
+#define SKIP_221(x, ...) SKIP_220(__VA_ARGS__)
+#define SKIP_222(x, ...) SKIP_221(__VA_ARGS__)
+#define SKIP_223(x, ...) SKIP_222(__VA_ARGS__)
+#define SKIP_224(x, ...) SKIP_223(__VA_ARGS__)
+#define SKIP_225(x, ...) SKIP_224(__VA_ARGS__)
+#define SKIP_226(x, ...) SKIP_225(__VA_ARGS__)
+#define SKIP_227(x, ...) SKIP_226(__VA_ARGS__)
+#define SKIP_228(x, ...) SKIP_227(__VA_ARGS__)
+#define SKIP_229(x, ...) SKIP_228(__VA_ARGS__)
+#define SKIP_230(x, ...) SKIP_229(__VA_ARGS__)
+#define SKIP_231(x, ...) SKIP_230(__VA_ARGS__)
+#define SKIP_232(x, ...) SKIP_231(__VA_ARGS__)
+#define SKIP_233(x, ...) SKIP_232(__VA_ARGS__)
+#define SKIP_234(x, ...) SKIP_233(__VA_ARGS__)
+#define SKIP_235(x, ...) SKIP_234(__VA_ARGS__)
+#define SKIP_236(x, ...) SKIP_235(__VA_ARGS__)
+#define SKIP_237(x, ...) SKIP_236(__VA_ARGS__)
+#define SKIP_238(x, ...) SKIP_237(__VA_ARGS__)
+#define SKIP_239(x, ...) SKIP_238(__VA_ARGS__)
+#define SKIP_240(x, ...) SKIP_239(__VA_ARGS__)
+#define SKIP_241(x, ...) SKIP_240(__VA_ARGS__)
+#define SKIP_242(x, ...) SKIP_241(__VA_ARGS__)
+#define SKIP_243(x, ...) SKIP_242(__VA_ARGS__)
+#define SKIP_244(x, ...) SKIP_243(__VA_ARGS__)
+#define SKIP_245(x, ...) SKIP_244(__VA_ARGS__)
+#define SKIP_246(x, ...) SKIP_245(__VA_ARGS__)
+#define SKIP_247(x, ...) SKIP_246(__VA_ARGS__)
+#define SKIP_248(x, ...) SKIP_247(__VA_ARGS__)
+#define SKIP_249(x, ...) SKIP_248(__VA_ARGS__)
+#define SKIP_250(x, ...) SKIP_249(__VA_ARGS__)
+#define SKIP_251(x, ...) SKIP_250(__VA_ARGS__)
+#define SKIP_252(x, ...) SKIP_251(__VA_ARGS__)
+#define SKIP_253(x, ...) SKIP_252(__VA_ARGS__)
+#define SKIP_254(x, ...) SKIP_253(__VA_ARGS__)
+#define SKIP_255(x, ...) SKIP_254(__VA_ARGS__)
+#define SKIP_256(x, ...) SKIP_255(__VA_ARGS__)
+
+/**
+ * @brief Loop from 0 to n, printing each number.
+ *
+ * @param n The number to loop to, up to 256.
+ */
+#define LOOP(n) REPEAT(n, LOOP_PRINT, ~) LOOP_PRINT(n, ~)
+#define LOOP_PRINT(i, _) printf("%d\n", i);
+
+// Example 6: Type-Specialized Containers
+/**
+ * @brief Macro for pasting three tokens.
+ *
+ * The arguments are expanded before pasting when they are themselves macro parameters, which is
+ * how the container macros below build names such as vec_int_push from a type name.
+ */
+#define CONCAT3(x, y, z) x ## y ## z
+
+/**
+ * @brief Default ordering, hash and equality for the container macros.
+ */
+#define DEFAULT_LESS(a, b) ((a) < (b))
+#define DEFAULT_HASH(k) ((uint64_t)(k) * 0x9e3779b97f4a7c15ull)
+#define DEFAULT_EQUAL(a, b) ((a) == (b))
+
+/**
+ * @brief Defines a growable vector of T named vec_NAME, with push, pop, sort and binary search.
+ *
+ * Elements are stored and compared as T, so there is no void* indirection, no memcpy of a runtime
+ * element size and no comparator callback: LESS is expanded inline.
+ *
+ * @param NAME The name suffix, one identifier.
+ * @param T The element type.
+ * @param LESS A macro or function LESS(a, b) that orders two elements.
+ */
+#define DEFINE_VEC_NAMED(NAME, T, LESS)                                                                  \
+    typedef struct {                                                                                     \
+        T *data;                                                                                         \
+        size_t len;                                                                                      \
+        size_t cap;                                                                                      \
+    } CONCAT(vec_, NAME);                                                                                \
+                                                                                                         \
+    static inline void CONCAT3(vec_, NAME, _init)(CONCAT(vec_, NAME) *v) {                               \
+        v->data = NULL;                                                                                  \
+        v->len = v->cap = 0;                                                                             \
+    }                                                                                                    \
+                                                                                                         \
+    static inline void CONCAT3(vec_, NAME, _free)(CONCAT(vec_, NAME) *v) {                               \
+        free(v->data);                                                                                   \
+        CONCAT3(vec_, NAME, _init)(v);                                                                   \
+    }                                                                                                    \
+                                                                                                         \
+    static inline int CONCAT3(vec_, NAME, _reserve)(CONCAT(vec_, NAME) *v, size_t cap) {                 \
+        if (cap <= v->cap)                                                                               \
+            return 0;                                                                                    \
+        T *data = realloc(v->data, cap * sizeof(T));                                                     \
+        if (!data)                                                                                       \
+            return -1;                                                                                   \
+        v->data = data;                                                                                  \
+        v->cap = cap;                                                                                    \
+        return 0;                                                                                        \
+    }                                                                                                    \
+                                                                                                         \
+    static inline int CONCAT3(vec_, NAME, _push)(CONCAT(vec_, NAME) *v, T value) {                       \
+        if (v->len == v->cap && CONCAT3(vec_, NAME, _reserve)(v, v->cap ? v->cap * 2 : 16) != 0)         \
+            return -1;                                                                                   \
+        v->data[v->len++] = value;                                                                       \
+        return 0;                                                                                        \
+    }                                                                                                    \
+                                                                                                         \
+    static inline T CONCAT3(vec_, NAME, _pop)(CONCAT(vec_, NAME) *v) {                                   \
+        return v->data[--v->len];                                                                        \
+    }                                                                                                    \
+                                                                                                         \
+    static void CONCAT3(vec_, NAME, _sift_down)(T *a, size_t i, size_t n) {                              \
+        T value = a[i];                                                                                  \
+        for (size_t child; (child = 2 * i + 1) < n; i = child) {                                         \
+            if (child + 1 < n && LESS(a[child], a[child + 1]))                                           \
+                child++;                                                                                 \
+            if (!LESS(value, a[child]))                                                                  \
+                break;                                                                                   \
+            a[i] = a[child];                                                                             \
+        }                                                                                                \
+        a[i] = value;                                                                                    \
+    }                                                                                                    \
+                                                                                                         \
+    /* Introsort: quicksort with a median of three, insertion sort for short ranges, heapsort when */   \
+    /* the recursion gets too deep */                                                                    \
+    static void CONCAT3(vec_, NAME, _sort_range)(T *a, size_t n, int depth) {                            \
+        while (n > 16) {                                                                                 \
+            if (depth-- == 0) {                                                                          \
+                for (size_t i = n / 2; i-- > 0;)                                                         \
+                    CONCAT3(vec_, NAME, _sift_down)(a, i, n);                                            \
+                for (size_t end = n - 1; end > 0; end--) {                                               \
+                    T top = a[0];                                                                        \
+                    a[0] = a[end];                                                                       \
+                    a[end] = top;                                                                        \
+                    CONCAT3(vec_, NAME, _sift_down)(a, 0, end);                                          \
+                }                                                                                        \
+                return;                                                                                  \
+            }                                                                                            \
+            T *lo = a, *mid = a + n / 2, *hi = a + n - 1, tmp;                                           \
+            if (LESS(*mid, *lo)) { tmp = *mid; *mid = *lo; *lo = tmp; }                                  \
+            if (LESS(*hi, *mid)) { tmp = *hi; *hi = *mid; *mid = tmp; }                                  \
+            if (LESS(*mid, *lo)) { tmp = *mid; *mid = *lo; *lo = tmp; }                                  \
+            T pivot = *mid;                                                                              \
+            T *i = a, *j = a + n - 1;                                                                    \
+            for (;;) {                                                                                   \
+                while (LESS(*i, pivot))                                                                  \
+                    i++;                                                                                 \
+                while (LESS(pivot, *j))                                                                  \
+                    j--;                                                                                 \
+                if (i >= j)                                                                              \
+                    break;                                                                               \
+                tmp = *i;                                                                                \
+                *i++ = *j;                                                                               \
+                *j-- = tmp;                                                                              \
+            }                                                                                            \
+            /* [a, j] and (j, a + n) remain; recurse into the smaller one */                             \
+            size_t left = (size_t)(j - a) + 1;                                                           \
+            if (left < n - left) {                                                                       \
+                CONCAT3(vec_, NAME, _sort_range)(a, left, depth);                                        \
+                a += left;                                                                               \
+                n -= left;                                                                               \
+            } else {                                                                                     \
+                CONCAT3(vec_, NAME, _sort_range)(a + left, n - left, depth);                             \
+                n = left;                                                                                \
+            }                                                                                            \
+        }                                                                                                \
+        for (size_t i = 1; i < n; i++) {                                                                 \
+            T value = a[i];                                                                              \
+            size_t k = i;                                                                                \
+            for (; k > 0 && LESS(value, a[k - 1]); k--)                                                  \
+                a[k] = a[k - 1];                                                                         \
+            a[k] = value;                                                                                \
+        }                                                                                                \
+    }                                                                                                    \
+                                                                                                         \
+    static inline void CONCAT3(vec_, NAME, _sort)(CONCAT(vec_, NAME) *v) {                               \
+        int depth = 0;                                                                                   \
+        for (size_t n = v->len; n > 1; n >>= 1)                                                          \
+            depth += 2;                                                                                  \
+        CONCAT3(vec_, NAME, _sort_range)(v->data, v->len, depth);                                        \
+    }                                                                                                    \
+                                                                                                         \
+    /* Index of the first element of a sorted vector that is not less than key */                       \
+    static inline size_t CONCAT3(vec_, NAME, _lower_bound)(const CONCAT(vec_, NAME) *v, T key) {         \
+        const T *base = v->data;                                                                         \
+        size_t n = v->len;                                                                               \
+        while (n > 1) {                                                                                  \
+            size_t half = n / 2;                                                                         \
+            base = LESS(base[half], key) ? base + half : base;                                           \
+            n -= half;                                                                                   \
+        }                                                                                                \
+        return (size_t)(base - v->data) + (n == 1 && LESS(*base, key));                                  \
+    }                                                                                                    \
+                                                                                                         \
+    static inline T *CONCAT3(vec_, NAME, _bsearch)(const CONCAT(vec_, NAME) *v, T key) {                 \
+        size_t i = CONCAT3(vec_, NAME, _lower_bound)(v, key);                                            \
+        return i < v->len && !LESS(key, v->data[i]) ? &v->data[i] : NULL;                                \
+    }
+
+/**
+ * @brief Defines vec_T ordered by <, e.g. DEFINE_VEC(int) gives vec_int and vec_int_push.
+ *
+ * @param T The element type, one identifier.
+ */
+#define DEFINE_VEC(T) DEFINE_VEC_NAMED(T, T, DEFAULT_LESS)
+
+/**
+ * @brief Defines an open-addressing hash map from K to V named hashmap_NAME.
+ *
+ * Keys and values live in two flat arrays probed linearly, with a byte per slot marking it used.
+ * Erasing shifts the following entries back instead of leaving tombstones.
+ *
+ * @param NAME The name suffix, one identifier.
+ * @param K The key type.
+ * @param V The value type.
+ * @param HASH A macro or function HASH(k) giving a uint64_t; the top bits pick the slot.
+ * @param EQUAL A macro or function EQUAL(a, b) comparing two keys.
+ */
+#define DEFINE_HASHMAP_NAMED(NAME, K, V, HASH, EQUAL)                                                    \
+    typedef struct {                                                                                     \
+        K *keys;                                                                                         \
+        V *values;                                                                                       \
+        unsigned char *used;                                                                             \
+        size_t len;                                                                                      \
+        size_t cap;                                                                                      \
+        int shift;                                                                                       \
+    } CONCAT(hashmap_, NAME);                                                                            \
+                                                                                                         \
+    static inline void CONCAT3(hashmap_, NAME, _init)(CONCAT(hashmap_, NAME) *m) {                       \
+        memset(m, 0, sizeof(*m));                                                                        \
+        m->shift = 64;                                                                                   \
+    }                                                                                                    \
+                                                                                                         \
+    static inline void CONCAT3(hashmap_, NAME, _free)(CONCAT(hashmap_, NAME) *m) {                       \
+        free(m->keys);                                                                                   \
+        free(m->values);                                                                                 \
+        free(m->used);                                                                                   \
+        CONCAT3(hashmap_, NAME, _init)(m);                                                               \
+    }                                                                                                    \
+                                                                                                         \
+    static inline size_t CONCAT3(hashmap_, NAME, _home)(const CONCAT(hashmap_, NAME) *m, K key) {        \
+        return (size_t)((uint64_t)(HASH(key)) >> m->shift);                                              \
+    }                                                                                                    \
+                                                                                                         \
+    static int CONCAT3(hashmap_, NAME, _grow)(CONCAT(hashmap_, NAME) *m) {                               \
+        CONCAT(hashmap_, NAME) bigger = { NULL, NULL, NULL, 0, m->cap ? m->cap * 2 : 16, m->shift };     \
+        bigger.shift = 64 - __builtin_ctzll(bigger.cap);                                                 \
+        bigger.keys = malloc(bigger.cap * sizeof(K));                                                    \
+        bigger.values = malloc(bigger.cap * sizeof(V));                                                  \
+        bigger.used = calloc(bigger.cap, 1);                                                             \
+        if (!bigger.keys || !bigger.values || !bigger.used) {                                            \
+            CONCAT3(hashmap_, NAME, _free)(&bigger);                                                     \
+            return -1;                                                                                   \
+        }                                                                                                \
+        for (size_t i = 0; i < m->cap; i++) {                                                            \
+            if (!m->used[i])                                                                             \
+                continue;                                                                                \
+            size_t j = CONCAT3(hashmap_, NAME, _home)(&bigger, m->keys[i]);                              \
+            while (bigger.used[j])                                                                       \
+                j = (j + 1) & (bigger.cap - 1);                                                          \
+            bigger.keys[j] = m->keys[i];                                                                 \
+            bigger.values[j] = m->values[i];                                                             \
+            bigger.used[j] = 1;                                                                          \
+        }                                                                                                \
+        bigger.len = m->len;                                                                             \
+        CONCAT3(hashmap_, NAME, _free)(m);                                                               \
+        *m = bigger;                                                                                     \
+        return 0;                                                                                        \
+    }                                                                                                    \
+                                                                                                         \
+    /* Inserts or replaces; returns -1 if memory runs out */                                             \
+    static inline int CONCAT3(hashmap_, NAME, _put)(CONCAT(hashmap_, NAME) *m, K key, V value) {         \
+        if ((m->len + 1) * 4 > m->cap * 3 && CONCAT3(hashmap_, NAME, _grow)(m) != 0)                     \
+            return -1;                                                                                   \
+        size_t i = CONCAT3(hashmap_, NAME, _home)(m, key);                                               \
+        for (; m->used[i]; i = (i + 1) & (m->cap - 1)) {                                                 \
+            if (EQUAL(m->keys[i], key)) {                                                                \
+                m->values[i] = value;                                                                    \
+                return 0;                                                                                \
+            }                                                                                            \
+        }                                                                                                \
+        m->keys[i] = key;                                                                                \
+        m->values[i] = value;                                                                            \
+        m->used[i] = 1;                                                                                  \
+        m->len++;                                                                                        \
+        return 0;                                                                                        \
+    }                                                                                                    \
+                                                                                                         \
+    static inline V *CONCAT3(hashmap_, NAME, _get)(const CONCAT(hashmap_, NAME) *m, K key) {             \
+        if (!m->cap)                                                                                     \
+            return NULL;                                                                                 \
+        for (size_t i = CONCAT3(hashmap_, NAME, _home)(m, key); m->used[i]; i = (i + 1) & (m->cap - 1)) {\
+            if (EQUAL(m->keys[i], key))                                                                  \
+                return &m->values[i];                                                                    \
+        }                                                                                                \
+        return NULL;                                                                                     \
+    }                                                                                                    \
+                                                                                                         \
+    /* Returns 1 if the key was there */                                                                 \
+    static inline int CONCAT3(hashmap_, NAME, _erase)(CONCAT(hashmap_, NAME) *m, K key) {                \
+        size_t mask = m->cap - 1, i;                                                                     \
+        if (!m->cap)                                                                                     \
+            return 0;                                                                                    \
+        for (i = CONCAT3(hashmap_, NAME, _home)(m, key);; i = (i + 1) & mask) {                          \
+            if (!m->used[i])                                                                             \
+                return 0;                                                                                \
+            if (EQUAL(m->keys[i], key))                                                                  \
+                break;                                                                                   \
+        }                                                                                                \
+        /* Pull back later entries whose home slot is not between the hole and themselves */             \
+        for (size_t j = (i + 1) & mask; m->used[j]; j = (j + 1) & mask) {                                \
+            size_t home = CONCAT3(hashmap_, NAME, _home)(m, m->keys[j]);                                 \
+            if (((j - home) & mask) >= ((j - i) & mask)) {                                               \
+                m->keys[i] = m->keys[j];                                                                 \
+                m->values[i] = m->values[j];                                                             \
+                i = j;                                                                                   \
+            }                                                                                            \
+        }                                                                                                \
+        m->used[i] = 0;                                                                                  \
+        m->len--;                                                                                        \
+        return 1;                                                                                        \
+    }
+
+/**
+ * @brief Defines hashmap_K_V for integer-like keys, e.g. DEFINE_HASHMAP(int, int) gives
+ * hashmap_int_int and hashmap_int_int_put.
+ *
+ * @param K The key type, one identifier.
+ * @param V The value type, one identifier.
+ */
+#define DEFINE_HASHMAP(K, V) DEFINE_HASHMAP_NAMED(CONCAT3(K, _, V), K, V, DEFAULT_HASH, DEFAULT_EQUAL)
+
+/**
+ * @brief Defines a binary heap of T named heap_NAME whose top is the least element by LESS.
+ *
+ * @param NAME The name suffix, one identifier.
+ * @param T The element type.
+ * @param LESS A macro or function LESS(a, b) that orders two elements.
+ */
+#define DEFINE_HEAP_NAMED(NAME, T, LESS)                                                                 \
+    typedef struct {                                                                                     \
+        T *data;                                                                                         \
+        size_t len;                                                                                      \
+        size_t cap;                                                                                      \
+    } CONCAT(heap_, NAME);                                                                               \
+                                                                                                         \
+    static inline void CONCAT3(heap_, NAME, _init)(CONCAT(heap_, NAME) *h) {                             \
+        h->data = NULL;                                                                                  \
+        h->len = h->cap = 0;                                                                             \
+    }                                                                                                    \
+                                                                                                         \
+    static inline void CONCAT3(heap_, NAME, _free)(CONCAT(heap_, NAME) *h) {                             \
+        free(h->data);                                                                                   \
+        CONCAT3(heap_, NAME, _init)(h);                                                                  \
+    }                                                                                                    \
+                                                                                                         \
+    static inline int CONCAT3(heap_, NAME, _push)(CONCAT(heap_, NAME) *h, T value) {                     \
+        if (h->len == h->cap) {                                                                          \
+            size_t cap = h->cap ? h->cap * 2 : 16;                                                       \
+            T *data = realloc(h->data, cap * sizeof(T));                                                 \
+            if (!data)                                                                                   \
+                return -1;                                                                               \
+            h->data = data;                                                                              \
+            h->cap = cap;                                                                                \
+        }                                                                                                \
+        size_t i = h->len++;                                                                             \
+        for (; i > 0 && LESS(value, h->data[(i - 1) / 2]); i = (i - 1) / 2)                              \
+            h->data[i] = h->data[(i - 1) / 2];                                                           \
+        h->data[i] = value;                                                                              \
+        return 0;                                                                                        \
+    }                                                                                                    \
+                                                                                                         \
+    static inline T CONCAT3(heap_, NAME, _top)(const CONCAT(heap_, NAME) *h) {                           \
+        return h->data[0];                                                                               \
+    }                                                                                                    \
+                                                                                                         \
+    static inline T CONCAT3(heap_, NAME, _pop)(CONCAT(heap_, NAME) *h) {                                 \
+        T top = h->data[0], value = h->data[--h->len];                                                   \
+        size_t i = 0, n = h->len;                                                                        \
+        for (size_t child; (child = 2 * i + 1) < n; i = child) {                                         \
+            if (child + 1 < n && LESS(h->data[child + 1], h->data[child]))                               \
+                child++;                                                                                 \
+            if (!LESS(h->data[child], value))                                                            \
+                break;                                                                                   \
+            h->data[i] = h->data[child];                                                                 \
+        }                                                                                                \
+        if (n)                                                                                           \
+            h->data[i] = value;                                                                          \
+        return top;                                                                                      \
+    }
+
+/**
+ * @brief Defines heap_T, a min-heap ordered by <, e.g. DEFINE_HEAP(int) gives heap_int_push.
+ *
+ * @param T The element type, one identifier.
+ */
+#define DEFINE_HEAP(T) DEFINE_HEAP_NAMED(T, T, DEFAULT_LESS)
+
+DEFINE_VEC(int)
+DEFINE_HASHMAP(int, int)
+DEFINE_HEAP(int)
+
+// Container Benchmark
+/**
+ * @brief void* equivalents of the containers above, in the style of qsort(): an element size known
+ * only at run time, memcpy() for every move and a callback for every comparison or hash.
+ */
+struct generic_vec {
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+    size_t size;
+};
+
+static int generic_vec_push(struct generic_vec *v, const void *elem) {
+    if (v->len == v->cap) {
+        size_t cap = v->cap ? v->cap * 2 : 16;
+        unsigned char *data = realloc(v->data, cap * v->size);
+        if (!data)
+            return -1;
+        v->data = data;
+        v->cap = cap;
+    }
+    memcpy(v->data + v->len++ * v->size, elem, v->size);
+    return 0;
+}
+
+struct generic_map {
+    unsigned char *keys;
+    unsigned char *values;
+    unsigned char *used;
+    size_t len;
+    size_t cap;
+    size_t key_size;
+    size_t value_size;
+    uint64_t (*hash)(const void *key);
+    int (*equal)(const void *a, const void *b);
+};
+
+static int generic_map_put(struct generic_map *m, const void *key, const void *value) {
+    if ((m->len + 1) * 4 > m->cap * 3) {
+        struct generic_map bigger = *m;
+        bigger.cap = m->cap ? m->cap * 2 : 16;
+        bigger.keys = malloc(bigger.cap * m->key_size);
+        bigger.values = malloc(bigger.cap * m->value_size);
+        bigger.used = calloc(bigger.cap, 1);
+        if (!bigger.keys || !bigger.values || !bigger.used)
+            return -1;
+        bigger.len = 0;
+        for (size_t i = 0; i < m->cap; i++) {
+            if (m->used[i])
+                generic_map_put(&bigger, m->keys + i * m->key_size, m->values + i * m->value_size);
+        }
+        free(m->keys);
+        free(m->values);
+        free(m->used);
+        *m = bigger;
+    }
+    size_t i = m->hash(key) & (m->cap - 1);
+    for (; m->used[i]; i = (i + 1) & (m->cap - 1)) {
+        if (m->equal(m->keys + i * m->key_size, key)) {
+            memcpy(m->values + i * m->value_size, value, m->value_size);
+            return 0;
+        }
+    }
+    memcpy(m->keys + i * m->key_size, key, m->key_size);
+    memcpy(m->values + i * m->value_size, value, m->value_size);
+    m->used[i] = 1;
+    m->len++;
+    return 0;
+}
+
+static void *generic_map_get(const struct generic_map *m, const void *key) {
+    for (size_t i = m->hash(key) & (m->cap - 1); m->used[i]; i = (i + 1) & (m->cap - 1)) {
+        if (m->equal(m->keys + i * m->key_size, key))
+            return m->values + i * m->value_size;
+    }
+    return NULL;
+}
+
+struct generic_heap {
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+    size_t size;
+    int (*compare)(const void *a, const void *b);
+};
+
+static void generic_swap(unsigned char *a, unsigned char *b, size_t size) {
+    unsigned char tmp[64];
+    memcpy(tmp, a, size);
+    memcpy(a, b, size);
+    memcpy(b, tmp, size);
+}
+
+static int generic_heap_push(struct generic_heap *h, const void *elem) {
+    if (h->len == h->cap) {
+        size_t cap = h->cap ? h->cap * 2 : 16;
+        unsigned char *data = realloc(h->data, cap * h->size);
+        if (!data)
+            return -1;
+        h->data = data;
+        h->cap = cap;
+    }
+    size_t i = h->len++;
+    memcpy(h->data + i * h->size, elem, h->size);
+    for (; i > 0 && h->compare(h->data + i * h->size, h->data + (i - 1) / 2 * h->size) < 0; i = (i - 1) / 2)
+        generic_swap(h->data + i * h->size, h->data + (i - 1) / 2 * h->size, h->size);
+    return 0;
+}
+
+static void generic_heap_pop(struct generic_heap *h, void *out) {
+    size_t i = 0, n = --h->len, size = h->size;
+    memcpy(out, h->data, size);
+    memcpy(h->data, h->data + n * size, size);
+    for (size_t child; (child = 2 * i + 1) < n; i = child) {
+        if (child + 1 < n && h->compare(h->data + (child + 1) * size, h->data + child * size) < 0)
+            child++;
+        if (h->compare(h->data + child * size, h->data + i * size) >= 0)
+            break;
+        generic_swap(h->data + i * size, h->data + child * size, size);
+    }
+}
+
+static int compare_int(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t hash_int(const void *key) {
+    return DEFAULT_HASH(*(const int *)key) >> 32;
+}
+
+static int equal_int(const void *a, const void *b) {
+    return *(const int *)a == *(const int *)b;
+}
+
+static double elapsed_ms(struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double ms = (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+    *start = now;
+    return ms;
+}
+
+/**
+ * @brief Times vec_int, hashmap_int_int and heap_int against the void* containers, qsort() and
+ * bsearch() on n random ints, and checks that both sides agree.
+ *
+ * @param n The number of elements.
+ * @return 0 if the results agree.
+ */
+int container_bench_main(size_t n) {
+    vec_int vec;
+    hashmap_int_int map;
+    heap_int heap;
+    struct generic_vec gvec = { NULL, 0, 0, sizeof(int) };
+    struct generic_map gmap = { NULL, NULL, NULL, 0, 0, sizeof(int), sizeof(int), hash_int, equal_int };
+    struct generic_heap gheap = { NULL, 0, 0, sizeof(int), compare_int };
+    struct timespec t;
+    double ms[2];
+    long long sum[2] = { 0, 0 };
+    int ok = 1;
+    uint64_t x = 88172645463325252ull;
+
+    vec_int_init(&vec);
+    hashmap_int_int_init(&map);
+    heap_int_init(&heap);
+    int *input = malloc(n * sizeof(int));
+    if (!input)
+        return 1;
+    for (size_t i = 0; i < n; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        input[i] = (int)(x >> 33);
+    }
+    printf("%zu random ints       generated      void*  speedup\n", n);
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    for (size_t i = 0; i < n; i++)
+        vec_int_push(&vec, input[i]);
+    ms[0] = elapsed_ms(&t);
+    for (size_t i = 0; i < n; i++)
+        generic_vec_push(&gvec, &input[i]);
+    ms[1] = elapsed_ms(&t);
+    printf("push              %9.1f ms %9.1f ms %7.2fx\n", ms[0], ms[1], ms[1] / ms[0]);
+
+    vec_int_sort(&vec);
+    ms[0] = elapsed_ms(&t);
+    qsort(gvec.data, gvec.len, sizeof(int), compare_int);
+    ms[1] = elapsed_ms(&t);
+    ok &= memcmp(vec.data, gvec.data, n * sizeof(int)) == 0;
+    printf("sort / qsort      %9.1f ms %9.1f ms %7.2fx\n", ms[0], ms[1], ms[1] / ms[0]);
+
+    for (size_t i = 0; i < n; i++) {
+        int key = input[i] ^ (int)(i & 1);  // about half are absent
+        int *found = vec_int_bsearch(&vec, key);
+        sum[0] += found ? *found : -1;
+    }
+    ms[0] = elapsed_ms(&t);
+    for (size_t i = 0; i < n; i++) {
+        int key = input[i] ^ (int)(i & 1);
+        int *found = bsearch(&key, gvec.data, gvec.len, sizeof(int), compare_int);
+        sum[1] += found ? *found : -1;
+    }
+    ms[1] = elapsed_ms(&t);
+    ok &= sum[0] == sum[1];
+    printf("bsearch           %9.1f ms %9.1f ms %7.2fx\n", ms[0], ms[1], ms[1] / ms[0]);
+
+    for (size_t i = 0; i < n; i++)
+        hashmap_int_int_put(&map, input[i], (int)i);
+    ms[0] = elapsed_ms(&t);
+    for (size_t i = 0; i < n; i++) {
+        int value = (int)i;
+        generic_map_put(&gmap, &input[i], &value);
+    }
+    ms[1] = elapsed_ms(&t);
+    printf("map put           %9.1f ms %9.1f ms %7.2fx\n", ms[0], ms[1], ms[1] / ms[0]);
+
+    sum[0] = sum[1] = 0;
+    for (size_t i = 0; i < n; i++) {
+        int *value = hashmap_int_int_get(&map, input[i] ^ (int)(i & 1));
+        sum[0] += value ? *value : -1;
+    }
+    ms[0] = elapsed_ms(&t);
+    for (size_t i = 0; i < n; i++) {
+        int key = input[i] ^ (int)(i & 1);
+        int *value = generic_map_get(&gmap, &key);
+        sum[1] += value ? *value : -1;
+    }
+    ms[1] = elapsed_ms(&t);
+    ok &= sum[0] == sum[1] && map.len == gmap.len;
+    printf("map get           %9.1f ms %9.1f ms %7.2fx\n", ms[0], ms[1], ms[1] / ms[0]);
+
+    // Erase every other key, then check that those are gone and every remaining entry is reachable
+    size_t erased = 0;
+    for (size_t i = 0; i < n; i += 2)
+        erased += hashmap_int_int_erase(&map, input[i]);
+    for (size_t i = 0; i < n; i += 2)
+        ok &= hashmap_int_int_get(&map, input[i]) == NULL;
+    for (size_t i = 0; i < map.cap; i++)
+        ok &= !map.used[i] || hashmap_int_int_get(&map, map.keys[i]) == &map.values[i];
+    ok &= map.len == gmap.len - erased;
+    elapsed_ms(&t);
+
+    for (size_t i = 0; i < n; i++)
+        heap_int_push(&heap, input[i]);
+    for (size_t i = 0; i < n; i++)
+        ok &= heap_int_pop(&heap) == vec.data[i];
+    ms[0] = elapsed_ms(&t);
+    for (size_t i = 0; i < n; i++)
+        generic_heap_push(&gheap, &input[i]);
+    for (size_t i = 0; i < n; i++) {
+        int top;
+        generic_heap_pop(&gheap, &top);
+        ok &= top == vec.data[i];
+    }
+    ms[1] = elapsed_ms(&t);
+    printf("heap push + pop   %9.1f ms %9.1f ms %7.2fx\n", ms[0], ms[1], ms[1] / ms[0]);
+
+    if (!ok)
+        fprintf(stderr, "generated and void* containers disagree\n");
+    vec_int_free(&vec);
+    hashmap_int_int_free(&map);
+    heap_int_free(&heap);
+    free(gvec.data);
+    free(gmap.keys);
+    free(gmap.values);
+    free(gmap.used);
+    free(gheap.data);
+    free(input);
+    return !ok;
+}
+
+// Example 7: Unrolled Kernels
 /**
- * @brief Recursive macro for looping from 0 to n.
+ * @brief Defines dot_N(a, b), the dot product of two float arrays of length N, fully unrolled.
+ *
+ * The terms go to 16 accumulators in turn, which the compiler keeps in vector registers, so several
+ * additions are in flight instead of one chain; the sum is rounded differently from a running total.
  *
- * @param n The number to loop to.
+ * @param N The length, a literal up to 256.
  */
-#define LOOP(n) LOOP_##n
+#define DEFINE_DOT(N)                                                                                    \
+    static inline float CONCAT(dot_, N)(const float *a, const float *b) {                                \
+        float acc[16] = { 0.0f };                                                                        \
+        REPEAT(N, DOT_TERM, ~)                                                                           \
+        return 0.0f REPEAT(16, DOT_SUM, ~);                                                              \
+    }
+#define DOT_TERM(i, _) acc[(i) % 16] += a[i] * b[i];
+#define DOT_SUM(i, _) + acc[i]
 
 /**
- * @brief Loop from 0 to 0.
+ * @brief Defines mat_mul_N(c, a, b), c = a * b for row-major N x N float matrices, fully unrolled.
+ *
+ * Each of the N * N cells is a column dot product from col_dot_N(), which the compiler inlines, so
+ * every index is a constant. The terms of a cell are added in the same order as the rolled loop.
+ *
+ * @param N The order, a literal; N * N must also be a literal up to 256, passed as NN.
  */
-#define LOOP_0 printf("0\n");
+#define DEFINE_MAT_MUL(N, NN)                                                                            \
+    static inline float CONCAT(col_dot_, N)(const float *row, const float *col) {                        \
+        return 0.0f REPEAT(N, COL_DOT_TERM, N);                                                          \
+    }                                                                                                    \
+    static inline void CONCAT(mat_mul_, N)(float *restrict c, const float *a, const float *b) {          \
+        REPEAT(NN, MAT_MUL_CELL, N)                                                                      \
+    }
+#define COL_DOT_TERM(k, n) + row[k] * col[(k) * (n)]
+#define MAT_MUL_CELL(i, n) c[i] = CONCAT(col_dot_, n)(&a[(i) / (n) * (n)], &b[(i) % (n)]);
+
+DEFINE_DOT(64)
+DEFINE_MAT_MUL(4, 16)
+DEFINE_MAT_MUL(8, 64)
 
 /**
- * @brief Loop from 1 to n.
+ * @brief CRC-32 (IEEE 802.3, reflected) lookup table, computed entirely by the preprocessor and the
+ * compiler, so it is in read-only data with nothing to initialize at run time.
  */
-#define LOOP_1 LOOP_0 printf("1\n");
+#define CRC32_STEP(c) (((c) >> 1) ^ ((c) & 1 ? 0xEDB88320u : 0))
+#define CRC32_ENTRY(i, _) \
+    CRC32_STEP(CRC32_STEP(CRC32_STEP(CRC32_STEP(CRC32_STEP(CRC32_STEP(CRC32_STEP(CRC32_STEP((uint32_t)(i))))))))),
+
+static const uint32_t crc32_table[256] = { REPEAT(256, CRC32_ENTRY, ~) };
 
 /**
- * @brief Loop from 2 to n.
+ * @brief Compile-time table of the names of an enum, generated from the same list as the values.
  */
-#define LOOP_2 LOOP_1 printf("2\n");
+#define KERNEL_NAME(i, _, name) [i] = #name,
+static const char *const kernel_names[] = { FOR_EACH(KERNEL_NAME, ~, dot_64, mat_mul_4, mat_mul_8, crc32) };
+
+// Kernel Benchmark
+static float dot_rolled(const float *a, const float *b, int n) {
+    float sum = 0.0f;
+    for (int i = 0; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+static void mat_mul_rolled(float *restrict c, const float *a, const float *b, int n) {
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            float sum = 0.0f;
+            for (int k = 0; k < n; k++)
+                sum += a[i * n + k] * b[k * n + j];
+            c[i * n + j] = sum;
+        }
+    }
+}
+
+static uint32_t crc32_runtime_table[256];
+
+static void crc32_fill(uint32_t *table) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = CRC32_STEP(c);
+        table[i] = c;
+    }
+}
+
+static uint32_t crc32_bitwise(const unsigned char *p, size_t len) {
+    uint32_t crc = 0xFFFFFFFFu;
+    while (len--) {
+        crc ^= *p++;
+        for (int k = 0; k < 8; k++)
+            crc = CRC32_STEP(crc);
+    }
+    return ~crc;
+}
+
+static inline uint32_t crc32_with(const uint32_t *table, const unsigned char *p, size_t len) {
+    uint32_t crc = 0xFFFFFFFFu;
+    while (len--)
+        crc = (crc >> 8) ^ table[(crc ^ *p++) & 0xFF];
+    return ~crc;
+}
+
+static uint32_t crc32_lookup(const unsigned char *p, size_t len) {
+    return crc32_with(crc32_table, p, len);
+}
+
+static uint32_t crc32_lookup_runtime(const unsigned char *p, size_t len) {
+    return crc32_with(crc32_runtime_table, p, len);
+}
 
 /**
- * @brief Loop from 3 to n.
+ * @brief Times the generated kernels against rolled loops whose size is only known at run time, and
+ * the compile-time CRC-32 table against the same lookup over a table filled at run time, and checks
+ * that they compute the same results.
+ *
+ * @param iterations The number of calls of each kernel.
+ * @return 0 if the results agree.
  */
-#define LOOP_3 LOOP_2 printf("3\n");
+int kernel_bench_main(long iterations) {
+    static float a[256], b[256], c[2][64];
+    static unsigned char data[1 << 16];
+    volatile float sink = 0;
+    struct timespec t;
+    double ns[2];
+    int ok = 1, n = iterations > 0 ? 64 : 0;  // keeps the rolled sizes opaque to the compiler
+
+    for (int i = 0; i < 256; i++) {
+        a[i] = (float)((i * 37) % 101) / 16 - 3;
+        b[i] = (float)((i * 53) % 97) / 32 - 1;
+    }
+    for (size_t i = 0; i < sizeof(data); i++)
+        data[i] = (unsigned char)(i * 2654435761u >> 13);
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    crc32_fill(crc32_runtime_table);
+    double fill_ns = elapsed_ms(&t) * 1e6;
+
+    printf("%-10s %12s %12s %8s   (ns per call)\n", "", "generated", "rolled", "speedup");
+    for (int k = 0; k < 4; k++) {
+        long calls = k == 3 ? iterations / 1000 + 1 : iterations;
+        for (int rolled = 0; rolled < 2; rolled++) {
+            clock_gettime(CLOCK_MONOTONIC, &t);
+            for (long i = 0; i < calls; i++) {
+                a[i & 63] += 1.0f / 1024;  // a new input each call
+                switch (k) {
+                    case 0:
+                        sink = rolled ? dot_rolled(a, b, n) : dot_64(a, b);
+                        break;
+                    case 1:
+                        rolled ? mat_mul_rolled(c[1], a, b, n / 16) : mat_mul_4(c[0], a, b);
+                        break;
+                    case 2:
+                        rolled ? mat_mul_rolled(c[1], a, b, n / 8) : mat_mul_8(c[0], a, b);
+                        break;
+                    default:
+                        sink = (float)(rolled ? crc32_lookup_runtime(data, sizeof(data)) : crc32_lookup(data, sizeof(data)));
+                        break;
+                }
+            }
+            ns[rolled] = elapsed_ms(&t) * 1e6 / calls;
+        }
+        printf("%-10s %12.1f %12.1f %7.2fx\n", kernel_names[k], ns[0], ns[1], ns[1] / ns[0]);
+    }
+    printf("crc32 rolled: the same lookup over a table filled at run time, which took %.0f ns\n", fill_ns);
+    (void) sink;
 
+    // The same inputs must give the same results
+    float dot = dot_64(a, b), expected = dot_rolled(a, b, 64);
+    ok &= fabsf(dot - expected) <= 1e-4f * (fabsf(expected) + 64);
+    mat_mul_4(c[0], a, b);
+    mat_mul_rolled(c[1], a, b, 4);
+    ok &= memcmp(c[0], c[1], 16 * sizeof(float)) == 0;
+    mat_mul_8(c[0], a, b);
+    mat_mul_rolled(c[1], a, b, 8);
+    ok &= memcmp(c[0], c[1], 64 * sizeof(float)) == 0;
+    ok &= crc32_lookup((const unsigned char *)"123456789", 9) == 0xCBF43926u;
+    ok &= memcmp(crc32_table, crc32_runtime_table, sizeof(crc32_table)) == 0;
+    ok &= crc32_lookup(data, sizeof(data)) == crc32_bitwise(data, sizeof(data));
+    if (!ok)
+        fprintf(stderr, "generated and rolled kernels disagree\n");
+    return !ok;
+}
+
+// Example 8: Compile-Time Log Levels and Tracing
 /**
- * @brief Loop from 4 to n.
+ * @brief Log levels. Sites above TRACE_LEVEL are compiled out.
+ *
+ * TRACE_LEVEL defaults to DEBUG when DEBUG is set and INFO otherwise; override it with
+ * -DTRACE_LEVEL=TRACE_LEVEL_WARN and the like.
  */
-#define LOOP_4 LOOP_3 printf("4\n");
+#define TRACE_LEVEL_ERROR 1
+#define TRACE_LEVEL_WARN 2
+#define TRACE_LEVEL_INFO 3
+#define TRACE_LEVEL_DEBUG 4
+#define TRACE_LEVEL_TRACE 5
+
+#ifndef TRACE_LEVEL
+    #define TRACE_LEVEL (DEBUG ? TRACE_LEVEL_DEBUG : TRACE_LEVEL_INFO)
+#endif
 
 /**
- * @brief Loop from 5 to n.
+ * @brief Subsystems, one bit each: TRACE_SUB_CORE, TRACE_SUB_NET, ...
+ *
+ * Sites of subsystems outside TRACE_MASK are compiled out, e.g. -DTRACE_MASK=TRACE_SUB_NET.
  */
-#define LOOP_5 LOOP_4 printf("5\n");
+#define TRACE_SUBSYSTEMS CORE, NET, STORAGE
+#define TRACE_SUB_BIT(i, _, name) CONCAT(TRACE_SUB_, name) = 1u << (i),
+enum trace_subsystem { FOR_EACH(TRACE_SUB_BIT, ~, TRACE_SUBSYSTEMS) };
+
+#ifndef TRACE_MASK
+    #define TRACE_MASK (~0u)
+#endif
 
 /**
- * @brief Loop from 6 to n.
+ * @brief Whether a site is compiled in; an integer constant expression.
+ *
+ * @param level ERROR, WARN, INFO, DEBUG or TRACE.
+ * @param sub A subsystem from TRACE_SUBSYSTEMS.
  */
-#define LOOP_6 LOOP_5 printf("6\n");
+#define TRACE_ENABLED(level, sub) TRACE_ENABLED_(TRACE_LEVEL_ ## level, TRACE_SUB_ ## sub)
+#define TRACE_ENABLED_(level, sub) ((level) <= TRACE_LEVEL && ((sub) & (TRACE_MASK)) != 0)
+
+// A call site, one static object per site; id is unique within the file
+struct trace_site {
+    const char *name;
+    const char *category;
+    const char *file;
+    int line;
+    int id;
+    char phase;  // Chrome trace event type: 'B' begin, 'E' end, 'i' instant, 'C' counter
+};
+
+struct trace_event {
+    uint64_t time;  // trace_clock() ticks
+    const struct trace_site *site;
+    int64_t value;
+    uint32_t thread;
+};
+
+#define TRACE_CAPACITY (1u << 16)  // events kept, a power of two; older ones are overwritten
+
+static struct trace_event trace_buffer[TRACE_CAPACITY];
+static atomic_ullong trace_next;
+static atomic_uint trace_threads;
+static _Thread_local uint32_t trace_thread;
+
+#if defined(__x86_64__) || defined(__i386__)
+static inline uint64_t trace_clock(void) {
+    return __rdtsc();
+}
+#else
+static inline uint64_t trace_clock(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+#endif
+
+/**
+ * @brief Appends an event to the trace buffer. Called by the TRACE_ macros.
+ *
+ * @param site The call site.
+ * @param value The value of a counter, 0 for other events.
+ */
+static inline void trace_record(const struct trace_site *site, int64_t value) {
+    uint64_t i = atomic_fetch_add_explicit(&trace_next, 1, memory_order_relaxed);
+    struct trace_event *event = &trace_buffer[i & (TRACE_CAPACITY - 1)];
+
+    if (!trace_thread)
+        trace_thread = atomic_fetch_add_explicit(&trace_threads, 1, memory_order_relaxed) + 1;
+    event->time = trace_clock();
+    event->site = site;
+    event->value = value;
+    event->thread = trace_thread;
+}
+
+/**
+ * @brief Records an event at a call site if the site is enabled; otherwise the condition is the
+ * constant 0 and the compiler drops the site, while still checking that its arguments compile.
+ *
+ * The level and subsystem names are pasted by the TRACE_ macros themselves, before they could be
+ * expanded: DEBUG is also a macro.
+ *
+ * @param level A TRACE_LEVEL_ value.
+ * @param sub A TRACE_SUB_ value.
+ * @param category The subsystem name as a string.
+ * @param name The event name, a string literal.
+ * @param phase The Chrome trace event type.
+ * @param value The recorded value.
+ */
+#define TRACE_AT(level, sub, category, name, phase, value)                                               \
+    do {                                                                                                 \
+        if (TRACE_ENABLED_(level, sub)) {                                                                \
+            static const struct trace_site trace_site_ = { name, category, __FILE__, __LINE__,           \
+                                                           __COUNTER__, phase };                         \
+            trace_record(&trace_site_, (int64_t)(value));                                                \
+        }                                                                                                \
+    } while (0)
+
+#define TRACE_EVENT(level, sub, name) TRACE_AT(TRACE_LEVEL_ ## level, TRACE_SUB_ ## sub, #sub, name, 'i', 0)
+#define TRACE_VALUE(level, sub, name, value) \
+    TRACE_AT(TRACE_LEVEL_ ## level, TRACE_SUB_ ## sub, #sub, name, 'C', value)
+#define TRACE_BEGIN(level, sub, name) TRACE_AT(TRACE_LEVEL_ ## level, TRACE_SUB_ ## sub, #sub, name, 'B', 0)
+#define TRACE_END(level, sub, name) TRACE_AT(TRACE_LEVEL_ ## level, TRACE_SUB_ ## sub, #sub, name, 'E', 0)
+
+/**
+ * @brief printf() if the site is enabled, also recorded as an instant event named by the format.
+ *
+ * @param level ERROR, WARN, INFO, DEBUG or TRACE.
+ * @param sub A subsystem from TRACE_SUBSYSTEMS.
+ */
+#define LOG(level, sub, ...)                                                                             \
+    do {                                                                                                 \
+        if (TRACE_ENABLED_(TRACE_LEVEL_ ## level, TRACE_SUB_ ## sub)) {                                  \
+            TRACE_AT(TRACE_LEVEL_ ## level, TRACE_SUB_ ## sub, #sub, FIRST(__VA_ARGS__), 'i', 0);         \
+            printf(__VA_ARGS__);                                                                         \
+        }                                                                                                \
+    } while (0)
+
+/**
+ * @brief The DEBUG_PRINT conversion for each type. Types not listed must be pointers, printed with %p.
+ */
+#define DEBUG_TYPES(M, x)                                                                                \
+    M(char, "%c", x)                                                                                     \
+    M(signed char, "%d", x)                                                                              \
+    M(unsigned char, "%d", x)                                                                            \
+    M(short, "%d", x)                                                                                    \
+    M(unsigned short, "%d", x)                                                                           \
+    M(_Bool, "%d", x)                                                                                    \
+    M(int, "%d", x)                                                                                      \
+    M(unsigned, "%u", x)                                                                                 \
+    M(long, "%ld", x)                                                                                    \
+    M(unsigned long, "%lu", x)                                                                           \
+    M(long long, "%lld", x)                                                                              \
+    M(unsigned long long, "%llu", x)                                                                     \
+    M(float, "%g", x)                                                                                    \
+    M(double, "%g", x)                                                                                   \
+    M(long double, "%Lg", x)                                                                             \
+    M(char *, "%s", x)                                                                                   \
+    M(const char *, "%s", x)
+#define DEBUG_FORMAT_CASE(type, conversion, x) type: "Debug: %s = " conversion "\n",
+#define DEBUG_ARG_CASE(type, conversion, x) type: (x),
+
+/**
+ * @brief The DEBUG_PRINT format for the type of x.
+ */
+#define DEBUG_FORMAT(x) _Generic((x), DEBUG_TYPES(DEBUG_FORMAT_CASE, x) default: "Debug: %s = %p\n")
 
 /**
- * @brief Loop from 7 to n.
+ * @brief x as DEBUG_FORMAT(x) expects it: unchanged, or a pointer converted to const void * for %p.
+ *
+ * Every association must compile for every x, so the pointer goes through uintptr_t.
  */
-#define LOOP_7 LOOP_6 printf("7\n");
+#define DEBUG_ARG(x) _Generic((x), DEBUG_TYPES(DEBUG_ARG_CASE, x) default: (const void *)(uintptr_t)(x))
+
+static void trace_json_string(FILE *out, const char *s) {
+    putc('"', out);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            putc('\\', out);
+        if ((unsigned char)*s >= 0x20)
+            putc(*s, out);
+    }
+    putc('"', out);
+}
 
 /**
- * @brief Loop from 8 to n.
+ * @brief Writes the buffered events as Chrome trace-event JSON, for chrome://tracing or Perfetto.
+ *
+ * Call it while no thread is tracing. Ticks are converted to microseconds with a rate measured over
+ * 10 ms here, which is enough for a constant-rate TSC.
+ *
+ * @param out The stream to write to.
+ * @return The number of events written.
  */
-#define LOOP_8 LOOP_7 printf("8\n");
+size_t trace_export_json(FILE *out) {
+    uint64_t next = atomic_load(&trace_next);
+    uint64_t first = next > TRACE_CAPACITY ? next - TRACE_CAPACITY : 0;
+    struct timespec start, end, pause = { 0, 10000000 };
+    double us_per_tick;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t tick0 = trace_clock();
+    nanosleep(&pause, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    uint64_t tick1 = trace_clock();
+    us_per_tick = ((end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3) / (tick1 - tick0);
+
+    // Slots are taken before the clock is read, so the first slot need not hold the earliest time
+    uint64_t base = UINT64_MAX;
+    for (uint64_t i = first; i < next; i++)
+        if (trace_buffer[i & (TRACE_CAPACITY - 1)].time < base)
+            base = trace_buffer[i & (TRACE_CAPACITY - 1)].time;
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (uint64_t i = first; i < next; i++) {
+        const struct trace_event *event = &trace_buffer[i & (TRACE_CAPACITY - 1)];
+        const struct trace_site *site = event->site;
+
+        fprintf(out, "%s\n{\"name\":", i == first ? "" : ",");
+        trace_json_string(out, site->name);
+        fprintf(out, ",\"cat\":");
+        trace_json_string(out, site->category);
+        fprintf(out, ",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,", site->phase,
+                (event->time - base) * us_per_tick, event->thread);
+        if (site->phase == 'C') {
+            // Every argument of a counter is plotted, so it gets only the value
+            fprintf(out, "\"args\":{");
+            trace_json_string(out, site->name);
+            fprintf(out, ":%lld}}", (long long)event->value);
+            continue;
+        }
+        if (site->phase == 'i')
+            fprintf(out, "\"s\":\"t\",");
+        fprintf(out, "\"args\":{\"site\":%d,\"line\":%d,\"file\":", site->id, site->line);
+        trace_json_string(out, site->file);
+        fprintf(out, "}}");
+    }
+    fprintf(out, "\n]}\n");
+    return (size_t)(next - first);
+}
 
 /**
- * @brief Loop from 9 to n.
+ * @brief Runs a small instrumented workload and writes its trace.
+ *
+ * @param path Where to write the JSON.
+ * @return 0 on success.
  */
-#define LOOP_9 LOOP_8 printf("9\n");
+int trace_demo_main(const char *path) {
+    FILE *out = fopen(path, "w");
+    vec_int v;
+
+    if (!out) {
+        perror(path);
+        return 1;
+    }
+    vec_int_init(&v);
+    LOG(INFO, CORE, "tracing to %s\n", path);
+    for (int round = 0; round < 4; round++) {
+        TRACE_BEGIN(INFO, STORAGE, "fill");
+        for (int i = 0; i < 200000; i++)
+            vec_int_push(&v, (int)((unsigned)i * 2654435761u >> 1));
+        TRACE_END(INFO, STORAGE, "fill");
+        TRACE_VALUE(DEBUG, STORAGE, "elements", v.len);
+
+        TRACE_BEGIN(INFO, CORE, "sort");
+        vec_int_sort(&v);
+        TRACE_END(INFO, CORE, "sort");
+        TRACE_EVENT(DEBUG, NET, "round done");
+        TRACE_VALUE(TRACE, CORE, "never recorded at the default level", round);
+    }
+    vec_int_free(&v);
+    size_t events = trace_export_json(out);
+    fclose(out);
+    printf("%zu events written to %s\n", events, path);
+    return 0;
+}
+
+/**
+ * @brief Compares the cost of an enabled trace site, a compiled-out one and a DEBUG_PRINT-style
+ * printf to /dev/null.
+ *
+ * @param n The number of calls of each.
+ * @return 0 if the compiled-out site recorded nothing.
+ */
+int trace_bench_main(long n) {
+    FILE *devnull = fopen("/dev/null", "w");
+    struct timespec t;
+    double ns[3];
+
+    if (!devnull)
+        return 1;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    for (long i = 0; i < n; i++)
+        TRACE_VALUE(INFO, CORE, "enabled", i);
+    ns[0] = elapsed_ms(&t) * 1e6 / n;
+    uint64_t before = atomic_load(&trace_next);
+    for (long i = 0; i < n; i++) {
+        TRACE_VALUE(TRACE, CORE, "compiled out", i);
+        __asm__ volatile("" ::: "memory");  // keep the empty loop
+    }
+    ns[1] = elapsed_ms(&t) * 1e6 / n;
+    int ok = TRACE_ENABLED(TRACE, CORE) || atomic_load(&trace_next) == before;
+    for (long i = 0; i < n; i++)
+        fprintf(devnull, DEBUG_FORMAT(i), "i", DEBUG_ARG(i));
+    ns[2] = elapsed_ms(&t) * 1e6 / n;
+    fclose(devnull);
+
+    printf("ns per call: enabled trace site %.1f, %s site %.1f, printf %.1f\n", ns[0],
+           TRACE_ENABLED(TRACE, CORE) ? "TRACE level" : "compiled-out", ns[1], ns[2]);
+    return !ok;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "bench-containers") == 0)
+        return container_bench_main(argc > 2 ? strtoull(argv[2], NULL, 0) : 4000000);
+    if (argc > 1 && strcmp(argv[1], "bench-kernels") == 0)
+        return kernel_bench_main(argc > 2 ? atol(argv[2]) : 10000000);
+    if (argc > 1 && strcmp(argv[1], "trace") == 0)
+        return trace_demo_main(argc > 2 ? argv[2] : "trace.json");
+    if (argc > 1 && strcmp(argv[1], "bench-trace") == 0)
+        return trace_bench_main(argc > 2 ? atol(argv[2]) : 10000000);
 
-int main() {
     // Example 1: Conditional Compilation
     int value = 42;
     DEBUG_PRINT(value);
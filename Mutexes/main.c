@@ -6,8 +6,28 @@
 // A mutex can be locked and unlocked by threads to ensure that only one 
 //  thread accesses the critical section of code at a time.
 
+// Build: gcc -O2 -pthread main.c -o mutexes
+// Run without arguments for the basic example. Other modes:
+//   bench [max_threads] [ms]   compare the lock implementations below
+//   profile [threads]          run a contended workload on profiled locks and dump them
+//   prof-overhead [n]          cost of lock profiling on uncontended lock/unlock
+//   bench-pool [tasks] [work] [workers]  thread pool vs a thread per task
+//   bench-map [max_threads] [ms]  concurrent hash map vs a mutex-guarded map
+
+#define _GNU_SOURCE  // syscall()
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 
 // Mutex to protect the shared resource
 pthread_mutex_t mutex;
@@ -34,11 +54,2334 @@ void* thread_function(void* arg) {
     return NULL;
 }
 
+// Lock Library
+
+// A default pthread_mutex_t convoys once many threads hit it. The locks below
+//  trade off differently and all sit behind one interface (struct lock):
+// - Ticket lock: FIFO fair; every waiter spins on the same cache line.
+// - MCS lock: FIFO fair; each waiter spins on its own queue node, so a release
+//   touches only the next waiter's cache line.
+// - Adaptive lock: spins briefly in case the holder is about to release, then
+//   sleeps in the kernel on a futex. Not fair, but cheap when the owner is
+//   descheduled or the critical section is long.
+
+#define SPIN_BEFORE_YIELD 1024  // Pause iterations before a spinning waiter yields its core
+#define ADAPTIVE_SPIN_MAX 512   // Upper bound on the adaptive lock's spin phase
+
 /**
- * Main function that creates multiple threads and protects the shared resource with a mutex
- * @return 0 on success
+ * Read the monotonic clock in nanoseconds
+ */
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * Tell the CPU we are in a spin-wait loop
+ */
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield" ::: "memory");
+#else
+    __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+/**
+ * Back off inside a spin loop, giving the core away after a while so an
+ * oversubscribed machine still makes progress
+ * @param spins Iterations spun so far; incremented
+ */
+static inline void spin_wait(unsigned int *spins) {
+    if (++*spins < SPIN_BEFORE_YIELD) {
+        cpu_relax();
+    } else {
+        *spins = 0;
+        sched_yield();
+    }
+}
+
+enum lock_kind {
+    LOCK_PTHREAD,
+    LOCK_TICKET,
+    LOCK_MCS,
+    LOCK_ADAPTIVE,
+    LOCK_KIND_COUNT
+};
+
+static const char *const lock_kind_names[LOCK_KIND_COUNT] = { "pthread", "ticket", "mcs", "adaptive" };
+
+/**
+ * Ticket lock: take a number, wait until it is served
+ */
+struct ticket_lock {
+    atomic_uint next;
+    atomic_uint serving;
+};
+
+/**
+ * MCS queue node; one per waiting or holding thread, usually on its stack
+ */
+struct lock_node {
+    struct lock_node *_Atomic next;
+    atomic_int locked;
+};
+
+/**
+ * MCS lock: a pointer to the tail of the queue of waiters
+ */
+struct mcs_lock {
+    struct lock_node *_Atomic tail;
+};
+
+/**
+ * Adaptive lock: 0 unlocked, 1 locked, 2 locked with sleepers
+ */
+struct adaptive_lock {
+    atomic_int state;
+    atomic_int spin_limit;  // Current length of the spin phase, tuned on every acquisition
+};
+
+/**
+ * A lock of any kind
+ */
+struct lock {
+    enum lock_kind kind;
+    union {
+        pthread_mutex_t mutex;
+        struct ticket_lock ticket;
+        struct mcs_lock mcs;
+        struct adaptive_lock adaptive;
+    };
+};
+
+/**
+ * futex(2) wrappers; glibc provides no function for them
+ */
+static void futex_wait(atomic_int *addr, int expected) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static void futex_wake(atomic_int *addr, int count) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+static void ticket_lock_acquire(struct ticket_lock *l) {
+    unsigned int ticket = atomic_fetch_add_explicit(&l->next, 1, memory_order_relaxed);
+    unsigned int spins = 0;
+
+    while (atomic_load_explicit(&l->serving, memory_order_acquire) != ticket)
+        spin_wait(&spins);
+}
+
+static void ticket_lock_release(struct ticket_lock *l) {
+    // Only the holder writes serving, so a plain increment is enough
+    unsigned int next = atomic_load_explicit(&l->serving, memory_order_relaxed) + 1;
+    atomic_store_explicit(&l->serving, next, memory_order_release);
+}
+
+static void mcs_lock_acquire(struct mcs_lock *l, struct lock_node *node) {
+    struct lock_node *prev;
+    unsigned int spins = 0;
+
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    atomic_store_explicit(&node->locked, 1, memory_order_relaxed);
+    prev = atomic_exchange_explicit(&l->tail, node, memory_order_acq_rel);
+    if (prev == NULL)
+        return;
+
+    // Queue behind prev and spin on our own node until it hands over
+    atomic_store_explicit(&prev->next, node, memory_order_release);
+    while (atomic_load_explicit(&node->locked, memory_order_acquire))
+        spin_wait(&spins);
+}
+
+static void mcs_lock_release(struct mcs_lock *l, struct lock_node *node) {
+    struct lock_node *next = atomic_load_explicit(&node->next, memory_order_acquire);
+    unsigned int spins = 0;
+
+    if (next == NULL) {
+        struct lock_node *expected = node;
+        if (atomic_compare_exchange_strong_explicit(&l->tail, &expected, NULL,
+                                                    memory_order_release, memory_order_relaxed))
+            return;
+        // A waiter swapped itself in but has not linked to us yet
+        while ((next = atomic_load_explicit(&node->next, memory_order_acquire)) == NULL)
+            spin_wait(&spins);
+    }
+    atomic_store_explicit(&next->locked, 0, memory_order_release);
+}
+
+/**
+ * Store a new spin limit for an adaptive lock, clamped to [1, ADAPTIVE_SPIN_MAX]
+ * @param l The lock
+ * @param limit The limit before clamping
+ */
+static void adaptive_set_spin_limit(struct adaptive_lock *l, int limit) {
+    if (limit < 1)
+        limit = 1;
+    else if (limit > ADAPTIVE_SPIN_MAX)
+        limit = ADAPTIVE_SPIN_MAX;
+    atomic_store_explicit(&l->spin_limit, limit, memory_order_relaxed);
+}
+
+static void adaptive_lock_acquire(struct adaptive_lock *l) {
+    int limit = atomic_load_explicit(&l->spin_limit, memory_order_relaxed);
+    int expected;
+
+    // Spin phase: only try the CAS when the lock looks free
+    for (int i = 0; i < limit * 2; ++i) {
+        expected = 0;
+        if (atomic_load_explicit(&l->state, memory_order_relaxed) == 0 &&
+            atomic_compare_exchange_weak_explicit(&l->state, &expected, 1,
+                                                  memory_order_acquire, memory_order_relaxed)) {
+            // Spinning paid off: move the limit towards how long it took
+            adaptive_set_spin_limit(l, limit + (i - limit) / 8 + 1);
+            return;
+        }
+        cpu_relax();
+    }
+    if (limit > 1)
+        adaptive_set_spin_limit(l, limit - limit / 8 - 1);
+
+    // Park phase: mark the lock contended and sleep until woken
+    while (atomic_exchange_explicit(&l->state, 2, memory_order_acquire) != 0)
+        futex_wait(&l->state, 2);
+}
+
+static void adaptive_lock_release(struct adaptive_lock *l) {
+    if (atomic_exchange_explicit(&l->state, 0, memory_order_release) == 2)
+        futex_wake(&l->state, 1);
+}
+
+/**
+ * Initialize a lock
+ * @param l The lock
+ * @param kind Which implementation to use
+ */
+void lock_init(struct lock *l, enum lock_kind kind) {
+    memset(l, 0, sizeof(*l));
+    l->kind = kind;
+    if (kind == LOCK_PTHREAD)
+        pthread_mutex_init(&l->mutex, NULL);
+    else if (kind == LOCK_ADAPTIVE)
+        atomic_store(&l->adaptive.spin_limit, ADAPTIVE_SPIN_MAX / 4);
+}
+
+/**
+ * Destroy a lock
+ * @param l The lock, which must be unlocked
+ */
+void lock_destroy(struct lock *l) {
+    if (l->kind == LOCK_PTHREAD)
+        pthread_mutex_destroy(&l->mutex);
+}
+
+/**
+ * Acquire a lock
+ * @param l The lock
+ * @param node Queue node for MCS locks; must stay valid until lock_release(). Ignored by other kinds
+ */
+void lock_acquire(struct lock *l, struct lock_node *node) {
+    switch (l->kind) {
+        case LOCK_PTHREAD: pthread_mutex_lock(&l->mutex); break;
+        case LOCK_TICKET: ticket_lock_acquire(&l->ticket); break;
+        case LOCK_MCS: mcs_lock_acquire(&l->mcs, node); break;
+        case LOCK_ADAPTIVE: adaptive_lock_acquire(&l->adaptive); break;
+        default: break;
+    }
+}
+
+/**
+ * Release a lock
+ * @param l The lock
+ * @param node The node passed to lock_acquire()
+ */
+void lock_release(struct lock *l, struct lock_node *node) {
+    switch (l->kind) {
+        case LOCK_PTHREAD: pthread_mutex_unlock(&l->mutex); break;
+        case LOCK_TICKET: ticket_lock_release(&l->ticket); break;
+        case LOCK_MCS: mcs_lock_release(&l->mcs, node); break;
+        case LOCK_ADAPTIVE: adaptive_lock_release(&l->adaptive); break;
+        default: break;
+    }
+}
+
+// Lock Profiling
+
+// struct prof_mutex is a drop-in for pthread_mutex_t that records, per lock:
+//  how often it was taken, how often the taker had to wait, and log2-bucketed
+//  histograms of wait time and hold time. Every thread writes only to its own
+//  stats buffer, so the instrumentation adds no shared cache-line traffic;
+//  prof_mutex_dump() sums the buffers of all threads, live or exited.
+//
+// An uncontended lock/unlock costs a trylock and a counter increment. Waits
+//  are always timed, since they are slow anyway; hold times are timed on one
+//  acquisition in PROF_HOLD_SAMPLE, which keeps timestamp reads (the TSC on
+//  x86, slow under virtualization) off the fast path. Timestamps are
+//  converted to nanoseconds only when dumping.
+//
+// Lock ids are recycled: prof_mutex_destroy() folds the lock's statistics
+//  into a per-name record, so short-lived locks sharing a name show up as
+//  one row. When a thread exits, its buffer is folded into a shared one and
+//  freed.
+
+#define PROF_MAX_LOCKS 256     // Profiled locks alive at the same time
+#define PROF_BUCKETS 40        // log2 histogram buckets (2^39 ticks is minutes)
+#define PROF_HOLD_SAMPLE 64    // Time the hold of one acquisition in this many (a power of two)
+#define PROF_NO_ID UINT32_MAX  // Id of a lock that could not be registered; it is not profiled
+
+/**
+ * A profiled mutex
+ */
+struct prof_mutex {
+    pthread_mutex_t mutex;
+    const char *name;
+    uint32_t id;
+    uint64_t acquired_at;  // Written and read only by the current holder; 0 if this hold is not sampled
+};
+
+/**
+ * One thread's statistics for one lock
+ */
+struct prof_lock_stats {
+    uint64_t acquisitions;
+    uint64_t contended;
+    uint64_t wait_ticks;
+    uint64_t hold_samples;  // Acquisitions whose hold time was measured
+    uint64_t hold_ticks;
+    uint64_t wait_hist[PROF_BUCKETS];
+    uint64_t hold_hist[PROF_BUCKETS];
+};
+
+/**
+ * A thread's stats buffer, linked into prof_threads while the thread runs
+ */
+struct prof_thread {
+    struct prof_lock_stats locks[PROF_MAX_LOCKS];
+    struct prof_thread *next;
+};
+
+/**
+ * Statistics of destroyed locks with the same name
+ */
+struct prof_retired {
+    const char *name;
+    struct prof_lock_stats total;
+    struct prof_retired *next;
+};
+
+// The registry, thread list and retired records change only on cold paths
+//  (init, destroy, thread start and exit, dump), all under prof_registry_lock
+static pthread_mutex_t prof_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct prof_mutex *prof_registry[PROF_MAX_LOCKS];
+static unsigned int prof_lock_count;  // Ids handed out so far, in use or free
+static uint32_t prof_free_ids[PROF_MAX_LOCKS];
+static unsigned int prof_free_count;
+static struct prof_thread *prof_threads;
+static struct prof_thread prof_exited;  // Sum of the buffers of exited threads
+static struct prof_retired *prof_retired;
+static pthread_key_t prof_thread_key;
+static pthread_once_t prof_thread_key_once = PTHREAD_ONCE_INIT;
+
+static _Thread_local struct prof_thread *prof_self;
+
+/**
+ * Read the profiling clock: TSC ticks on x86, nanoseconds elsewhere
+ */
+static inline uint64_t prof_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+/**
+ * Index of the log2 bucket for a duration
+ */
+static inline unsigned int prof_bucket(uint64_t ticks) {
+    unsigned int b = ticks ? 64 - __builtin_clzll(ticks) : 0;
+    return b < PROF_BUCKETS ? b : PROF_BUCKETS - 1;
+}
+
+/**
+ * Add to a counter that only this thread writes; readers use relaxed loads
+ */
+static inline void prof_add(uint64_t *counter, uint64_t value) {
+    __atomic_store_n(counter, *counter + value, __ATOMIC_RELAXED);
+}
+
+/**
+ * Add one lock's statistics to another; the caller holds prof_registry_lock
+ */
+static void prof_stats_add(struct prof_lock_stats *dst, const struct prof_lock_stats *src) {
+    const uint64_t *from = (const uint64_t *)src;
+    uint64_t *to = (uint64_t *)dst;
+
+    for (size_t i = 0; i < sizeof(struct prof_lock_stats) / sizeof(uint64_t); ++i)
+        to[i] += __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+}
+
+/**
+ * Thread exit: fold the thread's buffer into prof_exited and free it
+ */
+static void prof_thread_exit(void *arg) {
+    struct prof_thread *t = arg;
+
+    pthread_mutex_lock(&prof_registry_lock);
+    for (struct prof_thread **p = &prof_threads; *p; p = &(*p)->next) {
+        if (*p == t) {
+            *p = t->next;
+            break;
+        }
+    }
+    for (unsigned int id = 0; id < prof_lock_count; ++id)
+        prof_stats_add(&prof_exited.locks[id], &t->locks[id]);
+    pthread_mutex_unlock(&prof_registry_lock);
+    prof_self = NULL;
+    free(t);
+}
+
+static void prof_thread_key_create(void) {
+    pthread_key_create(&prof_thread_key, prof_thread_exit);
+}
+
+/**
+ * Get the calling thread's stats buffer, creating it on first use
+ */
+static struct prof_thread *prof_thread_stats(void) {
+    struct prof_thread *t = prof_self;
+
+    if (__builtin_expect(t == NULL, 0)) {
+        t = calloc(1, sizeof(*t));
+        if (!t) {
+            perror("calloc");
+            exit(EXIT_FAILURE);
+        }
+        pthread_once(&prof_thread_key_once, prof_thread_key_create);
+        pthread_setspecific(prof_thread_key, t);
+        pthread_mutex_lock(&prof_registry_lock);
+        t->next = prof_threads;
+        prof_threads = t;
+        pthread_mutex_unlock(&prof_registry_lock);
+        prof_self = t;
+    }
+    return t;
+}
+
+/**
+ * Initialize a profiled mutex
+ *
+ * If PROF_MAX_LOCKS profiled locks are already alive, the mutex still works
+ *  but is not profiled.
+ * @param m The mutex
+ * @param name Name shown by prof_mutex_dump(); a string literal or otherwise static
+ * @return 0 on success, -1 if the mutex is not profiled
+ */
+int prof_mutex_init(struct prof_mutex *m, const char *name) {
+    uint32_t id = PROF_NO_ID;
+
+    pthread_mutex_init(&m->mutex, NULL);
+    m->name = name;
+    m->acquired_at = 0;
+
+    pthread_mutex_lock(&prof_registry_lock);
+    if (prof_free_count > 0)
+        id = prof_free_ids[--prof_free_count];
+    else if (prof_lock_count < PROF_MAX_LOCKS)
+        id = prof_lock_count++;
+    if (id != PROF_NO_ID)
+        prof_registry[id] = m;
+    pthread_mutex_unlock(&prof_registry_lock);
+
+    m->id = id;
+    if (id == PROF_NO_ID) {
+        fprintf(stderr, "prof_mutex_init: more than %d profiled locks, '%s' is not profiled\n", PROF_MAX_LOCKS,
+                name);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Lock a profiled mutex, recording whether and how long it had to wait
+ * @param m The mutex
+ */
+void prof_mutex_lock(struct prof_mutex *m) {
+    if (__builtin_expect(m->id == PROF_NO_ID, 0)) {
+        pthread_mutex_lock(&m->mutex);
+        return;
+    }
+
+    struct prof_lock_stats *st = &prof_thread_stats()->locks[m->id];
+
+    if (pthread_mutex_trylock(&m->mutex) != 0) {
+        uint64_t start = prof_ticks();
+        pthread_mutex_lock(&m->mutex);
+        uint64_t waited = prof_ticks() - start;
+        prof_add(&st->contended, 1);
+        prof_add(&st->wait_ticks, waited);
+        prof_add(&st->wait_hist[prof_bucket(waited)], 1);
+    }
+    m->acquired_at = (st->acquisitions & (PROF_HOLD_SAMPLE - 1)) == 0 ? prof_ticks() : 0;
+    prof_add(&st->acquisitions, 1);
+}
+
+/**
+ * Unlock a profiled mutex, recording how long it was held if this hold was sampled
+ * @param m The mutex
+ */
+void prof_mutex_unlock(struct prof_mutex *m) {
+    // Record before unlocking, so that a thread that takes the lock next and destroys it sees the update
+    if (m->acquired_at != 0) {
+        struct prof_lock_stats *st = &prof_self->locks[m->id];
+        uint64_t held = prof_ticks() - m->acquired_at;
+        prof_add(&st->hold_samples, 1);
+        prof_add(&st->hold_ticks, held);
+        prof_add(&st->hold_hist[prof_bucket(held)], 1);
+    }
+    pthread_mutex_unlock(&m->mutex);
+}
+
+/**
+ * Destroy a profiled mutex. Its statistics remain available to prof_mutex_dump() under its name
+ * @param m The mutex, which must be unlocked and no longer used by any thread
+ */
+void prof_mutex_destroy(struct prof_mutex *m) {
+    pthread_mutex_destroy(&m->mutex);
+    if (m->id == PROF_NO_ID)
+        return;
+
+    pthread_mutex_lock(&prof_registry_lock);
+    struct prof_retired *r = prof_retired;
+    while (r && strcmp(r->name, m->name ? m->name : "?") != 0)
+        r = r->next;
+    if (!r && (r = calloc(1, sizeof(*r))) != NULL) {
+        r->name = m->name ? m->name : "?";
+        r->next = prof_retired;
+        prof_retired = r;
+    }
+
+    // Move the id's statistics out of every buffer so that the next lock given the id starts from zero
+    for (struct prof_thread *t = prof_threads; t; t = t->next) {
+        if (r)
+            prof_stats_add(&r->total, &t->locks[m->id]);
+        memset(&t->locks[m->id], 0, sizeof(struct prof_lock_stats));
+    }
+    if (r)
+        prof_stats_add(&r->total, &prof_exited.locks[m->id]);
+    memset(&prof_exited.locks[m->id], 0, sizeof(struct prof_lock_stats));
+
+    prof_registry[m->id] = NULL;
+    prof_free_ids[prof_free_count++] = m->id;
+    pthread_mutex_unlock(&prof_registry_lock);
+    m->id = PROF_NO_ID;
+}
+
+/**
+ * Estimate profiling clock ticks per nanosecond
+ */
+static double prof_ticks_per_ns(void) {
+    struct timespec ts = { 0, 20000000 };
+    uint64_t t0 = prof_ticks(), n0 = now_ns();
+    nanosleep(&ts, NULL);
+    return (double)(prof_ticks() - t0) / (double)(now_ns() - n0);
+}
+
+/**
+ * Approximate percentile from a log2 histogram, as the upper bound of its bucket
+ */
+static uint64_t prof_hist_percentile(const uint64_t *hist, uint64_t total, double q) {
+    uint64_t seen = 0;
+
+    for (unsigned int b = 0; b < PROF_BUCKETS; ++b) {
+        seen += hist[b];
+        if (seen > 0 && seen >= q * total)
+            return b ? (1ull << b) - 1 : 0;
+    }
+    return 0;
+}
+
+/**
+ * Aggregated statistics used by prof_mutex_dump()
+ */
+struct prof_summary {
+    const char *name;
+    struct prof_lock_stats total;
+};
+
+static int prof_summary_by_contention(const void *a, const void *b) {
+    const struct prof_summary *x = a, *y = b;
+    if (x->total.contended != y->total.contended)
+        return x->total.contended < y->total.contended ? 1 : -1;
+    return x->total.acquisitions < y->total.acquisitions ? 1 : x->total.acquisitions > y->total.acquisitions ? -1 : 0;
+}
+
+/**
+ * Print the most contended locks
+ *
+ * Safe to call while other threads are locking; counts read mid-update may be
+ *  off by one sample. Live locks and destroyed ones with the same name are
+ *  printed as one row.
+ * @param out Where to print
+ * @param top_n How many locks to print
+ */
+void prof_mutex_dump(FILE *out, int top_n) {
+    struct prof_summary *sum;
+    unsigned int count = 0;
+    double tpn = prof_ticks_per_ns();
+
+    pthread_mutex_lock(&prof_registry_lock);
+    unsigned int max = prof_lock_count;
+    for (struct prof_retired *r = prof_retired; r; r = r->next)
+        max++;
+    sum = calloc(max ? max : 1, sizeof(*sum));
+    if (!sum) {
+        pthread_mutex_unlock(&prof_registry_lock);
+        return;
+    }
+
+    for (unsigned int id = 0; id < prof_lock_count; ++id) {
+        if (!prof_registry[id])
+            continue;
+        struct prof_summary *s = &sum[count++];
+        s->name = prof_registry[id]->name ? prof_registry[id]->name : "?";
+        for (struct prof_thread *t = prof_threads; t; t = t->next)
+            prof_stats_add(&s->total, &t->locks[id]);
+        prof_stats_add(&s->total, &prof_exited.locks[id]);
+    }
+    for (struct prof_retired *r = prof_retired; r; r = r->next) {
+        unsigned int i = 0;
+        while (i < count && strcmp(sum[i].name, r->name) != 0)
+            ++i;
+        if (i == count)
+            sum[count++].name = r->name;
+        prof_stats_add(&sum[i].total, &r->total);
+    }
+    pthread_mutex_unlock(&prof_registry_lock);
+    qsort(sum, count, sizeof(*sum), prof_summary_by_contention);
+
+    fprintf(out, "%-20s %12s %12s %7s %10s %10s %10s %10s\n", "lock", "acquired", "contended", "cont%",
+            "wait avg", "wait p99", "hold avg", "hold p99");
+    for (unsigned int i = 0; i < count && (int)i < top_n; ++i) {
+        const struct prof_lock_stats *st = &sum[i].total;
+        if (st->acquisitions == 0)
+            continue;
+        fprintf(out, "%-20s %12llu %12llu %6.1f%% %8.0fns %8.0fns %8.0fns %8.0fns\n", sum[i].name,
+                (unsigned long long)st->acquisitions, (unsigned long long)st->contended,
+                100.0 * st->contended / st->acquisitions,
+                st->contended ? st->wait_ticks / tpn / st->contended : 0.0,
+                prof_hist_percentile(st->wait_hist, st->contended, 0.99) / tpn,
+                st->hold_samples ? st->hold_ticks / tpn / st->hold_samples : 0.0,
+                prof_hist_percentile(st->hold_hist, st->hold_samples, 0.99) / tpn);
+    }
+    free(sum);
+}
+
+// Thread Pool
+
+// Creating and joining a thread per unit of work, as the example at the top
+//  does, costs tens of microseconds each time. struct thread_pool keeps a
+//  fixed set of workers alive and feeds them tasks:
+// - Every worker owns a Chase-Lev deque. It pushes and pops tasks at the
+//   bottom without any locked instruction in the common case; idle workers
+//   steal from the top of other workers' deques.
+// - Threads outside the pool submit through a bounded MPMC queue (Dmitry
+//   Vyukov's design: each cell carries a sequence number, so producers and
+//   consumers only contend on their own index).
+// - Idle workers spin briefly, then sleep on a condition variable. The mutex
+//   is only taken when somebody is actually asleep.
+
+#define POOL_DEQUE_SIZE 4096     // Tasks per worker deque (power of two)
+#define POOL_INJECT_SIZE 4096    // Tasks in the injection queue (power of two)
+#define POOL_IDLE_SPINS 64       // Failed steal rounds before a worker sleeps
+
+typedef void (*task_fn)(void *arg);
+
+/**
+ * A unit of work
+ */
+struct task {
+    task_fn fn;
+    void *arg;
+};
+
+/**
+ * Deque slot. Thieves may read a slot the owner is overwriting; they only
+ * keep the value if their CAS on top then succeeds, which proves it was not
+ * overwritten, so the fields are atomics accessed relaxed.
+ */
+struct ws_slot {
+    _Atomic(task_fn) fn;
+    _Atomic(void *) arg;
+};
+
+/**
+ * Chase-Lev work-stealing deque with a fixed capacity
+ */
+struct ws_deque {
+    _Alignas(64) atomic_long top;     // Thieves take from here
+    _Alignas(64) atomic_long bottom;  // Owner pushes and pops here
+    struct ws_slot slots[POOL_DEQUE_SIZE];
+};
+
+/**
+ * Push a task; owner only
+ * @return 0 on success, -1 if the deque is full
+ */
+static int ws_deque_push(struct ws_deque *d, struct task t) {
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    long top = atomic_load_explicit(&d->top, memory_order_acquire);
+    struct ws_slot *s = &d->slots[b & (POOL_DEQUE_SIZE - 1)];
+
+    if (b - top >= POOL_DEQUE_SIZE)
+        return -1;
+    atomic_store_explicit(&s->fn, t.fn, memory_order_relaxed);
+    atomic_store_explicit(&s->arg, t.arg, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    return 0;
+}
+
+/**
+ * Pop the most recently pushed task; owner only
+ * @return 1 if a task was taken, 0 if the deque is empty
+ */
+static int ws_deque_pop(struct ws_deque *d, struct task *t) {
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    long top;
+    int taken = 1;
+
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    top = atomic_load_explicit(&d->top, memory_order_relaxed);
+    if (top > b) {
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        return 0;
+    }
+    struct ws_slot *s = &d->slots[b & (POOL_DEQUE_SIZE - 1)];
+    t->fn = atomic_load_explicit(&s->fn, memory_order_relaxed);
+    t->arg = atomic_load_explicit(&s->arg, memory_order_relaxed);
+    if (top == b) {
+        // Last task: race the thieves for it
+        taken = atomic_compare_exchange_strong_explicit(&d->top, &top, top + 1, memory_order_seq_cst,
+                                                        memory_order_relaxed);
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+    return taken;
+}
+
+/**
+ * Steal the oldest task; any thread
+ * @return 1 if a task was stolen, 0 if the deque looked empty or another thief won
+ */
+static int ws_deque_steal(struct ws_deque *d, struct task *t) {
+    long top = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+
+    if (top >= b)
+        return 0;
+    struct ws_slot *s = &d->slots[top & (POOL_DEQUE_SIZE - 1)];
+    t->fn = atomic_load_explicit(&s->fn, memory_order_relaxed);
+    t->arg = atomic_load_explicit(&s->arg, memory_order_relaxed);
+    return atomic_compare_exchange_strong_explicit(&d->top, &top, top + 1, memory_order_seq_cst,
+                                                   memory_order_relaxed);
+}
+
+/**
+ * Injection queue cell; seq says whose turn it is
+ */
+struct mpmc_cell {
+    atomic_size_t seq;
+    struct task task;
+};
+
+/**
+ * Bounded multi-producer/multi-consumer queue
+ */
+struct mpmc_queue {
+    _Alignas(64) atomic_size_t enqueue_pos;
+    _Alignas(64) atomic_size_t dequeue_pos;
+    _Alignas(64) struct mpmc_cell cells[POOL_INJECT_SIZE];
+};
+
+static void mpmc_queue_init(struct mpmc_queue *q) {
+    for (size_t i = 0; i < POOL_INJECT_SIZE; ++i)
+        atomic_init(&q->cells[i].seq, i);
+    atomic_init(&q->enqueue_pos, 0);
+    atomic_init(&q->dequeue_pos, 0);
+}
+
+/**
+ * Enqueue a task
+ * @return 0 on success, -1 if the queue is full
+ */
+static int mpmc_queue_enqueue(struct mpmc_queue *q, struct task t) {
+    size_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+
+    for (;;) {
+        struct mpmc_cell *cell = &q->cells[pos & (POOL_INJECT_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                cell->task = t;
+                atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+                return 0;
+            }
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * Dequeue a task
+ * @return 1 if a task was dequeued, 0 if the queue is empty
+ */
+static int mpmc_queue_dequeue(struct mpmc_queue *q, struct task *t) {
+    size_t pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+
+    for (;;) {
+        struct mpmc_cell *cell = &q->cells[pos & (POOL_INJECT_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->dequeue_pos, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                *t = cell->task;
+                atomic_store_explicit(&cell->seq, pos + POOL_INJECT_SIZE, memory_order_release);
+                return 1;
+            }
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+struct thread_pool;
+
+/**
+ * A pool worker and its deque
+ */
+struct pool_worker {
+    struct ws_deque deque;
+    struct thread_pool *pool;
+    pthread_t thread;
+    unsigned int rng;  // Victim selection
+};
+
+/**
+ * A fixed set of worker threads
  */
-int main() {
+struct thread_pool {
+    struct pool_worker *workers;
+    int nworkers;
+    struct mpmc_queue inject;
+    _Alignas(64) atomic_long pending;  // Submitted but not yet finished
+    _Alignas(64) atomic_uint wake_seq; // Bumped on submit so sleepers can't miss work
+    atomic_int sleepers;
+    atomic_int stop;
+    pthread_mutex_t idle_mutex;
+    pthread_cond_t idle_cond;
+};
+
+static _Thread_local struct pool_worker *pool_self;
+
+/**
+ * Find a task: own deque first, then the injection queue, then steal
+ * @param pool The pool
+ * @param self The calling worker, or NULL for an outside thread helping out
+ * @return 1 if a task was found
+ */
+static int thread_pool_find_task(struct thread_pool *pool, struct pool_worker *self, struct task *t) {
+    unsigned int seed;
+
+    if (self && ws_deque_pop(&self->deque, t))
+        return 1;
+    if (mpmc_queue_dequeue(&pool->inject, t))
+        return 1;
+    seed = self ? (self->rng = self->rng * 1103515245u + 12345u) >> 8 : (unsigned int)now_ns();
+    for (int i = 0; i < pool->nworkers; ++i) {
+        struct pool_worker *victim = &pool->workers[(seed + i) % pool->nworkers];
+        if (victim != self && ws_deque_steal(&victim->deque, t))
+            return 1;
+    }
+    return 0;
+}
+
+static void thread_pool_run(struct thread_pool *pool, struct task t) {
+    t.fn(t.arg);
+    atomic_fetch_sub_explicit(&pool->pending, 1, memory_order_release);
+}
+
+/**
+ * Wake a sleeping worker if there is one
+ */
+static void thread_pool_notify(struct thread_pool *pool) {
+    atomic_fetch_add(&pool->wake_seq, 1);
+    if (atomic_load(&pool->sleepers) > 0) {
+        pthread_mutex_lock(&pool->idle_mutex);
+        pthread_cond_signal(&pool->idle_cond);
+        pthread_mutex_unlock(&pool->idle_mutex);
+    }
+}
+
+static void *thread_pool_worker_main(void *arg) {
+    struct pool_worker *self = arg;
+    struct thread_pool *pool = self->pool;
+    struct task t;
+    int idle = 0;
+
+    pool_self = self;
+    while (!atomic_load_explicit(&pool->stop, memory_order_relaxed)) {
+        unsigned int seq = atomic_load(&pool->wake_seq);
+        if (thread_pool_find_task(pool, self, &t)) {
+            thread_pool_run(pool, t);
+            idle = 0;
+            continue;
+        }
+        if (++idle < POOL_IDLE_SPINS) {
+            if (idle & 7)
+                cpu_relax();
+            else
+                sched_yield();
+            continue;
+        }
+        // Announce ourselves before the final check; a submitter bumps
+        // wake_seq before looking at sleepers, so one of us sees the other
+        pthread_mutex_lock(&pool->idle_mutex);
+        atomic_fetch_add(&pool->sleepers, 1);
+        while (atomic_load(&pool->wake_seq) == seq && !atomic_load(&pool->stop))
+            pthread_cond_wait(&pool->idle_cond, &pool->idle_mutex);
+        atomic_fetch_sub(&pool->sleepers, 1);
+        pthread_mutex_unlock(&pool->idle_mutex);
+        idle = 0;
+    }
+    return NULL;
+}
+
+/**
+ * Start a thread pool
+ * @param pool The pool
+ * @param nworkers Number of worker threads (0 = one per online CPU)
+ * @return 0 on success, -1 on error
+ */
+int thread_pool_init(struct thread_pool *pool, int nworkers) {
+    if (nworkers <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nworkers = cpus > 0 ? (int)cpus : 1;
+    }
+    pool->workers = aligned_alloc(64, sizeof(*pool->workers) * nworkers);
+    if (!pool->workers) {
+        perror("aligned_alloc");
+        return -1;
+    }
+    pool->nworkers = nworkers;
+    mpmc_queue_init(&pool->inject);
+    atomic_init(&pool->pending, 0);
+    atomic_init(&pool->wake_seq, 0);
+    atomic_init(&pool->sleepers, 0);
+    atomic_init(&pool->stop, 0);
+    pthread_mutex_init(&pool->idle_mutex, NULL);
+    pthread_cond_init(&pool->idle_cond, NULL);
+    for (int i = 0; i < nworkers; ++i) {
+        struct pool_worker *w = &pool->workers[i];
+        atomic_init(&w->deque.top, 0);
+        atomic_init(&w->deque.bottom, 0);
+        w->pool = pool;
+        w->rng = (unsigned int)i * 2654435761u + 1;
+    }
+    for (int i = 0; i < nworkers; ++i) {
+        if (pthread_create(&pool->workers[i].thread, NULL, thread_pool_worker_main, &pool->workers[i]) != 0) {
+            perror("pthread_create");
+            atomic_store(&pool->stop, 1);
+            pthread_cond_broadcast(&pool->idle_cond);
+            while (i-- > 0)
+                pthread_join(pool->workers[i].thread, NULL);
+            free(pool->workers);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Run one pending task on the calling thread, if any
+ * @return 1 if a task was run
+ */
+static int thread_pool_help(struct thread_pool *pool) {
+    struct pool_worker *self = pool_self && pool_self->pool == pool ? pool_self : NULL;
+    struct task t;
+
+    if (!thread_pool_find_task(pool, self, &t))
+        return 0;
+    thread_pool_run(pool, t);
+    return 1;
+}
+
+/**
+ * Submit a task. From a worker it goes on that worker's deque; from any
+ * other thread it goes through the injection queue. If the target is full
+ * the caller runs queued tasks until there is room.
+ * @param pool The pool
+ * @param fn Function to run
+ * @param arg Its argument
+ */
+void thread_pool_submit(struct thread_pool *pool, task_fn fn, void *arg) {
+    struct task t = { fn, arg };
+    struct pool_worker *self = pool_self && pool_self->pool == pool ? pool_self : NULL;
+
+    atomic_fetch_add_explicit(&pool->pending, 1, memory_order_relaxed);
+    while (self ? ws_deque_push(&self->deque, t) < 0 : mpmc_queue_enqueue(&pool->inject, t) < 0) {
+        if (!thread_pool_help(pool))
+            sched_yield();
+    }
+    thread_pool_notify(pool);
+}
+
+/**
+ * Wait until every submitted task, including tasks submitted by tasks, has
+ * finished. The caller runs tasks while it waits.
+ * @param pool The pool
+ */
+void thread_pool_wait(struct thread_pool *pool) {
+    unsigned int spins = 0;
+
+    while (atomic_load_explicit(&pool->pending, memory_order_acquire) > 0) {
+        if (!thread_pool_help(pool))
+            spin_wait(&spins);
+    }
+}
+
+/**
+ * Shared state of one thread_pool_parallel_for() call
+ */
+struct parallel_for {
+    void (*body)(void *ctx, long begin, long end);
+    void *ctx;
+    long end;
+    long grain;
+    _Alignas(64) atomic_long next;  // Start of the next unclaimed chunk
+    _Alignas(64) atomic_int tasks;  // Claiming tasks that have not returned yet
+};
+
+/**
+ * Claim chunks until the range is exhausted
+ */
+static void parallel_for_task(void *arg) {
+    struct parallel_for *pf = arg;
+
+    for (;;) {
+        long begin = atomic_fetch_add_explicit(&pf->next, pf->grain, memory_order_relaxed);
+        if (begin >= pf->end)
+            break;
+        pf->body(pf->ctx, begin, begin + pf->grain < pf->end ? begin + pf->grain : pf->end);
+    }
+    // Last access to pf: the caller may return as soon as this drops to zero
+    atomic_fetch_sub_explicit(&pf->tasks, 1, memory_order_release);
+}
+
+/**
+ * Call body on chunks of [begin, end) in parallel and return when all are done
+ *
+ * One claiming task is submitted per worker; chunks are handed out
+ * dynamically, so uneven chunks still balance. The caller claims chunks too,
+ * and may itself be a task.
+ * @param pool The pool
+ * @param begin First index
+ * @param end One past the last index
+ * @param grain Items per chunk (at least 1)
+ * @param body Called with disjoint [chunk_begin, chunk_end) ranges
+ * @param ctx Passed to body
+ */
+void thread_pool_parallel_for(struct thread_pool *pool, long begin, long end, long grain,
+                              void (*body)(void *ctx, long begin, long end), void *ctx) {
+    struct parallel_for pf = { .body = body, .ctx = ctx, .end = end, .grain = grain > 0 ? grain : 1 };
+    unsigned int spins = 0;
+
+    if (end <= begin)
+        return;
+    atomic_init(&pf.next, begin);
+    atomic_init(&pf.tasks, pool->nworkers + 1);
+    for (int i = 0; i < pool->nworkers; ++i)
+        thread_pool_submit(pool, parallel_for_task, &pf);
+    parallel_for_task(&pf);
+    // A chunk is finished before its task returns, so this also waits for the work
+    while (atomic_load_explicit(&pf.tasks, memory_order_acquire) > 0)
+        if (!thread_pool_help(pool))
+            spin_wait(&spins);
+}
+
+/**
+ * Stop the workers and free the pool. Tasks still queued are not run.
+ * @param pool The pool
+ */
+void thread_pool_destroy(struct thread_pool *pool) {
+    pthread_mutex_lock(&pool->idle_mutex);
+    atomic_store(&pool->stop, 1);
+    pthread_cond_broadcast(&pool->idle_cond);
+    pthread_mutex_unlock(&pool->idle_mutex);
+    for (int i = 0; i < pool->nworkers; ++i)
+        pthread_join(pool->workers[i].thread, NULL);
+    pthread_mutex_destroy(&pool->idle_mutex);
+    pthread_cond_destroy(&pool->idle_cond);
+    free(pool->workers);
+}
+
+// Concurrent Hash Map
+
+// struct cmap maps 64-bit keys to 64-bit values with linear probing:
+// - get never locks, and writes only its own thread's epoch announcement.
+//   Slots are claimed once per table and never given back, so a reader that
+//   finds its key has found the only slot the key can occupy in that table.
+// - put and erase take one of CMAP_STRIPES adaptive locks (from the lock
+//   library above) chosen by the key's hash, so writers of different keys
+//   rarely meet. Empty slots are claimed with a CAS because probe runs
+//   cross stripes.
+// - Erased keys keep their slot with an ABSENT value; those tombstones are
+//   dropped when the table is next copied.
+// - Resize allocates the next table and copies the old one over in chunks.
+//   Every put and erase copies one chunk before it returns, so no thread
+//   ever stops for the whole copy. During the copy a writer moves its own
+//   key first and then writes to the new table. A moved slot holds MOVED,
+//   which sends readers on to the next table. Empty slots that the copy
+//   passes are closed as DEAD, so no late writer can use them.
+//
+// - A replaced table is retired, not freed: other threads may still be
+//   probing it. Every map operation announces the global epoch on entry, as
+//   in the epoch-based reclamation of Atomic Operations/main.c, and a table
+//   retired in epoch e is freed once the epoch reaches e + 2, when every
+//   operation that could have seen it has returned. Writers free retired
+//   tables as they go, so churn that keeps rehashing a table of the same size
+//   holds old copies only for as long as a preempted operation delays the
+//   epoch, not for the life of the map.
+//
+// Keys 0 and UINT64_MAX and values UINT64_MAX and UINT64_MAX - 1 are
+//  reserved.
+
+#define CMAP_EMPTY 0                // Key of an unused slot
+#define CMAP_DEAD UINT64_MAX        // Key of an unused slot closed by a resize
+#define CMAP_ABSENT UINT64_MAX      // Value of an erased key
+#define CMAP_MOVED (UINT64_MAX - 1) // Value of a key copied to the next table
+#define CMAP_STRIPES 64             // Writer locks (power of two)
+#define CMAP_MIN_CAPACITY 256
+#define CMAP_MIGRATE_CHUNK 64       // Slots copied per helping operation
+
+/**
+ * One key/value slot
+ */
+struct cmap_slot {
+    _Atomic uint64_t key;
+    _Atomic uint64_t value;
+};
+
+/**
+ * Per-stripe counts for one table, updated under the stripe lock
+ */
+struct cmap_count {
+    _Alignas(64) atomic_size_t used;  // Slots claimed
+    atomic_size_t live;               // Keys with a value
+    atomic_size_t direct;             // Keys written here while the previous table was being copied
+};
+
+/**
+ * One generation of the table
+ */
+struct cmap_table {
+    size_t mask;
+    struct cmap_table *_Atomic next;   // Set when a resize starts
+    struct cmap_table *retired_next;
+    uint64_t retired_epoch;            // cmap_epoch after the table was replaced
+    _Alignas(64) atomic_size_t migrate_next;  // Next chunk to copy
+    atomic_size_t migrated;                   // Slots copied so far
+    struct cmap_count counts[CMAP_STRIPES];
+    struct cmap_slot slots[];
+};
+
+/**
+ * Concurrent hash map
+ */
+struct cmap {
+    struct cmap_table *_Atomic table;
+    struct {
+        _Alignas(64) struct lock lock;
+    } stripes[CMAP_STRIPES];
+    pthread_mutex_t retired_lock;
+    struct cmap_table *retired;   // Replaced tables not freed yet, under retired_lock
+    atomic_uint retired_count;    // Length of retired
+    atomic_uint resizes;
+};
+
+enum cmap_put_result { CMAP_DONE, CMAP_NOT_FOUND, CMAP_RETRY, CMAP_FULL };
+
+/**
+ * A thread's epoch announcement, shared by all maps; reused after its thread exits
+ */
+struct cmap_reader {
+    _Alignas(64) atomic_uint_fast64_t state;  // (epoch << 1) | 1 inside a map operation, 0 otherwise
+    atomic_int in_use;
+    struct cmap_reader *next;
+};
+
+static _Alignas(64) atomic_uint_fast64_t cmap_epoch = 1;
+static struct cmap_reader *_Atomic cmap_readers;
+static _Thread_local struct cmap_reader *cmap_self;
+static pthread_key_t cmap_reader_key;
+static pthread_once_t cmap_reader_key_once = PTHREAD_ONCE_INIT;
+
+static void cmap_reader_release(void *arg) {
+    struct cmap_reader *r = arg;
+
+    atomic_store_explicit(&r->state, 0, memory_order_release);
+    atomic_store_explicit(&r->in_use, 0, memory_order_release);
+    cmap_self = NULL;
+}
+
+static void cmap_reader_key_create(void) {
+    pthread_key_create(&cmap_reader_key, cmap_reader_release);
+}
+
+/**
+ * Get the calling thread's announcement, claiming or creating one on first use
+ */
+static struct cmap_reader *cmap_reader_get(void) {
+    struct cmap_reader *r;
+
+    pthread_once(&cmap_reader_key_once, cmap_reader_key_create);
+    for (r = atomic_load_explicit(&cmap_readers, memory_order_acquire); r; r = r->next) {
+        int free_slot = 0;
+        if (atomic_compare_exchange_strong(&r->in_use, &free_slot, 1))
+            break;
+    }
+    if (!r) {
+        r = aligned_alloc(64, sizeof(*r));
+        if (!r) {
+            perror("aligned_alloc");
+            exit(EXIT_FAILURE);
+        }
+        atomic_init(&r->state, 0);
+        atomic_init(&r->in_use, 1);
+        r->next = atomic_load_explicit(&cmap_readers, memory_order_relaxed);
+        while (!atomic_compare_exchange_weak_explicit(&cmap_readers, &r->next, r, memory_order_release,
+                                                      memory_order_relaxed))
+            ;
+    }
+    pthread_setspecific(cmap_reader_key, r);
+    return cmap_self = r;
+}
+
+/**
+ * Announce the current epoch; tables seen until cmap_exit() stay allocated
+ */
+static inline struct cmap_reader *cmap_enter(void) {
+    struct cmap_reader *r = cmap_self;
+    uint64_t epoch;
+
+    if (__builtin_expect(r == NULL, 0))
+        r = cmap_reader_get();
+    // Re-check after the fence so we never announce an epoch already left behind
+    do {
+        epoch = atomic_load_explicit(&cmap_epoch, memory_order_relaxed);
+        atomic_store_explicit(&r->state, (epoch << 1) | 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+    } while (atomic_load_explicit(&cmap_epoch, memory_order_relaxed) != epoch);
+    return r;
+}
+
+static inline void cmap_exit(struct cmap_reader *r) {
+    atomic_store_explicit(&r->state, 0, memory_order_release);
+}
+
+/**
+ * Advance the epoch if every thread inside a map operation has announced it
+ * @return The epoch afterwards
+ */
+static uint64_t cmap_try_advance(void) {
+    uint64_t epoch = atomic_load_explicit(&cmap_epoch, memory_order_acquire);
+
+    atomic_thread_fence(memory_order_seq_cst);
+    for (struct cmap_reader *r = atomic_load_explicit(&cmap_readers, memory_order_acquire); r; r = r->next) {
+        uint64_t state = atomic_load_explicit(&r->state, memory_order_acquire);
+        if ((state & 1) && (state >> 1) != epoch)
+            return epoch;
+    }
+    if (atomic_compare_exchange_strong(&cmap_epoch, &epoch, epoch + 1))
+        return epoch + 1;
+    return epoch;  // Someone else advanced it
+}
+
+/**
+ * Free the retired tables no operation can still be using; call outside cmap_enter()/cmap_exit()
+ */
+static void cmap_reclaim(struct cmap *m) {
+    uint64_t epoch = cmap_try_advance();
+    struct cmap_table *done = NULL;
+
+    if (pthread_mutex_trylock(&m->retired_lock) != 0)
+        return;  // Another writer is at it
+    for (struct cmap_table **p = &m->retired; *p;) {
+        struct cmap_table *t = *p;
+        if (t->retired_epoch + 2 <= epoch) {
+            *p = t->retired_next;
+            t->retired_next = done;
+            done = t;
+            atomic_fetch_sub_explicit(&m->retired_count, 1, memory_order_relaxed);
+        } else {
+            p = &t->retired_next;
+        }
+    }
+    pthread_mutex_unlock(&m->retired_lock);
+    while (done) {
+        struct cmap_table *next = done->retired_next;
+        free(done);
+        done = next;
+    }
+}
+
+static inline uint64_t cmap_hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ull;
+    key ^= key >> 33;
+    return key;
+}
+
+static inline unsigned int cmap_stripe(uint64_t hash) {
+    return (unsigned int)(hash >> 58) & (CMAP_STRIPES - 1);  // Slot index uses the low bits
+}
+
+static struct cmap_table *cmap_table_new(size_t capacity) {
+    size_t bytes = sizeof(struct cmap_table) + capacity * sizeof(struct cmap_slot);
+    struct cmap_table *t = aligned_alloc(64, (bytes + 63) & ~(size_t)63);
+
+    if (!t)
+        return NULL;
+    t->mask = capacity - 1;
+    atomic_init(&t->next, NULL);
+    t->retired_next = NULL;
+    t->retired_epoch = 0;
+    atomic_init(&t->migrate_next, 0);
+    atomic_init(&t->migrated, 0);
+    for (int i = 0; i < CMAP_STRIPES; ++i) {
+        atomic_init(&t->counts[i].used, 0);
+        atomic_init(&t->counts[i].live, 0);
+        atomic_init(&t->counts[i].direct, 0);
+    }
+    for (size_t i = 0; i < capacity; ++i) {
+        atomic_init(&t->slots[i].key, CMAP_EMPTY);
+        atomic_init(&t->slots[i].value, CMAP_ABSENT);
+    }
+    return t;
+}
+
+/**
+ * Initialize a map
+ * @param m The map
+ * @param capacity Initial number of slots, rounded up to a power of two
+ * @return 0 on success, -1 on error
+ */
+int cmap_init(struct cmap *m, size_t capacity) {
+    size_t n = CMAP_MIN_CAPACITY;
+
+    while (n < capacity)
+        n <<= 1;
+    struct cmap_table *t = cmap_table_new(n);
+    if (!t) {
+        perror("aligned_alloc");
+        return -1;
+    }
+    atomic_init(&m->table, t);
+    for (int i = 0; i < CMAP_STRIPES; ++i)
+        lock_init(&m->stripes[i].lock, LOCK_ADAPTIVE);
+    pthread_mutex_init(&m->retired_lock, NULL);
+    m->retired = NULL;
+    atomic_init(&m->retired_count, 0);
+    atomic_init(&m->resizes, 0);
+    return 0;
+}
+
+/**
+ * Free a map; no other thread may be using it
+ */
+void cmap_destroy(struct cmap *m) {
+    struct cmap_table *t = atomic_load(&m->table);
+
+    while (t) {
+        struct cmap_table *next = atomic_load(&t->next);
+        free(t);
+        t = next;
+    }
+    for (t = m->retired; t;) {
+        struct cmap_table *next = t->retired_next;
+        free(t);
+        t = next;
+    }
+    for (int i = 0; i < CMAP_STRIPES; ++i)
+        lock_destroy(&m->stripes[i].lock);
+    pthread_mutex_destroy(&m->retired_lock);
+}
+
+/**
+ * Find the slot holding a key in one table
+ * @return The slot, or NULL if the probe run ends without it
+ */
+static struct cmap_slot *cmap_table_find(struct cmap_table *t, uint64_t key, uint64_t hash) {
+    size_t i = hash & t->mask;
+
+    for (size_t n = 0; n <= t->mask; ++n, i = (i + 1) & t->mask) {
+        uint64_t k = atomic_load_explicit(&t->slots[i].key, memory_order_acquire);
+        if (k == key)
+            return &t->slots[i];
+        if (k == CMAP_EMPTY || k == CMAP_DEAD)
+            return NULL;
+    }
+    return NULL;
+}
+
+/**
+ * Look up a key; never blocks
+ * @param m The map
+ * @param key The key
+ * @param value Set to the value if found
+ * @return 1 if found, 0 if not
+ */
+int cmap_get(struct cmap *m, uint64_t key, uint64_t *value) {
+    struct cmap_reader *r = cmap_enter();
+    uint64_t hash = cmap_hash(key);
+    int found = 0;
+
+    for (struct cmap_table *t = atomic_load_explicit(&m->table, memory_order_acquire); t;
+         t = atomic_load_explicit(&t->next, memory_order_acquire)) {
+        struct cmap_slot *s = cmap_table_find(t, key, hash);
+        if (!s)
+            continue;  // Not here; a resize may have put it in the next table
+        uint64_t v = atomic_load_explicit(&s->value, memory_order_acquire);
+        if (v == CMAP_MOVED)
+            continue;
+        if (v != CMAP_ABSENT) {
+            *value = v;
+            found = 1;
+        }
+        break;
+    }
+    cmap_exit(r);
+    return found;
+}
+
+/**
+ * Store a value in one table; caller holds the key's stripe lock
+ * @param t The table
+ * @param value New value, or CMAP_ABSENT to erase
+ * @param claim Whether to claim a slot if the key is missing
+ * @param direct Count a claimed slot as written during a copy
+ * @param was_live Set to whether the key had a value
+ */
+static enum cmap_put_result cmap_table_put(struct cmap_table *t, uint64_t key, uint64_t hash, uint64_t value,
+                                           int claim, int direct, int *was_live) {
+    struct cmap_count *count = &t->counts[cmap_stripe(hash)];
+    struct cmap_slot *s = NULL;
+    size_t i = hash & t->mask;
+    int claimed = 0;
+
+    for (size_t n = 0; n <= t->mask && !s; ++n, i = (i + 1) & t->mask) {
+        uint64_t k = atomic_load_explicit(&t->slots[i].key, memory_order_acquire);
+        if (k == CMAP_EMPTY) {
+            if (!claim)
+                return CMAP_NOT_FOUND;
+            if (atomic_compare_exchange_strong_explicit(&t->slots[i].key, &k, key, memory_order_acq_rel,
+                                                        memory_order_acquire)) {
+                s = &t->slots[i];
+                claimed = 1;
+                break;
+            }
+            // Lost the slot to another writer, or a resize closed it
+        }
+        if (k == key)
+            s = &t->slots[i];
+        else if (k == CMAP_DEAD)
+            return CMAP_RETRY;
+    }
+    if (!s)
+        return claim ? CMAP_FULL : CMAP_NOT_FOUND;
+
+    uint64_t old = atomic_load_explicit(&s->value, memory_order_relaxed);
+    if (old == CMAP_MOVED)
+        return CMAP_RETRY;
+    *was_live = old != CMAP_ABSENT;
+    atomic_store_explicit(&s->value, value, memory_order_release);
+    if (claimed) {
+        atomic_fetch_add_explicit(&count->used, 1, memory_order_relaxed);
+        if (direct)
+            atomic_fetch_add_explicit(&count->direct, 1, memory_order_relaxed);
+    }
+    if (*was_live != (value != CMAP_ABSENT)) {
+        if (*was_live)
+            atomic_fetch_sub_explicit(&count->live, 1, memory_order_relaxed);
+        else
+            atomic_fetch_add_explicit(&count->live, 1, memory_order_relaxed);
+    }
+    return CMAP_DONE;
+}
+
+/**
+ * Copy one slot to the next table and mark it moved; caller holds the key's stripe lock
+ */
+static void cmap_migrate_slot_locked(struct cmap_table *next, struct cmap_slot *s, uint64_t key, uint64_t hash) {
+    uint64_t v = atomic_load_explicit(&s->value, memory_order_acquire);
+    int was_live;
+
+    if (v == CMAP_MOVED)
+        return;
+    // The next table is sized to hold everything the old one can have, so this cannot fail
+    if (v != CMAP_ABSENT && cmap_table_put(next, key, hash, v, 1, 0, &was_live) != CMAP_DONE) {
+        fprintf(stderr, "cmap: resize target full\n");
+        abort();
+    }
+    atomic_store_explicit(&s->value, CMAP_MOVED, memory_order_release);
+}
+
+/**
+ * Copy one slot of a table being resized
+ */
+static void cmap_migrate_slot(struct cmap *m, struct cmap_table *t, struct cmap_table *next, size_t i) {
+    struct cmap_slot *s = &t->slots[i];
+    uint64_t key = CMAP_EMPTY;
+
+    if (atomic_compare_exchange_strong(&s->key, &key, CMAP_DEAD) || key == CMAP_DEAD)
+        return;
+    uint64_t hash = cmap_hash(key);
+    struct lock *l = &m->stripes[cmap_stripe(hash)].lock;
+    lock_acquire(l, NULL);
+    cmap_migrate_slot_locked(next, s, key, hash);
+    lock_release(l, NULL);
+}
+
+/**
+ * Copy up to max_chunks chunks of the table being resized, if any, and
+ * switch to the next table after the last one
+ * @return 1 if a resize is in progress
+ */
+static int cmap_help_migrate(struct cmap *m, int max_chunks) {
+    struct cmap_table *t = atomic_load_explicit(&m->table, memory_order_acquire);
+    struct cmap_table *next = atomic_load_explicit(&t->next, memory_order_acquire);
+    size_t capacity = t->mask + 1;
+
+    if (!next)
+        return 0;
+    for (int c = 0; c < max_chunks; ++c) {
+        size_t start = atomic_fetch_add_explicit(&t->migrate_next, CMAP_MIGRATE_CHUNK, memory_order_relaxed);
+        if (start >= capacity)
+            break;
+        size_t end = start + CMAP_MIGRATE_CHUNK < capacity ? start + CMAP_MIGRATE_CHUNK : capacity;
+        for (size_t i = start; i < end; ++i)
+            cmap_migrate_slot(m, t, next, i);
+        if (atomic_fetch_add_explicit(&t->migrated, end - start, memory_order_acq_rel) + (end - start) == capacity) {
+            // Last chunk: readers may still be in t, so retire it; the epoch is read after the switch
+            atomic_store_explicit(&m->table, next, memory_order_seq_cst);
+            pthread_mutex_lock(&m->retired_lock);
+            t->retired_epoch = atomic_load_explicit(&cmap_epoch, memory_order_seq_cst);
+            t->retired_next = m->retired;
+            m->retired = t;
+            atomic_fetch_add_explicit(&m->retired_count, 1, memory_order_relaxed);
+            pthread_mutex_unlock(&m->retired_lock);
+        }
+    }
+    return 1;
+}
+
+/**
+ * Start resizing the current table unless a resize is already running
+ */
+static void cmap_start_resize(struct cmap *m, struct cmap_table *t) {
+    size_t capacity = t->mask + 1, live = 0, target = capacity;
+    struct cmap_table *next, *expected = NULL;
+
+    if (atomic_load_explicit(&m->table, memory_order_acquire) != t || atomic_load(&t->next))
+        return;
+    for (int i = 0; i < CMAP_STRIPES; ++i)
+        live += atomic_load_explicit(&t->counts[i].live, memory_order_relaxed);
+    // Copied keys fill at most 3/8 of the next table and direct writes another 1/4
+    while (target * 3 < live * 8)
+        target <<= 1;
+    next = cmap_table_new(target);
+    if (!next)
+        return;  // Keep probing the full table; the next writer tries again
+    if (atomic_compare_exchange_strong(&t->next, &expected, next))
+        atomic_fetch_add_explicit(&m->resizes, 1, memory_order_relaxed);
+    else
+        free(next);
+}
+
+/**
+ * Write a key under its stripe lock, following any resize in progress
+ * @return 1 if the key had a value before, 0 if not
+ */
+static int cmap_write(struct cmap *m, uint64_t key, uint64_t value) {
+    uint64_t hash = cmap_hash(key);
+    unsigned int stripe = cmap_stripe(hash);
+    struct lock *l = &m->stripes[stripe].lock;
+    struct cmap_table *t, *next, *target;
+    struct cmap_reader *r = cmap_enter();
+    int was_live = 0;
+
+    lock_acquire(l, NULL);
+    for (;;) {
+        t = atomic_load_explicit(&m->table, memory_order_acquire);
+        next = atomic_load_explicit(&t->next, memory_order_acquire);
+        target = t;
+        if (next) {
+            struct cmap_slot *s = cmap_table_find(t, key, hash);
+            if (s)
+                cmap_migrate_slot_locked(next, s, key, hash);
+            target = next;
+            if (value != CMAP_ABSENT &&
+                atomic_load_explicit(&next->counts[stripe].direct, memory_order_relaxed) >=
+                    (next->mask + 1) / 4 / CMAP_STRIPES) {
+                // This stripe's share of the new table is used up until the copy finishes
+                lock_release(l, NULL);
+                if (!cmap_help_migrate(m, 1) || atomic_load(&t->migrate_next) > t->mask)
+                    sched_yield();
+                lock_acquire(l, NULL);
+                continue;
+            }
+        }
+        enum cmap_put_result r = cmap_table_put(target, key, hash, value, value != CMAP_ABSENT, next != NULL,
+                                                &was_live);
+        if (r == CMAP_DONE || r == CMAP_NOT_FOUND)
+            break;
+        if (r == CMAP_FULL) {
+            lock_release(l, NULL);
+            cmap_start_resize(m, t);
+            if (!cmap_help_migrate(m, 1))
+                sched_yield();
+            lock_acquire(l, NULL);
+        }
+    }
+    lock_release(l, NULL);
+
+    if (!next && atomic_load_explicit(&t->counts[stripe].used, memory_order_relaxed) >
+                     (t->mask + 1) * 3 / 4 / CMAP_STRIPES)
+        cmap_start_resize(m, t);
+    cmap_help_migrate(m, 1);
+    cmap_exit(r);
+    if (atomic_load_explicit(&m->retired_count, memory_order_relaxed))
+        cmap_reclaim(m);
+    return was_live;
+}
+
+/**
+ * Insert or replace a key
+ * @param m The map
+ * @param key Any key except 0 and UINT64_MAX
+ * @param value Any value below UINT64_MAX - 1
+ * @return 1 if the key was replaced, 0 if inserted
+ */
+int cmap_put(struct cmap *m, uint64_t key, uint64_t value) {
+    return cmap_write(m, key, value);
+}
+
+/**
+ * Remove a key
+ * @param m The map
+ * @param key The key
+ * @return 1 if the key was removed, 0 if it was not present
+ */
+int cmap_erase(struct cmap *m, uint64_t key) {
+    return cmap_write(m, key, CMAP_ABSENT);
+}
+
+// Lock Benchmark
+
+// Each thread repeatedly acquires the lock, does `cs_work` units of work on
+//  shared data, releases it, then does `cs_work` units of private work. The
+//  run reports total acquisitions per second and how evenly they were spread
+//  across threads (min/max ratio and Jain's fairness index, 1.0 = perfectly fair).
+
+/**
+ * State shared by all benchmark threads
+ */
+struct lock_bench {
+    struct lock lock;
+    unsigned int cs_work;
+    atomic_int start;
+    atomic_int stop;
+    volatile uint64_t shared[8];  // Data guarded by the lock
+};
+
+/**
+ * Per-thread result, padded so threads never share a cache line
+ */
+struct lock_bench_thread {
+    pthread_t thread;
+    struct lock_bench *bench;
+    uint64_t acquisitions;
+} __attribute__((aligned(64)));
+
+/**
+ * Burn a fixed amount of CPU work on a buffer
+ */
+static inline void do_work(volatile uint64_t *data, unsigned int units) {
+    for (unsigned int i = 0; i < units; ++i)
+        data[i & 7] += i;
+}
+
+static void *lock_bench_thread_main(void *arg) {
+    struct lock_bench_thread *t = arg;
+    struct lock_bench *b = t->bench;
+    volatile uint64_t private_data[8] = {0};
+    struct lock_node node;
+    uint64_t count = 0;
+
+    while (!atomic_load_explicit(&b->start, memory_order_acquire))
+        cpu_relax();
+    while (!atomic_load_explicit(&b->stop, memory_order_relaxed)) {
+        lock_acquire(&b->lock, &node);
+        do_work(b->shared, b->cs_work);
+        lock_release(&b->lock, &node);
+        do_work(private_data, b->cs_work);
+        count++;
+    }
+    t->acquisitions = count;
+    return NULL;
+}
+
+/**
+ * Run one benchmark configuration and print a result line
+ */
+static void lock_bench_run(enum lock_kind kind, int threads, unsigned int cs_work, int millis) {
+    struct lock_bench b;
+    struct lock_bench_thread *t = aligned_alloc(64, sizeof(*t) * threads);
+
+    memset(&b, 0, sizeof(b));
+    lock_init(&b.lock, kind);
+    b.cs_work = cs_work;
+    for (int i = 0; i < threads; ++i) {
+        t[i].bench = &b;
+        t[i].acquisitions = 0;
+        pthread_create(&t[i].thread, NULL, lock_bench_thread_main, &t[i]);
+    }
+
+    uint64_t start = now_ns();
+    atomic_store_explicit(&b.start, 1, memory_order_release);
+    usleep(millis * 1000);
+    atomic_store_explicit(&b.stop, 1, memory_order_relaxed);
+    for (int i = 0; i < threads; ++i)
+        pthread_join(t[i].thread, NULL);
+    uint64_t elapsed = now_ns() - start;
+
+    double total = 0, sum_sq = 0;
+    uint64_t min = UINT64_MAX, max = 0;
+    for (int i = 0; i < threads; ++i) {
+        double a = (double)t[i].acquisitions;
+        total += a;
+        sum_sq += a * a;
+        min = t[i].acquisitions < min ? t[i].acquisitions : min;
+        max = t[i].acquisitions > max ? t[i].acquisitions : max;
+    }
+    printf("%-9s %7d %8u %12.3f %9.3f %9.3f\n", lock_kind_names[kind], threads, cs_work,
+           total * 1e3 / elapsed, max ? (double)min / max : 0.0,
+           sum_sq > 0 ? total * total / (threads * sum_sq) : 0.0);
+
+    lock_destroy(&b.lock);
+    free(t);
+}
+
+/**
+ * Sweep lock kinds, thread counts and critical-section lengths
+ * @param max_threads Largest thread count; counts double from 1
+ * @param millis Duration of each configuration
+ * @return 0 on success
+ */
+int lock_bench_main(int max_threads, int millis) {
+    static const unsigned int cs_lengths[] = { 0, 50, 500 };
+
+    printf("%-9s %7s %8s %12s %9s %9s\n", "lock", "threads", "cs_work", "Mops/s", "min/max", "jain");
+    for (size_t c = 0; c < sizeof(cs_lengths) / sizeof(cs_lengths[0]); ++c) {
+        for (int threads = 1; threads <= max_threads; threads *= 2) {
+            for (int kind = 0; kind < LOCK_KIND_COUNT; ++kind)
+                lock_bench_run((enum lock_kind)kind, threads, cs_lengths[c], millis);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Shared state for the profiling demo: three locks with different contention
+ */
+struct prof_demo {
+    struct prof_mutex hot;     // Taken on every iteration by every thread
+    struct prof_mutex warm;    // Taken on every 16th iteration
+    struct prof_mutex cold;    // Private to thread 0
+    volatile uint64_t data[8];
+};
+
+struct prof_demo_arg {
+    struct prof_demo *demo;
+    int id;
+};
+
+static void *prof_demo_thread(void *arg) {
+    struct prof_demo *d = ((struct prof_demo_arg *)arg)->demo;
+    int id = ((struct prof_demo_arg *)arg)->id;
+
+    for (int i = 0; i < 200000; ++i) {
+        prof_mutex_lock(&d->hot);
+        do_work(d->data, 20);
+        prof_mutex_unlock(&d->hot);
+        if ((i & 15) == 0) {
+            prof_mutex_lock(&d->warm);
+            do_work(d->data, 200);
+            prof_mutex_unlock(&d->warm);
+        }
+        if (id == 0) {
+            prof_mutex_lock(&d->cold);
+            prof_mutex_unlock(&d->cold);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Run a small contended workload on profiled locks and dump the top locks
+ * @param threads Number of worker threads
+ * @return 0 on success
+ */
+int prof_demo_main(int threads) {
+    static struct prof_demo d;
+    pthread_t tid[64];
+    struct prof_demo_arg args[64];
+
+    if (threads > 64)
+        threads = 64;
+    prof_mutex_init(&d.hot, "hot");
+    prof_mutex_init(&d.warm, "warm");
+    prof_mutex_init(&d.cold, "cold");
+    for (int i = 0; i < threads; ++i) {
+        args[i].demo = &d;
+        args[i].id = i;
+        pthread_create(&tid[i], NULL, prof_demo_thread, &args[i]);
+    }
+    for (int i = 0; i < threads; ++i)
+        pthread_join(tid[i], NULL);
+
+    // Short-lived locks, far more than PROF_MAX_LOCKS of them: ids are recycled and the
+    //  statistics are kept under the name
+    for (int i = 0; i < 4 * PROF_MAX_LOCKS; ++i) {
+        struct prof_mutex request;
+        if (prof_mutex_init(&request, "request") < 0)
+            return 1;
+        prof_mutex_lock(&request);
+        prof_mutex_unlock(&request);
+        prof_mutex_destroy(&request);
+    }
+
+    // The threads have exited; their stats buffers were folded in and are still counted
+    prof_mutex_dump(stdout, 10);
+    return 0;
+}
+
+/**
+ * Measure the cost of profiling on uncontended lock/unlock pairs
+ * @param iterations Lock/unlock pairs per measurement
+ * @return 0 on success
+ */
+int prof_overhead_main(long iterations) {
+    pthread_mutex_t plain;
+    struct prof_mutex profiled;
+
+    pthread_mutex_init(&plain, NULL);
+    prof_mutex_init(&profiled, "overhead");
+
+    uint64_t start = now_ns();
+    for (long i = 0; i < iterations; ++i) {
+        pthread_mutex_lock(&plain);
+        pthread_mutex_unlock(&plain);
+    }
+    uint64_t plain_ns = now_ns() - start;
+
+    start = now_ns();
+    for (long i = 0; i < iterations; ++i) {
+        prof_mutex_lock(&profiled);
+        prof_mutex_unlock(&profiled);
+    }
+    uint64_t prof_ns = now_ns() - start;
+
+    printf("pthread_mutex lock/unlock: %6.1f ns\n", (double)plain_ns / iterations);
+    printf("prof_mutex lock/unlock:    %6.1f ns (+%.1f ns)\n", (double)prof_ns / iterations,
+           ((double)prof_ns - (double)plain_ns) / iterations);
+    pthread_mutex_destroy(&plain);
+    prof_mutex_destroy(&profiled);
+    return 0;
+}
+
+// Thread Pool Benchmark
+
+// Runs many small tasks three ways and reports the cost per task:
+// - thread: pthread_create() and pthread_join() per task, like the example
+// - submit: tasks submitted from outside the pool, then thread_pool_wait()
+// - spawn:  one root task per worker that submits the rest from inside the
+//           pool, so they land on worker deques and are balanced by stealing
+// A parallel_for over the same work is timed as well. Each run checks that
+// every task ran exactly once.
+
+/**
+ * State shared by the benchmark tasks
+ */
+struct pool_bench {
+    struct thread_pool *pool;
+    unsigned int work;       // do_work() units per task
+    long tasks_per_root;
+    _Alignas(64) atomic_long done;
+};
+
+static void pool_bench_task(void *arg) {
+    struct pool_bench *b = arg;
+    volatile uint64_t data[8] = {0};
+
+    do_work(data, b->work);
+    atomic_fetch_add_explicit(&b->done, 1, memory_order_relaxed);
+}
+
+static void *pool_bench_thread(void *arg) {
+    pool_bench_task(arg);
+    return NULL;
+}
+
+static void pool_bench_root(void *arg) {
+    struct pool_bench *b = arg;
+
+    for (long i = 0; i < b->tasks_per_root; ++i)
+        thread_pool_submit(b->pool, pool_bench_task, b);
+}
+
+static void pool_bench_range(void *ctx, long begin, long end) {
+    for (long i = begin; i < end; ++i)
+        pool_bench_task(ctx);
+}
+
+static void pool_bench_report(const char *name, struct pool_bench *b, long tasks, uint64_t elapsed, int *failed) {
+    long done = atomic_load(&b->done);
+
+    printf("%-12s %10ld %12.1f\n", name, tasks, (double)elapsed / tasks);
+    if (done != tasks) {
+        fprintf(stderr, "%s: %ld of %ld tasks ran\n", name, done, tasks);
+        *failed = 1;
+    }
+    atomic_store(&b->done, 0);
+}
+
+/**
+ * Compare the thread pool with a thread per task
+ * @param tasks Number of tasks per pool run
+ * @param work do_work() units per task
+ * @param workers Pool size (0 = one per online CPU)
+ * @return 0 on success, 1 if a run lost or duplicated tasks
+ */
+int pool_bench_main(long tasks, unsigned int work, int workers) {
+    static struct thread_pool pool;
+    struct pool_bench b = { .pool = &pool, .work = work };
+    long thread_tasks = tasks < 20000 ? tasks : 20000;  // Spawning is slow; keep it short
+    int failed = 0;
+    uint64_t start;
+
+    if (thread_pool_init(&pool, workers) < 0)
+        return 1;
+    atomic_init(&b.done, 0);
+    printf("%d workers, %u work units per task\n", pool.nworkers, work);
+    printf("%-12s %10s %12s\n", "method", "tasks", "ns/task");
+
+    start = now_ns();
+    for (long i = 0; i < thread_tasks; ++i) {
+        pthread_t t;
+        pthread_create(&t, NULL, pool_bench_thread, &b);
+        pthread_join(t, NULL);
+    }
+    pool_bench_report("thread", &b, thread_tasks, now_ns() - start, &failed);
+
+    start = now_ns();
+    for (long i = 0; i < tasks; ++i)
+        thread_pool_submit(&pool, pool_bench_task, &b);
+    thread_pool_wait(&pool);
+    pool_bench_report("submit", &b, tasks, now_ns() - start, &failed);
+
+    b.tasks_per_root = tasks / pool.nworkers;
+    start = now_ns();
+    for (int i = 0; i < pool.nworkers; ++i)
+        thread_pool_submit(&pool, pool_bench_root, &b);
+    thread_pool_wait(&pool);
+    pool_bench_report("spawn", &b, b.tasks_per_root * pool.nworkers, now_ns() - start, &failed);
+
+    start = now_ns();
+    thread_pool_parallel_for(&pool, 0, tasks, 64, pool_bench_range, &b);
+    pool_bench_report("parallel_for", &b, tasks, now_ns() - start, &failed);
+
+    thread_pool_destroy(&pool);
+    return failed;
+}
+
+// Hash Map Benchmark
+
+// The baseline is a plain linear-probing map behind one pthread mutex, the
+//  way a shared map usually starts out. Threads run a mix of gets and
+//  put/erase pairs on random keys, half of which are present at the start;
+//  with erases churning the table, the concurrent map keeps resizing in the
+//  background. Every value written is a function of its key, so a get that
+//  returns anything else counts as an error. A correctness pass runs first:
+//  each thread checks its own keys against a private copy while all of
+//  them force resizes.
+
+#define MAP_BENCH_KEYS 65536
+
+/**
+ * Single-threaded linear-probing map, used under a mutex as the baseline
+ */
+struct mutex_map {
+    pthread_mutex_t mutex;
+    size_t mask, used;
+    uint64_t *keys;    // 0 = empty
+    uint64_t *values;  // CMAP_ABSENT = erased
+};
+
+static int mutex_map_init(struct mutex_map *m, size_t capacity) {
+    size_t n = 16;
+
+    while (n < capacity)
+        n <<= 1;
+    m->keys = calloc(n, sizeof(uint64_t));
+    m->values = malloc(n * sizeof(uint64_t));
+    if (!m->keys || !m->values) {
+        free(m->keys);
+        free(m->values);
+        return -1;
+    }
+    m->mask = n - 1;
+    m->used = 0;
+    pthread_mutex_init(&m->mutex, NULL);
+    return 0;
+}
+
+static void mutex_map_destroy(struct mutex_map *m) {
+    pthread_mutex_destroy(&m->mutex);
+    free(m->keys);
+    free(m->values);
+}
+
+/**
+ * Find the slot for a key, or the empty slot ending its probe run; caller holds the mutex
+ */
+static size_t mutex_map_slot(struct mutex_map *m, uint64_t key) {
+    size_t i = cmap_hash(key) & m->mask;
+
+    while (m->keys[i] != key && m->keys[i] != 0)
+        i = (i + 1) & m->mask;
+    return i;
+}
+
+/**
+ * Rehash into a table sized for the live keys, dropping erased ones
+ */
+static void mutex_map_rehash(struct mutex_map *m) {
+    size_t old_cap = m->mask + 1, live = 0, n = old_cap;
+    uint64_t *keys = m->keys, *values = m->values;
+
+    for (size_t i = 0; i < old_cap; ++i)
+        live += keys[i] && values[i] != CMAP_ABSENT;
+    while (n * 3 < live * 8)
+        n <<= 1;
+    m->keys = calloc(n, sizeof(uint64_t));
+    m->values = malloc(n * sizeof(uint64_t));
+    if (!m->keys || !m->values) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    m->mask = n - 1;
+    m->used = 0;
+    for (size_t i = 0; i < old_cap; ++i) {
+        if (keys[i] && values[i] != CMAP_ABSENT) {
+            size_t s = mutex_map_slot(m, keys[i]);
+            m->keys[s] = keys[i];
+            m->values[s] = values[i];
+            m->used++;
+        }
+    }
+    free(keys);
+    free(values);
+}
+
+static int mutex_map_get(struct mutex_map *m, uint64_t key, uint64_t *value) {
+    int found;
+
+    pthread_mutex_lock(&m->mutex);
+    size_t i = mutex_map_slot(m, key);
+    found = m->keys[i] == key && m->values[i] != CMAP_ABSENT;
+    if (found)
+        *value = m->values[i];
+    pthread_mutex_unlock(&m->mutex);
+    return found;
+}
+
+static void mutex_map_write(struct mutex_map *m, uint64_t key, uint64_t value) {
+    pthread_mutex_lock(&m->mutex);
+    size_t i = mutex_map_slot(m, key);
+    if (m->keys[i] != key) {
+        if (value == CMAP_ABSENT) {
+            pthread_mutex_unlock(&m->mutex);
+            return;
+        }
+        m->keys[i] = key;
+        if (++m->used > (m->mask + 1) * 3 / 4) {
+            m->values[i] = value;
+            mutex_map_rehash(m);
+            pthread_mutex_unlock(&m->mutex);
+            return;
+        }
+    }
+    m->values[i] = value;
+    pthread_mutex_unlock(&m->mutex);
+}
+
+enum map_kind { MAP_CONCURRENT, MAP_MUTEX, MAP_KIND_COUNT };
+
+static const char *const map_kind_names[MAP_KIND_COUNT] = { "cmap", "mutex" };
+
+/**
+ * State shared by the map benchmark threads
+ */
+struct map_bench {
+    enum map_kind kind;
+    struct cmap cmap;
+    struct mutex_map mmap;
+    int read_percent;
+    _Alignas(64) atomic_int stop;
+};
+
+/**
+ * Per-thread result
+ */
+struct map_bench_thread {
+    _Alignas(64) struct map_bench *bench;
+    pthread_t tid;
+    uint64_t seed;
+    uint64_t ops, errors;
+    int index, threads;
+};
+
+static inline uint64_t map_bench_rand(uint64_t *seed) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 7;
+    *seed ^= *seed << 17;
+    return *seed;
+}
+
+static inline uint64_t map_bench_value(uint64_t key) {
+    return key * 3 + 1;
+}
+
+static int map_bench_get(struct map_bench *b, uint64_t key, uint64_t *value) {
+    return b->kind == MAP_CONCURRENT ? cmap_get(&b->cmap, key, value) : mutex_map_get(&b->mmap, key, value);
+}
+
+static void map_bench_write(struct map_bench *b, uint64_t key, uint64_t value) {
+    if (b->kind == MAP_CONCURRENT) {
+        if (value == CMAP_ABSENT)
+            cmap_erase(&b->cmap, key);
+        else
+            cmap_put(&b->cmap, key, value);
+    } else {
+        mutex_map_write(&b->mmap, key, value);
+    }
+}
+
+static void *map_bench_worker(void *arg) {
+    struct map_bench_thread *t = arg;
+    struct map_bench *b = t->bench;
+    uint64_t ops = 0, value;
+
+    while (!atomic_load_explicit(&b->stop, memory_order_relaxed)) {
+        for (int i = 0; i < 64; ++i) {
+            uint64_t r = map_bench_rand(&t->seed);
+            uint64_t key = (r >> 8) % MAP_BENCH_KEYS + 1;
+            if ((int)(r & 127) * 100 < b->read_percent * 128) {
+                if (map_bench_get(b, key, &value) && value != map_bench_value(key))
+                    t->errors++;
+            } else {
+                map_bench_write(b, key, (r >> 7) & 1 ? map_bench_value(key) : CMAP_ABSENT);
+            }
+        }
+        ops += 64;
+    }
+    t->ops = ops;
+    return NULL;
+}
+
+/**
+ * Each thread owns the keys congruent to its index and checks every
+ * operation against a private copy, while all threads together force the
+ * map through many resizes
+ */
+static void *map_check_worker(void *arg) {
+    struct map_bench_thread *t = arg;
+    struct cmap *m = &t->bench->cmap;
+    const int keys = 4096;
+    uint64_t *expect = calloc(keys, sizeof(uint64_t)), value;
+
+    if (!expect) {
+        t->errors++;
+        return NULL;
+    }
+    for (int round = 0; round < 200000; ++round) {
+        uint64_t r = map_bench_rand(&t->seed);
+        int k = (int)((r >> 8) % keys);
+        uint64_t key = (uint64_t)k * t->threads + t->index + 1;
+        int found;
+        switch (r & 3) {
+        case 0:
+            found = cmap_erase(m, key);
+            t->errors += found != (expect[k] != 0);
+            expect[k] = 0;
+            break;
+        case 1:
+            found = cmap_put(m, key, round + 1);
+            t->errors += found != (expect[k] != 0);
+            expect[k] = round + 1;
+            break;
+        default:
+            found = cmap_get(m, key, &value);
+            t->errors += found != (expect[k] != 0) || (found && value != expect[k]);
+            break;
+        }
+    }
+    for (int k = 0; k < keys; ++k) {
+        int found = cmap_get(m, (uint64_t)k * t->threads + t->index + 1, &value);
+        t->errors += found != (expect[k] != 0) || (found && value != expect[k]);
+    }
+    free(expect);
+    return NULL;
+}
+
+/**
+ * Run the correctness pass
+ * @return Number of mismatches
+ */
+static uint64_t map_check(int threads) {
+    static struct map_bench b;
+    struct map_bench_thread t[64];
+    uint64_t errors = 0;
+
+    if (threads > 64)
+        threads = 64;
+    if (cmap_init(&b.cmap, 0) < 0)
+        return 1;
+    for (int i = 0; i < threads; ++i) {
+        t[i] = (struct map_bench_thread){ .bench = &b, .seed = 0x9e3779b97f4a7c15ull * (i + 1), .index = i,
+                                          .threads = threads };
+        pthread_create(&t[i].tid, NULL, map_check_worker, &t[i]);
+    }
+    for (int i = 0; i < threads; ++i) {
+        pthread_join(t[i].tid, NULL);
+        errors += t[i].errors;
+    }
+    printf("check: %d threads, %u resizes, %u replaced tables not freed yet, %llu mismatches\n", threads,
+           atomic_load(&b.cmap.resizes), atomic_load(&b.cmap.retired_count), (unsigned long long)errors);
+    cmap_destroy(&b.cmap);
+    return errors;
+}
+
+/**
+ * Compare the concurrent map with the mutex map on 90/10 and 50/50 mixes
+ * @param max_threads Highest thread count (0 = number of online CPUs, at least 4)
+ * @param millis Duration of each run
+ * @return 0 on success, 1 on any mismatch
+ */
+int map_bench_main(int max_threads, int millis) {
+    static struct map_bench b;
+    static const int read_percents[] = { 90, 50 };
+    struct map_bench_thread t[64];
+    uint64_t errors = 0;
+
+    if (max_threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        max_threads = cpus > 4 ? (int)cpus : 4;
+    }
+    if (max_threads > 64)
+        max_threads = 64;
+    errors += map_check(max_threads);
+
+    printf("%-6s %6s %8s %12s %8s\n", "map", "reads", "threads", "Mops/s", "resizes");
+    for (size_t w = 0; w < sizeof(read_percents) / sizeof(read_percents[0]); ++w) {
+        for (int threads = 1; threads <= max_threads; threads *= 2) {
+            for (int kind = 0; kind < MAP_KIND_COUNT; ++kind) {
+                uint64_t seed = 42, ops = 0, start;
+                b.kind = kind;
+                b.read_percent = read_percents[w];
+                if (cmap_init(&b.cmap, 0) < 0 || mutex_map_init(&b.mmap, 0) < 0)
+                    return 1;
+                for (uint64_t k = 1; k <= MAP_BENCH_KEYS; ++k)
+                    if (map_bench_rand(&seed) & 1)
+                        map_bench_write(&b, k, map_bench_value(k));
+                unsigned int resizes = atomic_load(&b.cmap.resizes);
+                atomic_store(&b.stop, 0);
+                start = now_ns();
+                for (int i = 0; i < threads; ++i) {
+                    t[i] = (struct map_bench_thread){ .bench = &b, .seed = 0x2545f4914f6cdd1dull * (i + 1) };
+                    pthread_create(&t[i].tid, NULL, map_bench_worker, &t[i]);
+                }
+                usleep(millis * 1000);
+                atomic_store(&b.stop, 1);
+                for (int i = 0; i < threads; ++i) {
+                    pthread_join(t[i].tid, NULL);
+                    ops += t[i].ops;
+                    errors += t[i].errors;
+                }
+                printf("%-6s %5d%% %8d %12.2f %8u\n", map_kind_names[kind], read_percents[w], threads,
+                       ops * 1e3 / (now_ns() - start),
+                       kind == MAP_CONCURRENT ? atomic_load(&b.cmap.resizes) - resizes : 0);
+                cmap_destroy(&b.cmap);
+                mutex_map_destroy(&b.mmap);
+            }
+        }
+    }
+    if (errors)
+        fprintf(stderr, "%llu wrong values\n", (unsigned long long)errors);
+    return errors != 0;
+}
+
+/**
+ * Main function that creates multiple threads and protects the shared resource with a mutex
+ * @return 0 on success
+ */
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        return lock_bench_main(argc > 2 ? atoi(argv[2]) : (int)(cores > 1 ? cores * 2 : 4),
+                               argc > 3 ? atoi(argv[3]) : 200);
+    }
+    if (argc > 1 && strcmp(argv[1], "profile") == 0)
+        return prof_demo_main(argc > 2 ? atoi(argv[2]) : 4);
+    if (argc > 1 && strcmp(argv[1], "prof-overhead") == 0)
+        return prof_overhead_main(argc > 2 ? atol(argv[2]) : 10000000);
+    if (argc > 1 && strcmp(argv[1], "bench-pool") == 0)
+        return pool_bench_main(argc > 2 ? atol(argv[2]) : 1000000, argc > 3 ? atoi(argv[3]) : 100,
+                               argc > 4 ? atoi(argv[4]) : 0);
+    if (argc > 1 && strcmp(argv[1], "bench-map") == 0)
+        return map_bench_main(argc > 2 ? atoi(argv[2]) : 0, argc > 3 ? atoi(argv[3]) : 200);
+
     // Array to store the threads
     pthread_t threads[5];
 
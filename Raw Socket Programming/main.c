@@ -12,8 +12,16 @@
  * 
  * - Root/Administrator Privileges: Required to create raw sockets and send/receive
  *   packets.
+ *
+ * Build: gcc -O2 -pthread main.c -o raw_socket
+ * Run without arguments for the basic example, or see usage() for the other modes.
  */
 
+#define _GNU_SOURCE  // sendmmsg(), pthread_setaffinity_np()
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -22,9 +30,29 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <netinet/if_ether.h>
 #include <net/if.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+#include <linux/net_tstamp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <sys/wait.h>
 
 /**
  * @brief Structure to represent an Ethernet frame.
@@ -34,14 +62,26 @@ struct ether_frame {
     unsigned char data[ETH_FRAME_LEN - sizeof(struct ethhdr)];  ///< Payload
 };
 
+/*
+ * Internet checksum (RFC 1071)
+ *
+ * The one's complement sum is independent of byte order and word size, so it
+ * can be accumulated over wider words and folded down to 16 bits at the end.
+ * csum_partial() returns an unfolded 64-bit partial sum; partial sums of
+ * even-length pieces may be added together before folding.
+ */
+
 /**
- * @brief Calculate the checksum of a buffer.
+ * @brief Reference checksum, one 16-bit word at a time.
+ *
+ * The 32-bit accumulator overflows (dropping carries) for buffers larger than
+ * about 128 KiB, so it is only kept to validate the faster versions.
  *
  * @param b Pointer to the buffer.
  * @param len Length of the buffer.
  * @return The checksum.
  */
-unsigned short checksum(void *b, int len) {
+unsigned short checksum_reference(void *b, int len) {
     unsigned short *buf = b;
     unsigned int sum = 0;
     unsigned short result;
@@ -56,6 +96,217 @@ unsigned short checksum(void *b, int len) {
     return result;
 }
 
+/**
+ * @brief Add two partial sums with end-around carry.
+ */
+static inline uint64_t csum_add(uint64_t a, uint64_t b) {
+    a += b;
+    return a + (a < b);
+}
+
+/**
+ * @brief Sum the trailing (len % 4) bytes of a buffer as 16-bit words.
+ */
+static inline uint64_t csum_tail(const unsigned char *p, size_t len, uint64_t sum) {
+    uint16_t w;
+
+    if (len & 2) {
+        memcpy(&w, p, 2);
+        sum += w;
+        p += 2;
+    }
+    if (len & 1) {
+        w = 0;
+        memcpy(&w, p, 1);  // Pad the odd byte with zero in memory order
+        sum += w;
+    }
+    return sum;
+}
+
+/**
+ * @brief Portable partial sum with a 64-bit accumulator over 32-bit words.
+ *
+ * Each 32-bit addend fits 2^32 times into the accumulator before it could
+ * overflow, so no carry is ever lost.
+ *
+ * @param buf Pointer to the buffer; any alignment.
+ * @param len Length of the buffer.
+ * @param sum Partial sum to continue from.
+ * @return The unfolded partial sum.
+ */
+uint64_t csum_partial_scalar(const void *buf, size_t len, uint64_t sum) {
+    const unsigned char *p = buf;
+    uint64_t sum2 = 0;
+    uint32_t w[4];
+
+    while (len >= 16) {
+        memcpy(w, p, 16);
+        sum += (uint64_t)w[0] + w[1];
+        sum2 += (uint64_t)w[2] + w[3];
+        p += 16;
+        len -= 16;
+    }
+    while (len >= 4) {
+        memcpy(w, p, 4);
+        sum += w[0];
+        p += 4;
+        len -= 4;
+    }
+    return csum_tail(p, len, csum_add(sum, sum2));
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#include <x86intrin.h>
+
+/**
+ * @brief SSE2 partial sum: four 32-bit words widened to 64-bit lanes per load.
+ */
+__attribute__((target("sse2")))
+uint64_t csum_partial_sse2(const void *buf, size_t len, uint64_t sum) {
+    const unsigned char *p = buf;
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc0 = _mm_setzero_si128();
+    __m128i acc1 = _mm_setzero_si128();
+    uint64_t lanes[2];
+
+    while (len >= 32) {
+        __m128i a = _mm_loadu_si128((const __m128i *)p);
+        __m128i b = _mm_loadu_si128((const __m128i *)(p + 16));
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(a, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(a, zero));
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(b, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(b, zero));
+        p += 32;
+        len -= 32;
+    }
+    _mm_storeu_si128((__m128i *)lanes, _mm_add_epi64(acc0, acc1));
+    sum = csum_add(sum, lanes[0]);
+    sum = csum_add(sum, lanes[1]);
+    return csum_partial_scalar(p, len, sum);
+}
+
+/**
+ * @brief AVX2 partial sum: eight 32-bit words widened to 64-bit lanes per load.
+ */
+__attribute__((target("avx2")))
+uint64_t csum_partial_avx2(const void *buf, size_t len, uint64_t sum) {
+    const unsigned char *p = buf;
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    uint64_t lanes[4];
+
+    while (len >= 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)p);
+        __m256i b = _mm256_loadu_si256((const __m256i *)(p + 32));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(a, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(a, zero));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(b, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(b, zero));
+        p += 64;
+        len -= 64;
+    }
+    _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi64(acc0, acc1));
+    for (int i = 0; i < 4; ++i)
+        sum = csum_add(sum, lanes[i]);
+    return csum_partial_sse2(p, len, sum);
+}
+#endif
+
+static uint64_t csum_partial_resolve(const void *buf, size_t len, uint64_t sum);
+
+/**
+ * @brief The partial-sum implementation selected for this CPU.
+ */
+static uint64_t (*csum_partial_impl)(const void *, size_t, uint64_t) = csum_partial_resolve;
+
+/**
+ * @brief Pick the widest implementation the CPU supports, then run it.
+ */
+static uint64_t csum_partial_resolve(const void *buf, size_t len, uint64_t sum) {
+    uint64_t (*impl)(const void *, size_t, uint64_t) = csum_partial_scalar;
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        impl = csum_partial_avx2;
+    else if (__builtin_cpu_supports("sse2"))
+        impl = csum_partial_sse2;
+#endif
+    __atomic_store_n(&csum_partial_impl, impl, __ATOMIC_RELAXED);
+    return impl(buf, len, sum);
+}
+
+/**
+ * @brief Compute an unfolded partial sum with the best available implementation.
+ *
+ * @param buf Pointer to the buffer.
+ * @param len Length of the buffer; must be even unless this is the last piece.
+ * @param sum Partial sum to continue from, 0 to start.
+ * @return The unfolded partial sum.
+ */
+uint64_t csum_partial(const void *buf, size_t len, uint64_t sum) {
+    return __atomic_load_n(&csum_partial_impl, __ATOMIC_RELAXED)(buf, len, sum);
+}
+
+/**
+ * @brief Fold a partial sum to 16 bits and complement it.
+ *
+ * @param sum The partial sum.
+ * @return The checksum, ready to store in a header.
+ */
+uint16_t csum_fold(uint64_t sum) {
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+/**
+ * @brief Calculate the checksum of a buffer.
+ *
+ * @param b Pointer to the buffer.
+ * @param len Length of the buffer.
+ * @return The checksum.
+ */
+unsigned short checksum(void *b, int len) {
+    return csum_fold(csum_partial(b, (size_t)len, 0));
+}
+
+/**
+ * @brief Update a checksum after one 16-bit word changed (RFC 1624, eqn. 3).
+ *
+ * HC' = ~(~HC + ~m + m'). All values are as stored in the packet.
+ *
+ * @param check The current checksum field.
+ * @param old_word The word before the change.
+ * @param new_word The word after the change.
+ * @return The new checksum field.
+ */
+uint16_t csum_update16(uint16_t check, uint16_t old_word, uint16_t new_word) {
+    uint32_t sum = (uint16_t)~check + (uint32_t)(uint16_t)~old_word + new_word;
+
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+/**
+ * @brief Update a checksum after a 32-bit field (e.g. an IPv4 address) changed.
+ *
+ * @param check The current checksum field.
+ * @param old_value The field before the change, as stored in the packet.
+ * @param new_value The field after the change, as stored in the packet.
+ * @return The new checksum field.
+ */
+uint16_t csum_update32(uint16_t check, uint32_t old_value, uint32_t new_value) {
+    check = csum_update16(check, (uint16_t)old_value, (uint16_t)new_value);
+    return csum_update16(check, (uint16_t)(old_value >> 16), (uint16_t)(new_value >> 16));
+}
+
 /**
  * @brief Create a raw socket.
  *
@@ -71,17 +322,23 @@ int create_raw_socket() {
 }
 
 /**
- * @brief Send a raw Ethernet frame.
+ * @brief Build and send one raw Ethernet frame on a named interface.
+ *
+ * Resolves the interface, copies the payload into a stack frame and calls
+ * `sendto`, all per frame. The transmit engine below avoids each of these.
  *
  * @param sockfd The file descriptor of the raw socket.
+ * @param ifname The interface to send on.
  * @param dest_mac The destination MAC address.
  * @param src_mac The source MAC address.
  * @param ether_type The Ethernet type.
  * @param payload The payload.
  * @param payload_len The length of the payload.
+ * @return The result of `sendto`.
  */
-void send_raw_ethernet(int sockfd, const unsigned char *dest_mac, const unsigned char *src_mac,
-                       unsigned short ether_type, const unsigned char *payload, int payload_len) {
+ssize_t send_raw_ethernet_frame(int sockfd, const char *ifname, const unsigned char *dest_mac,
+                                const unsigned char *src_mac, unsigned short ether_type,
+                                const unsigned char *payload, int payload_len) {
     struct ether_frame frame;
     struct sockaddr_ll socket_address;
 
@@ -101,12 +358,29 @@ void send_raw_ethernet(int sockfd, const unsigned char *dest_mac, const unsigned
 
     // Set packet interface index
     struct ifreq ifr;
-    strncpy((char *)ifr.ifr_name, "eth0", IFNAMSIZ); // Change "eth0" to your network interface
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy((char *)ifr.ifr_name, ifname, IFNAMSIZ - 1);
     ioctl(sockfd, SIOCGIFINDEX, &ifr);
     socket_address.sll_ifindex = ifr.ifr_ifindex;
 
     // Send packet
-    if (sendto(sockfd, &frame, sizeof(struct ethhdr) + payload_len, 0, (struct sockaddr *)&socket_address, sizeof(struct sockaddr_ll)) < 0) {
+    return sendto(sockfd, &frame, sizeof(struct ethhdr) + payload_len, 0, (struct sockaddr *)&socket_address, sizeof(struct sockaddr_ll));
+}
+
+/**
+ * @brief Send a raw Ethernet frame.
+ *
+ * @param sockfd The file descriptor of the raw socket.
+ * @param dest_mac The destination MAC address.
+ * @param src_mac The source MAC address.
+ * @param ether_type The Ethernet type.
+ * @param payload The payload.
+ * @param payload_len The length of the payload.
+ */
+void send_raw_ethernet(int sockfd, const unsigned char *dest_mac, const unsigned char *src_mac,
+                       unsigned short ether_type, const unsigned char *payload, int payload_len) {
+    // Change "eth0" to your network interface
+    if (send_raw_ethernet_frame(sockfd, "eth0", dest_mac, src_mac, ether_type, payload, payload_len) < 0) {
         perror("Packet send failed");
     } else {
         printf("Packet sent successfully\n");
@@ -114,57 +388,3260 @@ void send_raw_ethernet(int sockfd, const unsigned char *dest_mac, const unsigned
 }
 
 /**
- * @brief Receive a raw Ethernet frame.
+ * @brief Callback invoked once for every received frame.
+ *
+ * The `recvfrom` path, the memory-mapped ring path and pcap file sources all
+ * deliver frames through this type, so the same consumer can be driven by
+ * any of them.
+ *
+ * @param frame Pointer to the start of the Ethernet header.
+ * @param len Number of captured bytes.
+ * @param ts_ns Capture time in nanoseconds since the Unix epoch.
+ * @param user Opaque pointer passed through from the caller.
+ */
+typedef void (*frame_handler)(const unsigned char *frame, unsigned int len, uint64_t ts_ns, void *user);
+
+/**
+ * @brief Read the monotonic clock.
+ *
+ * @return The current time in nanoseconds.
+ */
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * @brief Read the wall clock.
+ *
+ * @return Nanoseconds since the Unix epoch.
+ */
+static uint64_t realtime_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * @brief Read the CPU time consumed by the calling thread.
+ *
+ * @return The thread CPU time in nanoseconds.
+ */
+static uint64_t thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * @brief Look up the index of a network interface.
+ *
+ * @param sockfd Any open socket, used for the ioctl.
+ * @param ifname The interface name, e.g. "eth0".
+ * @return The interface index, or -1 on error.
+ */
+int get_ifindex(int sockfd, const char *ifname) {
+    struct ifreq ifr;
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    if (ioctl(sockfd, SIOCGIFINDEX, &ifr) < 0) {
+        perror("SIOCGIFINDEX failed");
+        return -1;
+    }
+    return ifr.ifr_ifindex;
+}
+
+/**
+ * @brief Bind a raw socket to one interface so only its traffic is captured.
  *
  * @param sockfd The file descriptor of the raw socket.
+ * @param ifname The interface name.
+ * @param protocol The Ethernet protocol to receive, in host byte order.
+ * @return 0 on success, -1 on error.
  */
-void receive_raw_ethernet(int sockfd) {
-    struct ether_frame frame;
+int bind_raw_socket(int sockfd, const char *ifname, unsigned short protocol) {
     struct sockaddr_ll socket_address;
-    socklen_t sll_len = sizeof(socket_address);
-    ssize_t recv_size;
+    int ifindex = get_ifindex(sockfd, ifname);
 
-    // Receive packet
-    recv_size = recvfrom(sockfd, &frame, sizeof(struct ether_frame), 0, (struct sockaddr *)&socket_address, &sll_len);
-    if (recv_size < 0) {
-        perror("Packet receive failed");
-    } else {
-        printf("Packet received successfully\n");
+    if (ifindex < 0)
+        return -1;
+
+    memset(&socket_address, 0, sizeof(socket_address));
+    socket_address.sll_family = AF_PACKET;
+    socket_address.sll_protocol = htons(protocol);
+    socket_address.sll_ifindex = ifindex;
+    if (bind(sockfd, (struct sockaddr *)&socket_address, sizeof(socket_address)) < 0) {
+        perror("Socket bind failed");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Packet decoder
+ *
+ * decode_frame() walks Ethernet, up to two 802.1Q/802.1ad tags, IPv4 or IPv6
+ * (skipping extension headers) and TCP, UDP or ICMP in place. Nothing is
+ * copied: the descriptor records offsets into the frame plus the few fields
+ * needed to classify it.
+ */
+
+#define DESC_TRUNCATED 0x01  ///< A header ran past the captured length
+#define DESC_FRAGMENT 0x02   ///< Non-first IP fragment; no L4 header
+
+/**
+ * @brief Compact description of a decoded frame. Offsets are from frame start.
+ */
+struct pkt_desc {
+    const unsigned char *frame;  ///< The frame this describes
+    uint32_t len;                ///< Captured length
+    uint16_t l3_off;             ///< Start of the network header
+    uint16_t l4_off;             ///< Start of the transport header, 0 if none
+    uint16_t payload_off;        ///< Start of the transport payload, 0 if none
+    uint16_t ether_type;         ///< Innermost EtherType, host order
+    uint16_t vlan_tci[2];        ///< Outer and inner VLAN tags, host order
+    uint8_t vlan_count;          ///< Number of VLAN tags seen
+    uint8_t ip_version;          ///< 4, 6, or 0 for non-IP
+    uint8_t ip_proto;            ///< Transport protocol number
+    uint8_t flags;               ///< DESC_* flags
+    uint16_t src_port;           ///< Source port, or ICMP type
+    uint16_t dst_port;           ///< Destination port, or ICMP code
+};
+
+/**
+ * @brief Load a big-endian 16-bit value from an unaligned address.
+ */
+static inline uint16_t load_be16(const unsigned char *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+/**
+ * @brief Decode a frame's headers into a descriptor without copying.
+ *
+ * @param frame Pointer to the start of the Ethernet header.
+ * @param len Number of captured bytes.
+ * @param d The descriptor to fill in.
+ * @return The highest layer decoded (2, 3 or 4), or -1 if the Ethernet header is truncated.
+ */
+int decode_frame(const unsigned char *frame, unsigned int len, struct pkt_desc *d) {
+    unsigned int off = sizeof(struct ethhdr);
+    uint16_t type;
+    uint8_t proto;
 
-        // Print Ethernet header info
-        printf("Destination MAC: %02x:%02x:%02x:%02x:%02x:%02x\n",
-               frame.header.h_dest[0], frame.header.h_dest[1], frame.header.h_dest[2],
-               frame.header.h_dest[3], frame.header.h_dest[4], frame.header.h_dest[5]);
-        printf("Source MAC: %02x:%02x:%02x:%02x:%02x:%02x\n",
-               frame.header.h_source[0], frame.header.h_source[1], frame.header.h_source[2],
-               frame.header.h_source[3], frame.header.h_source[4], frame.header.h_source[5]);
-        printf("Ethernet Type: %04x\n", ntohs(frame.header.h_proto));
+    *d = (struct pkt_desc){ .frame = frame, .len = len };
+    if (len < off) {
+        d->flags = DESC_TRUNCATED;
+        return -1;
+    }
 
-        // Print payload (data)
-        printf("Payload (first 20 bytes): ");
-        for (int i = 0; i < 20 && i < recv_size - sizeof(struct ether_frame); ++i) {
-            printf("%02x ", frame.data[i]);
+    // Layer 2: Ethernet and VLAN tags
+    type = load_be16(frame + 12);
+    while (type == ETH_P_8021Q || type == ETH_P_8021AD) {
+        if (len < off + 4) {
+            d->flags = DESC_TRUNCATED;
+            return 2;
         }
-        printf("\n");
+        if (d->vlan_count < 2)
+            d->vlan_tci[d->vlan_count++] = load_be16(frame + off);
+        type = load_be16(frame + off + 2);
+        off += 4;
+    }
+    d->ether_type = type;
+    d->l3_off = (uint16_t)off;
+
+    // Layer 3: IPv4 or IPv6
+    if (type == ETH_P_IP) {
+        const unsigned char *ip = frame + off;
+        unsigned int ihl;
+        if (len < off + 20 || (ip[0] >> 4) != 4 || (ihl = (ip[0] & 0x0F) * 4u) < 20 || len < off + ihl) {
+            d->flags = DESC_TRUNCATED;
+            return 2;
+        }
+        d->ip_version = 4;
+        proto = ip[9];
+        if (load_be16(ip + 6) & 0x1FFF)
+            d->flags |= DESC_FRAGMENT;
+        off += ihl;
+    } else if (type == ETH_P_IPV6) {
+        if (len < off + 40 || (frame[off] >> 4) != 6) {
+            d->flags = DESC_TRUNCATED;
+            return 2;
+        }
+        d->ip_version = 6;
+        proto = frame[off + 6];
+        off += 40;
+        while (proto == IPPROTO_HOPOPTS || proto == IPPROTO_ROUTING ||
+               proto == IPPROTO_DSTOPTS || proto == IPPROTO_FRAGMENT) {
+            const unsigned char *ext = frame + off;
+            if (len < off + 8) {
+                d->flags = DESC_TRUNCATED;
+                d->ip_proto = proto;
+                return 3;
+            }
+            if (proto == IPPROTO_FRAGMENT && (load_be16(ext + 2) & 0xFFF8))
+                d->flags |= DESC_FRAGMENT;
+            off += proto == IPPROTO_FRAGMENT ? 8u : (ext[1] + 1u) * 8;
+            proto = ext[0];
+        }
+    } else {
+        return 2;
+    }
+    d->ip_proto = proto;
+    if (d->flags & DESC_FRAGMENT)
+        return 3;
+
+    // Layer 4: TCP, UDP or ICMP
+    const unsigned char *l4 = frame + off;
+    unsigned int hdr_len;
+    switch (proto) {
+        case IPPROTO_TCP:
+            if (len < off + 20 || (hdr_len = (l4[12] >> 4) * 4u) < 20) {
+                d->flags |= DESC_TRUNCATED;
+                return 3;
+            }
+            d->src_port = load_be16(l4);
+            d->dst_port = load_be16(l4 + 2);
+            break;
+        case IPPROTO_UDP:
+            hdr_len = 8;
+            if (len < off + hdr_len) {
+                d->flags |= DESC_TRUNCATED;
+                return 3;
+            }
+            d->src_port = load_be16(l4);
+            d->dst_port = load_be16(l4 + 2);
+            break;
+        case IPPROTO_ICMP:
+        case IPPROTO_ICMPV6:
+            hdr_len = 8;
+            if (len < off + 4) {
+                d->flags |= DESC_TRUNCATED;
+                return 3;
+            }
+            d->src_port = l4[0];
+            d->dst_port = l4[1];
+            break;
+        default:
+            return 3;
     }
+    d->l4_off = (uint16_t)off;
+    if (len >= off + hdr_len)
+        d->payload_off = (uint16_t)(off + hdr_len);
+    else
+        d->flags |= DESC_TRUNCATED;
+    return 4;
 }
 
-int main() {
-    int sockfd = create_raw_socket();
+/*
+ * Flow table
+ *
+ * Open addressing with linear probing over a power-of-two array that is
+ * allocated once up front. Lookups never allocate; once the table reaches
+ * its load limit, packets of new flows are counted in `overflows` instead.
+ */
 
-    // Example: Send a raw Ethernet frame
-    unsigned char dest_mac[] = {0x00, 0x0c, 0x29, 0xb1, 0x1e, 0x1f}; // Destination MAC address
-    unsigned char src_mac[] = {0x00, 0x0c, 0x29, 0x73, 0x6d, 0x3b};  // Source MAC address
-    unsigned short ether_type = ETH_P_IP; // Ethernet type (IPv4)
-    unsigned char payload[] = "Hello, raw Ethernet!"; // Payload
-    int payload_len = strlen(payload);
+#define FLOW_TABLE_MAX_LOAD_PCT 75  ///< Refuse new flows beyond this load
 
-    send_raw_ethernet(sockfd, dest_mac, src_mac, ether_type, payload, payload_len);
+/**
+ * @brief Directional 5-tuple. IPv4 addresses use the first 4 bytes.
+ */
+struct flow_key {
+    uint8_t src_addr[16];
+    uint8_t dst_addr[16];
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint8_t ip_proto;
+    uint8_t ip_version;
+    uint8_t pad[2];
+};
+
+/**
+ * @brief Per-flow counters.
+ */
+struct flow_entry {
+    struct flow_key key;
+    uint32_t hash;       ///< 0 marks an empty slot
+    uint32_t pad;
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t first_ts;   ///< Timestamp of the first packet, in ns
+    uint64_t last_ts;    ///< Timestamp of the most recent packet, in ns
+};
 
-    // Example: Receive a raw Ethernet frame
-    receive_raw_ethernet(sockfd);
+/**
+ * @brief An open-addressing flow table.
+ */
+struct flow_table {
+    struct flow_entry *slots;
+    uint32_t mask;       ///< Capacity - 1
+    uint32_t count;      ///< Occupied slots
+    uint32_t limit;      ///< Maximum occupied slots
+    uint64_t overflows;  ///< Packets whose flow could not be inserted
+};
 
-    close(sockfd);
+/**
+ * @brief Allocate a flow table large enough for a number of flows.
+ *
+ * @param table The table to initialise.
+ * @param max_flows Number of flows to size for.
+ * @return 0 on success, -1 on error.
+ */
+int flow_table_init(struct flow_table *table, uint32_t max_flows) {
+    uint32_t capacity = 16;
+
+    while ((uint64_t)capacity * FLOW_TABLE_MAX_LOAD_PCT / 100 < max_flows)
+        capacity <<= 1;
+
+    memset(table, 0, sizeof(*table));
+    table->slots = calloc(capacity, sizeof(struct flow_entry));
+    if (!table->slots) {
+        perror("Flow table allocation failed");
+        return -1;
+    }
+    table->mask = capacity - 1;
+    table->limit = (uint32_t)((uint64_t)capacity * FLOW_TABLE_MAX_LOAD_PCT / 100);
     return 0;
 }
 
+/**
+ * @brief Release a flow table.
+ *
+ * @param table The table to free.
+ */
+void flow_table_free(struct flow_table *table) {
+    free(table->slots);
+    table->slots = NULL;
+}
+
+/**
+ * @brief Build a flow key from a decoded IP packet.
+ *
+ * @param d A descriptor with ip_version 4 or 6.
+ * @param key The key to fill in.
+ */
+void flow_key_from_desc(const struct pkt_desc *d, struct flow_key *key) {
+    const unsigned char *ip = d->frame + d->l3_off;
+
+    memset(key, 0, sizeof(*key));
+    if (d->ip_version == 4) {
+        memcpy(key->src_addr, ip + 12, 4);
+        memcpy(key->dst_addr, ip + 16, 4);
+    } else {
+        memcpy(key->src_addr, ip + 8, 16);
+        memcpy(key->dst_addr, ip + 24, 16);
+    }
+    key->src_port = d->src_port;
+    key->dst_port = d->dst_port;
+    key->ip_proto = d->ip_proto;
+    key->ip_version = d->ip_version;
+}
+
+/**
+ * @brief Hash a flow key. Never returns 0.
+ */
+static inline uint32_t flow_hash(const struct flow_key *key) {
+    uint64_t w[sizeof(*key) / 8];
+    uint64_t h = 0;
+
+    memcpy(w, key, sizeof(w));
+    for (size_t i = 0; i < sizeof(w) / sizeof(w[0]); ++i) {
+        h = (h ^ w[i]) * 0x9E3779B97F4A7C15ull;
+        h ^= h >> 29;
+    }
+    return (uint32_t)(h >> 32) | 1;
+}
+
+/**
+ * @brief Find the entry for a flow, inserting it if it is new.
+ *
+ * @param table The flow table.
+ * @param key The flow key.
+ * @return The entry, or NULL if the flow is new and the table is full.
+ */
+struct flow_entry *flow_table_lookup(struct flow_table *table, const struct flow_key *key) {
+    uint32_t hash = flow_hash(key);
+
+    for (uint32_t i = hash;; ++i) {
+        struct flow_entry *e = &table->slots[i & table->mask];
+        if (e->hash == hash && memcmp(&e->key, key, sizeof(*key)) == 0)
+            return e;
+        if (e->hash == 0) {
+            if (table->count >= table->limit)
+                return NULL;
+            table->count++;
+            e->hash = hash;
+            e->key = *key;
+            return e;
+        }
+    }
+}
+
+/**
+ * @brief Account one decoded packet to its flow.
+ *
+ * @param table The flow table.
+ * @param d The decoded packet; non-IP packets are ignored.
+ * @param ts_ns The packet timestamp in nanoseconds.
+ * @return The updated entry, or NULL if the packet was not accounted.
+ */
+struct flow_entry *flow_table_update(struct flow_table *table, const struct pkt_desc *d, uint64_t ts_ns) {
+    struct flow_key key;
+    struct flow_entry *e;
+
+    if (d->ip_version == 0)
+        return NULL;
+    flow_key_from_desc(d, &key);
+    e = flow_table_lookup(table, &key);
+    if (!e) {
+        table->overflows++;
+        return NULL;
+    }
+    if (e->packets++ == 0)
+        e->first_ts = ts_ns;
+    e->last_ts = ts_ns;
+    e->bytes += d->len;
+    return e;
+}
+
+/**
+ * @brief Decode a frame and account it in a flow table.
+ *
+ * A frame_handler, so live capture and pcap replay share the same pipeline.
+ *
+ * @param frame Pointer to the start of the Ethernet header.
+ * @param len Number of captured bytes.
+ * @param ts_ns Capture time in nanoseconds.
+ * @param user The struct flow_table to update.
+ */
+void flow_table_handler(const unsigned char *frame, unsigned int len, uint64_t ts_ns, void *user) {
+    struct pkt_desc d;
+
+    decode_frame(frame, len, &d);
+    flow_table_update(user, &d, ts_ns);
+}
+
+/**
+ * @brief Add every flow of one table to another.
+ *
+ * Counters of flows present in both are summed, so tables filled by
+ * different workers merge into one set of distinct flows.
+ *
+ * @param dst The table to merge into.
+ * @param src The table to merge from.
+ * @return 0 on success, -1 if dst reached its load limit.
+ */
+int flow_table_merge(struct flow_table *dst, const struct flow_table *src) {
+    int ret = 0;
+
+    for (uint32_t i = 0; i <= src->mask; ++i) {
+        const struct flow_entry *s = &src->slots[i];
+        if (s->hash == 0)
+            continue;
+        struct flow_entry *e = flow_table_lookup(dst, &s->key);
+        if (!e) {
+            dst->overflows += s->packets;
+            ret = -1;
+            continue;
+        }
+        if (e->packets == 0 || s->first_ts < e->first_ts)
+            e->first_ts = s->first_ts;
+        if (s->last_ts > e->last_ts)
+            e->last_ts = s->last_ts;
+        e->packets += s->packets;
+        e->bytes += s->bytes;
+    }
+    dst->overflows += src->overflows;
+    return ret;
+}
+
+/*
+ * pcap and pcapng files
+ *
+ * pcap_source maps a capture file and hands each frame to a frame_handler
+ * straight out of the mapping, so a trace can be replayed through the same
+ * pipeline as live traffic at memory speed. Both classic pcap (either byte
+ * order, micro- or nanosecond timestamps) and pcapng (section, interface,
+ * enhanced and simple packet blocks) are read.
+ *
+ * pcap_writer appends records to a large buffer and writes it out with one
+ * `write` when it fills, instead of one syscall per frame.
+ */
+
+#define PCAP_MAGIC 0xA1B2C3D4u       ///< Classic pcap, microsecond timestamps
+#define PCAP_MAGIC_NSEC 0xA1B23C4Du  ///< Classic pcap, nanosecond timestamps
+#define PCAP_LINKTYPE_ETHERNET 1
+#define PCAPNG_SHB 0x0A0D0D0Au        ///< Section header block
+#define PCAPNG_IDB 1u                 ///< Interface description block
+#define PCAPNG_SPB 3u                 ///< Simple packet block
+#define PCAPNG_EPB 6u                 ///< Enhanced packet block
+#define PCAPNG_BYTE_ORDER 0x1A2B3C4Du
+#define PCAPNG_MAX_IFACES 64
+#define PCAP_WRITER_BUFFER (1u << 20)
+
+/**
+ * @brief Classic pcap file header.
+ */
+struct pcap_file_hdr {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+};
+
+/**
+ * @brief Classic pcap per-record header.
+ */
+struct pcap_record_hdr {
+    uint32_t ts_sec;
+    uint32_t ts_frac;   ///< Microseconds, or nanoseconds for nanosecond captures
+    uint32_t incl_len;  ///< Bytes captured
+    uint32_t orig_len;  ///< Bytes on the wire
+};
+
+/**
+ * @brief A memory-mapped pcap or pcapng capture being read.
+ */
+struct pcap_source {
+    const unsigned char *data;  ///< Start of the capture
+    size_t len;                 ///< Length of the capture
+    size_t off;                 ///< Offset of the next record or block
+    int mapped;                 ///< Non-zero if data must be unmapped
+    int pcapng;                 ///< Non-zero for pcapng
+    int swapped;                ///< Non-zero if the file byte order differs from ours
+    uint64_t ts_units;          ///< Classic pcap: timestamp units per second
+    uint32_t snaplen;           ///< Classic pcap snaplen, or the current pcapng interface's
+    uint32_t if_count;          ///< pcapng interfaces in the current section
+    uint64_t if_units[PCAPNG_MAX_IFACES];    ///< pcapng: timestamp units per second
+    uint32_t if_snaplen[PCAPNG_MAX_IFACES];  ///< pcapng: snaplen per interface
+};
+
+/**
+ * @brief Read a 16-bit field in the source's byte order.
+ */
+static inline uint16_t pcap_u16(const struct pcap_source *src, const unsigned char *p) {
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return src->swapped ? __builtin_bswap16(v) : v;
+}
+
+/**
+ * @brief Read a 32-bit field in the source's byte order.
+ */
+static inline uint32_t pcap_u32(const struct pcap_source *src, const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return src->swapped ? __builtin_bswap32(v) : v;
+}
+
+/**
+ * @brief Convert a timestamp in some units per second to nanoseconds.
+ *
+ * The fraction is scaled in 128 bits once units exceed UINT64_MAX / 10^9,
+ * as pcapng if_tsresol allows up to 10^18 (pcapng_read_idb() caps it there).
+ */
+static inline uint64_t pcap_ts_to_ns(uint64_t ts, uint64_t units) {
+    if (units == 1000000000ull)
+        return ts;
+    if (units <= UINT64_MAX / 1000000000ull)
+        return ts / units * 1000000000ull + ts % units * 1000000000ull / units;
+    return ts / units * 1000000000ull + (uint64_t)((unsigned __int128)(ts % units) * 1000000000ull / units);
+}
+
+/**
+ * @brief Parse the header of a capture already in memory.
+ *
+ * @param src The source to initialise.
+ * @param data The capture contents; must stay valid while the source is used.
+ * @param len Length of the capture.
+ * @return 0 on success, -1 if the data is not a pcap or pcapng capture.
+ */
+int pcap_source_open_mem(struct pcap_source *src, const unsigned char *data, size_t len) {
+    uint32_t magic;
+
+    memset(src, 0, sizeof(*src));
+    src->data = data;
+    src->len = len;
+    if (len < 4)
+        return -1;
+    memcpy(&magic, data, 4);
+
+    if (magic == PCAPNG_SHB) {
+        // The section header is parsed by pcap_source_next() like any other block
+        src->pcapng = 1;
+        return 0;
+    }
+
+    if (len < sizeof(struct pcap_file_hdr))
+        return -1;
+    if (magic == __builtin_bswap32(PCAP_MAGIC) || magic == __builtin_bswap32(PCAP_MAGIC_NSEC)) {
+        src->swapped = 1;
+        magic = __builtin_bswap32(magic);
+    }
+    if (magic != PCAP_MAGIC && magic != PCAP_MAGIC_NSEC)
+        return -1;
+    src->ts_units = magic == PCAP_MAGIC_NSEC ? 1000000000ull : 1000000ull;
+    src->snaplen = pcap_u32(src, data + offsetof(struct pcap_file_hdr, snaplen));
+    src->off = sizeof(struct pcap_file_hdr);
+    return 0;
+}
+
+/**
+ * @brief Map a capture file and parse its header.
+ *
+ * @param src The source to initialise.
+ * @param path The capture file.
+ * @return 0 on success, -1 on error.
+ */
+int pcap_source_open(struct pcap_source *src, const char *path) {
+    struct stat st;
+    void *map;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        perror("Capture open failed");
+        return -1;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        fprintf(stderr, "%s: empty or unreadable capture\n", path);
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("Capture mmap failed");
+        return -1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    if (pcap_source_open_mem(src, map, st.st_size) < 0) {
+        fprintf(stderr, "%s: not a pcap or pcapng capture\n", path);
+        munmap(map, st.st_size);
+        return -1;
+    }
+    src->mapped = 1;
+    return 0;
+}
+
+/**
+ * @brief Release a capture source.
+ *
+ * @param src The source to close.
+ */
+void pcap_source_close(struct pcap_source *src) {
+    if (src->mapped)
+        munmap((void *)src->data, src->len);
+    src->data = NULL;
+}
+
+/**
+ * @brief Parse a pcapng interface description block.
+ */
+static void pcapng_read_idb(struct pcap_source *src, const unsigned char *body, uint32_t body_len) {
+    uint32_t id = src->if_count++;
+    size_t off = 8;
+
+    if (id >= PCAPNG_MAX_IFACES || body_len < 8)
+        return;
+    src->if_snaplen[id] = pcap_u32(src, body + 4);
+    src->if_units[id] = 1000000ull;
+
+    // Options: code, length, value padded to 4 bytes
+    while (off + 4 <= body_len) {
+        uint16_t code = pcap_u16(src, body + off);
+        uint16_t opt_len = pcap_u16(src, body + off + 2);
+        if (code == 0 || off + 4 + opt_len > body_len)
+            break;
+        if (code == 9 && opt_len >= 1) {  // if_tsresol
+            uint8_t res = body[off + 4];
+            uint64_t units = 1;
+            for (unsigned int i = 0; i < (res & 0x7F) && units < 1000000000000000000ull; ++i)
+                units *= (res & 0x80) ? 2 : 10;
+            src->if_units[id] = units;
+        }
+        off += 4 + ((opt_len + 3u) & ~3u);
+    }
+}
+
+/**
+ * @brief Return the next frame of a capture.
+ *
+ * The frame points into the capture itself; nothing is copied.
+ *
+ * @param src The capture source.
+ * @param frame Set to the start of the frame.
+ * @param len Set to the captured length.
+ * @param ts_ns Set to the timestamp in nanoseconds since the Unix epoch.
+ * @return 1 if a frame was returned, 0 at end of capture, -1 on a malformed capture.
+ */
+int pcap_source_next(struct pcap_source *src, const unsigned char **frame, uint32_t *len, uint64_t *ts_ns) {
+    if (!src->pcapng) {
+        if (src->off + sizeof(struct pcap_record_hdr) > src->len)
+            return 0;
+        const unsigned char *rh = src->data + src->off;
+        uint32_t incl_len = pcap_u32(src, rh + 8);
+        if (src->off + sizeof(struct pcap_record_hdr) + incl_len > src->len)
+            return -1;
+        *frame = rh + sizeof(struct pcap_record_hdr);
+        *len = incl_len;
+        *ts_ns = pcap_u32(src, rh) * 1000000000ull + pcap_ts_to_ns(pcap_u32(src, rh + 4), src->ts_units);
+        src->off += sizeof(struct pcap_record_hdr) + incl_len;
+        return 1;
+    }
+
+    while (src->off + 12 <= src->len) {
+        const unsigned char *block = src->data + src->off;
+        uint32_t type, total;
+
+        memcpy(&type, block, 4);
+        if (type == PCAPNG_SHB) {
+            // A new section may switch byte order and resets the interface list
+            uint32_t bom;
+            memcpy(&bom, block + 8, 4);
+            if (bom != PCAPNG_BYTE_ORDER && bom != __builtin_bswap32(PCAPNG_BYTE_ORDER))
+                return -1;
+            src->swapped = bom != PCAPNG_BYTE_ORDER;
+            src->if_count = 0;
+        }
+        type = pcap_u32(src, block);
+        total = pcap_u32(src, block + 4);
+        if (total < 12 || (total & 3) || src->off + total > src->len)
+            return -1;
+        src->off += total;
+
+        const unsigned char *body = block + 8;
+        uint32_t body_len = total - 12;
+        if (type == PCAPNG_IDB) {
+            pcapng_read_idb(src, body, body_len);
+        } else if (type == PCAPNG_EPB && body_len >= 20) {
+            uint32_t id = pcap_u32(src, body);
+            uint64_t ts = (uint64_t)pcap_u32(src, body + 4) << 32 | pcap_u32(src, body + 8);
+            uint32_t cap_len = pcap_u32(src, body + 12);
+            if (id >= src->if_count || id >= PCAPNG_MAX_IFACES || cap_len > body_len - 20)
+                return -1;
+            *frame = body + 20;
+            *len = cap_len;
+            *ts_ns = pcap_ts_to_ns(ts, src->if_units[id]);
+            return 1;
+        } else if (type == PCAPNG_SPB && body_len >= 4 && src->if_count > 0) {
+            uint32_t orig_len = pcap_u32(src, body);
+            uint32_t cap_len = orig_len;
+            if (src->if_snaplen[0] && cap_len > src->if_snaplen[0])
+                cap_len = src->if_snaplen[0];
+            if (cap_len > body_len - 4)
+                cap_len = body_len - 4;
+            *frame = body + 4;
+            *len = cap_len;
+            *ts_ns = 0;  // Simple packet blocks carry no timestamp
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Hand every remaining frame of a capture to a handler.
+ *
+ * @param src The capture source.
+ * @param handler Called once per frame with a pointer into the capture.
+ * @param user Passed through to the handler.
+ * @return The number of frames delivered, or -1 on a malformed capture.
+ */
+long pcap_source_dispatch(struct pcap_source *src, frame_handler handler, void *user) {
+    const unsigned char *frame;
+    uint32_t len;
+    uint64_t ts_ns;
+    long count = 0;
+    int rc;
+
+    while ((rc = pcap_source_next(src, &frame, &len, &ts_ns)) > 0) {
+        handler(frame, len, ts_ns, user);
+        count++;
+    }
+    return rc < 0 ? -1 : count;
+}
+
+/**
+ * @brief A buffered classic pcap writer with nanosecond timestamps.
+ */
+struct pcap_writer {
+    int fd;
+    unsigned char *buf;
+    size_t used;
+    uint32_t snaplen;
+    uint64_t frames;
+};
+
+/**
+ * @brief Write out everything buffered with a single `write` loop.
+ *
+ * @param w The writer.
+ * @return 0 on success, -1 on error.
+ */
+int pcap_writer_flush(struct pcap_writer *w) {
+    size_t done = 0;
+
+    while (done < w->used) {
+        ssize_t n = write(w->fd, w->buf + done, w->used - done);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("Capture write failed");
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    w->used = 0;
+    return 0;
+}
+
+/**
+ * @brief Create a capture file and buffer its header.
+ *
+ * @param w The writer to initialise.
+ * @param path The file to create or truncate.
+ * @param snaplen Frames are truncated to this many bytes; it is clamped so
+ *        that one record always fits in the write buffer.
+ * @return 0 on success, -1 on error.
+ */
+int pcap_writer_open(struct pcap_writer *w, const char *path, uint32_t snaplen) {
+    if (snaplen > PCAP_WRITER_BUFFER - sizeof(struct pcap_record_hdr))
+        snaplen = PCAP_WRITER_BUFFER - sizeof(struct pcap_record_hdr);
+    struct pcap_file_hdr fh = { PCAP_MAGIC_NSEC, 2, 4, 0, 0, snaplen, PCAP_LINKTYPE_ETHERNET };
+
+    memset(w, 0, sizeof(*w));
+    w->snaplen = snaplen;
+    w->buf = malloc(PCAP_WRITER_BUFFER);
+    if (!w->buf) {
+        perror("Capture buffer allocation failed");
+        return -1;
+    }
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (w->fd < 0) {
+        perror("Capture create failed");
+        free(w->buf);
+        return -1;
+    }
+    memcpy(w->buf, &fh, sizeof(fh));
+    w->used = sizeof(fh);
+    return 0;
+}
+
+/**
+ * @brief Append one frame to the capture.
+ *
+ * @param w The writer.
+ * @param frame The frame.
+ * @param len Length of the frame on the wire.
+ * @param ts_ns Timestamp in nanoseconds since the Unix epoch.
+ * @return 0 on success, -1 on error.
+ */
+int pcap_writer_write(struct pcap_writer *w, const unsigned char *frame, uint32_t len, uint64_t ts_ns) {
+    struct pcap_record_hdr rh;
+    uint32_t incl_len = len < w->snaplen ? len : w->snaplen;
+
+    if (w->used + sizeof(rh) + incl_len > PCAP_WRITER_BUFFER && pcap_writer_flush(w) < 0)
+        return -1;
+    rh.ts_sec = (uint32_t)(ts_ns / 1000000000ull);
+    rh.ts_frac = (uint32_t)(ts_ns % 1000000000ull);
+    rh.incl_len = incl_len;
+    rh.orig_len = len;
+    memcpy(w->buf + w->used, &rh, sizeof(rh));
+    memcpy(w->buf + w->used + sizeof(rh), frame, incl_len);
+    w->used += sizeof(rh) + incl_len;
+    w->frames++;
+    return 0;
+}
+
+/**
+ * @brief frame_handler that appends frames to a pcap_writer.
+ */
+void pcap_writer_handler(const unsigned char *frame, unsigned int len, uint64_t ts_ns, void *user) {
+    pcap_writer_write(user, frame, len, ts_ns);
+}
+
+/**
+ * @brief Flush and close a capture file.
+ *
+ * @param w The writer.
+ * @return 0 on success, -1 on error.
+ */
+int pcap_writer_close(struct pcap_writer *w) {
+    int rc = pcap_writer_flush(w);
+
+    if (close(w->fd) < 0)
+        rc = -1;
+    free(w->buf);
+    w->buf = NULL;
+    return rc;
+}
+
+/**
+ * @brief Print the Ethernet header and the start of the payload of a frame.
+ *
+ * Matches the frame_handler signature so it can be handed to any frame source.
+ *
+ * @param frame Pointer to the start of the Ethernet header.
+ * @param len Number of captured bytes.
+ * @param ts_ns Unused.
+ * @param user Unused.
+ */
+void print_ether_frame(const unsigned char *frame, unsigned int len, uint64_t ts_ns, void *user) {
+    const struct ethhdr *header = (const struct ethhdr *)frame;
+    const unsigned char *data = frame + sizeof(struct ethhdr);
+    (void)ts_ns;
+    (void)user;
+
+    if (len < sizeof(struct ethhdr))
+        return;
+
+    // Print Ethernet header info
+    printf("Destination MAC: %02x:%02x:%02x:%02x:%02x:%02x\n",
+           header->h_dest[0], header->h_dest[1], header->h_dest[2],
+           header->h_dest[3], header->h_dest[4], header->h_dest[5]);
+    printf("Source MAC: %02x:%02x:%02x:%02x:%02x:%02x\n",
+           header->h_source[0], header->h_source[1], header->h_source[2],
+           header->h_source[3], header->h_source[4], header->h_source[5]);
+    printf("Ethernet Type: %04x\n", ntohs(header->h_proto));
+
+    // Print decoded network and transport headers
+    struct pkt_desc d;
+    if (decode_frame(frame, len, &d) >= 3) {
+        char src[INET6_ADDRSTRLEN], dst[INET6_ADDRSTRLEN];
+        int family = d.ip_version == 4 ? AF_INET : AF_INET6;
+        const unsigned char *ip = frame + d.l3_off;
+        inet_ntop(family, ip + (d.ip_version == 4 ? 12 : 8), src, sizeof(src));
+        inet_ntop(family, ip + (d.ip_version == 4 ? 16 : 24), dst, sizeof(dst));
+        printf("IPv%u %s:%u -> %s:%u proto %u%s%s\n", d.ip_version, src, d.src_port, dst, d.dst_port,
+               d.ip_proto, d.flags & DESC_FRAGMENT ? " fragment" : "", d.flags & DESC_TRUNCATED ? " truncated" : "");
+    }
+
+    // Print payload (data)
+    printf("Payload (first 20 bytes): ");
+    for (unsigned int i = 0; i < 20 && i < len - sizeof(struct ethhdr); ++i) {
+        printf("%02x ", data[i]);
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Receive one frame with `recvfrom` and hand it to a handler.
+ *
+ * This is the copying fallback path: one syscall and one copy into a stack
+ * buffer per frame.
+ *
+ * @param sockfd The file descriptor of the raw socket.
+ * @param handler Called with the received frame.
+ * @param user Passed through to the handler.
+ * @return The number of bytes received, or -1 on error.
+ */
+ssize_t recv_dispatch(int sockfd, frame_handler handler, void *user) {
+    struct ether_frame frame;
+    ssize_t recv_size = recv(sockfd, &frame, sizeof(struct ether_frame), 0);
+
+    if (recv_size > 0)
+        handler((const unsigned char *)&frame, (unsigned int)recv_size, realtime_ns(), user);
+    return recv_size;
+}
+
+/**
+ * @brief Receive a raw Ethernet frame.
+ *
+ * @param sockfd The file descriptor of the raw socket.
+ */
+void receive_raw_ethernet(int sockfd) {
+    struct ether_frame frame;
+    struct sockaddr_ll socket_address;
+    socklen_t sll_len = sizeof(socket_address);
+    ssize_t recv_size;
+
+    // Receive packet
+    recv_size = recvfrom(sockfd, &frame, sizeof(struct ether_frame), 0, (struct sockaddr *)&socket_address, &sll_len);
+    if (recv_size < 0) {
+        perror("Packet receive failed");
+    } else {
+        printf("Packet received successfully\n");
+        print_ether_frame((const unsigned char *)&frame, (unsigned int)recv_size, realtime_ns(), NULL);
+    }
+}
+
+/*
+ * TPACKET_V3 receive ring
+ *
+ * With PACKET_RX_RING the kernel writes frames directly into a buffer shared
+ * with userspace. TPACKET_V3 groups frames into variable-length blocks; a
+ * block is handed to userspace when it fills up or its retire timeout
+ * expires, so one wakeup delivers many frames and nothing is copied.
+ */
+
+#define RX_RING_BLOCK_SIZE (1u << 20)  ///< Bytes per block (must be a multiple of the page size)
+#define RX_RING_BLOCK_COUNT 64         ///< Number of blocks in the ring
+#define RX_RING_FRAME_SIZE 2048        ///< Nominal frame slot size, used only for sizing
+#define RX_RING_RETIRE_MS 10           ///< Hand a partially filled block over after this long
+
+/**
+ * @brief A memory-mapped TPACKET_V3 receive ring.
+ */
+struct rx_ring {
+    int sockfd;               ///< Socket the ring is attached to
+    unsigned char *map;       ///< Start of the shared mapping
+    size_t map_len;           ///< Length of the mapping
+    unsigned int block_size;  ///< Bytes per block
+    unsigned int block_count; ///< Number of blocks
+    unsigned int current;     ///< Index of the next block to consume
+};
+
+/**
+ * @brief Attach a TPACKET_V3 receive ring to a raw socket and map it.
+ *
+ * Should be called before the socket is bound. On failure the socket is left
+ * usable for the `recvfrom` path.
+ *
+ * @param ring The ring to initialise.
+ * @param sockfd The file descriptor of the raw socket.
+ * @param block_size Bytes per block; a multiple of the page size.
+ * @param block_count Number of blocks.
+ * @return 0 on success, -1 on error.
+ */
+int rx_ring_setup(struct rx_ring *ring, int sockfd, unsigned int block_size, unsigned int block_count) {
+    struct tpacket_req3 req;
+    int version = TPACKET_V3;
+
+    memset(ring, 0, sizeof(*ring));
+    if (setsockopt(sockfd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        perror("PACKET_VERSION failed");
+        return -1;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = block_size;
+    req.tp_block_nr = block_count;
+    req.tp_frame_size = RX_RING_FRAME_SIZE;
+    req.tp_frame_nr = (block_size / RX_RING_FRAME_SIZE) * block_count;
+    req.tp_retire_blk_tov = RX_RING_RETIRE_MS;
+    req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+    if (setsockopt(sockfd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+        perror("PACKET_RX_RING failed");
+        return -1;
+    }
+
+    ring->map_len = (size_t)block_size * block_count;
+    ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, sockfd, 0);
+    if (ring->map == MAP_FAILED) {
+        perror("Ring mmap failed");
+        ring->map = NULL;
+        return -1;
+    }
+
+    ring->sockfd = sockfd;
+    ring->block_size = block_size;
+    ring->block_count = block_count;
+    return 0;
+}
+
+/**
+ * @brief Unmap a receive ring. The socket itself is not closed.
+ *
+ * @param ring The ring to tear down.
+ */
+void rx_ring_teardown(struct rx_ring *ring) {
+    if (ring->map)
+        munmap(ring->map, ring->map_len);
+    ring->map = NULL;
+}
+
+/**
+ * @brief Wait for the next block to be handed to userspace.
+ *
+ * @param ring The receive ring.
+ * @param timeout_ms How long to wait in poll(), or -1 to wait forever.
+ * @return The block, or NULL if none became ready within the timeout.
+ */
+struct tpacket_block_desc *rx_ring_next_block(struct rx_ring *ring, int timeout_ms) {
+    struct tpacket_block_desc *block =
+        (struct tpacket_block_desc *)(ring->map + (size_t)ring->current * ring->block_size);
+
+    if (!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+        struct pollfd pfd = { .fd = ring->sockfd, .events = POLLIN | POLLERR };
+        poll(&pfd, 1, timeout_ms);
+        if (!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER))
+            return NULL;
+    }
+    return block;
+}
+
+/**
+ * @brief Return a consumed block to the kernel and advance to the next one.
+ *
+ * Frames inside the block must not be touched after this call.
+ *
+ * @param ring The receive ring.
+ * @param block The block returned by rx_ring_next_block().
+ */
+void rx_ring_release_block(struct rx_ring *ring, struct tpacket_block_desc *block) {
+    __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    ring->current = (ring->current + 1) % ring->block_count;
+}
+
+/**
+ * @brief Hand every frame in a block to a handler, in place.
+ *
+ * @param block A block owned by userspace.
+ * @param handler Called once per frame with a pointer into the ring.
+ * @param user Passed through to the handler.
+ * @return The number of frames in the block.
+ */
+unsigned int rx_block_dispatch(struct tpacket_block_desc *block, frame_handler handler, void *user) {
+    unsigned int num_pkts = block->hdr.bh1.num_pkts;
+    struct tpacket3_hdr *ppd =
+        (struct tpacket3_hdr *)((unsigned char *)block + block->hdr.bh1.offset_to_first_pkt);
+
+    for (unsigned int i = 0; i < num_pkts; ++i) {
+        handler((const unsigned char *)ppd + ppd->tp_mac, ppd->tp_snaplen,
+                ppd->tp_sec * 1000000000ull + ppd->tp_nsec, user);
+        ppd = (struct tpacket3_hdr *)((unsigned char *)ppd + ppd->tp_next_offset);
+    }
+    return num_pkts;
+}
+
+/**
+ * @brief Receive one block of raw Ethernet frames from a ring and print them.
+ *
+ * @param ring The receive ring.
+ */
+void receive_raw_ethernet_ring(struct rx_ring *ring) {
+    struct tpacket_block_desc *block = rx_ring_next_block(ring, -1);
+
+    if (block) {
+        printf("Block received successfully (%u packets)\n", block->hdr.bh1.num_pkts);
+        rx_block_dispatch(block, print_ether_frame, NULL);
+        rx_ring_release_block(ring, block);
+    }
+}
+
+/*
+ * Batched transmit engine
+ *
+ * The interface is resolved and the socket bound once. Callers reserve a
+ * slot, write the frame directly into it and commit it; committed frames are
+ * sent together by one syscall per batch. With PACKET_TX_RING the slots live
+ * in memory shared with the kernel, so a flush is a single `send` that walks
+ * the ring. Without it, slots are private buffers sent with one `sendmmsg`.
+ *
+ * Virtual devices such as lo and veth release a ring slot as soon as the
+ * frame is handed to the receive path, while a local receiver may still be
+ * reading the frame out of the slot. Pass TX_ENGINE_COPY when a receiver
+ * on the same host must see exactly the bytes that were sent.
+ *
+ * A ring flush only asks the kernel to start sending; a slot is done once
+ * the kernel hands it back as TP_STATUS_AVAILABLE. tx_drain() waits for
+ * that, and must run before the ring is unmapped or a rate is measured.
+ * The kernel stops walking the ring at a frame it cannot queue (EAGAIN or
+ * ENOBUFS) and leaves the rest marked TP_STATUS_SEND_REQUEST, so the engine
+ * sends again whenever the oldest slot in flight has not been picked up.
+ * With PACKET_QDISC_BYPASS a frame the device drops also comes back
+ * AVAILABLE, so `sent` counts frames released, not frames on the wire.
+ */
+
+#define TX_ENGINE_COPY 0x1        ///< tx_engine_open() flag: never use PACKET_TX_RING
+#define TX_RING_FRAME_SIZE 2048   ///< Bytes per TX ring slot, header included
+#define TX_RING_FRAME_COUNT 1024  ///< Number of TX slots
+#define TX_BATCH 64               ///< Committed frames that trigger a flush
+#define TX_DRAIN_TIMEOUT_MS 1000  ///< How long tx_drain() waits for the kernel to release the ring
+
+/**
+ * @brief A transmit engine bound to one interface.
+ */
+struct tx_engine {
+    int sockfd;                ///< Dedicated socket bound to the interface
+    int use_ring;              ///< Non-zero when PACKET_TX_RING is in use
+    unsigned char *map;        ///< TX ring mapping, or sendmmsg buffers
+    size_t map_len;            ///< Length of map
+    unsigned int frame_count;  ///< Number of slots
+    unsigned int head;         ///< Next slot to reserve
+    unsigned int pending;      ///< Committed but not yet flushed
+    unsigned int inflight;     ///< Ring: committed slots the kernel has not released yet
+    struct mmsghdr *msgs;      ///< sendmmsg fallback: one message per slot
+    struct iovec *iovs;        ///< sendmmsg fallback: one iovec per slot
+    uint64_t sent;             ///< Frames accepted by sendmmsg or released by the ring, see above
+    uint64_t rejected;         ///< Ring frames the kernel refused (TP_STATUS_WRONG_FORMAT)
+    uint64_t busy;             ///< Ring sends that failed with EAGAIN or ENOBUFS and were retried
+};
+
+/**
+ * @brief Address of the frame data area of a TX ring slot.
+ */
+static unsigned char *tx_ring_data(struct tpacket2_hdr *hdr) {
+    return (unsigned char *)hdr + TPACKET2_HDRLEN - sizeof(struct sockaddr_ll);
+}
+
+/**
+ * @brief Open a transmit engine on an interface.
+ *
+ * Tries PACKET_TX_RING first, unless TX_ENGINE_COPY is given, and falls
+ * back to `sendmmsg` batches.
+ *
+ * @param tx The engine to initialise.
+ * @param ifname The interface to transmit on.
+ * @param flags 0 or TX_ENGINE_COPY.
+ * @return 0 on success, -1 on error.
+ */
+int tx_engine_open(struct tx_engine *tx, const char *ifname, int flags) {
+    struct tpacket_req req;
+    int version = TPACKET_V2;
+    int one = 1;
+
+    memset(tx, 0, sizeof(*tx));
+    tx->frame_count = TX_RING_FRAME_COUNT;
+    tx->sockfd = socket(AF_PACKET, SOCK_RAW, 0);
+    if (tx->sockfd < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+
+    // Frames go straight to the driver; they are not needed on the qdisc path
+    setsockopt(tx->sockfd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one));
+
+    // Blocks must be whole pages; frames may not straddle blocks
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = getpagesize() > TX_RING_FRAME_SIZE ? getpagesize() : TX_RING_FRAME_SIZE;
+    req.tp_frame_size = TX_RING_FRAME_SIZE;
+    req.tp_frame_nr = TX_RING_FRAME_COUNT;
+    req.tp_block_nr = TX_RING_FRAME_COUNT / (req.tp_block_size / TX_RING_FRAME_SIZE);
+    if (!(flags & TX_ENGINE_COPY) &&
+        setsockopt(tx->sockfd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) == 0 &&
+        setsockopt(tx->sockfd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) == 0) {
+        tx->map_len = (size_t)req.tp_block_size * req.tp_block_nr;
+        tx->map = mmap(NULL, tx->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, tx->sockfd, 0);
+        if (tx->map != MAP_FAILED)
+            tx->use_ring = 1;
+    }
+
+    if (!tx->use_ring) {
+        tx->map_len = (size_t)TX_RING_FRAME_SIZE * tx->frame_count;
+        tx->map = malloc(tx->map_len);
+        tx->msgs = calloc(tx->frame_count, sizeof(*tx->msgs));
+        tx->iovs = calloc(tx->frame_count, sizeof(*tx->iovs));
+        if (!tx->map || !tx->msgs || !tx->iovs) {
+            perror("Transmit buffer allocation failed");
+            goto fail;
+        }
+        for (unsigned int i = 0; i < tx->frame_count; ++i) {
+            tx->iovs[i].iov_base = tx->map + (size_t)i * TX_RING_FRAME_SIZE;
+            tx->msgs[i].msg_hdr.msg_iov = &tx->iovs[i];
+            tx->msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+
+    if (bind_raw_socket(tx->sockfd, ifname, 0) < 0)
+        goto fail;
+    return 0;
+
+fail:
+    if (tx->use_ring)
+        munmap(tx->map, tx->map_len);
+    else
+        free(tx->map);
+    free(tx->msgs);
+    free(tx->iovs);
+    close(tx->sockfd);
+    memset(tx, 0, sizeof(*tx));
+    return -1;
+}
+
+/**
+ * @brief Ring mode: retire the oldest in-flight slots the kernel has released.
+ *
+ * @param tx The transmit engine.
+ */
+static void tx_reap(struct tx_engine *tx) {
+    while (tx->inflight > 0) {
+        unsigned int tail = (tx->head + tx->frame_count - tx->inflight) % tx->frame_count;
+        struct tpacket2_hdr *hdr = (struct tpacket2_hdr *)(tx->map + (size_t)tail * TX_RING_FRAME_SIZE);
+        uint32_t status = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE);
+
+        // Slots are released in order; unflushed ones are still SEND_REQUEST
+        if (status & (TP_STATUS_SEND_REQUEST | TP_STATUS_SENDING))
+            break;
+        if (status & TP_STATUS_WRONG_FORMAT) {
+            __atomic_store_n(&hdr->tp_status, TP_STATUS_AVAILABLE, __ATOMIC_RELAXED);
+            tx->rejected++;
+        } else {
+            tx->sent++;
+        }
+        tx->inflight--;
+    }
+}
+
+/**
+ * @brief Ring mode: ask the kernel to walk the ring if any slot is waiting.
+ *
+ * A slot is waiting if it was committed since the last successful send, or
+ * if the oldest slot in flight is still TP_STATUS_SEND_REQUEST because the
+ * kernel stopped at it. EAGAIN and ENOBUFS leave the slots waiting for the
+ * next call.
+ *
+ * @param tx The transmit engine.
+ * @param flags MSG_DONTWAIT, or 0 to block until the frames are sent.
+ * @return 1 if the kernel took the slots, 0 if there was nothing to send or
+ *         it was busy, -1 on error.
+ */
+static int tx_kick(struct tx_engine *tx, int flags) {
+    if (tx->pending == 0) {
+        unsigned int tail = (tx->head + tx->frame_count - tx->inflight) % tx->frame_count;
+        struct tpacket2_hdr *hdr = (struct tpacket2_hdr *)(tx->map + (size_t)tail * TX_RING_FRAME_SIZE);
+        if (tx->inflight == 0 || !(__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) & TP_STATUS_SEND_REQUEST))
+            return 0;
+    }
+    if (send(tx->sockfd, NULL, 0, flags) < 0) {
+        if (errno == EAGAIN || errno == ENOBUFS) {
+            tx->busy++;
+            return 0;
+        }
+        perror("Ring send failed");
+        return -1;
+    }
+    tx->pending = 0;
+    return 1;
+}
+
+/**
+ * @brief Send every committed frame with a single syscall.
+ *
+ * Does not wait: ring slots stay in flight until the kernel releases them,
+ * see tx_drain().
+ *
+ * @param tx The transmit engine.
+ * @return The number of frames handed to the kernel, or -1 on error.
+ */
+int tx_flush(struct tx_engine *tx) {
+    unsigned int pending = tx->pending;
+
+    if (tx->use_ring) {
+        int kicked = tx_kick(tx, MSG_DONTWAIT);
+        return kicked <= 0 ? kicked : (int)pending;
+    }
+    if (pending == 0)
+        return 0;
+
+    unsigned int first = (tx->head + tx->frame_count - pending) % tx->frame_count;
+    unsigned int done = 0;
+    while (done < pending) {
+        // Slots are sent in order; split the batch where it wraps
+        unsigned int start = (first + done) % tx->frame_count;
+        unsigned int count = pending - done;
+        if (start + count > tx->frame_count)
+            count = tx->frame_count - start;
+        int n = sendmmsg(tx->sockfd, &tx->msgs[start], count, 0);
+        if (n < 0) {
+            perror("sendmmsg failed");
+            tx->pending -= done;
+            tx->sent += done;
+            return -1;
+        }
+        done += n;
+    }
+    tx->sent += pending;
+    tx->pending = 0;
+    return (int)pending;
+}
+
+/**
+ * @brief Send every committed frame and wait until the kernel is done with
+ * all of them.
+ *
+ * Without the ring this is tx_flush(). With it, sends block and are retried
+ * while the kernel leaves slots waiting, until every slot is back to
+ * TP_STATUS_AVAILABLE.
+ *
+ * @param tx The transmit engine.
+ * @return 0 on success, -1 on error or if slots are still busy after
+ *         TX_DRAIN_TIMEOUT_MS.
+ */
+int tx_drain(struct tx_engine *tx) {
+    if (!tx->use_ring)
+        return tx_flush(tx) < 0 ? -1 : 0;
+
+    uint64_t deadline = now_ns() + TX_DRAIN_TIMEOUT_MS * 1000000ull;
+    for (tx_reap(tx); tx->inflight > 0 || tx->pending > 0; tx_reap(tx)) {
+        struct pollfd pfd = { .fd = tx->sockfd, .events = POLLOUT };
+        if (now_ns() > deadline) {
+            fprintf(stderr, "Transmit ring: %u frames still in flight after %d ms\n", tx->inflight,
+                    TX_DRAIN_TIMEOUT_MS);
+            return -1;
+        }
+        if (tx_kick(tx, 0) < 0)
+            return -1;
+        poll(&pfd, 1, 1);
+    }
+    return 0;
+}
+
+/**
+ * @brief Reserve the next free slot and return where to write the frame.
+ *
+ * Blocks (flushing first) until the kernel has finished with the slot.
+ * At most TX_RING_FRAME_SIZE - TPACKET2_HDRLEN bytes may be written.
+ *
+ * @param tx The transmit engine.
+ * @return Pointer to the start of the Ethernet header in the slot, or NULL
+ *         if the flush needed to free a slot failed.
+ */
+unsigned char *tx_reserve(struct tx_engine *tx) {
+    if (!tx->use_ring) {
+        // Every slot holds an unsent frame; never hand one out for reuse
+        if (tx->pending == tx->frame_count && tx_flush(tx) < 0)
+            return NULL;
+        return tx->map + (size_t)tx->head * TX_RING_FRAME_SIZE;
+    }
+
+    // The slot at head is free unless the ring is full, in which case it is the oldest one in flight
+    while (tx->inflight == tx->frame_count) {
+        struct pollfd pfd = { .fd = tx->sockfd, .events = POLLOUT };
+        tx_reap(tx);
+        if (tx->inflight < tx->frame_count)
+            break;
+        // Also resends slots the kernel stopped at, not only new ones
+        if (tx_kick(tx, MSG_DONTWAIT) < 0)
+            return NULL;
+        poll(&pfd, 1, 1);
+    }
+    return tx_ring_data((struct tpacket2_hdr *)(tx->map + (size_t)tx->head * TX_RING_FRAME_SIZE));
+}
+
+/**
+ * @brief Mark the most recently reserved slot as ready to send.
+ *
+ * Flushes automatically once TX_BATCH frames are pending.
+ *
+ * @param tx The transmit engine.
+ * @param len Length of the frame written into the slot.
+ */
+void tx_commit(struct tx_engine *tx, unsigned int len) {
+    if (tx->use_ring) {
+        struct tpacket2_hdr *hdr = (struct tpacket2_hdr *)(tx->map + (size_t)tx->head * TX_RING_FRAME_SIZE);
+        hdr->tp_len = len;
+        __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+        tx->inflight++;
+    } else {
+        tx->iovs[tx->head].iov_len = len;
+    }
+
+    tx->head = (tx->head + 1) % tx->frame_count;
+    if (++tx->pending >= TX_BATCH)
+        tx_flush(tx);
+}
+
+/**
+ * @brief Send outstanding frames, wait for the kernel to finish with the
+ * ring, and release the engine.
+ *
+ * @param tx The transmit engine.
+ */
+void tx_engine_close(struct tx_engine *tx) {
+    tx_drain(tx);
+    if (tx->use_ring)
+        munmap(tx->map, tx->map_len);
+    else
+        free(tx->map);
+    free(tx->msgs);
+    free(tx->iovs);
+    close(tx->sockfd);
+}
+
+/**
+ * @brief Write an Ethernet header in place at the start of a frame.
+ *
+ * @param frame Where the frame starts, e.g. the result of tx_reserve().
+ * @param dest_mac The destination MAC address.
+ * @param src_mac The source MAC address.
+ * @param ether_type The Ethernet type.
+ * @return Pointer to the payload area following the header.
+ */
+unsigned char *build_ether_header(unsigned char *frame, const unsigned char *dest_mac,
+                                  const unsigned char *src_mac, unsigned short ether_type) {
+    struct ethhdr *header = (struct ethhdr *)frame;
+
+    memcpy(header->h_dest, dest_mac, ETH_ALEN);
+    memcpy(header->h_source, src_mac, ETH_ALEN);
+    header->h_proto = htons(ether_type);
+    return frame + sizeof(struct ethhdr);
+}
+
+/*
+ * Socket filters
+ *
+ * A raw socket bound to ETH_P_ALL copies every frame on the interface to
+ * userspace. filter_compile() turns a small filter description into a
+ * classic BPF program that the kernel runs on each frame before queueing it,
+ * so frames that do not match are dropped without ever being copied.
+ *
+ * The expression syntax accepted by filter_parse() is a list of terms that
+ * must all match, optionally joined by "and":
+ *
+ *   ether <type>   EtherType after any VLAN tag, e.g. "ether 0x88b5"
+ *   vlan [<id>]    802.1Q/802.1ad tagged, optionally with this VLAN id. Only
+ *                  one tag level is looked at and skipped.
+ *   ip | ip6       IPv4 or IPv6
+ *   tcp|udp|icmp   IPv4 with this protocol
+ *   proto <n>      IPv4 with protocol number n
+ *   host <a.b.c.d> IPv4 source or destination address
+ *   port <n>       TCP or UDP source or destination port (IPv4, first fragments)
+ */
+
+#define FILTER_MAX_INSNS 64
+#define FILTER_DROP 0xFF  ///< Placeholder jump offset meaning "to the drop instruction"
+
+/**
+ * @brief What a socket filter should accept. Fields set to -1 match anything.
+ */
+struct pkt_filter {
+    int ether_type;  ///< EtherType after any VLAN tag
+    int vlan;        ///< 0: don't care, 1: must be tagged
+    int vlan_id;     ///< VLAN id when vlan is 1, or -1 for any
+    int ip_proto;    ///< IPv4 protocol number
+    int has_host;    ///< Non-zero to match host
+    uint32_t host;   ///< IPv4 address, network byte order
+    int port;        ///< TCP/UDP port
+};
+
+/**
+ * @brief A classic BPF program under construction.
+ */
+struct filter_asm {
+    struct sock_filter insns[FILTER_MAX_INSNS];
+    int len;
+};
+
+/**
+ * @brief Append one instruction.
+ *
+ * @return Index of the instruction.
+ */
+static int fa_emit(struct filter_asm *a, uint16_t code, uint8_t jt, uint8_t jf, uint32_t k) {
+    a->insns[a->len] = (struct sock_filter)BPF_JUMP(code, k, jt, jf);
+    return a->len++;
+}
+
+/**
+ * @brief Point a forward jump's true branch at the next instruction to be emitted.
+ */
+static void fa_land_jt(struct filter_asm *a, int from) {
+    a->insns[from].jt = (uint8_t)(a->len - from - 1);
+}
+
+/**
+ * @brief Point a forward jump's false branch at the next instruction to be emitted.
+ */
+static void fa_land_jf(struct filter_asm *a, int from) {
+    a->insns[from].jf = (uint8_t)(a->len - from - 1);
+}
+
+/**
+ * @brief Parse a filter expression.
+ *
+ * @param expr The expression, see the syntax above.
+ * @param f The filter to fill in.
+ * @return 0 on success, -1 on a syntax error.
+ */
+int filter_parse(const char *expr, struct pkt_filter *f) {
+    char buf[256], *save = NULL;
+
+    *f = (struct pkt_filter){ .ether_type = -1, .vlan = 0, .vlan_id = -1, .ip_proto = -1, .port = -1 };
+    strncpy(buf, expr, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    for (char *tok = strtok_r(buf, " ", &save); tok; tok = strtok_r(NULL, " ", &save)) {
+        char *arg;
+        if (strcmp(tok, "and") == 0) {
+            continue;
+        } else if (strcmp(tok, "ip") == 0) {
+            f->ether_type = ETH_P_IP;
+        } else if (strcmp(tok, "ip6") == 0) {
+            f->ether_type = ETH_P_IPV6;
+        } else if (strcmp(tok, "tcp") == 0) {
+            f->ip_proto = IPPROTO_TCP;
+        } else if (strcmp(tok, "udp") == 0) {
+            f->ip_proto = IPPROTO_UDP;
+        } else if (strcmp(tok, "icmp") == 0) {
+            f->ip_proto = IPPROTO_ICMP;
+        } else if (strcmp(tok, "vlan") == 0) {
+            f->vlan = 1;
+            // The id is optional: only consume the next token if it is a number
+            char *peek = save;
+            while (peek && *peek == ' ')
+                peek++;
+            if (peek && *peek >= '0' && *peek <= '9') {
+                arg = strtok_r(NULL, " ", &save);
+                f->vlan_id = (int)strtol(arg, NULL, 0) & 0xFFF;
+            }
+        } else if ((arg = strtok_r(NULL, " ", &save)) == NULL) {
+            fprintf(stderr, "filter: '%s' needs an argument\n", tok);
+            return -1;
+        } else if (strcmp(tok, "ether") == 0) {
+            f->ether_type = (int)strtol(arg, NULL, 0) & 0xFFFF;
+        } else if (strcmp(tok, "proto") == 0) {
+            f->ip_proto = (int)strtol(arg, NULL, 0) & 0xFF;
+        } else if (strcmp(tok, "port") == 0) {
+            f->port = (int)strtol(arg, NULL, 0) & 0xFFFF;
+        } else if (strcmp(tok, "host") == 0) {
+            struct in_addr addr;
+            if (inet_pton(AF_INET, arg, &addr) != 1) {
+                fprintf(stderr, "filter: bad IPv4 address '%s'\n", arg);
+                return -1;
+            }
+            f->has_host = 1;
+            f->host = addr.s_addr;
+        } else {
+            fprintf(stderr, "filter: unknown term '%s'\n", tok);
+            return -1;
+        }
+    }
+
+    // Network and transport terms imply IPv4
+    if ((f->ip_proto >= 0 || f->has_host || f->port >= 0) && f->ether_type < 0)
+        f->ether_type = ETH_P_IP;
+    if ((f->ip_proto >= 0 || f->has_host || f->port >= 0) && f->ether_type != ETH_P_IP) {
+        fprintf(stderr, "filter: proto, host and port only apply to IPv4\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Compile a filter to a classic BPF program.
+ *
+ * VLAN tags may arrive in the frame or, when the stack has already removed
+ * them, only in the packet metadata; both are handled. X holds the offset
+ * of the network header throughout.
+ *
+ * @param f The filter.
+ * @param a The program to fill in.
+ */
+void filter_compile(const struct pkt_filter *f, struct filter_asm *a) {
+    int j_tag, j_8021ad, j_skip_tagged;
+
+    a->len = 0;
+
+    // X = 14, A = outer EtherType
+    fa_emit(a, BPF_LDX | BPF_W | BPF_IMM, 0, 0, sizeof(struct ethhdr));
+    fa_emit(a, BPF_LD | BPF_H | BPF_ABS, 0, 0, 12);
+    j_tag = fa_emit(a, BPF_JMP | BPF_JEQ | BPF_K, 0, 0, ETH_P_8021Q);
+    j_8021ad = fa_emit(a, BPF_JMP | BPF_JEQ | BPF_K, 0, 0, ETH_P_8021AD);
+
+    // Untagged in the frame: the tag, if any, is in the metadata
+    fa_land_jf(a, j_8021ad);
+    if (f->vlan) {
+        fa_emit(a, BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_VLAN_TAG_PRESENT);
+        fa_emit(a, BPF_JMP | BPF_JEQ | BPF_K, FILTER_DROP, 0, 0);
+        if (f->vlan_id >= 0) {
+            fa_emit(a, BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_VLAN_TAG);
+            fa_emit(a, BPF_ALU | BPF_AND | BPF_K, 0, 0, 0xFFF);
+            fa_emit(a, BPF_JMP | BPF_JEQ | BPF_K, 0, FILTER_DROP, (uint32_t)f->vlan_id);
+        }
+        fa_emit(a, BPF_LD | BPF_H | BPF_ABS, 0, 0, 12);
+    }
+    j_skip_tagged = fa_emit(a, BPF_JMP | BPF_JA, 0, 0, 0);
+
+    // Tagged in the frame: check the id, load the inner EtherType, X = 18
+    fa_land_jt(a, j_tag);
+    fa_land_jt(a, j_8021ad);
+    if (f->vlan_id >= 0) {
+        fa_emit(a, BPF_LD | BPF_H | BPF_ABS, 0, 0, 14);
+        fa_emit(a, BPF_ALU | BPF_AND | BPF_K, 0, 0, 0xFFF);
+        fa_emit(a, BPF_JMP | BPF_JEQ | BPF_K, 0, FILTER_DROP, (uint32_t)f->vlan_id);
+    }
+    fa_emit(a, BPF_LD | BPF_H | BPF_ABS, 0, 0, 16);
+    fa_emit(a, BPF_LDX | BPF_W | BPF_IMM, 0, 0, sizeof(struct ethhdr) + 4);
+    a->insns[j_skip_tagged].k = (uint32_t)(a->len - j_skip_tagged - 1);
+
+    // A = EtherType, X = network header offset
+    if (f->ether_type >= 0)
+        fa_emit(a, BPF_JMP | BPF_JEQ | BPF_K, 0, FILTER_DROP, (uint32_t)f->ether_type);
+    if (f->ip_proto >= 0) {
+        fa_emit(a, BPF_LD | BPF_B | BPF_IND, 0, 0, 9);
+        fa_emit(a, BPF_JMP | BPF_JEQ | BPF_K, 0, FILTER_DROP, (uint32_t)f->ip_proto);
+    }
+    if (f->has_host) {
+        fa_emit(a, BPF_LD | BPF_W | BPF_IND, 0, 0, 12);
+        int j_src = fa_emit(a, BPF_JMP | BPF_JEQ | BPF_K, 0, 0, ntohl(f->host));
+        fa_emit(a, BPF_LD | BPF_W | BPF_IND, 0, 0, 16);
+        fa_emit(a, BPF_JMP | BPF_JEQ | BPF_K, 0, FILTER_DROP, ntohl(f->host));
+        fa_land_jt(a, j_src);
+    }
+    if (f->port >= 0) {
+        // As in tcpdump, only TCP and UDP have ports; other protocols would match on arbitrary bytes
+        if (f->ip_proto != IPPROTO_TCP && f->ip_proto != IPPROTO_UDP) {
+            fa_emit(a, BPF_LD | BPF_B | BPF_IND, 0, 0, 9);
+            int j_tcp = fa_emit(a, BPF_JMP | BPF_JEQ | BPF_K, 0, 0, IPPROTO_TCP);
+            fa_emit(a, BPF_JMP | BPF_JEQ | BPF_K, 0, FILTER_DROP, IPPROTO_UDP);
+            fa_land_jt(a, j_tcp);
+        }
+        // Only first fragments carry ports; then X += IHL * 4
+        fa_emit(a, BPF_LD | BPF_H | BPF_IND, 0, 0, 6);
+        fa_emit(a, BPF_JMP | BPF_JSET | BPF_K, FILTER_DROP, 0, 0x1FFF);
+        fa_emit(a, BPF_LD | BPF_B | BPF_IND, 0, 0, 0);
+        fa_emit(a, BPF_ALU | BPF_AND | BPF_K, 0, 0, 0x0F);
+        fa_emit(a, BPF_ALU | BPF_LSH | BPF_K, 0, 0, 2);
+        fa_emit(a, BPF_ALU | BPF_ADD | BPF_X, 0, 0, 0);
+        fa_emit(a, BPF_MISC | BPF_TAX, 0, 0, 0);
+        fa_emit(a, BPF_LD | BPF_H | BPF_IND, 0, 0, 0);
+        int j_sport = fa_emit(a, BPF_JMP | BPF_JEQ | BPF_K, 0, 0, (uint32_t)f->port);
+        fa_emit(a, BPF_LD | BPF_H | BPF_IND, 0, 0, 2);
+        fa_emit(a, BPF_JMP | BPF_JEQ | BPF_K, 0, FILTER_DROP, (uint32_t)f->port);
+        fa_land_jt(a, j_sport);
+    }
+    fa_emit(a, BPF_RET | BPF_K, 0, 0, 0x40000);  // Accept the whole frame
+
+    // Resolve jumps to the final drop instruction
+    int drop = fa_emit(a, BPF_RET | BPF_K, 0, 0, 0);
+    for (int i = 0; i < drop; ++i) {
+        if (BPF_CLASS(a->insns[i].code) != BPF_JMP || BPF_OP(a->insns[i].code) == BPF_JA)
+            continue;
+        if (a->insns[i].jt == FILTER_DROP)
+            a->insns[i].jt = (uint8_t)(drop - i - 1);
+        if (a->insns[i].jf == FILTER_DROP)
+            a->insns[i].jf = (uint8_t)(drop - i - 1);
+    }
+}
+
+/**
+ * @brief Check a decoded frame against a filter in userspace.
+ *
+ * Used to validate compiled filters. VLAN terms are not checked because a
+ * tag removed by the stack is not visible in the received bytes.
+ *
+ * @param f The filter.
+ * @param d The decoded frame.
+ * @return Non-zero if the frame matches.
+ */
+int filter_match(const struct pkt_filter *f, const struct pkt_desc *d) {
+    const unsigned char *ip = d->frame + d->l3_off;
+
+    if (f->ether_type >= 0 && d->ether_type != f->ether_type)
+        return 0;
+    if (f->ip_proto >= 0 && (d->ip_version != 4 || d->ip_proto != f->ip_proto))
+        return 0;
+    if (f->has_host && (d->ip_version != 4 || (memcmp(ip + 12, &f->host, 4) != 0 && memcmp(ip + 16, &f->host, 4) != 0)))
+        return 0;
+    if (f->port >= 0 && (d->l4_off == 0 || (d->ip_proto != IPPROTO_TCP && d->ip_proto != IPPROTO_UDP) ||
+                         (d->src_port != f->port && d->dst_port != f->port)))
+        return 0;
+    return 1;
+}
+
+/**
+ * @brief Compile a filter expression and attach it to a socket.
+ *
+ * A drop-everything filter is attached first and the queue drained, so no
+ * frame that arrived before the real filter is delivered.
+ *
+ * @param sockfd The raw socket.
+ * @param expr The filter expression.
+ * @return 0 on success, -1 on error.
+ */
+int filter_attach(int sockfd, const char *expr) {
+    struct sock_filter drop_all = BPF_STMT(BPF_RET | BPF_K, 0);
+    struct sock_fprog prog = { 1, &drop_all };
+    struct pkt_filter f;
+    struct filter_asm a;
+    char scratch[64];
+
+    if (filter_parse(expr, &f) < 0)
+        return -1;
+    filter_compile(&f, &a);
+
+    if (setsockopt(sockfd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0) {
+        perror("SO_ATTACH_FILTER failed");
+        return -1;
+    }
+    while (recv(sockfd, scratch, sizeof(scratch), MSG_DONTWAIT) >= 0)
+        ;
+
+    prog.len = (unsigned short)a.len;
+    prog.filter = a.insns;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0) {
+        perror("SO_ATTACH_FILTER failed");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Packet and byte counters filled in by count_frame().
+ */
+struct rx_stats {
+    uint64_t packets;
+    uint64_t bytes;
+};
+
+/*
+ * Multi-core capture
+ *
+ * A capture group opens one socket and ring per worker and joins them all
+ * to one PACKET_FANOUT group, so the kernel spreads frames across workers
+ * (by flow hash, by receiving CPU, or round-robin). Each worker is pinned
+ * to its own core and runs its own pipeline: decode, a private flow table
+ * and private counters. Nothing is shared between workers while they run;
+ * counters are summed and flow tables merged after the workers have been
+ * joined. A flow can reach several workers (always with lb, and with cpu
+ * when its packets arrive on several CPUs), so flow counts are not summed.
+ */
+
+/**
+ * @brief Per-worker capture state. Aligned so workers never share a cache line.
+ */
+struct capture_worker {
+    pthread_t thread;
+    int cpu;                   ///< Core the worker is pinned to
+    int sockfd;
+    int use_ring;
+    struct rx_ring ring;
+    struct flow_table flows;   ///< Flows seen by this worker only
+    struct rx_stats stats;     ///< Written only by this worker
+    const int *stop;           ///< Set by capture_group_stop()
+} __attribute__((aligned(64)));
+
+/**
+ * @brief A set of workers sharing one fanout group.
+ */
+struct capture_group {
+    struct capture_worker *workers;
+    int count;
+    int stop;
+};
+
+/**
+ * @brief frame_handler for a capture worker: count, decode and account the frame.
+ */
+static void capture_worker_handler(const unsigned char *frame, unsigned int len, uint64_t ts_ns, void *user) {
+    struct capture_worker *w = user;
+
+    w->stats.packets++;
+    w->stats.bytes += len;
+    flow_table_handler(frame, len, ts_ns, &w->flows);
+}
+
+/**
+ * @brief Worker thread: pin to a core and drain this worker's socket.
+ */
+static void *capture_worker_main(void *arg) {
+    struct capture_worker *w = arg;
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(w->cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+    while (!__atomic_load_n(w->stop, __ATOMIC_RELAXED)) {
+        if (w->use_ring) {
+            struct tpacket_block_desc *block = rx_ring_next_block(&w->ring, 100);
+            if (block) {
+                rx_block_dispatch(block, capture_worker_handler, w);
+                rx_ring_release_block(&w->ring, block);
+            }
+        } else {
+            recv_dispatch(w->sockfd, capture_worker_handler, w);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Open a socket for one worker and join it to the fanout group.
+ *
+ * @return 0 on success, -1 on error.
+ */
+static int capture_worker_open(struct capture_worker *w, const char *ifname, uint32_t fanout_arg) {
+    w->sockfd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    if (w->sockfd < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+    w->use_ring = rx_ring_setup(&w->ring, w->sockfd, RX_RING_BLOCK_SIZE, RX_RING_BLOCK_COUNT / 4) == 0;
+    if (!w->use_ring) {
+        struct timeval tv = { .tv_sec = 0, .tv_usec = 100000 };
+        setsockopt(w->sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+    // The socket must be bound before it can join a fanout group
+    if (bind_raw_socket(w->sockfd, ifname, ETH_P_ALL) < 0)
+        return -1;
+    if (setsockopt(w->sockfd, SOL_PACKET, PACKET_FANOUT, &fanout_arg, sizeof(fanout_arg)) < 0) {
+        perror("PACKET_FANOUT failed");
+        return -1;
+    }
+    return flow_table_init(&w->flows, 1u << 16);
+}
+
+/**
+ * @brief Release a worker's socket, ring and flow table.
+ */
+static void capture_worker_close(struct capture_worker *w) {
+    if (w->use_ring)
+        rx_ring_teardown(&w->ring);
+    if (w->sockfd >= 0)
+        close(w->sockfd);
+    flow_table_free(&w->flows);
+}
+
+/**
+ * @brief Start a group of pinned capture workers on one interface.
+ *
+ * @param g The group to start.
+ * @param ifname The interface to capture on.
+ * @param count Number of workers; worker i is pinned to core i modulo the core count.
+ * @param fanout_mode PACKET_FANOUT_HASH, PACKET_FANOUT_CPU or PACKET_FANOUT_LB.
+ * @return 0 on success, -1 on error.
+ */
+int capture_group_start(struct capture_group *g, const char *ifname, int count, int fanout_mode) {
+    // Group ids are per network namespace; derive one from the pid to avoid clashes
+    uint32_t fanout_arg = ((uint32_t)getpid() & 0xFFFF) | ((uint32_t)fanout_mode << 16);
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (fanout_mode == PACKET_FANOUT_HASH)
+        fanout_arg |= (uint32_t)PACKET_FANOUT_FLAG_DEFRAG << 16;
+
+    g->count = count;
+    g->stop = 0;
+    g->workers = aligned_alloc(64, sizeof(struct capture_worker) * count);
+    if (!g->workers) {
+        perror("Worker allocation failed");
+        return -1;
+    }
+    memset(g->workers, 0, sizeof(struct capture_worker) * count);
+
+    for (int i = 0; i < count; ++i) {
+        struct capture_worker *w = &g->workers[i];
+        w->sockfd = -1;
+        w->cpu = (int)(i % (cores > 0 ? cores : 1));
+        w->stop = &g->stop;
+        if (capture_worker_open(w, ifname, fanout_arg) < 0) {
+            for (int j = 0; j <= i; ++j)
+                capture_worker_close(&g->workers[j]);
+            free(g->workers);
+            return -1;
+        }
+    }
+    for (int i = 0; i < count; ++i) {
+        int err = pthread_create(&g->workers[i].thread, NULL, capture_worker_main, &g->workers[i]);
+        if (err) {
+            fprintf(stderr, "Worker thread creation failed: %s\n", strerror(err));
+            __atomic_store_n(&g->stop, 1, __ATOMIC_RELAXED);
+            for (int j = 0; j < i; ++j)
+                pthread_join(g->workers[j].thread, NULL);
+            for (int j = 0; j < count; ++j)
+                capture_worker_close(&g->workers[j]);
+            free(g->workers);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Stop and join all workers, then merge their counters.
+ *
+ * @param g The running group.
+ * @param total Set to the sum of all workers' counters.
+ * @param flows Set to the number of distinct flows seen by any worker.
+ */
+void capture_group_stop(struct capture_group *g, struct rx_stats *total, uint64_t *flows) {
+    __atomic_store_n(&g->stop, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < g->count; ++i)
+        pthread_join(g->workers[i].thread, NULL);
+
+    struct flow_table merged;
+    uint32_t max_flows = 0;
+
+    total->packets = total->bytes = 0;
+    for (int i = 0; i < g->count; ++i) {
+        total->packets += g->workers[i].stats.packets;
+        total->bytes += g->workers[i].stats.bytes;
+        max_flows += g->workers[i].flows.count;
+    }
+
+    *flows = 0;
+    if (flow_table_init(&merged, max_flows) == 0) {
+        for (int i = 0; i < g->count; ++i)
+            flow_table_merge(&merged, &g->workers[i].flows);
+        *flows = merged.count;
+        flow_table_free(&merged);
+    }
+}
+
+/**
+ * @brief Release a stopped group.
+ *
+ * @param g The group.
+ */
+void capture_group_free(struct capture_group *g) {
+    for (int i = 0; i < g->count; ++i)
+        capture_worker_close(&g->workers[i]);
+    free(g->workers);
+    g->workers = NULL;
+}
+
+/*
+ * Packet generator
+ *
+ * pktgen sends copies of a pre-built frame template at a target rate. Each
+ * copy gets a sequence number and its send time (CLOCK_REALTIME) patched
+ * into the payload. A receiver on the same host matches sequence numbers
+ * and subtracts the send time from the kernel's SO_TIMESTAMPING receive
+ * timestamp (hardware if the NIC provides one, software otherwise) to get
+ * one-way latency without any outside tools.
+ *
+ * Pacing uses a token bucket kept in units of packet-nanoseconds, so rates
+ * are exact to the nanosecond with no floating point: every elapsed
+ * nanosecond adds `rate` units and every packet costs 10^9 units. At most
+ * `burst` packets' worth of credit accumulates while the sender is idle.
+ */
+
+#define PKTGEN_ETHER_TYPE 0x88B6  ///< IEEE local experimental EtherType 2
+#define PKTGEN_MAGIC 0x706B7467u  ///< "pktg"
+#define PKTGEN_SPIN_NS 50000      ///< Busy-wait below this, sleep above it
+
+/**
+ * @brief Header written at the start of every generated payload.
+ */
+struct pktgen_hdr {
+    uint32_t magic;
+    uint32_t stream;  ///< Distinguishes concurrent runs
+    uint64_t seq;
+    uint64_t tx_ns;   ///< Send time, CLOCK_REALTIME
+} __attribute__((packed));
+
+/**
+ * @brief A token bucket with nanosecond resolution.
+ */
+struct token_bucket {
+    uint64_t rate;     ///< Packets per second
+    uint64_t cap;      ///< Maximum credit: burst * 10^9
+    uint64_t credit;   ///< Packet-nanoseconds available
+    uint64_t last_ns;  ///< When credit was last topped up
+};
+
+/**
+ * @brief Initialise a token bucket, starting with one burst of credit.
+ *
+ * @param tb The bucket.
+ * @param rate Packets per second; must be non-zero.
+ * @param burst Largest number of back-to-back packets.
+ * @param now_ns Current monotonic time.
+ */
+void token_bucket_init(struct token_bucket *tb, uint64_t rate, uint64_t burst, uint64_t now_ns) {
+    tb->rate = rate;
+    tb->cap = (burst ? burst : 1) * 1000000000ull;
+    tb->credit = tb->cap;
+    tb->last_ns = now_ns;
+}
+
+/**
+ * @brief Take as many tokens as are available, up to a limit.
+ *
+ * @param tb The bucket.
+ * @param now_ns Current monotonic time.
+ * @param max Largest number of tokens wanted.
+ * @return The number of packets that may be sent now.
+ */
+uint64_t token_bucket_take(struct token_bucket *tb, uint64_t now_ns, uint64_t max) {
+    uint64_t elapsed = now_ns - tb->last_ns;
+
+    // Anything past one second is beyond any burst cap and would risk overflow
+    if (elapsed > 1000000000ull)
+        elapsed = 1000000000ull;
+    tb->credit += elapsed * tb->rate;
+    if (tb->credit > tb->cap)
+        tb->credit = tb->cap;
+    tb->last_ns = now_ns;
+
+    uint64_t n = tb->credit / 1000000000ull;
+    if (n > max)
+        n = max;
+    tb->credit -= n * 1000000000ull;
+    return n;
+}
+
+/**
+ * @brief Nanoseconds until the next token is available.
+ */
+uint64_t token_bucket_wait_ns(const struct token_bucket *tb) {
+    uint64_t missing = 1000000000ull - tb->credit % 1000000000ull;
+    return (missing + tb->rate - 1) / tb->rate;
+}
+
+/**
+ * @brief Pktgen run parameters.
+ */
+struct pktgen_config {
+    const char *ifname;
+    uint64_t rate;        ///< Packets per second
+    uint64_t count;       ///< Packets to send
+    unsigned int size;    ///< Frame size in bytes, at least 60
+    unsigned int burst;   ///< Token bucket depth
+};
+
+/**
+ * @brief Receiver state and results.
+ */
+struct pktgen_rx {
+    int sockfd;
+    uint32_t stream;
+    uint64_t count;          ///< Sequence numbers expected: 0..count-1
+    uint8_t *seen;           ///< One flag per sequence number
+    uint64_t *latency_ns;    ///< One sample per first arrival
+    uint64_t received;
+    uint64_t duplicates;
+    uint64_t reordered;      ///< Arrived after a higher sequence number
+    uint64_t max_seq;
+    int hw_timestamps;       ///< Non-zero if any sample used a hardware timestamp
+    int stop;
+};
+
+/**
+ * @brief Enable kernel receive timestamps, preferring hardware.
+ *
+ * @param sockfd The receiving socket.
+ * @return 0 on success, -1 on error.
+ */
+static int pktgen_enable_timestamps(int sockfd) {
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |
+                SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+
+    if (setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0) {
+        perror("SO_TIMESTAMPING failed");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Receiver thread: match sequence numbers and record latencies.
+ */
+static void *pktgen_rx_main(void *arg) {
+    struct pktgen_rx *rx = arg;
+    unsigned char frame[ETH_FRAME_LEN];
+    char control[256];
+    struct sockaddr_ll from;
+    struct iovec iov = { frame, sizeof(frame) };
+    struct msghdr msg = { &from, sizeof(from), &iov, 1, control, sizeof(control), 0 };
+
+    while (!__atomic_load_n(&rx->stop, __ATOMIC_ACQUIRE)) {
+        msg.msg_namelen = sizeof(from);
+        msg.msg_controllen = sizeof(control);
+        ssize_t n = recvmsg(rx->sockfd, &msg, 0);
+        if (n < (ssize_t)(sizeof(struct ethhdr) + sizeof(struct pktgen_hdr)) || from.sll_pkttype == PACKET_OUTGOING)
+            continue;
+
+        struct pktgen_hdr h;
+        memcpy(&h, frame + sizeof(struct ethhdr), sizeof(h));
+        if (h.magic != PKTGEN_MAGIC || h.stream != rx->stream || h.seq >= rx->count)
+            continue;
+
+        uint64_t rx_ns = 0;
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPING) {
+                struct timespec ts[3];
+                memcpy(ts, CMSG_DATA(c), sizeof(ts));
+                // ts[0] is the software timestamp, ts[2] the raw hardware one
+                if (ts[2].tv_sec || ts[2].tv_nsec) {
+                    rx_ns = ts[2].tv_sec * 1000000000ull + ts[2].tv_nsec;
+                    rx->hw_timestamps = 1;
+                } else {
+                    rx_ns = ts[0].tv_sec * 1000000000ull + ts[0].tv_nsec;
+                }
+            }
+        }
+        if (rx_ns == 0)
+            rx_ns = realtime_ns();
+
+        if (rx->seen[h.seq]) {
+            rx->duplicates++;
+            continue;
+        }
+        rx->seen[h.seq] = 1;
+        if (h.seq < rx->max_seq)
+            rx->reordered++;
+        else
+            rx->max_seq = h.seq;
+        rx->latency_ns[rx->received++] = rx_ns > h.tx_ns ? rx_ns - h.tx_ns : 0;
+    }
+    return NULL;
+}
+
+/**
+ * @brief qsort comparator for uint64_t.
+ */
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief Send paced, sequenced frames and report loss and one-way latency.
+ *
+ * @param cfg The run parameters.
+ * @return 0 on success
+ */
+int pktgen_run(const struct pktgen_config *cfg) {
+    static const unsigned char src_mac[ETH_ALEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    static const unsigned char dst_mac[ETH_ALEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+    unsigned char template[ETH_FRAME_LEN];
+    unsigned int size = cfg->size < 60 ? 60 : cfg->size > ETH_FRAME_LEN ? ETH_FRAME_LEN : cfg->size;
+    struct timeval tv = { .tv_sec = 0, .tv_usec = 100000 };
+    struct token_bucket tb;
+    struct tx_engine tx;
+    struct pktgen_rx rx;
+    pthread_t rx_thread;
+    int err;
+
+    // The token bucket divides by the rate and the report by the count
+    if (cfg->rate == 0 || cfg->count == 0) {
+        fprintf(stderr, "pktgen: pps and count must be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    memset(&rx, 0, sizeof(rx));
+    rx.stream = (uint32_t)getpid();
+    rx.count = cfg->count;
+    rx.seen = calloc(cfg->count, 1);
+    rx.latency_ns = malloc(cfg->count * sizeof(uint64_t));
+    rx.sockfd = socket(AF_PACKET, SOCK_RAW, htons(PKTGEN_ETHER_TYPE));
+    if (!rx.seen || !rx.latency_ns || rx.sockfd < 0) {
+        perror("Receiver setup failed");
+        goto fail;
+    }
+    setsockopt(rx.sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (pktgen_enable_timestamps(rx.sockfd) < 0 || bind_raw_socket(rx.sockfd, cfg->ifname, PKTGEN_ETHER_TYPE) < 0 ||
+        tx_engine_open(&tx, cfg->ifname, TX_ENGINE_COPY) < 0)
+        goto fail;
+    if ((err = pthread_create(&rx_thread, NULL, pktgen_rx_main, &rx)) != 0) {
+        fprintf(stderr, "Receiver thread creation failed: %s\n", strerror(err));
+        tx_engine_close(&tx);
+        goto fail;
+    }
+
+    // Build the template once; only seq and tx_ns change per packet
+    struct pktgen_hdr h = { PKTGEN_MAGIC, rx.stream, 0, 0 };
+    memset(template, 0, sizeof(template));
+    memcpy(build_ether_header(template, dst_mac, src_mac, PKTGEN_ETHER_TYPE), &h, sizeof(h));
+    const size_t seq_off = sizeof(struct ethhdr) + offsetof(struct pktgen_hdr, seq);
+    const size_t ts_off = sizeof(struct ethhdr) + offsetof(struct pktgen_hdr, tx_ns);
+
+    uint64_t start = now_ns();
+    uint64_t seq = 0;
+    int tx_failed = 0;
+    token_bucket_init(&tb, cfg->rate, cfg->burst, start);
+    while (seq < cfg->count && !tx_failed) {
+        uint64_t now = now_ns();
+        uint64_t n = token_bucket_take(&tb, now, cfg->count - seq);
+        if (n == 0) {
+            uint64_t wait = token_bucket_wait_ns(&tb);
+            if (wait > PKTGEN_SPIN_NS) {
+                struct timespec ts = { 0, (long)(wait - PKTGEN_SPIN_NS / 2) };
+                nanosleep(&ts, NULL);
+            } else {
+                // Spin, but let a receiver sharing this core run
+                sched_yield();
+            }
+            continue;
+        }
+        for (uint64_t i = 0; i < n; ++i, ++seq) {
+            unsigned char *frame = tx_reserve(&tx);
+            if (!frame) {
+                tx_failed = 1;
+                break;
+            }
+            uint64_t tx_ns = realtime_ns();
+            memcpy(frame, template, size);
+            memcpy(frame + seq_off, &seq, sizeof(seq));
+            memcpy(frame + ts_off, &tx_ns, sizeof(tx_ns));
+            tx_commit(&tx, size);
+        }
+        // Never hold paced frames back waiting for a full batch
+        if (tx_flush(&tx) < 0)
+            tx_failed = 1;
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    // Let in-flight frames arrive, then stop the receiver
+    usleep(200000);
+    __atomic_store_n(&rx.stop, 1, __ATOMIC_RELEASE);
+    pthread_join(rx_thread, NULL);
+    tx_engine_close(&tx);
+    close(rx.sockfd);
+    if (tx_failed) {
+        fprintf(stderr, "pktgen: transmit failed after %llu frames\n", (unsigned long long)seq);
+        free(rx.seen);
+        free(rx.latency_ns);
+        return EXIT_FAILURE;
+    }
+
+    printf("pktgen on %s: %llu frames of %u bytes, target %llu pps, achieved %.0f pps\n", cfg->ifname,
+           (unsigned long long)cfg->count, size, (unsigned long long)cfg->rate, cfg->count * 1e9 / elapsed);
+    printf("received %llu, lost %llu (%.4f%%), duplicates %llu, reordered %llu\n",
+           (unsigned long long)rx.received, (unsigned long long)(cfg->count - rx.received),
+           100.0 * (cfg->count - rx.received) / cfg->count, (unsigned long long)rx.duplicates,
+           (unsigned long long)rx.reordered);
+    if (rx.received) {
+        uint64_t *lat = rx.latency_ns;
+        size_t n = rx.received;
+        qsort(lat, n, sizeof(uint64_t), compare_u64);
+        printf("one-way latency (%s timestamps, ns): min %llu p50 %llu p99 %llu p999 %llu max %llu\n",
+               rx.hw_timestamps ? "hardware" : "software", (unsigned long long)lat[0],
+               (unsigned long long)lat[(n - 1) / 2], (unsigned long long)lat[(size_t)((n - 1) * 0.99)],
+               (unsigned long long)lat[(size_t)((n - 1) * 0.999)], (unsigned long long)lat[n - 1]);
+    }
+
+    free(rx.seen);
+    free(rx.latency_ns);
+    return 0;
+
+fail:
+    if (rx.sockfd >= 0)
+        close(rx.sockfd);
+    free(rx.seen);
+    free(rx.latency_ns);
+    return EXIT_FAILURE;
+}
+
+/*
+ * Benchmarks
+ *
+ * bench-rx: a child process blasts minimum-size frames with a private
+ * EtherType onto an interface (use `lo` or one end of a veth pair) while the
+ * parent receives them, first with `recvfrom` and then with the ring, and
+ * reports packets/sec and receiving-thread CPU time per packet.
+ *
+ * The other modes are described at their entry points below.
+ */
+
+#define BENCH_ETHER_TYPE 0x88B5  ///< IEEE local experimental EtherType
+
+/**
+ * @brief frame_handler that only counts frames.
+ */
+static void count_frame(const unsigned char *frame, unsigned int len, uint64_t ts_ns, void *user) {
+    struct rx_stats *stats = user;
+    (void)frame;
+    (void)ts_ns;
+    stats->packets++;
+    stats->bytes += len;
+}
+
+/**
+ * @brief Send frames with BENCH_ETHER_TYPE on an interface until killed.
+ *
+ * @param ifname The interface to transmit on.
+ */
+static void bench_traffic_generator(const char *ifname) {
+    unsigned char frame[64] = {0};
+    struct ethhdr *header = (struct ethhdr *)frame;
+    struct sockaddr_ll socket_address;
+    int sockfd = create_raw_socket();
+
+    memset(header->h_dest, 0xff, ETH_ALEN);
+    header->h_proto = htons(BENCH_ETHER_TYPE);
+    memset(&socket_address, 0, sizeof(socket_address));
+    socket_address.sll_family = AF_PACKET;
+    socket_address.sll_ifindex = get_ifindex(sockfd, ifname);
+    for (;;)
+        sendto(sockfd, frame, sizeof(frame), 0, (struct sockaddr *)&socket_address, sizeof(socket_address));
+}
+
+/**
+ * @brief Receive for a fixed time with one of the two paths and report rates.
+ *
+ * @param ifname The interface to capture on.
+ * @param seconds How long to receive for.
+ * @param use_ring Non-zero for the TPACKET_V3 ring, zero for `recvfrom`.
+ */
+static void bench_rx_mode(const char *ifname, int seconds, int use_ring) {
+    struct rx_stats stats = {0, 0};
+    struct tpacket_stats_v3 kstats;
+    socklen_t kstats_len = sizeof(kstats);
+    struct rx_ring ring;
+    int sockfd = socket(AF_PACKET, SOCK_RAW, htons(BENCH_ETHER_TYPE));
+
+    if (sockfd < 0) {
+        perror("Socket creation failed");
+        return;
+    }
+    if (use_ring && rx_ring_setup(&ring, sockfd, RX_RING_BLOCK_SIZE, RX_RING_BLOCK_COUNT) < 0) {
+        close(sockfd);
+        return;
+    }
+    if (!use_ring) {
+        struct timeval tv = { .tv_sec = 0, .tv_usec = 100000 };
+        setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+    if (bind_raw_socket(sockfd, ifname, BENCH_ETHER_TYPE) < 0) {
+        if (use_ring)
+            rx_ring_teardown(&ring);
+        close(sockfd);
+        return;
+    }
+
+    uint64_t start = now_ns();
+    uint64_t deadline = start + (uint64_t)seconds * 1000000000ull;
+    uint64_t cpu_start = thread_cpu_ns();
+    while (now_ns() < deadline) {
+        if (use_ring) {
+            struct tpacket_block_desc *block = rx_ring_next_block(&ring, 100);
+            if (block) {
+                rx_block_dispatch(block, count_frame, &stats);
+                rx_ring_release_block(&ring, block);
+            }
+        } else {
+            recv_dispatch(sockfd, count_frame, &stats);
+        }
+    }
+    uint64_t cpu = thread_cpu_ns() - cpu_start;
+    uint64_t elapsed = now_ns() - start;
+
+    memset(&kstats, 0, sizeof(kstats));
+    getsockopt(sockfd, SOL_PACKET, PACKET_STATISTICS, &kstats, &kstats_len);
+    printf("%-8s %12.0f pkts/s %10.1f MB/s %10.1f CPU ns/pkt %10u drops\n",
+           use_ring ? "ring" : "recvfrom",
+           stats.packets * 1e9 / elapsed,
+           stats.bytes * 1e3 / elapsed,
+           stats.packets ? (double)cpu / stats.packets : 0.0,
+           kstats.tp_drops);
+
+    if (use_ring)
+        rx_ring_teardown(&ring);
+    close(sockfd);
+}
+
+/**
+ * @brief Compare the `recvfrom` and TPACKET_V3 ring receive paths.
+ *
+ * @param ifname The interface to generate traffic on and capture from.
+ * @param seconds How long to run each mode.
+ * @return 0 on success
+ */
+int bench_rx(const char *ifname, int seconds) {
+    pid_t generator = fork();
+
+    if (generator < 0) {
+        perror("fork failed");
+        return EXIT_FAILURE;
+    }
+    if (generator == 0) {
+        bench_traffic_generator(ifname);
+        _exit(0);
+    }
+
+    printf("Receive benchmark on %s, %d s per mode\n", ifname, seconds);
+    bench_rx_mode(ifname, seconds, 0);
+    bench_rx_mode(ifname, seconds, 1);
+
+    kill(generator, SIGKILL);
+    waitpid(generator, NULL, 0);
+    return 0;
+}
+
+/**
+ * @brief Compare send_raw_ethernet_frame() against the transmit engine.
+ *
+ * @param ifname The interface to transmit on.
+ * @param count Number of frames to send in each mode.
+ * @return 0 on success
+ */
+int bench_tx(const char *ifname, long count) {
+    unsigned char dest_mac[ETH_ALEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+    unsigned char src_mac[ETH_ALEN] = {0};
+    unsigned char payload[46] = {0};
+    struct tx_engine tx;
+    int sockfd = create_raw_socket();
+
+    printf("Transmit benchmark on %s, %ld frames of %zu bytes per mode\n",
+           ifname, count, sizeof(struct ethhdr) + sizeof(payload));
+
+    uint64_t start = now_ns();
+    for (long i = 0; i < count; ++i)
+        send_raw_ethernet_frame(sockfd, ifname, dest_mac, src_mac, BENCH_ETHER_TYPE, payload, sizeof(payload));
+    uint64_t elapsed = now_ns() - start;
+    printf("%-8s %12.0f pkts/s %10.1f ns/pkt\n", "sendto", count * 1e9 / elapsed, (double)elapsed / count);
+    close(sockfd);
+
+    if (tx_engine_open(&tx, ifname, 0) < 0)
+        return EXIT_FAILURE;
+    start = now_ns();
+    for (long i = 0; i < count; ++i) {
+        unsigned char *frame = tx_reserve(&tx);
+        if (!frame)
+            break;
+        unsigned char *data = build_ether_header(frame, dest_mac, src_mac, BENCH_ETHER_TYPE);
+        memset(data, 0, sizeof(payload));
+        tx_commit(&tx, sizeof(struct ethhdr) + sizeof(payload));
+    }
+    // Stop the clock only once the kernel has transmitted every frame
+    int drained = tx_drain(&tx);
+    elapsed = now_ns() - start;
+    printf("%-8s %12.0f pkts/s %10.1f ns/pkt\n", tx.use_ring ? "tx-ring" : "sendmmsg",
+           tx.sent * 1e9 / elapsed, (double)elapsed / (tx.sent ? tx.sent : 1));
+    if (tx.busy)
+        printf("%-8s %12llu sends retried after EAGAIN or ENOBUFS\n", "", (unsigned long long)tx.busy);
+    if (drained < 0 || tx.sent != (uint64_t)count)
+        fprintf(stderr, "only %llu of %ld frames sent (%llu rejected)\n", (unsigned long long)tx.sent, count,
+                (unsigned long long)tx.rejected);
+    tx_engine_close(&tx);
+    return drained < 0 || tx.sent != (uint64_t)count ? EXIT_FAILURE : 0;
+}
+
+/**
+ * @brief Cycle counter used for bytes/cycle figures (TSC on x86, ns elsewhere).
+ */
+static uint64_t read_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return now_ns();
+#endif
+}
+
+/**
+ * @brief A named partial-sum implementation for the checksum benchmark.
+ */
+struct csum_impl {
+    const char *name;
+    uint64_t (*fn)(const void *, size_t, uint64_t);
+};
+
+/**
+ * @brief Adapt checksum_reference() to the partial-sum signature.
+ *
+ * Returns the complement so csum_fold() gives back the reference checksum.
+ */
+static uint64_t csum_partial_reference(const void *buf, size_t len, uint64_t sum) {
+    (void)sum;
+    return (uint16_t)~checksum_reference((void *)buf, (int)len);
+}
+
+/**
+ * @brief Collect the implementations this CPU can run.
+ *
+ * @param impls Filled with up to four implementations.
+ * @return The number of implementations.
+ */
+static int csum_impls(struct csum_impl *impls) {
+    int n = 0;
+
+    impls[n++] = (struct csum_impl){ "reference", csum_partial_reference };
+    impls[n++] = (struct csum_impl){ "scalar", csum_partial_scalar };
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        impls[n++] = (struct csum_impl){ "sse2", csum_partial_sse2 };
+    if (__builtin_cpu_supports("avx2"))
+        impls[n++] = (struct csum_impl){ "avx2", csum_partial_avx2 };
+#endif
+    return n;
+}
+
+/**
+ * @brief Whether an RFC 1624 update matches a full recomputation.
+ *
+ * They differ only when the data sums to zero: recomputation gives 0xFFFF
+ * and eqn. 3 gives 0x0000, the other zero of one's complement (RFC 1624,
+ * section 3). IPv4, TCP and UDP headers never sum to zero.
+ */
+static int csum_update_agrees(uint16_t got, uint16_t want) {
+    return got == want || (want == 0xFFFF && got == 0x0000);
+}
+
+/**
+ * @brief Check every implementation and the incremental helpers.
+ *
+ * Compares against checksum_reference() for every length up to 4 KiB at
+ * every alignment within a cache line, checks a 1 MiB all-ones buffer where
+ * the reference accumulator would overflow, and checks RFC 1624 updates
+ * against full recomputation.
+ *
+ * @return The number of mismatches.
+ */
+static long csum_verify(void) {
+    enum { MAX_LEN = 4096, MAX_ALIGN = 64, JUMBO = 1 << 20 };
+    static unsigned char buf[MAX_LEN + MAX_ALIGN];
+    struct csum_impl impls[4];
+    int n = csum_impls(impls);
+    long failures = 0;
+
+    srand(1);
+    for (size_t i = 0; i < sizeof(buf); ++i)
+        buf[i] = (unsigned char)rand();
+
+    for (int k = 1; k < n; ++k) {
+        for (size_t align = 0; align < MAX_ALIGN; ++align) {
+            for (size_t len = 0; len <= MAX_LEN; ++len) {
+                uint16_t want = checksum_reference(buf + align, (int)len);
+                uint16_t got = csum_fold(impls[k].fn(buf + align, len, 0));
+                if (got != want && failures++ < 10)
+                    printf("%s: len %zu align %zu: got %04x want %04x\n", impls[k].name, len, align, got, want);
+            }
+        }
+
+        // Every word is 0xFFFF, so the one's complement sum is 0xFFFF and the checksum is 0
+        unsigned char *jumbo = malloc(JUMBO);
+        memset(jumbo, 0xFF, JUMBO);
+        uint16_t got = csum_fold(impls[k].fn(jumbo, JUMBO, 0));
+        if (got != 0 && failures++ < 10)
+            printf("%s: 1 MiB of 0xff: got %04x want 0000\n", impls[k].name, got);
+        free(jumbo);
+    }
+
+    // Rewrite one random word or dword of a 20-byte header and update incrementally
+    for (int i = 0; i < 1000000; ++i) {
+        unsigned char hdr[20];
+        for (size_t j = 0; j < sizeof(hdr); ++j)
+            hdr[j] = (unsigned char)rand();
+        uint16_t check = checksum(hdr, sizeof(hdr));
+        size_t off = (size_t)(rand() % 5) * 4;
+        uint32_t old_value, new_value = (uint32_t)rand() ^ ((uint32_t)rand() << 16);
+        memcpy(&old_value, hdr + off, 4);
+        if (i & 1) {
+            memcpy(hdr + off, &new_value, 4);
+            check = csum_update32(check, old_value, new_value);
+        } else {
+            memcpy(hdr + off, &new_value, 2);
+            check = csum_update16(check, (uint16_t)old_value, (uint16_t)new_value);
+        }
+        uint16_t want = checksum(hdr, sizeof(hdr));
+        if (!csum_update_agrees(check, want) && failures++ < 10)
+            printf("incremental: got %04x want %04x\n", check, want);
+    }
+
+    // Words and checksums at the one's complement edges: an all-zero header (checksum 0xFFFF), one
+    // balanced to checksum 0x0000, and a random one, with the first word moved between edge values
+    static const uint16_t edges[] = { 0x0000, 0x0001, 0x7FFF, 0x8000, 0xFFFE, 0xFFFF };
+    enum { EDGES = sizeof(edges) / sizeof(edges[0]) };
+    for (int base = 0; base < 3; ++base) {
+        for (int a = 0; a < EDGES; ++a) {
+            for (int b = 0; b < EDGES; ++b) {
+                uint16_t words[10] = { 0 };
+                if (base > 0) {
+                    for (int j = 1; j < 10; ++j)
+                        words[j] = (uint16_t)rand();
+                }
+                words[0] = edges[a];
+                if (base == 1) {
+                    // Make the one's complement sum 0xFFFF so the checksum is 0x0000
+                    words[9] = 0;
+                    words[9] = checksum(words, sizeof(words));
+                }
+                uint16_t check = checksum(words, sizeof(words));
+                uint16_t old_word = words[0];
+                words[0] = edges[b];
+                uint16_t got = csum_update16(check, old_word, words[0]);
+                uint16_t want = checksum(words, sizeof(words));
+                if (!csum_update_agrees(got, want) && failures++ < 10)
+                    printf("incremental edge: %04x -> %04x from check %04x: got %04x want %04x\n", old_word,
+                           words[0], check, got, want);
+
+                // The same change through the 32-bit helper, with the neighbouring word flipped as well
+                uint32_t old_value, new_value;
+                memcpy(&old_value, words, 4);
+                words[1] = (uint16_t)~words[1];
+                memcpy(&new_value, words, 4);
+                got = csum_update32(want, old_value, new_value);
+                want = checksum(words, sizeof(words));
+                if (!csum_update_agrees(got, want) && failures++ < 10)
+                    printf("incremental edge: %08x -> %08x: got %04x want %04x\n", old_value, new_value, got, want);
+            }
+        }
+    }
+    return failures;
+}
+
+/**
+ * @brief Verify the checksum implementations and report bytes/cycle per size.
+ *
+ * @return 0 if every implementation agrees with the reference.
+ */
+int bench_csum(void) {
+    static const size_t sizes[] = { 20, 64, 256, 1500, 9000, 65536 };
+    struct csum_impl impls[4];
+    int n = csum_impls(impls);
+    unsigned char *buf = malloc(65536);
+    volatile uint64_t sink = 0;
+    long failures = csum_verify();
+
+    printf("Checksum verification: %s (%ld mismatches)\n", failures ? "FAILED" : "ok", failures);
+
+    for (size_t i = 0; i < 65536; ++i)
+        buf[i] = (unsigned char)i;
+
+    printf("%-10s", "bytes/cyc");
+    for (int k = 0; k < n; ++k)
+        printf("%12s", impls[k].name);
+    printf("\n");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        long iterations = (long)((256u << 20) / sizes[s]);
+        printf("%-10zu", sizes[s]);
+        for (int k = 0; k < n; ++k) {
+            uint64_t start = read_cycles();
+            for (long it = 0; it < iterations; ++it)
+                sink += impls[k].fn(buf, sizes[s], 0);
+            uint64_t cycles = read_cycles() - start;
+            printf("%12.2f", (double)sizes[s] * iterations / cycles);
+        }
+        printf("\n");
+    }
+
+    free(buf);
+    return failures ? EXIT_FAILURE : 0;
+}
+
+/*
+ * bench-decode: decode and flow-account a synthetic capture held in memory
+ * in pcap format, so the numbers exclude NIC and kernel costs.
+ */
+
+/**
+ * @brief Write a synthetic frame for a flow.
+ *
+ * The flow number picks one of five shapes: IPv4/TCP, IPv4/UDP,
+ * 802.1Q IPv4/UDP, QinQ IPv6/TCP and IPv4/ICMP.
+ *
+ * @param buf Where to write the frame; at least 1514 bytes.
+ * @param flow The flow number; selects addresses, ports and shape.
+ * @param payload_len Transport payload length.
+ * @return The frame length.
+ */
+static unsigned int build_synthetic_frame(unsigned char *buf, uint32_t flow, unsigned int payload_len) {
+    static const unsigned char client_mac[ETH_ALEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    static const unsigned char server_mac[ETH_ALEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02};
+    static const uint8_t protos[5] = { IPPROTO_TCP, IPPROTO_UDP, IPPROTO_UDP, IPPROTO_TCP, IPPROTO_ICMP };
+    unsigned int kind = flow % 5;
+    uint8_t proto = protos[kind];
+    unsigned int l4_len = (proto == IPPROTO_TCP ? 20 : 8) + payload_len;
+    unsigned char *p;
+
+    if (kind == 2) {
+        p = build_ether_header(buf, server_mac, client_mac, ETH_P_8021Q);
+        *(uint16_t *)p = htons(100);
+        *(uint16_t *)(p + 2) = htons(ETH_P_IP);
+        p += 4;
+    } else if (kind == 3) {
+        p = build_ether_header(buf, server_mac, client_mac, ETH_P_8021AD);
+        *(uint16_t *)p = htons(200);
+        *(uint16_t *)(p + 2) = htons(ETH_P_8021Q);
+        *(uint16_t *)(p + 4) = htons(300);
+        *(uint16_t *)(p + 6) = htons(ETH_P_IPV6);
+        p += 8;
+    } else {
+        p = build_ether_header(buf, server_mac, client_mac, ETH_P_IP);
+    }
+
+    if (kind == 3) {
+        struct ip6_hdr *ip6 = (struct ip6_hdr *)p;
+        memset(ip6, 0, sizeof(*ip6));
+        ip6->ip6_flow = htonl(6u << 28);
+        ip6->ip6_plen = htons(l4_len);
+        ip6->ip6_nxt = proto;
+        ip6->ip6_hlim = 64;
+        ip6->ip6_src.s6_addr[0] = 0xfd;
+        memcpy(&ip6->ip6_src.s6_addr[12], &flow, 4);
+        ip6->ip6_dst.s6_addr[0] = 0xfd;
+        ip6->ip6_dst.s6_addr[15] = 1;
+        p += sizeof(*ip6);
+    } else {
+        struct iphdr *ip = (struct iphdr *)p;
+        memset(ip, 0, sizeof(*ip));
+        ip->version = 4;
+        ip->ihl = 5;
+        ip->tot_len = htons(sizeof(*ip) + l4_len);
+        ip->ttl = 64;
+        ip->protocol = proto;
+        ip->saddr = htonl(0x0A000000u | (flow & 0xFFFFFF));
+        ip->daddr = htonl(0xC0A80001u);
+        ip->check = checksum(ip, sizeof(*ip));
+        p += sizeof(*ip);
+    }
+
+    memset(p, 0, l4_len);
+    if (proto == IPPROTO_TCP) {
+        struct tcphdr *tcp = (struct tcphdr *)p;
+        tcp->source = htons(1024 + flow % 60000);
+        tcp->dest = htons(80);
+        tcp->doff = 5;
+    } else if (proto == IPPROTO_UDP) {
+        struct udphdr *udp = (struct udphdr *)p;
+        udp->source = htons(1024 + flow % 60000);
+        udp->dest = htons(53);
+        udp->len = htons(l4_len);
+    } else {
+        p[0] = 8;  // Echo request
+    }
+    return (unsigned int)(p + l4_len - buf);
+}
+
+/**
+ * @brief Build an in-memory pcap capture of synthetic traffic.
+ *
+ * @param flows Number of distinct flows.
+ * @param packets Number of packets; flows are picked pseudo-randomly.
+ * @param out_len Set to the length of the capture.
+ * @return The capture, to be released with free(), or NULL on error.
+ */
+static unsigned char *build_synthetic_pcap(uint32_t flows, uint32_t packets, size_t *out_len) {
+    size_t cap = sizeof(struct pcap_file_hdr) + (size_t)packets * (sizeof(struct pcap_record_hdr) + 350);
+    unsigned char *pcap = malloc(cap);
+    struct pcap_file_hdr fh = { PCAP_MAGIC, 2, 4, 0, 0, 65535, PCAP_LINKTYPE_ETHERNET };
+    size_t off = sizeof(fh);
+    uint64_t x = 88172645463325252ull;
+
+    if (!pcap)
+        return NULL;
+    memcpy(pcap, &fh, sizeof(fh));
+    for (uint32_t i = 0; i < packets; ++i) {
+        struct pcap_record_hdr rh;
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        uint32_t flow = (uint32_t)(x % flows);
+        unsigned int len = build_synthetic_frame(pcap + off + sizeof(rh), flow, (flow * 37) % 256);
+        rh.ts_sec = 1700000000u + i / 1000000;
+        rh.ts_frac = i % 1000000;
+        rh.incl_len = rh.orig_len = len;
+        memcpy(pcap + off, &rh, sizeof(rh));
+        off += sizeof(rh) + len;
+    }
+    *out_len = off;
+    return pcap;
+}
+
+/**
+ * @brief Bytes currently allocated from the heap, or 0 if unknown.
+ */
+static size_t heap_in_use(void) {
+#ifdef __GLIBC__
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief frame_handler that only decodes, counting the layers reached.
+ */
+static void decode_frame_handler(const unsigned char *frame, unsigned int len, uint64_t ts_ns, void *user) {
+    struct pkt_desc d;
+    (void)ts_ns;
+    *(unsigned long *)user += (unsigned long)decode_frame(frame, len, &d);
+}
+
+/**
+ * @brief Decode and flow-account a synthetic capture and report rates.
+ *
+ * @param flows Number of distinct flows in the capture.
+ * @param packets Number of packets in the capture.
+ * @return 0 on success
+ */
+int bench_decode(uint32_t flows, uint32_t packets) {
+    enum { PASSES = 5 };
+    struct flow_table table;
+    struct pcap_source src;
+    size_t pcap_len;
+    unsigned char *pcap = build_synthetic_pcap(flows, packets, &pcap_len);
+    unsigned long layers = 0;
+
+    if (!pcap || flow_table_init(&table, flows) < 0)
+        return EXIT_FAILURE;
+    printf("Decode benchmark: %u packets, %u flows, %.1f MB capture\n", packets, flows, pcap_len / 1e6);
+
+    uint64_t start = now_ns();
+    for (int pass = 0; pass < PASSES; ++pass) {
+        pcap_source_open_mem(&src, pcap, pcap_len);
+        pcap_source_dispatch(&src, decode_frame_handler, &layers);
+    }
+    uint64_t elapsed = now_ns() - start;
+    printf("%-14s %8.2f Mpps %8.1f ns/pkt\n", "decode", (double)packets * PASSES * 1e3 / elapsed,
+           (double)elapsed / ((double)packets * PASSES));
+
+    size_t heap_before = heap_in_use();
+    start = now_ns();
+    for (int pass = 0; pass < PASSES; ++pass) {
+        pcap_source_open_mem(&src, pcap, pcap_len);
+        pcap_source_dispatch(&src, flow_table_handler, &table);
+    }
+    elapsed = now_ns() - start;
+    size_t heap_after = heap_in_use();
+    printf("%-14s %8.2f Mpps %8.1f ns/pkt\n", "decode+flow", (double)packets * PASSES * 1e3 / elapsed,
+           (double)elapsed / ((double)packets * PASSES));
+    printf("flows %u, overflowed packets %llu, heap growth during run %zd bytes\n",
+           table.count, (unsigned long long)table.overflows, (ssize_t)(heap_after - heap_before));
+
+    flow_table_free(&table);
+    free(pcap);
+    return 0;
+}
+
+/**
+ * @brief Write a synthetic capture to a file through pcap_writer.
+ *
+ * @param path The capture file to create.
+ * @param flows Number of distinct flows.
+ * @param packets Number of packets.
+ * @return 0 on success
+ */
+int synth_pcap(const char *path, uint32_t flows, uint32_t packets) {
+    struct pcap_source src;
+    struct pcap_writer w;
+    size_t pcap_len;
+    unsigned char *pcap = build_synthetic_pcap(flows, packets, &pcap_len);
+
+    if (!pcap || pcap_writer_open(&w, path, 65535) < 0)
+        return EXIT_FAILURE;
+    pcap_source_open_mem(&src, pcap, pcap_len);
+    pcap_source_dispatch(&src, pcap_writer_handler, &w);
+    printf("Wrote %llu frames to %s\n", (unsigned long long)w.frames, path);
+    free(pcap);
+    return pcap_writer_close(&w) < 0 ? EXIT_FAILURE : 0;
+}
+
+/**
+ * @brief Replay a capture file through the decoder and flow table.
+ *
+ * Reports parse throughput with no NIC or kernel involvement.
+ *
+ * @param path The pcap or pcapng file.
+ * @return 0 on success
+ */
+int replay_pcap(const char *path) {
+    struct pcap_source src;
+    struct flow_table table;
+
+    if (pcap_source_open(&src, path) < 0 || flow_table_init(&table, 1u << 20) < 0)
+        return EXIT_FAILURE;
+
+    uint64_t start = now_ns();
+    long frames = pcap_source_dispatch(&src, flow_table_handler, &table);
+    uint64_t elapsed = now_ns() - start;
+    if (frames < 0)
+        fprintf(stderr, "%s: malformed capture, stopped at offset %zu\n", path, src.off);
+    else
+        printf("%ld frames, %u flows, %.2f Mpps, %.1f MB/s\n", frames, table.count,
+               frames * 1e3 / elapsed, src.len * 1e3 / elapsed);
+
+    flow_table_free(&table);
+    pcap_source_close(&src);
+    return frames < 0 ? EXIT_FAILURE : 0;
+}
+
+/**
+ * @brief Capture frames from an interface into a pcap file.
+ *
+ * Uses the receive ring when available and `recvfrom` otherwise.
+ *
+ * @param ifname The interface to capture on.
+ * @param path The capture file to create.
+ * @param count Stop after at least this many frames.
+ * @param expr Optional socket filter expression, or NULL to capture everything.
+ * @return 0 on success
+ */
+int capture_pcap(const char *ifname, const char *path, long count, const char *expr) {
+    struct pcap_writer w;
+    struct rx_ring ring;
+    int sockfd = create_raw_socket();
+    int use_ring;
+
+    if (expr && filter_attach(sockfd, expr) < 0) {
+        close(sockfd);
+        return EXIT_FAILURE;
+    }
+    use_ring = rx_ring_setup(&ring, sockfd, RX_RING_BLOCK_SIZE, RX_RING_BLOCK_COUNT) == 0;
+    if (bind_raw_socket(sockfd, ifname, ETH_P_ALL) < 0 || pcap_writer_open(&w, path, 65535) < 0) {
+        if (use_ring)
+            rx_ring_teardown(&ring);
+        close(sockfd);
+        return EXIT_FAILURE;
+    }
+    while ((long)w.frames < count) {
+        if (use_ring) {
+            struct tpacket_block_desc *block = rx_ring_next_block(&ring, -1);
+            if (block) {
+                rx_block_dispatch(block, pcap_writer_handler, &w);
+                rx_ring_release_block(&ring, block);
+            }
+        } else if (recv_dispatch(sockfd, pcap_writer_handler, &w) < 0) {
+            perror("Packet receive failed");
+            break;
+        }
+    }
+    printf("Captured %llu frames on %s to %s\n", (unsigned long long)w.frames, ifname, path);
+
+    if (use_ring)
+        rx_ring_teardown(&ring);
+    close(sockfd);
+    return pcap_writer_close(&w) < 0 ? EXIT_FAILURE : 0;
+}
+
+/**
+ * @brief Send synthetic frames from many flows on an interface until killed.
+ *
+ * @param ifname The interface to transmit on.
+ * @param flows Number of distinct flows to cycle through.
+ */
+static void bench_flow_generator(const char *ifname, uint32_t flows) {
+    struct tx_engine tx;
+
+    if (tx_engine_open(&tx, ifname, 0) < 0)
+        _exit(1);
+    for (uint32_t flow = 0;; flow = (flow + 1) % flows) {
+        unsigned char *frame = tx_reserve(&tx);
+        if (!frame)
+            _exit(1);
+        tx_commit(&tx, build_synthetic_frame(frame, flow, 18));
+    }
+}
+
+/**
+ * @brief Measure capture throughput with 1 to max_workers fanout workers.
+ *
+ * Run on one end of a veth pair (or `lo`); a child process generates
+ * traffic from 4096 flows on the same interface.
+ *
+ * @param ifname The interface to capture on.
+ * @param max_workers The largest worker count to try.
+ * @param seconds How long to run each worker count.
+ * @param mode_name "hash", "cpu" or "lb".
+ * @return 0 on success
+ */
+int bench_fanout(const char *ifname, int max_workers, int seconds, const char *mode_name) {
+    int mode = strcmp(mode_name, "cpu") == 0 ? PACKET_FANOUT_CPU
+             : strcmp(mode_name, "lb") == 0  ? PACKET_FANOUT_LB
+                                             : PACKET_FANOUT_HASH;
+    pid_t generator = fork();
+
+    if (generator < 0) {
+        perror("fork failed");
+        return EXIT_FAILURE;
+    }
+    if (generator == 0) {
+        bench_flow_generator(ifname, 4096);
+        _exit(0);
+    }
+
+    printf("Fanout benchmark on %s, mode %s, %d s per run\n", ifname, mode_name, seconds);
+    for (int n = 1; n <= max_workers; ++n) {
+        struct capture_group g;
+        struct rx_stats total;
+        uint64_t flows;
+
+        if (capture_group_start(&g, ifname, n, mode) < 0)
+            break;
+        uint64_t start = now_ns();
+        sleep(seconds);
+        capture_group_stop(&g, &total, &flows);
+        uint64_t elapsed = now_ns() - start;
+
+        uint64_t min = UINT64_MAX, max = 0;
+        for (int i = 0; i < n; ++i) {
+            uint64_t p = g.workers[i].stats.packets;
+            min = p < min ? p : min;
+            max = p > max ? p : max;
+        }
+        printf("%2d workers %12.0f pkts/s  per-worker min %llu max %llu  flows %llu\n", n,
+               total.packets * 1e9 / elapsed, (unsigned long long)min, (unsigned long long)max,
+               (unsigned long long)flows);
+        capture_group_free(&g);
+    }
+
+    kill(generator, SIGKILL);
+    waitpid(generator, NULL, 0);
+    return 0;
+}
+
+/**
+ * @brief Receive-side counters for bench-filter.
+ */
+struct filter_bench_stats {
+    struct pkt_filter filter;
+    uint64_t packets;
+    uint64_t mismatches;  ///< Frames the kernel accepted that the filter should have dropped
+};
+
+/**
+ * @brief frame_handler for bench-filter: count and cross-check each frame.
+ */
+static void filter_bench_handler(const unsigned char *frame, unsigned int len, uint64_t ts_ns, void *user) {
+    struct filter_bench_stats *stats = user;
+    struct pkt_desc d;
+    (void)ts_ns;
+
+    stats->packets++;
+    decode_frame(frame, len, &d);
+    if (!filter_match(&stats->filter, &d))
+        stats->mismatches++;
+}
+
+/**
+ * @brief Receive with `recvfrom` for a fixed time, optionally filtered, and report CPU use.
+ */
+static void bench_filter_mode(const char *ifname, int seconds, const char *expr) {
+    struct filter_bench_stats stats;
+    struct timeval tv = { .tv_sec = 0, .tv_usec = 100000 };
+    struct rusage before, after;
+    int sockfd = create_raw_socket();
+
+    memset(&stats, 0, sizeof(stats));
+    filter_parse(expr ? expr : "", &stats.filter);
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (bind_raw_socket(sockfd, ifname, ETH_P_ALL) < 0 || (expr && filter_attach(sockfd, expr) < 0)) {
+        close(sockfd);
+        return;
+    }
+
+    uint64_t deadline = now_ns() + (uint64_t)seconds * 1000000000ull;
+    getrusage(RUSAGE_THREAD, &before);
+    while (now_ns() < deadline)
+        recv_dispatch(sockfd, filter_bench_handler, &stats);
+    getrusage(RUSAGE_THREAD, &after);
+
+    double user_ms = (after.ru_utime.tv_sec - before.ru_utime.tv_sec) * 1e3 +
+                     (after.ru_utime.tv_usec - before.ru_utime.tv_usec) / 1e3;
+    double sys_ms = (after.ru_stime.tv_sec - before.ru_stime.tv_sec) * 1e3 +
+                    (after.ru_stime.tv_usec - before.ru_stime.tv_usec) / 1e3;
+    printf("%-40s %10.0f pkts/s delivered %8.1f ms user %8.1f ms sys %6llu mismatches\n",
+           expr ? expr : "(no filter)", stats.packets / (double)seconds, user_ms, sys_ms,
+           (unsigned long long)stats.mismatches);
+    close(sockfd);
+}
+
+/**
+ * @brief Compare receiver CPU use with and without a selective socket filter.
+ *
+ * A child process sends synthetic traffic from 4096 flows; the default
+ * filter matches just one of them.
+ *
+ * @param ifname The interface to capture on.
+ * @param seconds How long to run each mode.
+ * @param expr The filter expression.
+ * @return 0 on success
+ */
+int bench_filter(const char *ifname, int seconds, const char *expr) {
+    struct pkt_filter f;
+    struct filter_asm a;
+    pid_t generator;
+
+    if (filter_parse(expr, &f) < 0)
+        return EXIT_FAILURE;
+    filter_compile(&f, &a);
+    printf("Filter benchmark on %s, %d s per mode; '%s' compiles to %d instructions\n",
+           ifname, seconds, expr, a.len);
+
+    generator = fork();
+    if (generator < 0) {
+        perror("fork failed");
+        return EXIT_FAILURE;
+    }
+    if (generator == 0) {
+        bench_flow_generator(ifname, 4096);
+        _exit(0);
+    }
+
+    bench_filter_mode(ifname, seconds, NULL);
+    bench_filter_mode(ifname, seconds, expr);
+
+    kill(generator, SIGKILL);
+    waitpid(generator, NULL, 0);
+    return 0;
+}
+
+/**
+ * @brief Print command line usage.
+ *
+ * @param prog The program name.
+ */
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s                          send and receive one frame\n"
+            "       %s --ring                   receive with the TPACKET_V3 ring\n"
+            "       %s bench-rx [ifname] [sec]  compare recvfrom and ring receive\n"
+            "       %s bench-tx [ifname] [n]    compare sendto and batched transmit\n"
+            "       %s bench-csum               verify and time checksum implementations\n"
+            "       %s bench-decode [flows] [n] decode and flow-account a synthetic capture\n"
+            "       %s synth file [flows] [n]   write a synthetic capture\n"
+            "       %s replay file              decode and flow-account a pcap/pcapng file\n"
+            "       %s capture ifname file [n] [expr]\n"
+            "                                  capture n frames matching expr to a pcap file\n"
+            "       %s bench-fanout [ifname] [workers] [sec] [hash|cpu|lb]\n"
+            "                                  capture scaling with PACKET_FANOUT\n"
+            "       %s bench-filter [ifname] [sec] [expr]\n"
+            "                                  receiver CPU with and without a BPF filter\n"
+            "       %s pktgen [ifname] [pps] [count] [size] [burst]\n"
+            "                                  paced generator with loss and latency report\n",
+            prog, prog, prog, prog, prog, prog, prog, prog, prog, prog, prog, prog);
+}
+
+int main(int argc, char *argv[]) {
+    int use_ring = 0;
+
+    if (argc > 1 && strcmp(argv[1], "bench-rx") == 0)
+        return bench_rx(argc > 2 ? argv[2] : "lo", argc > 3 ? atoi(argv[3]) : 5);
+    if (argc > 1 && strcmp(argv[1], "bench-tx") == 0)
+        return bench_tx(argc > 2 ? argv[2] : "lo", argc > 3 ? atol(argv[3]) : 1000000);
+    if (argc > 1 && strcmp(argv[1], "bench-csum") == 0)
+        return bench_csum();
+    if (argc > 1 && strcmp(argv[1], "bench-decode") == 0)
+        return bench_decode(argc > 2 ? (uint32_t)atol(argv[2]) : 100000, argc > 3 ? (uint32_t)atol(argv[3]) : 1000000);
+    if (argc > 2 && strcmp(argv[1], "synth") == 0)
+        return synth_pcap(argv[2], argc > 3 ? (uint32_t)atol(argv[3]) : 100000, argc > 4 ? (uint32_t)atol(argv[4]) : 1000000);
+    if (argc > 2 && strcmp(argv[1], "replay") == 0)
+        return replay_pcap(argv[2]);
+    if (argc > 3 && strcmp(argv[1], "capture") == 0)
+        return capture_pcap(argv[2], argv[3], argc > 4 ? atol(argv[4]) : 1000, argc > 5 ? argv[5] : NULL);
+    if (argc > 1 && strcmp(argv[1], "bench-fanout") == 0)
+        return bench_fanout(argc > 2 ? argv[2] : "lo", argc > 3 ? atoi(argv[3]) : (int)sysconf(_SC_NPROCESSORS_ONLN),
+                            argc > 4 ? atoi(argv[4]) : 3, argc > 5 ? argv[5] : "hash");
+    if (argc > 1 && strcmp(argv[1], "bench-filter") == 0)
+        return bench_filter(argc > 2 ? argv[2] : "lo", argc > 3 ? atoi(argv[3]) : 3,
+                            argc > 4 ? argv[4] : "udp and port 53 and host 10.0.0.6");
+    if (argc > 1 && strcmp(argv[1], "pktgen") == 0) {
+        struct pktgen_config cfg = {
+            argc > 2 ? argv[2] : "lo",
+            argc > 3 ? strtoull(argv[3], NULL, 0) : 100000,
+            argc > 4 ? strtoull(argv[4], NULL, 0) : 500000,
+            argc > 5 ? (unsigned int)atoi(argv[5]) : 64,
+            argc > 6 ? (unsigned int)atoi(argv[6]) : 32,
+        };
+        return pktgen_run(&cfg);
+    }
+    if (argc > 1 && strcmp(argv[1], "--ring") == 0) {
+        use_ring = 1;
+    } else if (argc > 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int sockfd = create_raw_socket();
+
+    // Example: Send a raw Ethernet frame
+    unsigned char dest_mac[] = {0x00, 0x0c, 0x29, 0xb1, 0x1e, 0x1f}; // Destination MAC address
+    unsigned char src_mac[] = {0x00, 0x0c, 0x29, 0x73, 0x6d, 0x3b};  // Source MAC address
+    unsigned short ether_type = ETH_P_IP; // Ethernet type (IPv4)
+    unsigned char payload[] = "Hello, raw Ethernet!"; // Payload
+    int payload_len = strlen((char *)payload);
+
+    send_raw_ethernet(sockfd, dest_mac, src_mac, ether_type, payload, payload_len);
+
+    // Example: Receive raw Ethernet frames, falling back to recvfrom if the ring is unavailable
+    struct rx_ring ring;
+    if (use_ring && rx_ring_setup(&ring, sockfd, RX_RING_BLOCK_SIZE, RX_RING_BLOCK_COUNT) == 0) {
+        receive_raw_ethernet_ring(&ring);
+        rx_ring_teardown(&ring);
+    } else {
+        receive_raw_ethernet(sockfd);
+    }
+
+    close(sockfd);
+    return 0;
+}
@@ -10,47 +10,1540 @@
 // The va_list variable is initialized using va_start() before the loop,
 // and cleaned up using va_end() after the loop.
 
+/// DEFERRED LOGGING
+// Build: gcc -O2 -pthread main.c -o variadic
+// Run "bench [calls]" for the call latency of printf, my_printf and the deferred log_printf, or
+// "bench-format [calls]" to compare my_snprintf with snprintf and check that they agree.
+
+#define _GNU_SOURCE  // strchrnul()
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+/// FORMATTING ENGINE
+// my_printf() and my_snprintf() share one formatter. It writes into a buffer: the caller's for
+// my_snprintf(), which truncates like snprintf(), or a per-thread buffer for my_printf(), which is
+// handed to write() only when it fills up or is flushed. Nothing is allocated, and stdio is only
+// called for the rare doubles noted below.
+//
+// Supported: %d %i %u %x %X %c %s %p %f %%, the flags - + space 0 #, a width and a precision (either
+// may be *), and the length modifiers l, ll and z. %f with a precision rounds exactly like printf;
+// %f without one prints the shortest digits that read back as the same double (Grisu3, with an exact
+// fallback for the rare values it cannot decide), instead of printf's six decimals. %.Nf of values
+// of 2^64 and above is passed on to snprintf().
+
+#define FMT_MAX_PRECISION 400  // larger precisions are clamped
+
+// Where formatted text goes
+struct fmt_sink {
+    char *buf;
+    size_t cap;
+    size_t len;
+    size_t total;  // characters produced, including any that were truncated
+    int fd;        // -1 to truncate when the buffer is full, else where to write() it
+};
+
+// Conversion flags, width and precision of one specifier
+struct fmt_spec {
+    int left;       // '-'
+    char sign;      // '+', ' ' or 0
+    int zero;       // '0'
+    int alt;        // '#'
+    int width;
+    int precision;  // -1 if none was given
+};
+
+static const char fmt_digits2[200] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static void fmt_flush(struct fmt_sink *sink) {
+    size_t done = 0;
+
+    while (done < sink->len) {
+        ssize_t n = write(sink->fd, sink->buf + done, sink->len - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += (size_t)n;
+    }
+    sink->len = 0;
+}
+
+static void fmt_put_slow(struct fmt_sink *sink, const char *s, size_t n) {
+    while (n > 0) {
+        if (sink->len == sink->cap) {
+            if (sink->fd < 0)
+                return;
+            fmt_flush(sink);
+        }
+        size_t k = sink->cap - sink->len < n ? sink->cap - sink->len : n;
+        memcpy(sink->buf + sink->len, s, k);
+        sink->len += k;
+        s += k;
+        n -= k;
+    }
+}
+
+static inline void fmt_put(struct fmt_sink *sink, const char *s, size_t n) {
+    sink->total += n;
+    if (__builtin_expect(n <= sink->cap - sink->len, 1)) {
+        memcpy(sink->buf + sink->len, s, n);
+        sink->len += n;
+    } else {
+        fmt_put_slow(sink, s, n);
+    }
+}
+
+static void fmt_fill(struct fmt_sink *sink, char c, size_t n) {
+    sink->total += n;
+    while (n > 0) {
+        if (sink->len == sink->cap) {
+            if (sink->fd < 0)
+                return;
+            fmt_flush(sink);
+        }
+        size_t k = sink->cap - sink->len < n ? sink->cap - sink->len : n;
+        memset(sink->buf + sink->len, c, k);
+        sink->len += k;
+        n -= k;
+    }
+}
+
+/**
+ * Writes the decimal digits of a value, two at a time, so that they end just before end.
+ *
+ * @return Where the digits start
+ */
+static char *fmt_dec(char *end, uint64_t value) {
+    while (value >= 100) {
+        end -= 2;
+        memcpy(end, &fmt_digits2[(value % 100) * 2], 2);
+        value /= 100;
+    }
+    if (value >= 10) {
+        end -= 2;
+        memcpy(end, &fmt_digits2[value * 2], 2);
+    } else {
+        *--end = (char)('0' + value);
+    }
+    return end;
+}
+
+static char *fmt_hex(char *end, uint64_t value, int upper) {
+    const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+
+    do {
+        *--end = digits[value & 15];
+        value >>= 4;
+    } while (value);
+    return end;
+}
+
+/**
+ * Writes a converted value with its prefix (sign or 0x), padded to the width of the specifier.
+ *
+ * @param zeros Leading zeros the precision asks for
+ * @param zero_pad Whether the '0' flag applies to this conversion
+ */
+static void fmt_pad(struct fmt_sink *sink, const struct fmt_spec *spec, const char *prefix, size_t prefix_len,
+                    size_t zeros, const char *body, size_t body_len, int zero_pad) {
+    size_t len = prefix_len + zeros + body_len;
+    size_t pad = spec->width > 0 && (size_t)spec->width > len ? (size_t)spec->width - len : 0;
+
+    if (pad && !spec->left && !(zero_pad && spec->zero))
+        fmt_fill(sink, ' ', pad);
+    if (prefix_len)
+        fmt_put(sink, prefix, prefix_len);
+    if (pad && !spec->left && zero_pad && spec->zero)
+        fmt_fill(sink, '0', pad);
+    if (zeros)
+        fmt_fill(sink, '0', zeros);
+    fmt_put(sink, body, body_len);
+    if (pad && spec->left)
+        fmt_fill(sink, ' ', pad);
+}
+
+static void fmt_integer(struct fmt_sink *sink, const struct fmt_spec *spec, uint64_t value, int negative,
+                        char conversion) {
+    char buf[24], *end = buf + sizeof(buf), *start;
+    char prefix[2];
+    size_t prefix_len = 0;
+
+    if (conversion == 'x' || conversion == 'X') {
+        start = fmt_hex(end, value, conversion == 'X');
+        if (spec->alt && value) {
+            prefix[prefix_len++] = '0';
+            prefix[prefix_len++] = conversion;
+        }
+    } else {
+        start = fmt_dec(end, value);
+        if (negative)
+            prefix[prefix_len++] = '-';
+        else if (spec->sign && conversion != 'u')
+            prefix[prefix_len++] = spec->sign;
+    }
+    if (spec->precision == 0 && value == 0)
+        start = end;
+
+    size_t len = (size_t)(end - start);
+    size_t zeros = spec->precision > 0 && (size_t)spec->precision > len ? (size_t)spec->precision - len : 0;
+    fmt_pad(sink, spec, prefix, prefix_len, zeros, start, len, spec->precision < 0);
+}
+
+// A double as f * 2^e
+struct fmt_diyfp {
+    uint64_t f;
+    int e;
+};
+
+// 10^k for k = -348, -340, ..., 340, rounded to 64 bits: f * 2^e
+static const struct {
+    uint64_t f;
+    int e;
+    int k;
+} fmt_powers[87] = {
+    { 0xfa8fd5a0081c0288ull, -1220, -348 }, { 0xbaaee17fa23ebf76ull, -1193, -340 },
+    { 0x8b16fb203055ac76ull, -1166, -332 }, { 0xcf42894a5dce35eaull, -1140, -324 },
+    { 0x9a6bb0aa55653b2dull, -1113, -316 }, { 0xe61acf033d1a45dfull, -1087, -308 },
+    { 0xab70fe17c79ac6caull, -1060, -300 }, { 0xff77b1fcbebcdc4full, -1034, -292 },
+    { 0xbe5691ef416bd60cull, -1007, -284 }, { 0x8dd01fad907ffc3cull, -980, -276 },
+    { 0xd3515c2831559a83ull, -954, -268 }, { 0x9d71ac8fada6c9b5ull, -927, -260 },
+    { 0xea9c227723ee8bcbull, -901, -252 }, { 0xaecc49914078536dull, -874, -244 },
+    { 0x823c12795db6ce57ull, -847, -236 }, { 0xc21094364dfb5637ull, -821, -228 },
+    { 0x9096ea6f3848984full, -794, -220 }, { 0xd77485cb25823ac7ull, -768, -212 },
+    { 0xa086cfcd97bf97f4ull, -741, -204 }, { 0xef340a98172aace5ull, -715, -196 },
+    { 0xb23867fb2a35b28eull, -688, -188 }, { 0x84c8d4dfd2c63f3bull, -661, -180 },
+    { 0xc5dd44271ad3cdbaull, -635, -172 }, { 0x936b9fcebb25c996ull, -608, -164 },
+    { 0xdbac6c247d62a584ull, -582, -156 }, { 0xa3ab66580d5fdaf6ull, -555, -148 },
+    { 0xf3e2f893dec3f126ull, -529, -140 }, { 0xb5b5ada8aaff80b8ull, -502, -132 },
+    { 0x87625f056c7c4a8bull, -475, -124 }, { 0xc9bcff6034c13053ull, -449, -116 },
+    { 0x964e858c91ba2655ull, -422, -108 }, { 0xdff9772470297ebdull, -396, -100 },
+    { 0xa6dfbd9fb8e5b88full, -369, -92 }, { 0xf8a95fcf88747d94ull, -343, -84 },
+    { 0xb94470938fa89bcfull, -316, -76 }, { 0x8a08f0f8bf0f156bull, -289, -68 },
+    { 0xcdb02555653131b6ull, -263, -60 }, { 0x993fe2c6d07b7facull, -236, -52 },
+    { 0xe45c10c42a2b3b06ull, -210, -44 }, { 0xaa242499697392d3ull, -183, -36 },
+    { 0xfd87b5f28300ca0eull, -157, -28 }, { 0xbce5086492111aebull, -130, -20 },
+    { 0x8cbccc096f5088ccull, -103, -12 }, { 0xd1b71758e219652cull, -77, -4 },
+    { 0x9c40000000000000ull, -50, 4 }, { 0xe8d4a51000000000ull, -24, 12 },
+    { 0xad78ebc5ac620000ull, 3, 20 }, { 0x813f3978f8940984ull, 30, 28 },
+    { 0xc097ce7bc90715b3ull, 56, 36 }, { 0x8f7e32ce7bea5c70ull, 83, 44 },
+    { 0xd5d238a4abe98068ull, 109, 52 }, { 0x9f4f2726179a2245ull, 136, 60 },
+    { 0xed63a231d4c4fb27ull, 162, 68 }, { 0xb0de65388cc8ada8ull, 189, 76 },
+    { 0x83c7088e1aab65dbull, 216, 84 }, { 0xc45d1df942711d9aull, 242, 92 },
+    { 0x924d692ca61be758ull, 269, 100 }, { 0xda01ee641a708deaull, 295, 108 },
+    { 0xa26da3999aef774aull, 322, 116 }, { 0xf209787bb47d6b85ull, 348, 124 },
+    { 0xb454e4a179dd1877ull, 375, 132 }, { 0x865b86925b9bc5c2ull, 402, 140 },
+    { 0xc83553c5c8965d3dull, 428, 148 }, { 0x952ab45cfa97a0b3ull, 455, 156 },
+    { 0xde469fbd99a05fe3ull, 481, 164 }, { 0xa59bc234db398c25ull, 508, 172 },
+    { 0xf6c69a72a3989f5cull, 534, 180 }, { 0xb7dcbf5354e9beceull, 561, 188 },
+    { 0x88fcf317f22241e2ull, 588, 196 }, { 0xcc20ce9bd35c78a5ull, 614, 204 },
+    { 0x98165af37b2153dfull, 641, 212 }, { 0xe2a0b5dc971f303aull, 667, 220 },
+    { 0xa8d9d1535ce3b396ull, 694, 228 }, { 0xfb9b7cd9a4a7443cull, 720, 236 },
+    { 0xbb764c4ca7a44410ull, 747, 244 }, { 0x8bab8eefb6409c1aull, 774, 252 },
+    { 0xd01fef10a657842cull, 800, 260 }, { 0x9b10a4e5e9913129ull, 827, 268 },
+    { 0xe7109bfba19c0c9dull, 853, 276 }, { 0xac2820d9623bf429ull, 880, 284 },
+    { 0x80444b5e7aa7cf85ull, 907, 292 }, { 0xbf21e44003acdd2dull, 933, 300 },
+    { 0x8e679c2f5e44ff8full, 960, 308 }, { 0xd433179d9c8cb841ull, 986, 316 },
+    { 0x9e19db92b4e31ba9ull, 1013, 324 }, { 0xeb96bf6ebadf77d9ull, 1039, 332 },
+    { 0xaf87023b9bf0ee6bull, 1066, 340 },
+};
+
+static struct fmt_diyfp fmt_normalize(uint64_t f, int e) {
+    int shift = __builtin_clzll(f);
+    return (struct fmt_diyfp){ f << shift, e - shift };
+}
+
+// Product rounded to the upper 64 bits
+static struct fmt_diyfp fmt_multiply(struct fmt_diyfp a, struct fmt_diyfp b) {
+    unsigned __int128 p = (unsigned __int128)a.f * b.f;
+    return (struct fmt_diyfp){ (uint64_t)(p >> 64) + ((uint64_t)p >> 63), a.e + b.e + 64 };
+}
+
+/**
+ * Moves the last digit towards w as far as the boundaries allow, and reports whether the result is
+ * provably the closest shortest representation (Grisu3's round_weed).
+ */
+static int fmt_round_weed(char *digits, int length, uint64_t distance_too_high_w, uint64_t unsafe_interval,
+                          uint64_t rest, uint64_t ten_kappa, uint64_t unit) {
+    uint64_t small_distance = distance_too_high_w - unit;
+    uint64_t big_distance = distance_too_high_w + unit;
+
+    while (rest < small_distance && unsafe_interval - rest >= ten_kappa &&
+           (rest + ten_kappa < small_distance || small_distance - rest >= rest + ten_kappa - small_distance)) {
+        digits[length - 1]--;
+        rest += ten_kappa;
+    }
+    if (rest < big_distance && unsafe_interval - rest >= ten_kappa &&
+        (rest + ten_kappa < big_distance || big_distance - rest > rest + ten_kappa - big_distance))
+        return 0;
+    return 2 * unit <= rest && rest <= unsafe_interval - 4 * unit;
+}
+
 /**
- * Custom printf-like function that can handle a few specific format specifiers
- * (%d for integers, %c for characters, and %s for strings).
- * 
+ * Shortest digits of a positive finite double by Grisu3, so that value = digits * 10^exponent.
+ *
+ * @return 1 on success, 0 if Grisu3 cannot guarantee the result and the caller must fall back
+ */
+static int fmt_grisu3(double value, char *digits, int *length, int *exponent) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint64_t mantissa = bits & ((1ull << 52) - 1);
+    int biased = (int)(bits >> 52) & 0x7ff;
+    uint64_t f = biased ? mantissa | (1ull << 52) : mantissa;
+    int e = biased ? biased - 1075 : -1074;
+
+    struct fmt_diyfp w = fmt_normalize(f, e);
+    struct fmt_diyfp plus = fmt_normalize((f << 1) + 1, e - 1);
+    struct fmt_diyfp minus = mantissa == 0 && biased > 1 ? (struct fmt_diyfp){ (f << 2) - 1, e - 2 }
+                                                         : (struct fmt_diyfp){ (f << 1) - 1, e - 1 };
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    // A cached power that brings the exponent of w into [-60, -32]
+    double dk = (-60 - (w.e + 64) + 63) * 0.30102999566398114;
+    int k = (int)dk;
+    if (dk > k)
+        k++;
+    int index = (348 + k - 1) / 8 + 1;
+    struct fmt_diyfp ten_mk = { fmt_powers[index].f, fmt_powers[index].e };
+
+    struct fmt_diyfp scaled_w = fmt_multiply(w, ten_mk);
+    struct fmt_diyfp too_low = fmt_multiply(minus, ten_mk);
+    struct fmt_diyfp too_high = fmt_multiply(plus, ten_mk);
+    uint64_t unit = 1;
+    too_low.f -= unit;
+    too_high.f += unit;
+    uint64_t unsafe_interval = too_high.f - too_low.f;
+
+    int shift = -too_high.e;
+    uint64_t one = 1ull << shift;
+    uint32_t integrals = (uint32_t)(too_high.f >> shift);
+    uint64_t fractionals = too_high.f & (one - 1);
+    static const uint32_t pow10[10] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+                                        1000000000 };
+    int kappa = 9;
+    while (kappa > 0 && pow10[kappa] > integrals)
+        kappa--;
+    uint32_t divisor = pow10[kappa++];
+
+    *length = 0;
+    while (kappa > 0) {
+        digits[(*length)++] = (char)('0' + integrals / divisor);
+        integrals %= divisor;
+        kappa--;
+        uint64_t rest = ((uint64_t)integrals << shift) + fractionals;
+        if (rest < unsafe_interval) {
+            *exponent = kappa - fmt_powers[index].k;
+            return fmt_round_weed(digits, *length, too_high.f - scaled_w.f, unsafe_interval, rest,
+                                  (uint64_t)divisor << shift, unit);
+        }
+        divisor /= 10;
+    }
+    for (;;) {
+        fractionals *= 10;
+        unit *= 10;
+        unsafe_interval *= 10;
+        digits[(*length)++] = (char)('0' + (fractionals >> shift));
+        fractionals &= one - 1;
+        kappa--;
+        if (fractionals < unsafe_interval) {
+            *exponent = kappa - fmt_powers[index].k;
+            return fmt_round_weed(digits, *length, (too_high.f - scaled_w.f) * unit, unsafe_interval,
+                                  fractionals, one, unit);
+        }
+    }
+}
+
+static atomic_ulong fmt_grisu3_fallbacks;
+
+/**
+ * Writes a non-negative finite double with the fewest digits that read back as the same value,
+ * in positional notation.
+ *
+ * @return The number of characters written to out
+ */
+static size_t fmt_shortest(char *out, double value) {
+    char digits[24];
+    int length, exponent;
+    char *p = out;
+
+    if (value == 0) {
+        *p = '0';
+        return 1;
+    }
+    if (!fmt_grisu3(value, digits, &length, &exponent)) {
+        // Find the shortest %e that reads back, then take its digits and exponent
+        char text[40];
+        atomic_fetch_add_explicit(&fmt_grisu3_fallbacks, 1, memory_order_relaxed);
+        for (length = 1; length < 17; length++) {
+            snprintf(text, sizeof(text), "%.*e", length - 1, value);
+            if (strtod(text, NULL) == value)
+                break;
+        }
+        snprintf(text, sizeof(text), "%.*e", length - 1, value);
+        digits[0] = text[0];
+        memcpy(digits + 1, text + 2, length - 1);
+        exponent = atoi(strchr(text, 'e') + 1) - (length - 1);
+    }
+
+    int point = length + exponent;  // digits before the decimal point
+    if (point <= 0) {
+        *p++ = '0';
+        *p++ = '.';
+        memset(p, '0', -point);
+        p += -point;
+        memcpy(p, digits, length);
+        p += length;
+    } else if (point >= length) {
+        memcpy(p, digits, length);
+        p += length;
+        memset(p, '0', point - length);
+        p += point - length;
+    } else {
+        memcpy(p, digits, point);
+        p += point;
+        *p++ = '.';
+        memcpy(p, digits + point, length - point);
+        p += length - point;
+    }
+    return (size_t)(p - out);
+}
+
+/**
+ * Writes a non-negative finite double with precision decimals, rounded half to even on the exact
+ * binary value like printf. Values of 2^64 and above, and tiny values with very long precisions,
+ * are left to snprintf().
+ *
+ * @return The number of characters written to out
+ */
+static size_t fmt_fixed(char *out, size_t size, double value, int precision, int alt) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int biased = (int)(bits >> 52) & 0x7ff;
+    uint64_t f = biased ? (bits & ((1ull << 52) - 1)) | (1ull << 52) : bits & ((1ull << 52) - 1);
+    int e = biased ? biased - 1075 : -1074;
+
+    if (e > 11 || (e < -124 && precision > 21))
+        return (size_t)snprintf(out, size, alt ? "%#.*f" : "%.*f", precision, value);
+
+    // value = integral + fraction / 2^shift
+    uint64_t integral = 0;
+    unsigned __int128 fraction = 0, mask = 0;
+    int shift = 0;
+    if (e >= 0) {
+        integral = f << e;
+    } else if (e >= -124) {
+        shift = -e;
+        integral = shift < 64 ? f >> shift : 0;
+        mask = ((unsigned __int128)1 << shift) - 1;
+        fraction = f & mask;
+    }  // else below 2^-71, which rounds to zero at 21 decimals or fewer
+
+    // Leave a character in front for a carry out of the leading digit
+    char *p = out + 1;
+    char digits[24], *end = digits + sizeof(digits), *start = fmt_dec(end, integral);
+    memcpy(p, start, end - start);
+    p += end - start;
+    if (precision > 0 || alt)
+        *p++ = '.';
+    for (int i = 0; i < precision; i++) {
+        fraction *= 10;
+        *p++ = (char)('0' + (int)(fraction >> shift));
+        fraction &= mask;
+    }
+
+    unsigned __int128 half = shift ? (unsigned __int128)1 << (shift - 1) : 0;
+    char last = p[-1] == '.' ? p[-2] : p[-1];
+    if (shift && (fraction > half || (fraction == half && (last & 1)))) {
+        char *q = p - 1;
+        for (; q > out; q--) {
+            if (*q == '.')
+                continue;
+            if (*q != '9') {
+                ++*q;
+                break;
+            }
+            *q = '0';
+        }
+        if (q == out) {
+            *out = '1';
+            return (size_t)(p - out);
+        }
+    }
+    memmove(out, out + 1, p - out - 1);
+    return (size_t)(p - out - 1);
+}
+
+static void fmt_double(struct fmt_sink *sink, const struct fmt_spec *spec, double value) {
+    char buf[FMT_MAX_PRECISION + 340];
+    char prefix = signbit(value) ? '-' : spec->sign;
+
+    value = fabs(value);
+    if (isnan(value) || isinf(value)) {
+        fmt_pad(sink, spec, &prefix, prefix != 0, 0, isnan(value) ? "nan" : "inf", 3, 0);
+        return;
+    }
+    size_t len = spec->precision < 0 ? fmt_shortest(buf, value)
+                                     : fmt_fixed(buf, sizeof(buf), value, spec->precision, spec->alt);
+    fmt_pad(sink, spec, &prefix, prefix != 0, 0, buf, len, 1);
+}
+
+#define FMT_STAR_WIDTH 1      // the width is the next argument
+#define FMT_STAR_PRECISION 2  // the precision is the next argument
+
+// What a conversion takes from the arguments
+enum fmt_arg_type { FMT_ARG_NONE, FMT_ARG_INT, FMT_ARG_LONG, FMT_ARG_LLONG, FMT_ARG_SIZE, FMT_ARG_DOUBLE,
+                    FMT_ARG_POINTER, FMT_ARG_STRING };
+
+// One converted argument; integers are widened to long long with the sign of their type
+union fmt_arg {
+    long long i;
+    double f;
+    const void *p;
+    struct {
+        const char *s;
+        size_t len;  // characters to print, the precision already applied
+    } str;
+};
+
+/**
+ * Parses the flags, width, precision and length modifier of a specifier. A width or precision given
+ * as '*' is left to the caller, who takes it from the arguments (width first) with fmt_star_width()
+ * and fmt_star_precision().
+ *
+ * @param p The character after the '%'
+ * @param spec Where the flags, width and precision go
+ * @param length Set to 0 for no length modifier, 1 for l, 2 for ll and 3 for z
+ * @param stars Set to the FMT_STAR_* bits of the '*'s given
+ * @return Where the conversion character is; it is the terminating NUL if the format ends early
+ */
+static const char *fmt_parse(const char *p, struct fmt_spec *spec, int *length, int *stars) {
+    *spec = (struct fmt_spec){ 0, 0, 0, 0, 0, -1 };
+    *stars = 0;
+    for (;; p++) {
+        if (*p == '-')
+            spec->left = 1;
+        else if (*p == '+')
+            spec->sign = '+';
+        else if (*p == ' ')
+            spec->sign = spec->sign ? spec->sign : ' ';
+        else if (*p == '0')
+            spec->zero = 1;
+        else if (*p == '#')
+            spec->alt = 1;
+        else
+            break;
+    }
+    if (*p == '*') {
+        *stars |= FMT_STAR_WIDTH;
+        p++;
+    } else {
+        while (*p >= '0' && *p <= '9')
+            spec->width = spec->width * 10 + (*p++ - '0');
+    }
+    if (*p == '.') {
+        p++;
+        spec->precision = 0;
+        if (*p == '*') {
+            *stars |= FMT_STAR_PRECISION;
+            p++;
+        } else {
+            while (*p >= '0' && *p <= '9')
+                spec->precision = spec->precision * 10 + (*p++ - '0');
+        }
+        if (spec->precision > FMT_MAX_PRECISION)
+            spec->precision = FMT_MAX_PRECISION;
+    }
+    *length = 0;
+    if (*p == 'l') {
+        *length = 1;
+        if (*++p == 'l') {
+            *length = 2;
+            p++;
+        }
+    } else if (*p == 'z') {
+        *length = 3;
+        p++;
+    }
+    return p;
+}
+
+static void fmt_star_width(struct fmt_spec *spec, int width) {
+    spec->width = width;
+    if (width < 0) {
+        spec->left = 1;
+        spec->width = -width;
+    }
+}
+
+static void fmt_star_precision(struct fmt_spec *spec, int precision) {
+    spec->precision = precision > FMT_MAX_PRECISION ? FMT_MAX_PRECISION : precision;
+}
+
+/**
+ * Returns what a conversion takes from the arguments, not counting '*' widths and precisions.
+ */
+static enum fmt_arg_type fmt_arg_type(char conversion, int length) {
+    switch (conversion) {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'x':
+        case 'X':
+            return length == 0 ? FMT_ARG_INT : length == 1 ? FMT_ARG_LONG : length == 2 ? FMT_ARG_LLONG : FMT_ARG_SIZE;
+        case 'c':
+            return FMT_ARG_INT;
+        case 's':
+            return FMT_ARG_STRING;
+        case 'p':
+            return FMT_ARG_POINTER;
+        case 'f':
+            return FMT_ARG_DOUBLE;
+        default:
+            return FMT_ARG_NONE;
+    }
+}
+
+/**
+ * Writes one conversion.
+ *
+ * @param conversion The conversion character, not NUL
+ * @param length The length modifier, as fmt_parse() returns it
+ * @param arg The argument, read as fmt_arg_type() says; ignored by conversions that take none
+ */
+static void fmt_convert(struct fmt_sink *sink, struct fmt_spec *spec, char conversion, int length,
+                        const union fmt_arg *arg) {
+    switch (conversion) {
+        case 'd':
+        case 'i': {
+            long long value = arg->i;
+            fmt_integer(sink, spec, value < 0 ? 0 - (uint64_t)value : (uint64_t)value, value < 0, 'd');
+            break;
+        }
+        case 'u':
+        case 'x':
+        case 'X': {
+            uint64_t value = length == 0   ? (unsigned int)arg->i
+                             : length == 1 ? (unsigned long)arg->i
+                             : length == 2 ? (unsigned long long)arg->i
+                                           : (size_t)arg->i;
+            fmt_integer(sink, spec, value, 0, conversion);
+            break;
+        }
+        case 'c': {
+            char c = (char)arg->i;
+            fmt_pad(sink, spec, NULL, 0, 0, &c, 1, 0);
+            break;
+        }
+        case 's':
+            fmt_pad(sink, spec, NULL, 0, 0, arg->str.s, arg->str.len, 0);
+            break;
+        case 'p':
+            if (!arg->p) {
+                fmt_pad(sink, spec, NULL, 0, 0, "(nil)", 5, 0);
+            } else {
+                spec->alt = 1;
+                fmt_integer(sink, spec, (uintptr_t)arg->p, 0, 'x');
+            }
+            break;
+        case 'f':
+            fmt_double(sink, spec, arg->f);
+            break;
+        case '%':
+            fmt_put(sink, "%", 1);
+            break;
+        default: {
+            char unknown[] = "Unknown format specifier: %?\n";
+            unknown[sizeof(unknown) - 3] = conversion;
+            fmt_put(sink, unknown, sizeof(unknown) - 1);
+            break;
+        }
+    }
+}
+
+/**
+ * Formats into a sink; the engine behind my_printf() and my_snprintf().
+ *
+ * @param sink Where the text goes
  * @param format The format string
  * @param args The variable arguments
  */
-#include <stdarg.h>
-#include <stdio.h>
+static void fmt_format(struct fmt_sink *sink, const char *format, va_list args) {
+    const char *p = format;
+
+    while (*p != '\0') {
+        const char *literal = p;
+        p = strchrnul(p, '%');
+        if (*p == '%' && *(p + 1) == '\0')
+            p++;
+        fmt_put(sink, literal, p - literal);
+        if (*p == '\0')
+            break;
+
+        struct fmt_spec spec;
+        union fmt_arg arg = { 0 };
+        int length, stars;
+        p = fmt_parse(p + 1, &spec, &length, &stars);
+        if (stars & FMT_STAR_WIDTH)
+            fmt_star_width(&spec, va_arg(args, int));
+        if (stars & FMT_STAR_PRECISION)
+            fmt_star_precision(&spec, va_arg(args, int));
+        switch (fmt_arg_type(*p, length)) {
+            case FMT_ARG_INT:
+                arg.i = va_arg(args, int);
+                break;
+            case FMT_ARG_LONG:
+                arg.i = va_arg(args, long);
+                break;
+            case FMT_ARG_LLONG:
+                arg.i = va_arg(args, long long);
+                break;
+            case FMT_ARG_SIZE:
+                arg.i = va_arg(args, ssize_t);
+                break;
+            case FMT_ARG_DOUBLE:
+                arg.f = va_arg(args, double);
+                break;
+            case FMT_ARG_POINTER:
+                arg.p = va_arg(args, void *);
+                break;
+            case FMT_ARG_STRING:
+                arg.str.s = va_arg(args, char *);
+                if (!arg.str.s)
+                    arg.str.s = "(null)";
+                arg.str.len = spec.precision < 0 ? strlen(arg.str.s) : strnlen(arg.str.s, spec.precision);
+                break;
+            case FMT_ARG_NONE:
+                break;
+        }
+        if (*p == '\0')
+            return;
+        fmt_convert(sink, &spec, *p, length, &arg);
+        p++;
+    }
+}
+
+/**
+ * snprintf() with my_printf()'s specifiers: writes at most size - 1 characters and a terminating NUL.
+ *
+ * @param buf The buffer
+ * @param size The size of the buffer
+ * @param format The format string
+ * @param args The variable arguments
+ * @return The length of the whole formatted text, which may be size or more if it was truncated
+ */
+int my_vsnprintf(char *buf, size_t size, const char *format, va_list args) {
+    struct fmt_sink sink = { buf, size ? size - 1 : 0, 0, 0, -1 };
 
+    fmt_format(&sink, format, args);
+    if (size)
+        buf[sink.len] = '\0';
+    return (int)sink.total;
+}
+
+int my_snprintf(char *buf, size_t size, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int n = my_vsnprintf(buf, size, format, args);
+    va_end(args);
+    return n;
+}
+
+// Per-thread output buffer of my_printf()
+#define MY_OUT_SIZE 8192
+
+static _Thread_local struct {
+    char buf[MY_OUT_SIZE];
+    size_t len;
+    int registered;
+} my_out;
+
+static pthread_key_t my_out_key;
+static pthread_once_t my_out_once = PTHREAD_ONCE_INIT;
+static int my_out_tty;
+
+/**
+ * Writes out what my_printf() has buffered on this thread. Threads flush on exit, and the main thread
+ * when the program exits; call it before mixing my_printf() with other output.
+ */
+void my_flush(void) {
+    struct fmt_sink sink = { my_out.buf, MY_OUT_SIZE, my_out.len, 0, STDOUT_FILENO };
+
+    fmt_flush(&sink);
+    my_out.len = 0;
+}
+
+static void my_out_exit(void *unused) {
+    (void) unused;
+    my_flush();
+}
+
+static void my_out_init(void) {
+    pthread_key_create(&my_out_key, my_out_exit);
+    atexit(my_flush);
+    my_out_tty = isatty(STDOUT_FILENO);
+}
+
+/**
+ * Custom printf-like function. It takes the specifiers listed under FORMATTING ENGINE and buffers
+ * the text per thread, writing it with one write() when the buffer fills, when my_flush() is called,
+ * when the thread or program exits, or after every call if stdout is a terminal.
+ *
+ * @param format The format string
+ * @param args The variable arguments
+ */
 void my_printf(const char *format, ...) {
+    struct fmt_sink sink = { my_out.buf, MY_OUT_SIZE, my_out.len, 0, STDOUT_FILENO };
     va_list args;
+
+    if (!my_out.registered) {
+        pthread_once(&my_out_once, my_out_init);
+        pthread_setspecific(my_out_key, &my_out);
+        my_out.registered = 1;
+    }
     va_start(args, format);
+    fmt_format(&sink, format, args);
+    va_end(args);
+    my_out.len = sink.len;
+    if (my_out_tty)
+        my_flush();
+}
 
-    const char *p = format;
+/**
+ * Deferred logging: log_printf() takes my_printf()'s specifiers but does not format anything on the
+ * calling thread. It copies the format pointer, a timestamp and the raw va_arg values into a record in
+ * the calling thread's own ring buffer, and a background thread started by log_start() decodes the
+ * records and writes the text with the same engine. The format string must therefore outlive the call
+ * (a string literal); %s arguments are copied into the record, up to LOG_MAX_STRING characters, so they
+ * need not.
+ *
+ * Each ring has one producer (its thread) and one consumer (the log thread), so a record is published
+ * with a single release store of the head and needs no lock. When a ring is full the record is dropped
+ * and counted rather than blocking the caller.
+ */
+
+#define LOG_RING_SIZE (1u << 20)  // bytes per thread, a power of two
+#define LOG_MAX_STRING 255        // longer %s arguments are truncated
+#define LOG_MAX_ARGS 16           // calls with more arguments are dropped
+#define LOG_FORMAT_CACHE 64       // parsed formats remembered per thread
+#define LOG_OUT_SIZE 65536        // bytes the log thread formats before each write()
+#define LOG_STAR_PRECISION -2     // the precision of a %s is the argument before it
+
+// Record header; the arguments follow in 8-byte slots
+struct log_record {
+    const char *format;  // NULL marks padding up to the end of the ring
+    uint64_t timestamp;  // nanoseconds, CLOCK_MONOTONIC
+    uint32_t size;       // header plus arguments, a multiple of 8
+    uint32_t reserved;
+};
+
+// Arguments of a format, parsed once per thread
+struct log_format {
+    const char *format;
+    int count;
+    unsigned char types[LOG_MAX_ARGS];  // enum fmt_arg_type, '*' widths and precisions included
+    short precisions[LOG_MAX_ARGS];     // of %s arguments: -1 for none, or LOG_STAR_PRECISION
+};
+
+struct log_ring {
+    _Atomic uint64_t head __attribute__((aligned(64)));  // written by the producer
+    uint64_t cached_tail;                                 // producer's last look at tail
+    struct log_format formats[LOG_FORMAT_CACHE];          // producer's format cache
+    _Atomic uint64_t tail __attribute__((aligned(64)));  // written by the consumer
+    uint64_t drain_head;                                  // consumer's snapshot of head for one drain
+    struct log_ring *drain_next;                          // rings being drained, consumer only
+    _Atomic(struct log_ring *) next;
+    atomic_int exited;
+    _Atomic uint64_t dropped;
+    unsigned char data[LOG_RING_SIZE] __attribute__((aligned(64)));
+};
+
+static _Atomic(struct log_ring *) log_rings;
+static _Thread_local struct log_ring *log_self;
+static pthread_key_t log_key;
+static pthread_once_t log_key_once = PTHREAD_ONCE_INIT;
+static pthread_t log_thread;
+static int log_fd;
+static atomic_int log_stopping;
+static uint64_t log_dropped_total;  // drops of freed rings, owned by the log thread
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void log_ring_exit(void *ring) {
+    log_self = NULL;
+    atomic_store_explicit(&((struct log_ring *)ring)->exited, 1, memory_order_release);
+}
+
+static void log_make_key(void) {
+    pthread_key_create(&log_key, log_ring_exit);
+}
+
+/**
+ * Returns the calling thread's ring, creating and publishing it on first use.
+ */
+static struct log_ring *log_ring_new(void) {
+    struct log_ring *ring = aligned_alloc(64, sizeof(*ring));
+    if (!ring)
+        return NULL;
+    memset(ring, 0, offsetof(struct log_ring, data));
+    pthread_once(&log_key_once, log_make_key);
+    pthread_setspecific(log_key, ring);
+
+    struct log_ring *head = atomic_load_explicit(&log_rings, memory_order_relaxed);
+    do {
+        atomic_store_explicit(&ring->next, head, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(&log_rings, &head, ring, memory_order_release,
+                                                    memory_order_relaxed));
+    return log_self = ring;
+}
+
+static inline uint32_t log_align8(size_t n) {
+    return (uint32_t)((n + 7) & ~(size_t)7);
+}
+
+/**
+ * Returns the arguments of a format, parsing it only the first time this thread logs it. The format is
+ * parsed by fmt_parse(), so the arguments are the ones fmt_format() would take.
+ *
+ * @return The cached entry, or NULL if the format has more than LOG_MAX_ARGS arguments
+ */
+static const struct log_format *log_format_lookup(struct log_ring *ring, const char *format) {
+    struct log_format *entry = &ring->formats[((uintptr_t)format >> 3) & (LOG_FORMAT_CACHE - 1)];
+
+    if (entry->format == format)
+        return entry;
+    entry->format = NULL;
+    entry->count = 0;
+    for (const char *p = strchr(format, '%'); p; p = strchr(p + 1, '%')) {
+        struct fmt_spec spec;
+        int length, stars;
+        p = fmt_parse(p + 1, &spec, &length, &stars);
+        enum fmt_arg_type type = fmt_arg_type(*p, length);
+        if (entry->count + !!(stars & FMT_STAR_WIDTH) + !!(stars & FMT_STAR_PRECISION) + (type != FMT_ARG_NONE) >
+            LOG_MAX_ARGS)
+            return NULL;
+        if (stars & FMT_STAR_WIDTH)
+            entry->types[entry->count++] = FMT_ARG_INT;
+        if (stars & FMT_STAR_PRECISION)
+            entry->types[entry->count++] = FMT_ARG_INT;
+        if (type != FMT_ARG_NONE) {
+            entry->precisions[entry->count] = stars & FMT_STAR_PRECISION ? LOG_STAR_PRECISION : spec.precision;
+            entry->types[entry->count++] = type;
+        }
+        if (*p == '\0')
+            break;
+    }
+    entry->format = format;
+    return entry;
+}
+
+/**
+ * Deferred my_printf(): records the call for the log thread to format.
+ *
+ * @param format The format string, which must stay valid until it is written (a string literal)
+ * @param args The variable arguments
+ */
+void log_printf(const char *format, ...) {
+    struct log_ring *ring = log_self ? log_self : log_ring_new();
+    uint64_t timestamp = now_ns();
+    const struct log_format *layout;
+    union fmt_arg values[LOG_MAX_ARGS];
+    va_list args;
+
+    if (!ring)
+        return;
+    layout = log_format_lookup(ring, format);
+    if (!layout) {
+        atomic_store_explicit(&ring->dropped, atomic_load_explicit(&ring->dropped, memory_order_relaxed) + 1,
+                              memory_order_relaxed);
+        return;
+    }
+
+    // Pull the arguments first; strings decide the size of the record
+    uint32_t size = sizeof(struct log_record);
+    va_start(args, format);
+    for (int i = 0; i < layout->count; i++) {
+        switch ((enum fmt_arg_type)layout->types[i]) {
+            case FMT_ARG_INT:
+                values[i].i = va_arg(args, int);
+                break;
+            case FMT_ARG_LONG:
+                values[i].i = va_arg(args, long);
+                break;
+            case FMT_ARG_LLONG:
+                values[i].i = va_arg(args, long long);
+                break;
+            case FMT_ARG_SIZE:
+                values[i].i = va_arg(args, ssize_t);
+                break;
+            case FMT_ARG_DOUBLE:
+                values[i].f = va_arg(args, double);
+                break;
+            case FMT_ARG_POINTER:
+                values[i].p = va_arg(args, void *);
+                break;
+            case FMT_ARG_STRING: {
+                // Never read past the precision: the string need not be terminated within it
+                int precision = layout->precisions[i] == LOG_STAR_PRECISION ? (int)values[i - 1].i
+                                                                              : layout->precisions[i];
+                values[i].str.s = va_arg(args, char *);
+                if (!values[i].str.s)
+                    values[i].str.s = "(null)";
+                values[i].str.len = strnlen(values[i].str.s, precision >= 0 && precision < LOG_MAX_STRING
+                                                                 ? (size_t)precision : LOG_MAX_STRING);
+                break;
+            }
+            case FMT_ARG_NONE:
+                break;
+        }
+        size += layout->types[i] == FMT_ARG_STRING ? log_align8(4 + values[i].str.len) : 8;
+    }
+    va_end(args);
+
+    // A record never wraps; skip the tail of the ring if it does not fit there
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t offset = (uint32_t)(head & (LOG_RING_SIZE - 1));
+    uint32_t skip = LOG_RING_SIZE - offset < size ? LOG_RING_SIZE - offset : 0;
+    if (head + skip + size - ring->cached_tail > LOG_RING_SIZE) {
+        ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head + skip + size - ring->cached_tail > LOG_RING_SIZE) {
+            atomic_store_explicit(&ring->dropped, atomic_load_explicit(&ring->dropped, memory_order_relaxed) + 1,
+                                  memory_order_relaxed);
+            return;
+        }
+    }
+    if (skip) {
+        if (skip >= sizeof(struct log_record)) {
+            struct log_record *pad = (struct log_record *)&ring->data[offset];
+            pad->format = NULL;
+            pad->size = skip;
+        }
+        offset = 0;
+    }
+
+    struct log_record *record = (struct log_record *)&ring->data[offset];
+    unsigned char *arg = (unsigned char *)(record + 1);
+    record->format = format;
+    record->timestamp = timestamp;
+    record->size = size;
+    for (int i = 0; i < layout->count; i++) {
+        if (layout->types[i] == FMT_ARG_STRING) {
+            uint32_t n = (uint32_t)values[i].str.len;
+            memcpy(arg, &n, 4);
+            memcpy(arg + 4, values[i].str.s, n);
+            arg += log_align8(4 + n);
+        } else {
+            memcpy(arg, &values[i], 8);
+            arg += 8;
+        }
+    }
+    atomic_store_explicit(&ring->head, head + skip + size, memory_order_release);
+}
+
+/**
+ * Writes one record the way my_printf() would have, prefixed with its timestamp.
+ *
+ * @param sink Where the text goes
+ * @param record The record
+ */
+static void log_write_record(struct fmt_sink *sink, const struct log_record *record) {
+    static const struct fmt_spec plain = { 0, 0, 0, 0, 0, -1 }, nanoseconds = { 0, 0, 1, 0, 9, -1 };
+    const unsigned char *slot = (const unsigned char *)(record + 1);
+    const char *p = record->format;
+
+    fmt_put(sink, "[", 1);
+    fmt_integer(sink, &plain, record->timestamp / 1000000000u, 0, 'u');
+    fmt_put(sink, ".", 1);
+    fmt_integer(sink, &nanoseconds, record->timestamp % 1000000000u, 0, 'u');
+    fmt_put(sink, "] ", 2);
+
+    // The same walk as fmt_format(), with the arguments taken from the record's slots
     while (*p != '\0') {
-        if (*p == '%' && *(p + 1) != '\0') {
-            switch (*(++p)) {
-                case 'd':
-                    printf("%d", va_arg(args, int));
+        const char *literal = p;
+        p = strchrnul(p, '%');
+        if (*p == '%' && *(p + 1) == '\0')
+            p++;
+        fmt_put(sink, literal, p - literal);
+        if (*p == '\0')
+            break;
+
+        struct fmt_spec spec;
+        union fmt_arg arg = { 0 };
+        int length, stars;
+        p = fmt_parse(p + 1, &spec, &length, &stars);
+        if (stars & FMT_STAR_WIDTH) {
+            memcpy(&arg.i, slot, 8);
+            fmt_star_width(&spec, (int)arg.i);
+            slot += 8;
+        }
+        if (stars & FMT_STAR_PRECISION) {
+            memcpy(&arg.i, slot, 8);
+            fmt_star_precision(&spec, (int)arg.i);
+            slot += 8;
+        }
+        switch (fmt_arg_type(*p, length)) {
+            case FMT_ARG_NONE:
+                break;
+            case FMT_ARG_STRING: {
+                uint32_t n;
+                memcpy(&n, slot, 4);
+                arg.str.s = (const char *)slot + 4;
+                arg.str.len = spec.precision >= 0 && (uint32_t)spec.precision < n ? (size_t)spec.precision : n;
+                slot += log_align8(4 + n);
+                break;
+            }
+            default:
+                memcpy(&arg, slot, 8);
+                slot += 8;
+                break;
+        }
+        if (*p == '\0')
+            break;
+        fmt_convert(sink, &spec, *p, length, &arg);
+        p++;
+    }
+}
+
+/**
+ * Returns the next record of a ring, or NULL if it is empty. Padding is consumed on the way.
+ */
+static const struct log_record *log_peek(struct log_ring *ring, uint64_t head) {
+    for (;;) {
+        uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        if (tail == head)
+            return NULL;
+        uint32_t offset = (uint32_t)(tail & (LOG_RING_SIZE - 1));
+        const struct log_record *record = (const struct log_record *)&ring->data[offset];
+        if (LOG_RING_SIZE - offset < sizeof(struct log_record)) {
+            atomic_store_explicit(&ring->tail, tail + (LOG_RING_SIZE - offset), memory_order_release);
+        } else if (!record->format) {
+            atomic_store_explicit(&ring->tail, tail + record->size, memory_order_release);
+        } else {
+            return record;
+        }
+    }
+}
+
+/**
+ * Writes every record published so far, merging the rings in timestamp order, and frees the rings of
+ * threads that have exited once they are empty.
+ *
+ * @return The number of records written
+ */
+static size_t log_drain(int fd) {
+    struct log_ring *rings = NULL, **last = &rings;
+    char buf[LOG_OUT_SIZE];
+    struct fmt_sink sink = { buf, sizeof(buf), 0, 0, fd };
+    size_t written = 0;
+
+    // Free drained rings of exited threads; only this thread unlinks, producers only push at the head
+    struct log_ring *prev = NULL;
+    struct log_ring *ring = atomic_load_explicit(&log_rings, memory_order_acquire);
+    while (ring) {
+        struct log_ring *next = atomic_load_explicit(&ring->next, memory_order_relaxed);
+        if (atomic_load_explicit(&ring->exited, memory_order_acquire) &&
+            atomic_load_explicit(&ring->head, memory_order_acquire) ==
+                atomic_load_explicit(&ring->tail, memory_order_relaxed)) {
+            struct log_ring *expected = ring;
+            if (prev) {
+                atomic_store_explicit(&prev->next, next, memory_order_relaxed);
+            } else if (!atomic_compare_exchange_strong_explicit(&log_rings, &expected, next,
+                                                                memory_order_acq_rel, memory_order_acquire)) {
+                // New rings were pushed in front of this one; find its predecessor among them
+                for (prev = expected; atomic_load_explicit(&prev->next, memory_order_relaxed) != ring;)
+                    prev = atomic_load_explicit(&prev->next, memory_order_relaxed);
+                atomic_store_explicit(&prev->next, next, memory_order_relaxed);
+            }
+            log_dropped_total += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+            free(ring);
+        } else {
+            ring->drain_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+            *last = ring;
+            last = &ring->drain_next;
+            prev = ring;
+        }
+        ring = next;
+    }
+    *last = NULL;
+
+    // Merge what was published before the heads were read
+    for (;;) {
+        const struct log_record *first = NULL;
+        struct log_ring *from = NULL;
+        for (ring = rings; ring; ring = ring->drain_next) {
+            const struct log_record *record = log_peek(ring, ring->drain_head);
+            if (record && (!first || record->timestamp < first->timestamp)) {
+                first = record;
+                from = ring;
+            }
+        }
+        if (!first)
+            break;
+        log_write_record(&sink, first);
+        atomic_store_explicit(&from->tail, atomic_load_explicit(&from->tail, memory_order_relaxed) + first->size,
+                              memory_order_release);
+        written++;
+    }
+    fmt_flush(&sink);
+    return written;
+}
+
+static void *log_thread_main(void *arg) {
+    struct timespec idle = { 0, 1000000 };
+
+    (void) arg;
+    while (!atomic_load_explicit(&log_stopping, memory_order_acquire)) {
+        if (!log_drain(log_fd))
+            nanosleep(&idle, NULL);
+    }
+    log_drain(log_fd);
+    return NULL;
+}
+
+/**
+ * Starts the log thread. The log thread write()s to the stream's file descriptor, like my_printf();
+ * anything buffered in the stream is flushed first, and nothing else should write to it until
+ * log_stop().
+ *
+ * @param out The stream the log thread writes to
+ * @return 0 on success, an error number otherwise
+ */
+int log_start(FILE *out) {
+    fflush(out);
+    log_fd = fileno(out);
+    atomic_store(&log_stopping, 0);
+    return pthread_create(&log_thread, NULL, log_thread_main, NULL);
+}
+
+/**
+ * Writes everything logged so far and stops the log thread.
+ *
+ * @return The number of records dropped because a ring was full
+ */
+uint64_t log_stop(void) {
+    uint64_t dropped = 0;
+
+    atomic_store_explicit(&log_stopping, 1, memory_order_release);
+    pthread_join(log_thread, NULL);
+    for (struct log_ring *ring = atomic_load(&log_rings); ring; ring = atomic_load(&ring->next))
+        dropped += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+    return dropped + log_dropped_total;
+}
+
+/**
+ * Benchmark: the latency of single calls of printf, my_printf and log_printf with the same format,
+ * with stdout and the log going to /dev/null. Calls come in bursts of 1000 with a 1 ms pause between
+ * them, as logging on a hot path would, so the log thread gets to drain the ring. The times include
+ * one clock read, which the "(clock)" row measures on its own.
+ */
+
+#define BENCH_BURST 1000
+
+enum bench_kind { BENCH_CLOCK, BENCH_PRINTF, BENCH_MY_PRINTF, BENCH_LOG_PRINTF, BENCH_KIND_COUNT };
+
+static const char *bench_names[BENCH_KIND_COUNT] = { "(clock)", "printf", "my_printf", "log_printf" };
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void *check_thread(void *arg) {
+    for (int i = 0; i < 1000; i++)
+        log_printf("thread %c line %d: %s\n", *(const char *)arg, i, i % 2 ? "odd" : "even");
+    return NULL;
+}
+
+/**
+ * Checks that the log thread writes what my_printf would, in order, for two threads.
+ *
+ * @return 0 if it does
+ */
+static int check_log(void) {
+    FILE *out = tmpfile();
+    pthread_t threads[2];
+    char line[128], word[8];
+    int lines[2] = { 0, 0 }, n, ok = 1;
+    char id;
+
+    if (!out || log_start(out) != 0)
+        return 1;
+    pthread_create(&threads[0], NULL, check_thread, "a");
+    pthread_create(&threads[1], NULL, check_thread, "b");
+    pthread_join(threads[0], NULL);
+    pthread_join(threads[1], NULL);
+    ok = log_stop() == 0;
+
+    rewind(out);
+    while (fgets(line, sizeof(line), out)) {
+        char *text = strchr(line, ']');
+        if (!text || sscanf(text, "] thread %c line %d: %7s", &id, &n, word) != 3 || id < 'a' || id > 'b' ||
+            n != lines[id - 'a']++ || strcmp(word, n % 2 ? "odd" : "even") != 0)
+            ok = 0;
+    }
+    fclose(out);
+    return !(ok && lines[0] == 1000 && lines[1] == 1000);
+}
+
+int bench_main(long calls) {
+    uint64_t *latency = malloc(sizeof(*latency) * calls);
+    struct timespec pause = { 0, 1000000 };
+    FILE *devnull = fopen("/dev/null", "w");
+    int saved_stdout = dup(STDOUT_FILENO);
+
+    if (!latency || !devnull || saved_stdout < 0)
+        return 1;
+    if (check_log() != 0) {
+        fprintf(stderr, "log_printf output does not match\n");
+        return 1;
+    }
+    if (sysconf(_SC_NPROCESSORS_ONLN) < 2)
+        printf("note: one CPU online, the log thread shares it with the caller\n");
+    printf("%-12s %8s %8s %8s %8s   (ns per call)\n", "", "mean", "p50", "p99", "p99.9");
+
+    for (int k = 0; k < BENCH_KIND_COUNT; k++) {
+        uint64_t dropped = 0, total = 0;
+
+        fflush(stdout);
+        dup2(fileno(devnull), STDOUT_FILENO);
+        if (k == BENCH_LOG_PRINTF)
+            log_start(devnull);
+        for (long i = 0; i < calls; i++) {
+            uint64_t start = now_ns();
+            switch (k) {
+                case BENCH_CLOCK:
                     break;
-                case 'c':
-                    printf("%c", (char) va_arg(args, int));
+                case BENCH_PRINTF:
+                    printf("request %d from %s took %d us, status %c\n", (int)i, "10.0.0.1", 250, 'K');
                     break;
-                case 's':
-                    printf("%s", va_arg(args, char *));
+                case BENCH_MY_PRINTF:
+                    my_printf("request %d from %s took %d us, status %c\n", (int)i, "10.0.0.1", 250, 'K');
                     break;
                 default:
-                    printf("Unknown format specifier: %%%c\n", *p);
+                    log_printf("request %d from %s took %d us, status %c\n", (int)i, "10.0.0.1", 250, 'K');
                     break;
             }
-        } else {
-            putchar(*p);
+            latency[i] = now_ns() - start;
+            if (i % BENCH_BURST == BENCH_BURST - 1)
+                nanosleep(&pause, NULL);
         }
-        p++;
+        if (k == BENCH_LOG_PRINTF)
+            dropped = log_stop();
+        my_flush();
+        fflush(stdout);
+        dup2(saved_stdout, STDOUT_FILENO);
+
+        for (long i = 0; i < calls; i++)
+            total += latency[i];
+        qsort(latency, calls, sizeof(*latency), compare_u64);
+        printf("%-12s %8.0f %8llu %8llu %8llu", bench_names[k], (double)total / calls,
+               (unsigned long long)latency[calls / 2], (unsigned long long)latency[calls * 99 / 100],
+               (unsigned long long)latency[calls * 999 / 1000]);
+        if (k == BENCH_LOG_PRINTF)
+            printf("   %llu dropped", (unsigned long long)dropped);
+        printf("\n");
     }
+    fclose(devnull);
+    free(latency);
+    return 0;
+}
 
-    va_end(args);
+/**
+ * Formatting benchmark: my_snprintf against snprintf on a few typical lines, after checking that
+ * both produce the same text. For the shortest %f there is no printf equivalent; it is compared with
+ * %.17g, the usual way to print a double that reads back, and checked by reading it back with strtod
+ * and comparing its digit count with the shortest %e that reads back.
+ */
+
+enum format_case { FORMAT_INTEGERS, FORMAT_PADDING, FORMAT_POINTER, FORMAT_FIXED, FORMAT_SHORTEST,
+                   FORMAT_CASE_COUNT };
+
+static const char *format_names[FORMAT_CASE_COUNT] = { "integers", "padding", "pointer", "fixed %.3f",
+                                                       "shortest %f" };
+
+typedef int (*format_fn)(char *, size_t, const char *, ...);
+
+// A pseudo-random double for case i: short decimals, wide magnitudes and arbitrary bit patterns
+static double format_value(uint64_t i) {
+    uint64_t x = i * 0x9e3779b97f4a7c15ull;
+    double d = (double)(x % 1000000);
+
+    x ^= x >> 29;
+    switch (i % 3) {
+        case 0:
+            return (double)(x % 100000000) / 1000;
+        case 1:
+            for (int e = (int)(x >> 58) - 32; e != 0; e += e < 0 ? 1 : -1)
+                d = e < 0 ? d / 10 : d * 10;
+            return d;
+        default:
+            x = (x & ~(0x7ffull << 52)) | ((x % 2046 + 1) << 52);  // any finite, non-zero double
+            memcpy(&d, &x, sizeof(d));
+            return d;
+    }
+}
+
+static int format_case(int k, format_fn fn, char *buf, size_t size, uint64_t i) {
+    static const char *names[4] = { "eth0", "loopback", "wlan0", "bridge-uplink" };
+    double x = format_value(i);
+
+    switch (k) {
+        case FORMAT_INTEGERS:
+            return fn(buf, size, "id=%d n=%u mask=%x big=%ld huge=%lld\n", (int)i - 5000000, (unsigned)i * 7,
+                      (unsigned)i * 2654435761u, (long)i * 1000003, (long long)i * -999999937ll);
+        case FORMAT_PADDING:
+            return fn(buf, size, "[%-12s|%8d|%08x|%+5d|%.3d|%5c]\n", names[i & 3], (int)(i % 100000),
+                      (unsigned)i, (int)(i % 1000) - 500, (int)(i % 1000), 'a' + (int)(i % 26));
+        case FORMAT_POINTER:
+            return fn(buf, size, "node %p next %p\n", (void *)(uintptr_t)(i * 64 + 0x7f0000000000ull), NULL);
+        case FORMAT_FIXED:
+            // Magnitudes that fit 64 bits; larger ones are passed on to snprintf
+            x = (double)(int64_t)(i * 0x9e3779b97f4a7c15ull % 2000000000000ull) / 997 - 1e9;
+            return fn(buf, size, "t=%.3f load=%.6f delta=%10.2f\n", x, x * 1e-3, (double)(int64_t)i / -7);
+        default:
+            return fn(buf, size, fn == my_snprintf ? "value=%f\n" : "value=%.17g\n", x);
+    }
+}
+
+// Significant digits of a number printed by fmt_shortest() or %e
+static int format_digits(const char *s) {
+    int first = -1, last = -1, n = 0;
+
+    for (; *s && *s != 'e' && *s != '\n'; s++) {
+        if (*s < '0' || *s > '9')
+            continue;
+        if (*s != '0') {
+            if (first < 0)
+                first = n;
+            last = n;
+        }
+        n++;
+    }
+    return first < 0 ? 1 : last - first + 1;
+}
+
+static int format_check(long calls) {
+    char mine[1024], theirs[1024];
+    int failures = 0;
+
+    for (int k = 0; k < FORMAT_SHORTEST; k++) {
+        for (long i = 0; i < calls && failures < 5; i++) {
+            int a = format_case(k, my_snprintf, mine, sizeof(mine), i);
+            int b = format_case(k, snprintf, theirs, sizeof(theirs), i);
+            if (a != b || strcmp(mine, theirs) != 0) {
+                fprintf(stderr, "%s differs: \"%s\" vs \"%s\"\n", format_names[k], mine, theirs);
+                failures++;
+            }
+        }
+    }
+    for (long i = 0; i < calls && failures < 10; i++) {
+        double x = format_value(i);
+        int shortest;
+        format_case(FORMAT_SHORTEST, my_snprintf, mine, sizeof(mine), i);
+        for (shortest = 1; shortest < 17; shortest++) {
+            snprintf(theirs, sizeof(theirs), "%.*e", shortest - 1, x);
+            if (strtod(theirs, NULL) == x)
+                break;
+        }
+        if (strtod(mine + 6, NULL) != x || format_digits(mine + 6) > shortest) {
+            fprintf(stderr, "shortest %%f of %.17g is %s", x, mine + 6);
+            failures++;
+        }
+    }
+
+    // Truncation, flags and the odd cases
+    static const struct {
+        const char *format;
+        double value;
+    } edge[] = { { "%.0f|%.1f", 0.5 }, { "%.0f|%.1f", 2.5 }, { "%.2f|%.1f", 0.125 }, { "%8.3f|%-8.1f|", -9.9996 },
+                 { "%+010.2f|%#.0f", 3.14159 }, { "%.3f|%f", 1e300 }, { "%.3f|%.0f", -0.0 },
+                 { "%.20f|%5.1f", 1e-30 }, { "%.10f|%.1f", 0.999999999999 } };
+    for (size_t i = 0; i < sizeof(edge) / sizeof(edge[0]); i++) {
+        my_snprintf(mine, sizeof(mine), edge[i].format, edge[i].value, edge[i].value);
+        snprintf(theirs, sizeof(theirs), edge[i].format, edge[i].value, edge[i].value);
+        if (strcmp(mine, theirs) != 0 && !strstr(edge[i].format, "|%f")) {
+            fprintf(stderr, "\"%s\" differs: \"%s\" vs \"%s\"\n", edge[i].format, mine, theirs);
+            failures++;
+        }
+    }
+    if (my_snprintf(mine, 8, "%s=%d", "truncated", 42) != 12 || strcmp(mine, "truncat") != 0 ||
+        my_snprintf(mine, sizeof(mine), "%5s|%-5c|%.2s|%x|%#X|%p|%%|%lu|%zu|%*d|%-*d|", "ab", 'z', "xyz", 0,
+                    255u, NULL, 18446744073709551615ul, (size_t)7, 4, 1, 3, 2) != 62 ||
+        strcmp(mine, "   ab|z    |xy|0|0XFF|(nil)|%|18446744073709551615|7|   1|2  |") != 0) {
+        fprintf(stderr, "edge cases: \"%s\"\n", mine);
+        failures++;
+    }
+    return failures;
 }
 
-int main() {
+int format_bench_main(long calls) {
+    char buf[256];
+
+    if (format_check(calls < 200000 ? calls : 200000) != 0)
+        return 1;
+    printf("%-14s %12s %12s %8s   (ns per call; %lu Grisu3 fallbacks in the check)\n", "", "snprintf",
+           "my_snprintf", "speedup", atomic_load_explicit(&fmt_grisu3_fallbacks, memory_order_relaxed));
+    for (int k = 0; k < FORMAT_CASE_COUNT; k++) {
+        double ns[2];
+        for (int mine = 0; mine < 2; mine++) {
+            uint64_t start = now_ns();
+            for (long i = 0; i < calls; i++)
+                format_case(k, mine ? my_snprintf : snprintf, buf, sizeof(buf), i);
+            ns[mine] = (double)(now_ns() - start) / calls;
+        }
+        printf("%-14s %12.1f %12.1f %7.2fx\n", format_names[k], ns[0], ns[1], ns[0] / ns[1]);
+    }
+
+    // Whole lines to a file descriptor: printf through stdio against my_printf's per-thread buffer
+    FILE *devnull = fopen("/dev/null", "w");
+    int saved_stdout = dup(STDOUT_FILENO);
+    double lines[2];
+    fflush(stdout);
+    dup2(fileno(devnull), STDOUT_FILENO);
+    for (int mine = 0; mine < 2; mine++) {
+        uint64_t start = now_ns();
+        for (long i = 0; i < calls; i++) {
+            if (mine)
+                my_printf("id=%d n=%u mask=%x big=%ld\n", (int)i, (unsigned)i * 7, (unsigned)i, (long)i * 1000003);
+            else
+                printf("id=%d n=%u mask=%x big=%ld\n", (int)i, (unsigned)i * 7, (unsigned)i, (long)i * 1000003);
+        }
+        my_flush();
+        fflush(stdout);
+        lines[mine] = calls * 1e3 / (now_ns() - start);
+    }
+    dup2(saved_stdout, STDOUT_FILENO);
+    fclose(devnull);
+    printf("%-14s %11.1fM %11.1fM %7.2fx   (lines per second to /dev/null)\n", "printf lines", lines[0],
+           lines[1], lines[1] / lines[0]);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+        return bench_main(argc > 2 ? atol(argv[2]) : 200000);
+    if (argc > 1 && strcmp(argv[1], "bench-format") == 0)
+        return format_bench_main(argc > 2 ? atol(argv[2]) : 2000000);
+
     my_printf("Hello, %s!\n", "User");
     my_printf("Character: %c, Integer: %d\n", 'A', 123);
     return 0;